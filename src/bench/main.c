@@ -0,0 +1,1335 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * darktable-bench runs a fixed set of inputs through the export pixelpipe, once with the default
+ * history, once per module that can be switched on, and once per given xmp, on every codepath this
+ * machine has. it records how long each module took, compares the output to stored references and
+ * writes a json report, so that optimizations can be checked for speed and for changes to the pixels.
+ * the output of the default history is also handed to the deflating tiff and png writers, to time those.
+ *
+ * the synthetic inputs are generated from a fixed formula, so they are the same on every run and
+ * every machine. real images, raws included, can be added with --image.
+ */
+
+#include <glib.h>        // for g_strdup, GList, etc
+#include <glib/gstdio.h> // for g_unlink, g_rmdir
+#include <gtk/gtk.h>     // for gtk_init_check
+#include <libintl.h>     // for bind_textdomain_codeset, etc
+#include <math.h>        // for exp2f, cosf, sqrt
+#include <stdint.h>      // for int32_t, uint32_t
+#include <stdio.h>       // for fprintf, FILE, etc
+#include <stdlib.h>      // for exit, EXIT_FAILURE
+#include <string.h>      // for strcmp
+
+#include "common/colorspaces.h"    // for dt_colorspaces_get_transform, etc
+#include "common/darktable.h"      // for darktable, dt_init, dt_get_wtime, etc
+#include "common/exif.h"           // for dt_exif_xmp_read
+#include "common/fast_math.h"      // for dt_fast_cbrtf, dt_lab_f_m, etc
+#include "common/film.h"           // for dt_film_new
+#include "common/image.h"          // for dt_image_import
+#include "common/image_cache.h"    // for dt_image_cache_get, etc
+#include "common/imageio.h"        // for IMAGEIO_FLOAT, IMAGEIO_RGB
+#include "common/imageio_module.h" // for dt_imageio_get_format_by_name, etc
+#include "common/mipmap_cache.h"   // for dt_mipmap_cache_get, etc
+#include "common/opencl.h"         // for dt_opencl_is_inited
+#include "config.h"                // for GETTEXT_PACKAGE, etc
+#include "control/conf.h"          // for dt_conf_get_bool, dt_conf_set_bool
+#include "develop/blend.h"         // for dt_develop_blend_params_t
+#include "develop/develop.h"       // for dt_develop_t, dt_dev_history_item_t, etc
+#include "develop/imageop.h"       // for dt_iop_module_t, IOP_FLAGS_*
+#include "develop/pixelpipe.h"     // for dt_dev_pixelpipe_t, etc
+
+// only the combinations dt_codepaths_init() can come up with, the helpers treat anything else as unreachable
+typedef enum dt_bench_codepath_t
+{
+  DT_BENCH_SSE2 = 0,
+  DT_BENCH_OPENMP_SIMD = 1,
+  DT_BENCH_OPENCL = 2,
+  DT_BENCH_CODEPATHS = 3
+} dt_bench_codepath_t;
+
+static const char *_codepath_names[DT_BENCH_CODEPATHS] = { "sse2", "simd", "opencl" };
+
+// format writers timed on the output of the default history
+typedef struct dt_bench_writer_t
+{
+  const char *name;
+  const char *format;
+  const char *extension;
+  int bpp;
+  int compress; // tiff only: 0 uncompressed, 1 deflate, 2 deflate with predictor
+} dt_bench_writer_t;
+
+static const dt_bench_writer_t _writers[] = {
+  { "write-tiff-8-deflate", "tiff", "tif", 8, 2 },
+  { "write-tiff-16-deflate", "tiff", "tif", 16, 2 },
+  { "write-png-8", "png", "png", 8, 0 },
+  { "write-png-16", "png", "png", 16, 0 },
+};
+
+typedef enum dt_bench_status_t
+{
+  DT_BENCH_MATCH = 0,    // the output is within the tolerance of the reference
+  DT_BENCH_MISMATCH = 1, // it isn't
+  DT_BENCH_MISSING = 2,  // there is no reference to compare to
+  DT_BENCH_WRITTEN = 3,  // the output has just been stored as the new reference
+  DT_BENCH_SKIPPED = 4   // there was no reference directory given
+} dt_bench_status_t;
+
+static const char *_status_names[] = { "match", "mismatch", "missing", "written", "skipped" };
+
+typedef struct dt_bench_input_t
+{
+  gchar *name; // used in the report and for the reference file names
+  gchar *filename;
+  gboolean synthetic; // generated by us, to be deleted at the end
+  int32_t imgid;
+} dt_bench_input_t;
+
+typedef struct dt_bench_case_t
+{
+  gchar *name;
+  gchar *op;  // module switched on with its default parameters, or NULL
+  gchar *xmp; // history stack to use, or NULL for the default one
+} dt_bench_case_t;
+
+typedef struct dt_bench_t
+{
+  GList *inputs;    // dt_bench_input_t
+  GList *histories; // xmp file names
+  gchar **modules;  // only benchmark these modules on their own, NULL for all of them
+  const char *refdir;
+  gboolean update_references;
+  float tolerance;
+  int iterations;
+  gboolean codepaths[DT_BENCH_CODEPATHS];
+  gboolean writers;       // time the format writers as well
+  gboolean math;          // check and time the approximations in common/fast_math.h
+  gboolean colorspaces;   // check and time the 3d luts of colorin and colorout against lcms2
+  const char *tmpdir;     // where the synthetic inputs and the written files go
+  dt_codepath_t detected; // what dt_init has chosen, the codepaths run are limited to that
+  FILE *report;
+  gboolean first_result;
+  int failures;
+} dt_bench_t;
+
+// the synthetic input: an exposure ramp of 11 ev from left to right, neutral at the top and sweeping
+// through the hues below, with multiplicative noise and a sharp checker board on the right for the
+// local contrast and denoising modules. the brightest part is clipped.
+static int _write_synthetic(const char *filename, const int width, const int height)
+{
+  FILE *f = g_fopen(filename, "wb");
+  if(!f) return 1;
+
+  // pfm is little endian and stores the bottom row first
+  fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
+  float *row = (float *)malloc(sizeof(float) * 3 * width);
+  for(int j = height - 1; j >= 0; j--)
+  {
+    const float v = j / (float)height;
+    for(int i = 0; i < width; i++)
+    {
+      const float u = i / (float)width;
+      const float lum = exp2f(-8.0f + 11.0f * u);
+      const float sat = v < 0.25f ? 0.0f : 1.0f - (v - 0.25f) / 0.75f;
+      const float hue = 2.0f * M_PI * 4.0f * v;
+
+      // noise from a hash of the position, so it doesn't depend on the order the pixels are written in
+      uint32_t h = (uint32_t)i * 73856093u ^ (uint32_t)j * 19349663u;
+      h ^= h >> 13;
+      h *= 0x5bd1e995u;
+      h ^= h >> 15;
+      const float noise = 1.0f + 0.05f * ((h & 0xffffu) / 65535.0f - 0.5f);
+      const float checker = (u > 0.75f && v > 0.5f) ? (((i >> 3) ^ (j >> 3)) & 1 ? 1.25f : 0.8f) : 1.0f;
+
+      for(int c = 0; c < 3; c++)
+      {
+        const float tint = 1.0f - sat + sat * (0.5f + 0.5f * cosf(hue - c * 2.0f * M_PI / 3.0f));
+        row[3 * i + c] = lum * tint * noise * checker;
+      }
+    }
+    fwrite(row, sizeof(float) * 3, width, f);
+  }
+  free(row);
+  const int err = ferror(f);
+  fclose(f);
+  return err;
+}
+
+// only reads what _write_reference writes: little endian, 3 channels.
+static float *_read_reference(const char *filename, int *width, int *height)
+{
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return NULL;
+
+  float *buf = NULL;
+  char head[3] = { 0 };
+  float scale = 0.0f;
+  if(fscanf(f, "%2s %d %d %f", head, width, height, &scale) == 4 && !strcmp(head, "PF") && scale < 0.0f
+     && *width > 0 && *height > 0 && fgetc(f) != EOF)
+  {
+    buf = (float *)malloc(sizeof(float) * 3 * *width * *height);
+    for(int j = *height - 1; j >= 0 && buf; j--)
+    {
+      if(fread(buf + (size_t)3 * *width * j, sizeof(float) * 3, *width, f) != (size_t)*width)
+      {
+        free(buf);
+        buf = NULL;
+      }
+    }
+  }
+  fclose(f);
+  return buf;
+}
+
+static int _write_reference(const char *filename, const float *const out, const int width, const int height)
+{
+  FILE *f = g_fopen(filename, "wb");
+  if(!f) return 1;
+
+  fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
+  float *row = (float *)malloc(sizeof(float) * 3 * width);
+  for(int j = height - 1; j >= 0; j--)
+  {
+    for(int i = 0; i < width; i++)
+      for(int c = 0; c < 3; c++) row[3 * i + c] = out[4 * ((size_t)width * j + i) + c];
+    fwrite(row, sizeof(float) * 3, width, f);
+  }
+  free(row);
+  const int err = ferror(f);
+  fclose(f);
+  return err;
+}
+
+static dt_bench_status_t _compare(dt_bench_t *b, const char *reference, const float *const out,
+                                  const int width, const int height, float *max_error, float *rms_error)
+{
+  *max_error = *rms_error = 0.0f;
+  if(!b->refdir) return DT_BENCH_SKIPPED;
+
+  // only the first codepath run stores a reference, the others are compared to that
+  if(b->update_references && !g_file_test(reference, G_FILE_TEST_EXISTS))
+    return _write_reference(reference, out, width, height) ? DT_BENCH_MISSING : DT_BENCH_WRITTEN;
+
+  int rwidth = 0, rheight = 0;
+  float *ref = _read_reference(reference, &rwidth, &rheight);
+  if(!ref) return DT_BENCH_MISSING;
+  if(rwidth != width || rheight != height)
+  {
+    free(ref);
+    *max_error = INFINITY;
+    return DT_BENCH_MISMATCH;
+  }
+
+  double sum = 0.0;
+  float max = 0.0f;
+  for(size_t k = 0; k < (size_t)width * height; k++)
+  {
+    for(int c = 0; c < 3; c++)
+    {
+      const float d = fabsf(out[4 * k + c] - ref[3 * k + c]);
+      // nan or inf where the reference has none is as wrong as it gets
+      max = isfinite(d) ? MAX(max, d) : INFINITY;
+      sum += isfinite(d) ? (double)d * d : 0.0;
+    }
+  }
+  free(ref);
+
+  *max_error = max;
+  *rms_error = sqrt(sum / (3.0 * width * height));
+  return max <= b->tolerance ? DT_BENCH_MATCH : DT_BENCH_MISMATCH;
+}
+
+static void _json_string(FILE *f, const char *s)
+{
+  fputc('"', f);
+  for(; s && *s; s++)
+  {
+    if(*s == '"' || *s == '\\')
+      fprintf(f, "\\%c", *s);
+    else if((unsigned char)*s < 0x20)
+      fprintf(f, "\\u%04x", (unsigned char)*s);
+    else
+      fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+static void _json_float(FILE *f, const double v)
+{
+  // json has no infinity
+  if(isfinite(v))
+    fprintf(f, "%.9g", v);
+  else
+    fprintf(f, "null");
+}
+
+static void _report_result(dt_bench_t *b, const dt_bench_input_t *input, const dt_bench_case_t *bcase,
+                           const dt_bench_codepath_t codepath, dt_dev_pixelpipe_t *pipe, const double *times,
+                           const double total, const dt_bench_status_t status, const float max_error,
+                           const float rms_error)
+{
+  printf("%-24s %-24s %-6s %5dx%-5d %9.3f s  %-8s max %.3g rms %.3g\n", input->name, bcase->name,
+         _codepath_names[codepath], pipe->processed_width, pipe->processed_height, total,
+         _status_names[status], max_error, rms_error);
+  if(!b->report) return;
+
+  FILE *f = b->report;
+  fprintf(f, "%s\n    {\n      \"input\": ", b->first_result ? "" : ",");
+  _json_string(f, input->name);
+  fprintf(f, ",\n      \"case\": ");
+  _json_string(f, bcase->name);
+  fprintf(f, ",\n      \"codepath\": \"%s\",\n      \"width\": %d,\n      \"height\": %d,\n      \"time\": ",
+          _codepath_names[codepath], pipe->processed_width, pipe->processed_height);
+  _json_float(f, total);
+  fprintf(f, ",\n      \"reference\": \"%s\",\n      \"max_error\": ", _status_names[status]);
+  _json_float(f, max_error);
+  fprintf(f, ",\n      \"rms_error\": ");
+  _json_float(f, rms_error);
+  fprintf(f, ",\n      \"modules\": [");
+
+  int k = 0;
+  gboolean first = TRUE;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes), k++)
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled) continue;
+    fprintf(f, "%s\n        { \"op\": ", first ? "" : ",");
+    _json_string(f, piece->module->op);
+    fprintf(f, ", \"instance\": ");
+    _json_string(f, piece->module->multi_name);
+    fprintf(f, ", \"time\": ");
+    _json_float(f, times[k]);
+    fprintf(f, " }");
+    first = FALSE;
+  }
+  fprintf(f, "\n      ]\n    }");
+  b->first_result = FALSE;
+}
+
+static void _report_writer(dt_bench_t *b, const dt_bench_input_t *input, const dt_bench_writer_t *writer,
+                           const int width, const int height, const double total, const goffset size)
+{
+  // throughput of the uncompressed pixels
+  const double rate = 4.0 * writer->bpp / 8 * width * height / (total * 1e6);
+  printf("%-24s %-24s %-6s %5dx%-5d %9.3f s  %.1f MB/s, %" G_GOFFSET_FORMAT " bytes\n", input->name,
+         writer->name, "cpu", width, height, total, rate, size);
+  if(!b->report) return;
+
+  FILE *f = b->report;
+  fprintf(f, "%s\n    {\n      \"input\": ", b->first_result ? "" : ",");
+  _json_string(f, input->name);
+  fprintf(f, ",\n      \"case\": ");
+  _json_string(f, writer->name);
+  fprintf(f, ",\n      \"codepath\": \"cpu\",\n      \"width\": %d,\n      \"height\": %d,\n      \"time\": ",
+          width, height);
+  _json_float(f, total);
+  fprintf(f, ",\n      \"bytes\": %" G_GOFFSET_FORMAT "\n    }", size);
+  b->first_result = FALSE;
+}
+
+// time the format modules on the pipe output, converted the way the export does it
+static void _run_writers(dt_bench_t *b, dt_bench_input_t *input, const float *const out, const int width,
+                         const int height)
+{
+  const size_t npixels = (size_t)width * height;
+  uint8_t *buf8 = (uint8_t *)dt_alloc_align(64, sizeof(uint8_t) * 4 * npixels);
+  uint16_t *buf16 = (uint16_t *)dt_alloc_align(64, sizeof(uint16_t) * 4 * npixels);
+  if(!buf8 || !buf16)
+  {
+    dt_free_align(buf8);
+    dt_free_align(buf16);
+    return;
+  }
+  for(size_t k = 0; k < 4 * npixels; k++)
+  {
+    buf8[k] = CLAMP(out[k] * 0xff, 0, 0xff);
+    buf16[k] = CLAMP(out[k] * 0x10000, 0, 0xffff);
+  }
+
+  // the modules take their settings from the config, put back what the user had afterwards
+  const int tiff_bpp = dt_conf_get_int("plugins/imageio/format/tiff/bpp");
+  const int tiff_compress = dt_conf_get_int("plugins/imageio/format/tiff/compress");
+  const int png_bpp = dt_conf_get_int("plugins/imageio/format/png/bpp");
+
+  for(size_t w = 0; w < sizeof(_writers) / sizeof(_writers[0]); w++)
+  {
+    const dt_bench_writer_t *writer = _writers + w;
+    dt_imageio_module_format_t *format = dt_imageio_get_format_by_name(writer->format);
+    if(!format) continue;
+    gchar *key = g_strdup_printf("plugins/imageio/format/%s/bpp", writer->format);
+    dt_conf_set_int(key, writer->bpp);
+    g_free(key);
+    dt_conf_set_int("plugins/imageio/format/tiff/compress", writer->compress);
+
+    dt_imageio_module_data_t *fdata = format->get_params(format);
+    if(!fdata) continue;
+    fdata->width = width;
+    fdata->height = height;
+
+    gchar *basename = g_strdup_printf("%s-%s.%s", input->name, writer->name, writer->extension);
+    gchar *filename = g_build_filename(b->tmpdir, basename, NULL);
+    g_free(basename);
+
+    double total = INFINITY;
+    int err = 0;
+    for(int it = 0; it < b->iterations && !err; it++)
+    {
+      const double start = dt_get_wtime();
+      // no image id, so nothing but the pixels is written
+      err = format->write_image(fdata, filename, writer->bpp == 8 ? (void *)buf8 : (void *)buf16, NULL, 0, 0,
+                                1, 1);
+      total = MIN(total, dt_get_wtime() - start);
+    }
+
+    GStatBuf st;
+    const goffset size = (!err && !g_stat(filename, &st)) ? st.st_size : 0;
+    if(err)
+    {
+      fprintf(stderr, "[darktable-bench] %s failed for `%s'\n", writer->name, input->name);
+      b->failures++;
+    }
+    else
+      _report_writer(b, input, writer, width, height, total, size);
+
+    g_unlink(filename);
+    g_free(filename);
+    format->free_params(format, fdata);
+  }
+
+  dt_conf_set_int("plugins/imageio/format/tiff/bpp", tiff_bpp);
+  dt_conf_set_int("plugins/imageio/format/tiff/compress", tiff_compress);
+  dt_conf_set_int("plugins/imageio/format/png/bpp", png_bpp);
+  dt_free_align(buf8);
+  dt_free_align(buf16);
+}
+
+static gboolean _set_codepath(dt_bench_t *b, const dt_bench_codepath_t codepath)
+{
+  switch(codepath)
+  {
+    case DT_BENCH_SSE2:
+      if(!b->detected.SSE2) return FALSE;
+      darktable.codepath.SSE2 = 1;
+      darktable.codepath.OPENMP_SIMD = 0;
+      darktable.codepath._no_intrinsics = 0;
+      break;
+    case DT_BENCH_OPENMP_SIMD:
+      // what dt_codepaths_init() does with codepaths/openmp_simd set
+      darktable.codepath.SSE2 = b->detected.SSE2;
+      darktable.codepath.OPENMP_SIMD = 1;
+      darktable.codepath._no_intrinsics = !b->detected.SSE2;
+      break;
+    case DT_BENCH_OPENCL:
+      if(!dt_opencl_is_inited()) return FALSE;
+      // the cpu fallbacks run on the best codepath there is
+      darktable.codepath = b->detected;
+      break;
+    default:
+      return FALSE;
+  }
+  // the pipe looks at the preference before every run
+  dt_conf_set_bool("opencl", codepath == DT_BENCH_OPENCL);
+  return TRUE;
+}
+
+// g_strv_contains() needs a newer glib than we do
+static gboolean _strv_contains(gchar **strv, const char *str)
+{
+  for(; strv && *strv; strv++)
+    if(!strcmp(*strv, str)) return TRUE;
+  return FALSE;
+}
+
+static void _clear_history(dt_develop_t *dev)
+{
+  for(GList *history = dev->history; history; history = g_list_next(history))
+  {
+    dt_dev_history_item_t *hist = (dt_dev_history_item_t *)history->data;
+    free(hist->params);
+    free(hist->blend_params);
+    free(hist);
+  }
+  g_list_free(dev->history);
+  dev->history = NULL;
+  dev->history_end = 0;
+}
+
+static dt_iop_module_t *_find_module(dt_develop_t *dev, const char *op)
+{
+  for(GList *modules = dev->iop; modules; modules = g_list_next(modules))
+  {
+    dt_iop_module_t *m = (dt_iop_module_t *)modules->data;
+    if(m->multi_priority == 0 && !strcmp(m->op, op)) return m;
+  }
+  return NULL;
+}
+
+// modules that are off by default and can be switched on for this image
+static gboolean _module_usable(const dt_iop_module_t *m)
+{
+  return m->multi_priority == 0 && !m->default_enabled && !m->hide_enable_button
+         && !(m->flags() & (IOP_FLAGS_DEPRECATED | IOP_FLAGS_HIDDEN));
+}
+
+static void _enable_module(dt_develop_t *dev, dt_iop_module_t *m)
+{
+  dt_dev_history_item_t *h = (dt_dev_history_item_t *)calloc(1, sizeof(dt_dev_history_item_t));
+  h->module = m;
+  h->enabled = 1;
+  h->params = malloc(m->params_size);
+  memcpy(h->params, m->default_params, m->params_size);
+  h->blend_params = malloc(sizeof(dt_develop_blend_params_t));
+  memcpy(h->blend_params, m->default_blendop_params, sizeof(dt_develop_blend_params_t));
+  h->multi_priority = m->multi_priority;
+  g_strlcpy(h->multi_name, m->multi_name, sizeof(h->multi_name));
+  dev->history = g_list_append(dev->history, h);
+  dev->history_end++;
+}
+
+static void _run_case(dt_bench_t *b, dt_bench_input_t *input, dt_mipmap_buffer_t *buf, dt_bench_case_t *bcase)
+{
+  if(bcase->xmp)
+  {
+    dt_image_t *image = dt_image_cache_get(darktable.image_cache, input->imgid, 'w');
+    const int err = dt_exif_xmp_read(image, bcase->xmp, 1);
+    dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+    if(err)
+    {
+      fprintf(stderr, "[darktable-bench] can't read history from `%s'\n", bcase->xmp);
+      b->failures++;
+      return;
+    }
+  }
+
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, input->imgid);
+  // whatever the import found in the sidecar isn't part of the benchmark
+  if(!bcase->xmp) _clear_history(&dev);
+  if(bcase->op)
+  {
+    dt_iop_module_t *m = _find_module(&dev, bcase->op);
+    if(m) _enable_module(&dev, m);
+  }
+
+  dt_dev_pixelpipe_t pipe;
+  if(!dt_dev_pixelpipe_init_export(&pipe, dev.image_storage.width, dev.image_storage.height,
+                                   IMAGEIO_RGB | IMAGEIO_FLOAT))
+  {
+    fprintf(stderr, "[darktable-bench] can't allocate a pixelpipe for `%s'\n", input->name);
+    dt_dev_cleanup(&dev);
+    b->failures++;
+    return;
+  }
+  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf->buf, buf->width, buf->height, 1.0f,
+                             buf->pre_monochrome_demosaiced);
+  dt_dev_pixelpipe_create_nodes(&pipe, &dev);
+  dt_dev_pixelpipe_synch_all(&pipe, &dev);
+  dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
+                                  &pipe.processed_height);
+
+  gchar *reference = NULL;
+  if(b->refdir)
+  {
+    gchar *basename = g_strdup_printf("%s-%s.pfm", input->name, bcase->name);
+    reference = g_build_filename(b->refdir, basename, NULL);
+    g_free(basename);
+  }
+
+  const int nodes = g_list_length(pipe.nodes);
+  double *times = (double *)malloc(sizeof(double) * nodes);
+
+  for(dt_bench_codepath_t codepath = 0; codepath < DT_BENCH_CODEPATHS; codepath++)
+  {
+    if(!b->codepaths[codepath] || !_set_codepath(b, codepath)) continue;
+
+    // the fastest of all iterations, that one is least disturbed by whatever else the machine does
+    double total = INFINITY;
+    for(int k = 0; k < nodes; k++) times[k] = INFINITY;
+
+    for(int it = 0; it < b->iterations; it++)
+    {
+      // every module has to run each time, not just the ones whose output isn't cached
+      dt_dev_pixelpipe_flush_caches(&pipe);
+      for(GList *n = pipe.nodes; n; n = g_list_next(n))
+        ((dt_dev_pixelpipe_iop_t *)n->data)->process_time = 0.0;
+
+      const double start = dt_get_wtime();
+      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, pipe.processed_width, pipe.processed_height, 1.0f);
+      total = MIN(total, dt_get_wtime() - start);
+
+      int k = 0;
+      for(GList *n = pipe.nodes; n; n = g_list_next(n), k++)
+        times[k] = MIN(times[k], ((dt_dev_pixelpipe_iop_t *)n->data)->process_time);
+    }
+
+    float max_error = 0.0f, rms_error = 0.0f;
+    const dt_bench_status_t status
+        = pipe.backbuf ? _compare(b, reference, (float *)pipe.backbuf, pipe.processed_width,
+                                  pipe.processed_height, &max_error, &rms_error)
+                       : DT_BENCH_MISMATCH;
+    if(status == DT_BENCH_MISMATCH) b->failures++;
+
+    _report_result(b, input, bcase, codepath, &pipe, times, total, status, max_error, rms_error);
+  }
+
+  if(b->writers && !bcase->op && !bcase->xmp && pipe.backbuf)
+    _run_writers(b, input, (float *)pipe.backbuf, pipe.processed_width, pipe.processed_height);
+
+  free(times);
+  g_free(reference);
+  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_dev_cleanup(&dev);
+}
+
+static void _run_input(dt_bench_t *b, dt_bench_input_t *input)
+{
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, input->imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  if(!buf.buf || !buf.width || !buf.height)
+  {
+    fprintf(stderr, "[darktable-bench] can't load `%s'\n", input->filename);
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    b->failures++;
+    return;
+  }
+
+  // which modules can be switched on depends on the image, raws have some more
+  GList *cases = NULL;
+  dt_bench_case_t *bcase = (dt_bench_case_t *)calloc(1, sizeof(dt_bench_case_t));
+  bcase->name = g_strdup("defaults");
+  cases = g_list_append(cases, bcase);
+
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, input->imgid);
+  for(GList *modules = dev.iop; modules; modules = g_list_next(modules))
+  {
+    const dt_iop_module_t *m = (dt_iop_module_t *)modules->data;
+    if(!_module_usable(m) || (b->modules && !_strv_contains(b->modules, m->op)))
+      continue;
+    bcase = (dt_bench_case_t *)calloc(1, sizeof(dt_bench_case_t));
+    bcase->name = g_strdup(m->op);
+    bcase->op = g_strdup(m->op);
+    cases = g_list_append(cases, bcase);
+  }
+  dt_dev_cleanup(&dev);
+
+  for(GList *h = b->histories; h; h = g_list_next(h))
+  {
+    gchar *basename = g_path_get_basename((const char *)h->data);
+    char *ext = strrchr(basename, '.');
+    if(ext) *ext = '\0';
+    bcase = (dt_bench_case_t *)calloc(1, sizeof(dt_bench_case_t));
+    bcase->name = g_strdup_printf("history-%s", basename);
+    bcase->xmp = g_strdup((const char *)h->data);
+    cases = g_list_append(cases, bcase);
+    g_free(basename);
+  }
+
+  for(GList *c = cases; c; c = g_list_next(c))
+  {
+    bcase = (dt_bench_case_t *)c->data;
+    _run_case(b, input, &buf, bcase);
+    g_free(bcase->name);
+    g_free(bcase->op);
+    g_free(bcase->xmp);
+    free(bcase);
+  }
+  g_list_free(cases);
+
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+}
+
+static void _free_input(gpointer data)
+{
+  dt_bench_input_t *input = (dt_bench_input_t *)data;
+  if(input->synthetic) g_unlink(input->filename);
+  g_free(input->name);
+  g_free(input->filename);
+  free(input);
+}
+
+// the approximations in common/fast_math.h, checked against libm in double precision on every float of
+// their domain, and timed on a buffer spread over it. the sse versions are checked the same way and
+// against the plain c ones.
+typedef struct dt_bench_math_t
+{
+  const char *name;
+  float lo, hi;      // domain, lo and hi have the same sign
+  gboolean relative; // relative or absolute error
+  double bound;      // the accuracy the function is meant to have, anything above is a failure
+  double (*reference)(const double x);
+  float (*scalar)(const float x);
+  void (*scalar_rows)(const float *const in, float *const out, const size_t n);
+#if defined(__SSE2__)
+  __m128 (*sse)(const __m128 x);
+  void (*sse_rows)(const float *const in, float *const out, const size_t n);
+#endif
+} dt_bench_math_t;
+
+// function pointers in the timed loops would cost more than the approximations themselves
+#define DT_BENCH_MATH_ROWS(name, f)                                                                         \
+  static void name(const float *const in, float *const out, const size_t n)                                 \
+  {                                                                                                         \
+    for(size_t k = 0; k < n; k++) out[k] = f(in[k]);                                                        \
+  }
+#define DT_BENCH_MATH_ROWS_SSE(name, f)                                                                     \
+  static void name(const float *const in, float *const out, const size_t n)                                 \
+  {                                                                                                         \
+    for(size_t k = 0; k < n; k += 4) _mm_store_ps(out + k, f(_mm_load_ps(in + k)));                         \
+  }
+
+static double _math_cbrt(const double x)
+{
+  return cbrt(x);
+}
+
+static double _math_lab_f(const double x)
+{
+  return x > 216.0 / 24389.0 ? cbrt(x) : (24389.0 / 27.0 * x + 16.0) / 116.0;
+}
+
+static double _math_lab_f_inv(const double x)
+{
+  return x > 6.0 / 29.0 ? x * x * x : (116.0 * x - 16.0) * 27.0 / 24389.0;
+}
+
+static double _math_exp(const double x)
+{
+  return exp(x);
+}
+
+static double _math_mexp2(const double x)
+{
+  return exp2(-x);
+}
+
+static float _math_cbrtf_halley(const float x)
+{
+  return dt_cbrtf_halley(dt_fast_cbrtf(x), x);
+}
+
+DT_BENCH_MATH_ROWS(_math_fast_cbrtf_rows, dt_fast_cbrtf)
+DT_BENCH_MATH_ROWS(_math_cbrtf_halley_rows, _math_cbrtf_halley)
+DT_BENCH_MATH_ROWS(_math_lab_f_rows, dt_lab_f_m)
+DT_BENCH_MATH_ROWS(_math_lab_f_inv_rows, dt_lab_f_inv_m)
+DT_BENCH_MATH_ROWS(_math_fast_expf_rows, dt_fast_expf)
+DT_BENCH_MATH_ROWS(_math_fast_mexp2f_rows, dt_fast_mexp2f)
+
+#if defined(__SSE2__)
+static __m128 _math_cbrtf_halley_sse2(const __m128 x)
+{
+  return dt_cbrtf_halley_sse2(dt_fast_cbrtf_sse2(x), x);
+}
+
+DT_BENCH_MATH_ROWS_SSE(_math_fast_cbrtf_rows_sse2, dt_fast_cbrtf_sse2)
+DT_BENCH_MATH_ROWS_SSE(_math_cbrtf_halley_rows_sse2, _math_cbrtf_halley_sse2)
+DT_BENCH_MATH_ROWS_SSE(_math_lab_f_rows_sse2, dt_lab_f_m_sse2)
+DT_BENCH_MATH_ROWS_SSE(_math_lab_f_inv_rows_sse, dt_lab_f_inv_m_sse)
+DT_BENCH_MATH_ROWS_SSE(_math_fast_expf_rows_sse2, dt_fast_expf_sse2)
+#define DT_BENCH_MATH_SSE(f, rows) , f, rows
+#else
+#define DT_BENCH_MATH_SSE(f, rows)
+#endif
+
+static const dt_bench_math_t _math[] = {
+  { "math-fast-cbrtf", 1e-6f, 16.0f, TRUE, 0.04, _math_cbrt, dt_fast_cbrtf,
+    _math_fast_cbrtf_rows DT_BENCH_MATH_SSE(dt_fast_cbrtf_sse2, _math_fast_cbrtf_rows_sse2) },
+  { "math-cbrtf-halley", 1e-6f, 16.0f, TRUE, 4e-5, _math_cbrt, _math_cbrtf_halley,
+    _math_cbrtf_halley_rows DT_BENCH_MATH_SSE(_math_cbrtf_halley_sse2, _math_cbrtf_halley_rows_sse2) },
+  { "math-lab-f", 0.0f, 2.0f, TRUE, 4e-5, _math_lab_f, dt_lab_f_m,
+    _math_lab_f_rows DT_BENCH_MATH_SSE(dt_lab_f_m_sse2, _math_lab_f_rows_sse2) },
+  { "math-lab-f-inv", 0.0f, 1.5f, FALSE, 1e-6, _math_lab_f_inv, dt_lab_f_inv_m,
+    _math_lab_f_inv_rows DT_BENCH_MATH_SSE(dt_lab_f_inv_m_sse, _math_lab_f_inv_rows_sse) },
+  { "math-fast-expf", -100.0f, 0.0f, FALSE, 0.07, _math_exp, dt_fast_expf,
+    _math_fast_expf_rows DT_BENCH_MATH_SSE(dt_fast_expf_sse2, _math_fast_expf_rows_sse2) },
+  { "math-fast-mexp2f", 0.0f, 126.0f, FALSE, 0.05, _math_mexp2, dt_fast_mexp2f,
+    _math_fast_mexp2f_rows DT_BENCH_MATH_SSE(NULL, NULL) },
+};
+
+// values in the timed buffer
+#define DT_BENCH_MATH_VALUES (1 << 22)
+
+typedef struct dt_bench_math_error_t
+{
+  double max, rms;
+  float worst;      // where max is
+  double sse_diff;  // largest difference of the sse version to the plain one, in the same measure
+} dt_bench_math_error_t;
+
+static inline double _math_error(const dt_bench_math_t *m, const float a, const double r)
+{
+  return m->relative ? fabs((a - r) / r) : fabs(a - r);
+}
+
+static void _math_check(const dt_bench_math_t *m, const gboolean sse, dt_bench_math_error_t *err)
+{
+  // floats of one sign are ordered like their bit patterns, so the domain is a range of integers
+  const gboolean negative = m->hi <= 0.0f;
+  union
+  {
+    float f;
+    uint32_t u;
+  } lo = { .f = fabsf(negative ? m->hi : m->lo) }, hi = { .f = fabsf(negative ? m->lo : m->hi) };
+  const uint32_t first = lo.u, count = hi.u - lo.u + 1;
+
+  double max = 0.0, sum = 0.0, sse_diff = 0.0;
+  float worst = 0.0f;
+#ifdef _OPENMP
+#pragma omp parallel default(none) shared(m, max, sum, sse_diff, worst)                                  \
+    firstprivate(sse, negative, first, count)
+#endif
+  {
+    double t_max = 0.0, t_sum = 0.0, t_diff = 0.0;
+    float t_worst = 0.0f;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(uint32_t k = 0; k < count; k++)
+    {
+      union
+      {
+        uint32_t u;
+        float f;
+      } v = { .u = first + k };
+      const float x = negative ? -v.f : v.f;
+      const double r = m->reference(x);
+      const float plain = m->scalar(x);
+      float a = plain;
+#if defined(__SSE2__)
+      if(sse)
+      {
+        a = _mm_cvtss_f32(m->sse(_mm_set1_ps(x)));
+        t_diff = fmax(t_diff, _math_error(m, a, plain));
+      }
+#endif
+      const double e = _math_error(m, a, r);
+      t_sum += e * e;
+      if(!(e <= t_max)) // catches nan, too
+      {
+        t_max = e;
+        t_worst = x;
+      }
+    }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      sum += t_sum;
+      sse_diff = fmax(sse_diff, t_diff);
+      if(!(t_max <= max))
+      {
+        max = t_max;
+        worst = t_worst;
+      }
+    }
+  }
+  err->max = max;
+  err->rms = sqrt(sum / count);
+  err->worst = worst;
+  err->sse_diff = sse_diff;
+}
+
+static void _report_math(dt_bench_t *b, const dt_bench_math_t *m, const char *codepath,
+                         const dt_bench_math_error_t *err, const double total)
+{
+  const dt_bench_status_t status = err->max <= m->bound ? DT_BENCH_MATCH : DT_BENCH_MISMATCH;
+  if(status != DT_BENCH_MATCH) b->failures++;
+  printf("%-24s %-24s %-6s %11d %9.3f s  %-8s max %.3g at %.9g rms %.3g, %.2f ns/value\n", "fast_math",
+         m->name, codepath, DT_BENCH_MATH_VALUES, total, _status_names[status], err->max, err->worst, err->rms,
+         total * 1e9 / DT_BENCH_MATH_VALUES);
+  if(!b->report) return;
+
+  FILE *f = b->report;
+  fprintf(f, "%s\n    {\n      \"input\": \"fast_math\",\n      \"case\": ", b->first_result ? "" : ",");
+  _json_string(f, m->name);
+  fprintf(f, ",\n      \"codepath\": \"%s\",\n      \"values\": %d,\n      \"time\": ", codepath,
+          DT_BENCH_MATH_VALUES);
+  _json_float(f, total);
+  fprintf(f, ",\n      \"reference\": \"%s\",\n      \"bound\": ", _status_names[status]);
+  _json_float(f, m->bound);
+  fprintf(f, ",\n      \"max_error\": ");
+  _json_float(f, err->max);
+  fprintf(f, ",\n      \"worst\": ");
+  _json_float(f, err->worst);
+  fprintf(f, ",\n      \"rms_error\": ");
+  _json_float(f, err->rms);
+  if(strcmp(codepath, "scalar"))
+  {
+    fprintf(f, ",\n      \"scalar_difference\": ");
+    _json_float(f, err->sse_diff);
+  }
+  fprintf(f, "\n    }");
+  b->first_result = FALSE;
+}
+
+static double _time_math_rows(dt_bench_t *b, void (*rows)(const float *const, float *const, const size_t),
+                              const float *const in, float *const out)
+{
+  double total = INFINITY;
+  for(int it = 0; it < b->iterations; it++)
+  {
+    const double start = dt_get_wtime();
+    rows(in, out, DT_BENCH_MATH_VALUES);
+    total = MIN(total, dt_get_wtime() - start);
+  }
+  return total;
+}
+
+static void _run_math(dt_bench_t *b)
+{
+  float *in = (float *)dt_alloc_align(64, sizeof(float) * DT_BENCH_MATH_VALUES);
+  float *out = (float *)dt_alloc_align(64, sizeof(float) * DT_BENCH_MATH_VALUES);
+  if(!in || !out)
+  {
+    dt_free_align(in);
+    dt_free_align(out);
+    return;
+  }
+
+  for(size_t i = 0; i < sizeof(_math) / sizeof(_math[0]); i++)
+  {
+    const dt_bench_math_t *m = _math + i;
+    for(int k = 0; k < DT_BENCH_MATH_VALUES; k++)
+      in[k] = m->lo + (m->hi - m->lo) * (k + 0.5f) / DT_BENCH_MATH_VALUES;
+
+    dt_bench_math_error_t err;
+    _math_check(m, FALSE, &err);
+    _report_math(b, m, "scalar", &err, _time_math_rows(b, m->scalar_rows, in, out));
+#if defined(__SSE2__)
+    if(m->sse)
+    {
+      _math_check(m, TRUE, &err);
+      _report_math(b, m, "sse2", &err, _time_math_rows(b, m->sse_rows, in, out));
+    }
+#endif
+  }
+
+  dt_free_align(in);
+  dt_free_align(out);
+}
+
+// the transforms colorin and colorout get from dt_colorspaces_get_transform() with their 3d lut, checked
+// against lcms2 on pseudo random colors of the whole input domain and timed against it
+typedef struct dt_bench_color_t
+{
+  const char *name;
+  dt_colorspaces_color_profile_type_t in, out;
+  cmsUInt32Number in_format, out_format;
+} dt_bench_color_t;
+
+static const dt_bench_color_t _colors[] = {
+  { "colorin-lin-rec2020-lab", DT_COLORSPACE_LIN_REC2020, DT_COLORSPACE_LAB, TYPE_RGBA_FLT, TYPE_LabA_FLT },
+  { "colorin-srgb-lab", DT_COLORSPACE_SRGB, DT_COLORSPACE_LAB, TYPE_RGBA_FLT, TYPE_LabA_FLT },
+  { "colorout-lab-srgb", DT_COLORSPACE_LAB, DT_COLORSPACE_SRGB, TYPE_LabA_FLT, TYPE_RGBA_FLT },
+  { "colorout-lab-adobergb", DT_COLORSPACE_LAB, DT_COLORSPACE_ADOBERGB, TYPE_LabA_FLT, TYPE_RGBA_FLT },
+};
+
+#define DT_BENCH_COLOR_PIXELS (1 << 20)
+// largest delta E (cie 76) the lut may be off, about a just noticeable difference
+#define DT_BENCH_COLOR_MAX_DELTA_E 2.0
+
+static double _time_transform(dt_bench_t *b, const dt_colorspaces_transform_t *t, const gboolean lut,
+                              const float *const in, float *const out)
+{
+  double total = INFINITY;
+  for(int it = 0; it < b->iterations; it++)
+  {
+    const double start = dt_get_wtime();
+    if(lut)
+      dt_colorspaces_apply_transform(t, in, out, DT_BENCH_COLOR_PIXELS);
+    else
+      cmsDoTransform(t->xform, in, out, DT_BENCH_COLOR_PIXELS);
+    total = MIN(total, dt_get_wtime() - start);
+  }
+  return total;
+}
+
+static void _report_color(dt_bench_t *b, const dt_bench_color_t *c, const dt_bench_status_t status,
+                          const double max_de, const double mean_de, const double lut_time,
+                          const double lcms_time)
+{
+  printf("%-24s %-24s %-6s %11d %9.3f s  %-8s max %.3g mean %.3g delta E, lut %.1f Mpix/s, lcms2 %.1f "
+         "Mpix/s\n",
+         "colorspaces", c->name, "lut", DT_BENCH_COLOR_PIXELS, lut_time, _status_names[status], max_de,
+         mean_de, DT_BENCH_COLOR_PIXELS / (1e6 * fmax(lut_time, 1e-9)),
+         DT_BENCH_COLOR_PIXELS / (1e6 * fmax(lcms_time, 1e-9)));
+  if(!b->report) return;
+
+  FILE *f = b->report;
+  fprintf(f, "%s\n    {\n      \"input\": \"colorspaces\",\n      \"case\": ", b->first_result ? "" : ",");
+  _json_string(f, c->name);
+  fprintf(f, ",\n      \"codepath\": \"lut\",\n      \"pixels\": %d,\n      \"time\": ",
+          DT_BENCH_COLOR_PIXELS);
+  _json_float(f, lut_time);
+  fprintf(f, ",\n      \"lcms2_time\": ");
+  _json_float(f, lcms_time);
+  fprintf(f, ",\n      \"reference\": \"%s\",\n      \"bound\": ", _status_names[status]);
+  _json_float(f, DT_BENCH_COLOR_MAX_DELTA_E);
+  fprintf(f, ",\n      \"max_delta_e\": ");
+  _json_float(f, max_de);
+  fprintf(f, ",\n      \"mean_delta_e\": ");
+  _json_float(f, mean_de);
+  fprintf(f, "\n    }");
+  b->first_result = FALSE;
+}
+
+static void _run_colorspaces(dt_bench_t *b)
+{
+  float *in = (float *)dt_alloc_align(64, sizeof(float) * 4 * DT_BENCH_COLOR_PIXELS);
+  float *ref = (float *)dt_alloc_align(64, sizeof(float) * 4 * DT_BENCH_COLOR_PIXELS);
+  float *out = (float *)dt_alloc_align(64, sizeof(float) * 4 * DT_BENCH_COLOR_PIXELS);
+  if(!in || !ref || !out)
+  {
+    dt_free_align(in);
+    dt_free_align(ref);
+    dt_free_align(out);
+    return;
+  }
+
+  const cmsHPROFILE Lab
+      = dt_colorspaces_get_profile(DT_COLORSPACE_LAB, "", DT_PROFILE_DIRECTION_ANY)->profile;
+  for(size_t i = 0; i < sizeof(_colors) / sizeof(_colors[0]); i++)
+  {
+    const dt_bench_color_t *c = _colors + i;
+    const cmsHPROFILE in_profile = dt_colorspaces_get_profile(c->in, "", DT_PROFILE_DIRECTION_ANY)->profile;
+    const cmsHPROFILE out_profile = dt_colorspaces_get_profile(c->out, "", DT_PROFILE_DIRECTION_ANY)->profile;
+    dt_colorspaces_transform_t *t = dt_colorspaces_get_transform(
+        in_profile, c->in_format, out_profile, c->out_format, NULL, INTENT_PERCEPTUAL, 0, 0, TRUE);
+    // rgb results are compared in Lab
+    cmsHTRANSFORM to_Lab = c->out_format == TYPE_LabA_FLT
+                               ? NULL
+                               : cmsCreateTransform(out_profile, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT,
+                                                    INTENT_RELATIVE_COLORIMETRIC, 0);
+    if(!t || (c->out_format != TYPE_LabA_FLT && !to_Lab))
+    {
+      fprintf(stderr, "error: lcms2 can't create the transform for %s\n", c->name);
+      b->failures++;
+      dt_colorspaces_release_transform(t);
+      if(to_Lab) cmsDeleteTransform(to_Lab);
+      continue;
+    }
+
+    uint32_t seed = 0x9e3779b9;
+    for(int k = 0; k < DT_BENCH_COLOR_PIXELS; k++)
+    {
+      float u[3];
+      for(int ch = 0; ch < 3; ch++)
+      {
+        seed = seed * 1664525u + 1013904223u;
+        u[ch] = (seed >> 8) / (float)(1 << 24);
+      }
+      float *const px = in + 4 * k;
+      if(c->in_format == TYPE_LabA_FLT)
+      {
+        px[0] = 100.0f * u[0];
+        px[1] = 255.0f * u[1] - 128.0f;
+        px[2] = 255.0f * u[2] - 128.0f;
+      }
+      else
+        for(int ch = 0; ch < 3; ch++) px[ch] = u[ch];
+      px[3] = 1.0f;
+    }
+
+    const double lcms_time = _time_transform(b, t, FALSE, in, ref);
+    const double lut_time = _time_transform(b, t, TRUE, in, out);
+
+    double max_de = 0.0, sum_de = 0.0;
+    if(to_Lab)
+    {
+      cmsDoTransform(to_Lab, ref, ref, DT_BENCH_COLOR_PIXELS);
+      cmsDoTransform(to_Lab, out, out, DT_BENCH_COLOR_PIXELS);
+      cmsDeleteTransform(to_Lab);
+    }
+    for(int k = 0; k < DT_BENCH_COLOR_PIXELS; k++)
+    {
+      const float *const r = ref + 4 * k, *const o = out + 4 * k;
+      const double de = sqrt((r[0] - o[0]) * (r[0] - o[0]) + (r[1] - o[1]) * (r[1] - o[1])
+                             + (r[2] - o[2]) * (r[2] - o[2]));
+      max_de = fmax(max_de, de);
+      sum_de += de;
+    }
+
+    // without a lut the transform is lcms2 itself, nothing to check
+    dt_bench_status_t status = DT_BENCH_SKIPPED;
+    if(t->clut) status = max_de <= DT_BENCH_COLOR_MAX_DELTA_E ? DT_BENCH_MATCH : DT_BENCH_MISMATCH;
+    if(status == DT_BENCH_MISMATCH) b->failures++;
+    _report_color(b, c, status, max_de, sum_de / DT_BENCH_COLOR_PIXELS, lut_time, lcms_time);
+    dt_colorspaces_release_transform(t);
+  }
+
+  dt_free_align(in);
+  dt_free_align(ref);
+  dt_free_align(out);
+}
+
+static void usage(const char *progname)
+{
+  fprintf(stderr,
+          "usage: %s [-h, --help; --version]\n"
+          "  [--size <width>x<height>]... (default = 1024x768 and 3000x2000)\n"
+          "  [--image <file>]... [--history <xmp file>]...\n"
+          "  [--modules <op>[,<op>...]] [--codepaths <sse2,simd,opencl>] [--no-writers] [--no-math]\n"
+          "  [--no-colorspaces]\n"
+          "  [--iterations <N> (default = 3)]\n"
+          "  [--references <dir>] [--update-references] [--tolerance <max error> (default = 0.005)]\n"
+          "  [--report <json file>]\n"
+          "  [--core <darktable options>]\n"
+          "\n"
+          "Every input is run through the export pixelpipe with the default history,\n"
+          "with each module that is off by default switched on, and with each given\n"
+          "history, on every requested codepath this machine supports. The fastest of\n"
+          "the iterations is reported, in total and per module. The output of the default\n"
+          "history is also written as deflated tiff and png, to time the format writers.\n"
+          "\n"
+          "The approximations of common/fast_math.h are checked against libm on every\n"
+          "float of their domain, plain and sse versions, and timed. The run fails if\n"
+          "one is less accurate than it is meant to be. The 3d luts colorin and colorout\n"
+          "use instead of lcms2 are compared to it in delta E and timed the same way.\n"
+          "\n"
+          "The output is compared to the references in the given directory, and the\n"
+          "run fails if any pixel differs by more than the tolerance. With\n"
+          "--update-references missing references are written instead.\n"
+          "\n"
+          "Use --core --configdir <dir> to keep your configuration out of this, and\n"
+          "--core -t <N> to fix the number of threads.\n",
+          progname);
+}
+
+int main(int argc, char *arg[])
+{
+  bindtextdomain(GETTEXT_PACKAGE, DARKTABLE_LOCALEDIR);
+  bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
+  textdomain(GETTEXT_PACKAGE);
+
+  gtk_init_check(&argc, &arg);
+
+  dt_bench_t b = { 0 };
+  b.tolerance = 0.005f;
+  b.iterations = 3;
+  b.first_result = TRUE;
+  b.writers = TRUE;
+  b.math = TRUE;
+  b.colorspaces = TRUE;
+  for(int c = 0; c < DT_BENCH_CODEPATHS; c++) b.codepaths[c] = TRUE;
+
+  GList *sizes = NULL, *images = NULL;
+  const char *report = NULL;
+
+  int k;
+  for(k = 1; k < argc; k++)
+  {
+    if(!strcmp(arg[k], "-h") || !strcmp(arg[k], "--help"))
+    {
+      usage(arg[0]);
+      exit(EXIT_FAILURE);
+    }
+    else if(!strcmp(arg[k], "--version"))
+    {
+      printf("this is darktable-bench %s\ncopyright (c) 2016 darktable developers\n",
+             darktable_package_version);
+      exit(EXIT_FAILURE);
+    }
+    else if(!strcmp(arg[k], "--size") && argc > k + 1)
+    {
+      k++;
+      int width = 0, height = 0;
+      if(sscanf(arg[k], "%dx%d", &width, &height) != 2 || width < 16 || height < 16)
+      {
+        fprintf(stderr, "error: invalid size `%s'\n", arg[k]);
+        exit(EXIT_FAILURE);
+      }
+      sizes = g_list_append(sizes, GINT_TO_POINTER(width));
+      sizes = g_list_append(sizes, GINT_TO_POINTER(height));
+    }
+    else if(!strcmp(arg[k], "--image") && argc > k + 1)
+      images = g_list_append(images, arg[++k]);
+    else if(!strcmp(arg[k], "--history") && argc > k + 1)
+      b.histories = g_list_append(b.histories, arg[++k]);
+    else if(!strcmp(arg[k], "--modules") && argc > k + 1)
+    {
+      g_strfreev(b.modules);
+      b.modules = g_strsplit(arg[++k], ",", -1);
+    }
+    else if(!strcmp(arg[k], "--codepaths") && argc > k + 1)
+    {
+      gchar **names = g_strsplit(arg[++k], ",", -1);
+      for(int c = 0; c < DT_BENCH_CODEPATHS; c++)
+        b.codepaths[c] = _strv_contains(names, _codepath_names[c]);
+      g_strfreev(names);
+    }
+    else if(!strcmp(arg[k], "--no-writers"))
+      b.writers = FALSE;
+    else if(!strcmp(arg[k], "--no-math"))
+      b.math = FALSE;
+    else if(!strcmp(arg[k], "--no-colorspaces"))
+      b.colorspaces = FALSE;
+    else if(!strcmp(arg[k], "--iterations") && argc > k + 1)
+      b.iterations = MAX(atoi(arg[++k]), 1);
+    else if(!strcmp(arg[k], "--references") && argc > k + 1)
+      b.refdir = arg[++k];
+    else if(!strcmp(arg[k], "--update-references"))
+      b.update_references = TRUE;
+    else if(!strcmp(arg[k], "--tolerance") && argc > k + 1)
+      b.tolerance = MAX(atof(arg[++k]), 0.0f);
+    else if(!strcmp(arg[k], "--report") && argc > k + 1)
+      report = arg[++k];
+    else if(!strcmp(arg[k], "--core"))
+    {
+      // everything from here on should be passed to the core
+      k++;
+      break;
+    }
+    else
+    {
+      usage(arg[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if(!sizes && !images)
+  {
+    sizes = g_list_append(sizes, GINT_TO_POINTER(1024));
+    sizes = g_list_append(sizes, GINT_TO_POINTER(768));
+    sizes = g_list_append(sizes, GINT_TO_POINTER(3000));
+    sizes = g_list_append(sizes, GINT_TO_POINTER(2000));
+  }
+
+  if(b.refdir && b.update_references && g_mkdir_with_parents(b.refdir, 0750))
+  {
+    fprintf(stderr, "error: could not create directory `%s'\n", b.refdir);
+    exit(EXIT_FAILURE);
+  }
+
+  int m_argc = 0;
+  char *m_arg[5 + argc - k];
+  m_arg[m_argc++] = "darktable-bench";
+  m_arg[m_argc++] = "--library";
+  m_arg[m_argc++] = ":memory:";
+  m_arg[m_argc++] = "--conf";
+  m_arg[m_argc++] = "write_sidecar_files=FALSE";
+  for(; k < argc; k++) m_arg[m_argc++] = arg[k];
+  m_arg[m_argc] = NULL;
+
+  // init dt without gui:
+  if(dt_init(m_argc, m_arg, 0, NULL)) exit(EXIT_FAILURE);
+
+  b.detected = darktable.codepath;
+  const gboolean opencl = dt_conf_get_bool("opencl");
+
+  gchar *tmpdir = g_dir_make_tmp("darktable-bench-XXXXXX", NULL);
+  if(!tmpdir)
+  {
+    fprintf(stderr, "error: could not create a temporary directory\n");
+    dt_cleanup();
+    exit(EXIT_FAILURE);
+  }
+  b.tmpdir = tmpdir;
+
+  // synthetic inputs first, they are the ones meant to be compared across machines
+  for(GList *s = sizes; s && g_list_next(s); s = g_list_next(g_list_next(s)))
+  {
+    const int width = GPOINTER_TO_INT(s->data), height = GPOINTER_TO_INT(g_list_next(s)->data);
+    dt_bench_input_t *input = (dt_bench_input_t *)calloc(1, sizeof(dt_bench_input_t));
+    input->name = g_strdup_printf("synthetic-%dx%d", width, height);
+    gchar *basename = g_strdup_printf("%s.pfm", input->name);
+    input->filename = g_build_filename(tmpdir, basename, NULL);
+    input->synthetic = TRUE;
+    g_free(basename);
+    if(_write_synthetic(input->filename, width, height))
+    {
+      fprintf(stderr, "error: could not write `%s'\n", input->filename);
+      _free_input(input);
+      b.failures++;
+      continue;
+    }
+    b.inputs = g_list_append(b.inputs, input);
+  }
+  for(GList *i = images; i; i = g_list_next(i))
+  {
+    dt_bench_input_t *input = (dt_bench_input_t *)calloc(1, sizeof(dt_bench_input_t));
+    input->name = g_path_get_basename((const char *)i->data);
+    input->filename = g_strdup((const char *)i->data);
+    b.inputs = g_list_append(b.inputs, input);
+  }
+
+  if(report)
+  {
+    b.report = g_fopen(report, "wb");
+    if(!b.report)
+      fprintf(stderr, "error: could not write `%s'\n", report);
+    else
+    {
+      fprintf(b.report, "{\n  \"version\": ");
+      _json_string(b.report, darktable_package_version);
+      fprintf(b.report, ",\n  \"iterations\": %d,\n  \"tolerance\": ", b.iterations);
+      _json_float(b.report, b.tolerance);
+      fprintf(b.report, ",\n  \"results\": [");
+    }
+  }
+
+  if(b.math) _run_math(&b);
+  if(b.colorspaces) _run_colorspaces(&b);
+
+  for(GList *i = b.inputs; i; i = g_list_next(i))
+  {
+    dt_bench_input_t *input = (dt_bench_input_t *)i->data;
+    dt_film_t film;
+    gchar *directory = g_path_get_dirname(input->filename);
+    const int filmid = dt_film_new(&film, directory);
+    g_free(directory);
+    input->imgid = dt_image_import(filmid, input->filename, TRUE);
+    if(!input->imgid)
+    {
+      fprintf(stderr, "error: can't open file %s\n", input->filename);
+      b.failures++;
+      continue;
+    }
+    _run_input(&b, input);
+  }
+
+  if(b.report)
+  {
+    fprintf(b.report, "\n  ],\n  \"failures\": %d\n}\n", b.failures);
+    fclose(b.report);
+  }
+
+  // don't leave our choices in the user's config
+  darktable.codepath = b.detected;
+  dt_conf_set_bool("opencl", opencl);
+
+  dt_cleanup();
+
+  g_list_free_full(b.inputs, _free_input);
+  g_rmdir(tmpdir);
+  g_free(tmpdir);
+  g_list_free(sizes);
+  g_list_free(images);
+  g_list_free(b.histories);
+  g_strfreev(b.modules);
+
+  if(b.failures) fprintf(stderr, "%d failures\n", b.failures);
+  return b.failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
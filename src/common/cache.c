@@ -64,6 +64,14 @@ void dt_cache_cleanup(dt_cache_t *cache)
   dt_pthread_mutex_destroy(&cache->lock);
 }
 
+void dt_cache_set_cost(dt_cache_t *cache, dt_cache_entry_t *entry, const size_t cost)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  cache->cost = cache->cost - entry->cost + cost;
+  entry->cost = cost;
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key)
 {
   dt_pthread_mutex_lock(&cache->lock);
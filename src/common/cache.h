@@ -82,6 +82,9 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
 // release a lock on a cache entry. the cache knows which one you mean (r or w).
 void dt_cache_release(dt_cache_t *cache, dt_cache_entry_t *entry);
 
+// change the cost of an entry the caller holds a lock on, for buffers that only know their size once filled.
+void dt_cache_set_cost(dt_cache_t *cache, dt_cache_entry_t *entry, const size_t cost);
+
 // 0: not contained
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key);
 // returns 0 on success, 1 if the key was not found.
@@ -21,6 +21,7 @@
 #include "common/image.h"
 #include "common/imageio_rawspeed.h"
 #include "common/metadata.h"
+#include "common/search_index.h"
 #include "common/utility.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -47,6 +48,8 @@ static const char *comparators[] = {
 
 /* Stores the collection query, returns 1 if changed.. */
 static int _dt_collection_store(const dt_collection_t *collection, gchar *query);
+/* sorting by exposure statistics needs them joined from image_stats */
+static gboolean _sort_by_stats(const dt_collection_t *collection);
 /* Counts the number of images in the current collection */
 static uint32_t _dt_collection_compute_count(const dt_collection_t *collection);
 /* signal handlers to update the cached count when something interesting might have happened.
@@ -172,6 +175,10 @@ int dt_collection_update(const dt_collection_t *collection)
     selq = dt_util_dstrcat(selq, "select distinct id from (select * from images where %s) join (select id as "
                                  "film_rolls_id, folder from film_rolls) on film_id = film_rolls_id",
                            wq);
+  else if(_sort_by_stats(collection))
+    selq = dt_util_dstrcat(selq, "select distinct id from (select * from images where %s) as a left outer "
+                                 "join image_stats as s on a.id = s.imgid",
+                           wq);
   else if(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT)
     selq = dt_util_dstrcat(selq, "select distinct images.id from images %s", wq);
   else
@@ -350,6 +357,14 @@ gchar *dt_collection_get_sort_query(const dt_collection_t *collection)
         sq = dt_util_dstrcat(sq, ORDER_BY_QUERY, "folder desc, filename desc, version");
         break;
 
+      case DT_COLLECTION_SORT_BRIGHTNESS:
+        sq = dt_util_dstrcat(sq, ORDER_BY_QUERY, "brightness desc, filename, version");
+        break;
+
+      case DT_COLLECTION_SORT_DYNAMIC_RANGE:
+        sq = dt_util_dstrcat(sq, ORDER_BY_QUERY, "dynamic_range desc, filename, version");
+        break;
+
       case DT_COLLECTION_SORT_NONE:
         // shouldn't happen
         break;
@@ -387,6 +402,14 @@ gchar *dt_collection_get_sort_query(const dt_collection_t *collection)
         sq = dt_util_dstrcat(sq, ORDER_BY_QUERY, "folder, filename, version");
         break;
 
+      case DT_COLLECTION_SORT_BRIGHTNESS:
+        sq = dt_util_dstrcat(sq, ORDER_BY_QUERY, "brightness, filename, version");
+        break;
+
+      case DT_COLLECTION_SORT_DYNAMIC_RANGE:
+        sq = dt_util_dstrcat(sq, ORDER_BY_QUERY, "dynamic_range, filename, version");
+        break;
+
       case DT_COLLECTION_SORT_NONE:
         // shouldn't happen
         break;
@@ -397,6 +420,13 @@ gchar *dt_collection_get_sort_query(const dt_collection_t *collection)
 }
 
 
+static gboolean _sort_by_stats(const dt_collection_t *collection)
+{
+  return (collection->params.sort == DT_COLLECTION_SORT_BRIGHTNESS
+          || collection->params.sort == DT_COLLECTION_SORT_DYNAMIC_RANGE)
+         && (collection->params.query_flags & COLLECTION_QUERY_USE_SORT);
+}
+
 static int _dt_collection_store(const dt_collection_t *collection, gchar *query)
 {
   /* store flags to conf */
@@ -432,7 +462,8 @@ static uint32_t _dt_collection_compute_count(const dt_collection_t *collection)
   else
     count_query = dt_util_dstrcat(count_query, "select count(distinct id) %s", fq);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), count_query, -1, &stmt, NULL);
+  // a running import doesn't hold this up, the new images are counted once their batch is committed
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), count_query, -1, &stmt, NULL);
   if((collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
      && !(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
   {
@@ -485,10 +516,12 @@ GList *dt_collection_get_all(const dt_collection_t *collection, int limit)
           && (collection->params.query_flags & COLLECTION_QUERY_USE_SORT))
     query = dt_util_dstrcat(
         query, "join (select id as film_rolls_id, folder from film_rolls) on film_id = film_rolls_id ");
+  else if(_sort_by_stats(collection))
+    query = dt_util_dstrcat(query, "as a left outer join image_stats as s on a.id = s.imgid ");
 
   query = dt_util_dstrcat(query, "%s limit ?1", sq);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), query, -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, limit);
 
   while(sqlite3_step(stmt) == SQLITE_ROW)
@@ -513,7 +546,7 @@ int dt_collection_get_nth(const dt_collection_t *collection, int nth)
     return -1;
   const gchar *query = dt_collection_get_query(collection);
   sqlite3_stmt *stmt = NULL;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), query, -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, nth);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, 1);
 
@@ -552,6 +585,8 @@ GList *dt_collection_get_selected(const dt_collection_t *collection, int limit)
           && (collection->params.query_flags & COLLECTION_QUERY_USE_SORT))
     query = dt_util_dstrcat(
         query, "join (select id as film_rolls_id, folder from film_rolls) on film_id = film_rolls_id ");
+  else if(_sort_by_stats(collection))
+    query = dt_util_dstrcat(query, "as a left outer join image_stats as s on a.id = s.imgid ");
 
   query = dt_util_dstrcat(query, "where id in (select imgid from selected_images) %s limit ?1", sq);
 
@@ -814,6 +849,54 @@ void dt_collection_get_makermodel(const gchar *filter, GList **sanitized, GList
   }
 }
 
+// text filter on one of the columns the search index knows, falling back to the plain like
+static gchar *_text_query(dt_search_index_column_t column, const gchar *plain, const gchar *pattern)
+{
+  gchar *indexed = dt_search_index_images_like(darktable.search_index, column, pattern);
+  gchar *query = indexed ? g_strdup_printf("(id in (%s))", indexed) : g_strdup(plain);
+  g_free(indexed);
+  return query;
+}
+
+static gchar *_metadata_query(dt_search_index_column_t column, int key, const gchar *escaped_text)
+{
+  gchar *pattern = g_strdup_printf("%%%s%%", escaped_text);
+  gchar *plain
+      = g_strdup_printf("(id in (select id from meta_data where key = %d and value like '%s'))", key, pattern);
+  gchar *query = _text_query(column, plain, pattern);
+  g_free(plain);
+  g_free(pattern);
+  return query;
+}
+
+// numeric filter on one of the columns of image_stats, images without statistics never match
+static gchar *_stats_query(const char *column, const gchar *escaped_text)
+{
+  gchar *query = NULL;
+  gchar *operator, *number1, *number2;
+  dt_collection_split_operator_number(escaped_text, &number1, &number2, &operator);
+
+  if(operator&& strcmp(operator, "[]") == 0)
+  {
+    if(number1 && number2)
+      query = dt_util_dstrcat(query, "(id in (select imgid from image_stats where %s >= %s and %s <= %s))",
+                              column, number1, column, number2);
+  }
+  else if(operator&& number1)
+    query = dt_util_dstrcat(query, "(id in (select imgid from image_stats where %s %s %s))", column, operator,
+                            number1);
+  else if(number1)
+    query = dt_util_dstrcat(query, "(id in (select imgid from image_stats where round(%s) = %s))", column,
+                            number1);
+  else
+    query = dt_util_dstrcat(query, "(id in (select imgid from image_stats))");
+
+  g_free(operator);
+  g_free(number1);
+  g_free(number2);
+  return query;
+}
+
 static gchar *get_query_string(const dt_collection_properties_t property, const gchar *text)
 {
   char *escaped_text = sqlite3_mprintf("%q", text);
@@ -896,36 +979,44 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       }
       break;
     case DT_COLLECTION_PROP_TAG: // tag
-      query = dt_util_dstrcat(query, "(id in (select imgid from tagged_images as a join "
-                                 "tags as b on a.tagid = b.id where name like '%s'))",
-                              escaped_text);
-      break;
+    {
+      gchar *tags = dt_search_index_tags_like(darktable.search_index, escaped_text);
+      if(tags)
+        query = dt_util_dstrcat(query, "(id in (select imgid from tagged_images where tagid in (%s)))", tags);
+      else
+        query = dt_util_dstrcat(query, "(id in (select imgid from tagged_images as a join "
+                                   "tags as b on a.tagid = b.id where name like '%s'))",
+                                escaped_text);
+      g_free(tags);
+    }
+    break;
 
     // TODO: How to handle images without metadata? In the moment they are not shown.
     // TODO: Autogenerate this code?
     case DT_COLLECTION_PROP_TITLE: // title
-      query = dt_util_dstrcat(query, "(id in (select id from meta_data where key = %d and value like '%%%s%%'))",
-                      DT_METADATA_XMP_DC_TITLE, escaped_text);
+      query = _metadata_query(DT_SEARCH_INDEX_TITLE, DT_METADATA_XMP_DC_TITLE, escaped_text);
       break;
     case DT_COLLECTION_PROP_DESCRIPTION: // description
-      query = dt_util_dstrcat(query, "(id in (select id from meta_data where key = %d and value like '%%%s%%'))",
-                      DT_METADATA_XMP_DC_DESCRIPTION, escaped_text);
+      query = _metadata_query(DT_SEARCH_INDEX_DESCRIPTION, DT_METADATA_XMP_DC_DESCRIPTION, escaped_text);
       break;
     case DT_COLLECTION_PROP_CREATOR: // creator
-      query = dt_util_dstrcat(query, "(id in (select id from meta_data where key = %d and value like '%%%s%%'))",
-                      DT_METADATA_XMP_DC_CREATOR, escaped_text);
+      query = _metadata_query(DT_SEARCH_INDEX_CREATOR, DT_METADATA_XMP_DC_CREATOR, escaped_text);
       break;
     case DT_COLLECTION_PROP_PUBLISHER: // publisher
-      query = dt_util_dstrcat(query, "(id in (select id from meta_data where key = %d and value like '%%%s%%'))",
-                      DT_METADATA_XMP_DC_PUBLISHER, escaped_text);
+      query = _metadata_query(DT_SEARCH_INDEX_PUBLISHER, DT_METADATA_XMP_DC_PUBLISHER, escaped_text);
       break;
     case DT_COLLECTION_PROP_RIGHTS: // rights
-      query = dt_util_dstrcat(query, "(id in (select id from meta_data where key = %d and value like '%%%s%%'))",
-                      DT_METADATA_XMP_DC_RIGHTS, escaped_text);
+      query = _metadata_query(DT_SEARCH_INDEX_RIGHTS, DT_METADATA_XMP_DC_RIGHTS, escaped_text);
       break;
     case DT_COLLECTION_PROP_LENS: // lens
-      query = dt_util_dstrcat(query, "(lens like '%%%s%%')", escaped_text);
-      break;
+    {
+      gchar *pattern = g_strdup_printf("%%%s%%", escaped_text);
+      gchar *plain = g_strdup_printf("(lens like '%s')", pattern);
+      query = _text_query(DT_SEARCH_INDEX_LENS, plain, pattern);
+      g_free(plain);
+      g_free(pattern);
+    }
+    break;
 
     case DT_COLLECTION_PROP_FOCAL_LENGTH: // focal length
     {
@@ -998,8 +1089,14 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
     break;
 
     case DT_COLLECTION_PROP_FILENAME: // filename
-      query = dt_util_dstrcat(query, "(filename like '%%%s%%')", escaped_text);
-      break;
+    {
+      gchar *pattern = g_strdup_printf("%%%s%%", escaped_text);
+      gchar *plain = g_strdup_printf("(filename like '%s')", pattern);
+      query = _text_query(DT_SEARCH_INDEX_FILENAME, plain, pattern);
+      g_free(plain);
+      g_free(pattern);
+    }
+    break;
 
     case DT_COLLECTION_PROP_DAY:
     // query = dt_util_dstrcat(query, "(datetime_taken like '%%%s%%')", escaped_text);
@@ -1031,6 +1128,18 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
     }
     break;
 
+    case DT_COLLECTION_PROP_BRIGHTNESS: // mean brightness, in percent
+      query = _stats_query("brightness", escaped_text);
+      break;
+
+    case DT_COLLECTION_PROP_CLIPPING: // clipped highlights, in percent
+      query = _stats_query("clipped", escaped_text);
+      break;
+
+    case DT_COLLECTION_PROP_DYNAMIC_RANGE: // dynamic range, in EV
+      query = _stats_query("dynamic_range", escaped_text);
+      break;
+
     default:
       // we shouldn't be here
       break;
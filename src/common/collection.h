@@ -65,7 +65,9 @@ typedef enum dt_collection_sort_t
   DT_COLLECTION_SORT_ID,
   DT_COLLECTION_SORT_COLOR,
   DT_COLLECTION_SORT_GROUP,
-  DT_COLLECTION_SORT_PATH
+  DT_COLLECTION_SORT_PATH,
+  DT_COLLECTION_SORT_BRIGHTNESS,
+  DT_COLLECTION_SORT_DYNAMIC_RANGE
 } dt_collection_sort_t;
 
 typedef enum dt_collection_properties_t
@@ -88,7 +90,10 @@ typedef enum dt_collection_properties_t
   DT_COLLECTION_PROP_ISO,
   DT_COLLECTION_PROP_APERTURE,
   DT_COLLECTION_PROP_FILENAME,
-  DT_COLLECTION_PROP_GEOTAGGING
+  DT_COLLECTION_PROP_GEOTAGGING,
+  DT_COLLECTION_PROP_BRIGHTNESS,
+  DT_COLLECTION_PROP_CLIPPING,
+  DT_COLLECTION_PROP_DYNAMIC_RANGE
 } dt_collection_properties_t;
 
 typedef enum dt_collection_rating_comperator_t
@@ -20,12 +20,17 @@
 #include "common/colormatrices.c"
 #include "common/darktable.h"
 #include "common/debug.h"
+#include "common/fast_math.h"
 #include "common/srgb_tone_curve_values.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/imageop.h"
 #include "external/adobe_coeff.c"
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 #ifdef USE_COLORDGTK
 #include "colord-gtk.h"
 #endif
@@ -348,62 +353,25 @@ static cmsToneCurve *build_linear_gamma(void)
   return cmsBuildParametricToneCurve(0, 1, Parameters);
 }
 
-static float cbrt_5f(float f)
-{
-  uint32_t *p = (uint32_t *)&f;
-  *p = *p / 3 + 709921077;
-  return f;
-}
-
-static float cbrta_halleyf(const float a, const float R)
-{
-  const float a3 = a * a * a;
-  const float b = a * (a3 + R + R) / (a3 + a3 + R);
-  return b;
-}
-
-static float lab_f(const float x)
-{
-  const float epsilon = 216.0f / 24389.0f;
-  const float kappa = 24389.0f / 27.0f;
-  if(x > epsilon)
-  {
-    // approximate cbrtf(x):
-    const float a = cbrt_5f(x);
-    return cbrta_halleyf(a, x);
-  }
-  else
-    return (kappa * x + 16.0f) / 116.0f;
-}
-
 void dt_XYZ_to_Lab(const float *XYZ, float *Lab)
 {
   const float d50[3] = { 0.9642, 1.0, 0.8249 };
-  const float f[3] = { lab_f(XYZ[0] / d50[0]), lab_f(XYZ[1] / d50[1]), lab_f(XYZ[2] / d50[2]) };
+  const float f[3] = { dt_lab_f_m(XYZ[0] / d50[0]), dt_lab_f_m(XYZ[1] / d50[1]),
+                        dt_lab_f_m(XYZ[2] / d50[2]) };
   Lab[0] = 116.0f * f[1] - 16.0f;
   Lab[1] = 500.0f * (f[0] - f[1]);
   Lab[2] = 200.0f * (f[1] - f[2]);
 }
 
-static float lab_f_inv(const float x)
-{
-  const float epsilon = 0.20689655172413796; // cbrtf(216.0f/24389.0f);
-  const float kappa = 24389.0f / 27.0f;
-  if(x > epsilon)
-    return x * x * x;
-  else
-    return (116.0f * x - 16.0f) / kappa;
-}
-
 void dt_Lab_to_XYZ(const float *Lab, float *XYZ)
 {
   const float d50[3] = { 0.9642, 1.0, 0.8249 };
   const float fy = (Lab[0] + 16.0f) / 116.0f;
   const float fx = Lab[1] / 500.0f + fy;
   const float fz = fy - Lab[2] / 200.0f;
-  XYZ[0] = d50[0] * lab_f_inv(fx);
-  XYZ[1] = d50[1] * lab_f_inv(fy);
-  XYZ[2] = d50[2] * lab_f_inv(fz);
+  XYZ[0] = d50[0] * dt_lab_f_inv_m(fx);
+  XYZ[1] = d50[1] * dt_lab_f_inv_m(fy);
+  XYZ[2] = d50[2] * dt_lab_f_inv_m(fz);
 }
 
 void dt_XYZ_to_sRGB(const float * const XYZ, float *sRGB)
@@ -1066,6 +1034,8 @@ static dt_colorspaces_color_profile_t *_create_profile(dt_colorspaces_color_prof
 // this function is basically thread safe, at least when not called on the global darktable.color_profiles
 static void _update_display_transforms(dt_colorspaces_t *self)
 {
+  self->display_transforms_generation++;
+
   if(self->transform_srgb_to_display) cmsDeleteTransform(self->transform_srgb_to_display);
   self->transform_srgb_to_display = NULL;
 
@@ -1100,6 +1070,339 @@ void dt_colorspaces_update_display_transforms()
   _update_display_transforms(darktable.color_profiles);
 }
 
+// shared transforms and their 3d luts
+
+#define DT_COLORSPACES_TRANSFORMS_UNUSED 16
+#define DT_COLORSPACES_CLUT_SIZE 33
+#define DT_COLORSPACES_CLUT_CHECKS 8192
+// worst case error allowed for the 3d lut, in delta E for Lab and percent for rgb output
+#define DT_COLORSPACES_CLUT_MAX_ERROR 1.0f
+
+// returns FALSE if the contents of the profile can't be identified
+static gboolean _profile_checksum(cmsHPROFILE profile, char *checksum, size_t checksum_size)
+{
+  if(!profile)
+  {
+    g_strlcpy(checksum, "-", checksum_size);
+    return TRUE;
+  }
+
+  // profiles with a valid profile id don't need to be serialized
+  cmsUInt8Number id[16];
+  cmsGetHeaderProfileID(profile, id);
+  gboolean have_id = FALSE;
+  for(int k = 0; k < 16; k++) have_id |= id[k] != 0;
+
+  gchar *sum = NULL;
+  cmsUInt32Number size = 0;
+  if(have_id)
+    sum = g_compute_checksum_for_data(G_CHECKSUM_MD5, id, sizeof(id));
+  else if(cmsSaveProfileToMem(profile, NULL, &size))
+  {
+    uint8_t *data = (uint8_t *)malloc(size);
+    if(cmsSaveProfileToMem(profile, data, &size)) sum = g_compute_checksum_for_data(G_CHECKSUM_MD5, data, size);
+    free(data);
+  }
+
+  if(!sum) return FALSE;
+  g_strlcpy(checksum, sum, checksum_size);
+  g_free(sum);
+  return TRUE;
+}
+
+// map a pixel to the [0..1] domain of the lut. linear rgb goes through a cube root which keeps the lut
+// accurate in the shadows and makes the mapping to Lab close to linear.
+static inline void _clut_encode(const cmsUInt32Number format, const float *const in, float *const u)
+{
+  if(format == TYPE_LabA_FLT)
+  {
+    u[0] = in[0] / 100.0f;
+    u[1] = (in[1] + 128.0f) / 255.0f;
+    u[2] = (in[2] + 128.0f) / 255.0f;
+  }
+  else
+  {
+    for(int c = 0; c < 3; c++)
+    {
+      const float x = CLAMP(in[c], 0.0f, 1.0f);
+      u[c] = x > 0.0f ? dt_cbrtf_halley(dt_fast_cbrtf(x), x) : 0.0f;
+    }
+  }
+}
+
+static inline void _clut_decode(const cmsUInt32Number format, const float *const u, float *const out)
+{
+  if(format == TYPE_LabA_FLT)
+  {
+    out[0] = u[0] * 100.0f;
+    out[1] = u[1] * 255.0f - 128.0f;
+    out[2] = u[2] * 255.0f - 128.0f;
+  }
+  else
+  {
+    for(int c = 0; c < 3; c++) out[c] = u[c] * u[c] * u[c];
+  }
+}
+
+// tetrahedral interpolation, the lut has 4 floats per node so they can be loaded as one vector
+static inline void _clut_lookup(const float *const clut, const int n, const float *const u, float *const out)
+{
+  int i[3];
+  float f[3];
+  for(int c = 0; c < 3; c++)
+  {
+    const float x = CLAMP(u[c], 0.0f, 1.0f) * (n - 1);
+    i[c] = MIN((int)x, n - 2);
+    f[c] = x - i[c];
+  }
+
+  const size_t s0 = (size_t)4 * n * n, s1 = (size_t)4 * n, s2 = 4;
+  const float *const c000 = clut + i[0] * s0 + i[1] * s1 + i[2] * s2;
+  const float *const c111 = c000 + s0 + s1 + s2;
+
+  // walk from c000 to c111 along the edges of the tetrahedron containing the point
+  const float *a, *b;
+  float w1, w2, w3;
+  if(f[0] >= f[1])
+  {
+    if(f[1] >= f[2])
+    {
+      a = c000 + s0; b = c000 + s0 + s1; w1 = f[0]; w2 = f[1]; w3 = f[2];
+    }
+    else if(f[0] >= f[2])
+    {
+      a = c000 + s0; b = c000 + s0 + s2; w1 = f[0]; w2 = f[2]; w3 = f[1];
+    }
+    else
+    {
+      a = c000 + s2; b = c000 + s0 + s2; w1 = f[2]; w2 = f[0]; w3 = f[1];
+    }
+  }
+  else
+  {
+    if(f[2] >= f[1])
+    {
+      a = c000 + s2; b = c000 + s1 + s2; w1 = f[2]; w2 = f[1]; w3 = f[0];
+    }
+    else if(f[2] >= f[0])
+    {
+      a = c000 + s1; b = c000 + s1 + s2; w1 = f[1]; w2 = f[2]; w3 = f[0];
+    }
+    else
+    {
+      a = c000 + s1; b = c000 + s0 + s1; w1 = f[1]; w2 = f[0]; w3 = f[2];
+    }
+  }
+
+#if defined(__SSE__)
+  const __m128 v = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.0f - w1), _mm_load_ps(c000)),
+                 _mm_mul_ps(_mm_set1_ps(w1 - w2), _mm_load_ps(a))),
+      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(w2 - w3), _mm_load_ps(b)), _mm_mul_ps(_mm_set1_ps(w3), _mm_load_ps(c111))));
+  const float alpha = out[3];
+  _mm_storeu_ps(out, v);
+  out[3] = alpha;
+#else
+  for(int c = 0; c < 3; c++)
+    out[c] = (1.0f - w1) * c000[c] + (w1 - w2) * a[c] + (w2 - w3) * b[c] + w3 * c111[c];
+#endif
+}
+
+static void _clut_apply(const dt_colorspaces_transform_t *t, const float *in, float *out, const int width)
+{
+  for(int j = 0; j < width; j++, in += 4, out += 4)
+  {
+    float u[3];
+    _clut_encode(t->in_format, in, u);
+    out[3] = in[3];
+    _clut_lookup(t->clut, t->clut_size, u, out);
+  }
+}
+
+static float _clut_error(const cmsUInt32Number format, const float *const a, const float *const b)
+{
+  if(format == TYPE_LabA_FLT)
+    return sqrtf((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+
+  float err = 0.0f;
+  for(int c = 0; c < 3; c++) err = fmaxf(err, 100.0f * fabsf(a[c] - b[c]));
+  return err;
+}
+
+// sample the transform into a 3d lut and keep it if it reproduces lcms2 closely enough
+static void _transform_build_clut(dt_colorspaces_transform_t *t)
+{
+  const int n = DT_COLORSPACES_CLUT_SIZE;
+  const size_t nodes = (size_t)n * n * n;
+  float *clut = dt_alloc_align(16, sizeof(float) * 4 * nodes);
+  float *check = malloc(sizeof(float) * 4 * 3 * DT_COLORSPACES_CLUT_CHECKS);
+  if(!clut || !check)
+  {
+    dt_free_align(clut);
+    free(check);
+    return;
+  }
+
+  for(int i = 0; i < n; i++)
+    for(int j = 0; j < n; j++)
+      for(int k = 0; k < n; k++)
+      {
+        float *node = clut + 4 * (((size_t)i * n + j) * n + k);
+        const float u[3] = { i / (n - 1.0f), j / (n - 1.0f), k / (n - 1.0f) };
+        _clut_decode(t->in_format, u, node);
+        node[3] = 1.0f;
+      }
+  cmsDoTransform(t->xform, clut, clut, nodes);
+
+  // compare against lcms2 on a fixed set of pseudo random points in between the nodes
+  float *in = check, *ref = check + 4 * DT_COLORSPACES_CLUT_CHECKS, *res = check + 8 * DT_COLORSPACES_CLUT_CHECKS;
+  uint32_t seed = 0x12345678;
+  for(int k = 0; k < DT_COLORSPACES_CLUT_CHECKS; k++)
+  {
+    float u[3];
+    for(int c = 0; c < 3; c++)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      u[c] = (seed >> 8) / (float)(1 << 24);
+    }
+    _clut_decode(t->in_format, u, in + 4 * k);
+    in[4 * k + 3] = 1.0f;
+  }
+
+  double start = dt_get_wtime();
+  cmsDoTransform(t->xform, in, ref, DT_COLORSPACES_CLUT_CHECKS);
+  const double lcms_time = dt_get_wtime() - start;
+  start = dt_get_wtime();
+  t->clut = clut;
+  t->clut_size = n;
+  _clut_apply(t, in, res, DT_COLORSPACES_CLUT_CHECKS);
+  const double clut_time = dt_get_wtime() - start;
+
+  float max_error = 0.0f;
+  double sum_error = 0.0;
+  for(int k = 0; k < DT_COLORSPACES_CLUT_CHECKS; k++)
+  {
+    const float err = _clut_error(t->out_format, ref + 4 * k, res + 4 * k);
+    max_error = fmaxf(max_error, err);
+    sum_error += err;
+  }
+  free(check);
+
+  const gboolean accurate = max_error <= DT_COLORSPACES_CLUT_MAX_ERROR;
+  dt_print(DT_DEBUG_PERF, "[colorspaces] 3d lut %s: mean error %.3f, max error %.3f, lcms2 %.1f Mpix/s, lut "
+                          "%.1f Mpix/s\n",
+           accurate ? "used" : "dropped", sum_error / DT_COLORSPACES_CLUT_CHECKS, max_error,
+           DT_COLORSPACES_CLUT_CHECKS / (1e6 * fmax(lcms_time, 1e-9)),
+           DT_COLORSPACES_CLUT_CHECKS / (1e6 * fmax(clut_time, 1e-9)));
+
+  if(!accurate)
+  {
+    dt_free_align(clut);
+    t->clut = NULL;
+    t->clut_size = 0;
+  }
+}
+
+static void _transform_free(gpointer data)
+{
+  dt_colorspaces_transform_t *t = (dt_colorspaces_transform_t *)data;
+  if(t->xform) cmsDeleteTransform(t->xform);
+  dt_free_align(t->clut);
+  g_free(t->key);
+  free(t);
+}
+
+dt_colorspaces_transform_t *dt_colorspaces_get_transform(cmsHPROFILE in_profile, cmsUInt32Number in_format,
+                                                         cmsHPROFILE out_profile, cmsUInt32Number out_format,
+                                                         cmsHPROFILE proof_profile, int intent, int proof_intent,
+                                                         cmsUInt32Number flags, gboolean clut)
+{
+  dt_colorspaces_t *self = darktable.color_profiles;
+  if(!in_profile || !out_profile) return NULL;
+
+  // only the layouts used by the pixelpipe can be handled by the lut
+  clut = clut && !proof_profile && (in_format == TYPE_RGBA_FLT || in_format == TYPE_LabA_FLT)
+         && (out_format == TYPE_RGBA_FLT || out_format == TYPE_LabA_FLT);
+
+  // a profile we can't identify may be freed and another one allocated at the same address, so transforms
+  // using it aren't shared. they get no key and are freed once released.
+  char in_sum[33], out_sum[33], proof_sum[33];
+  gchar *key = NULL;
+  if(_profile_checksum(in_profile, in_sum, sizeof(in_sum))
+     && _profile_checksum(out_profile, out_sum, sizeof(out_sum))
+     && _profile_checksum(proof_profile, proof_sum, sizeof(proof_sum)))
+    key = g_strdup_printf("%s %s %s %u %u %d %d %u %d", in_sum, out_sum, proof_sum, in_format, out_format,
+                          intent, proof_intent, flags, clut);
+
+  // creating the transform under the lock also keeps several pipes from building the same one at once
+  dt_pthread_mutex_lock(&self->transforms_lock);
+  dt_colorspaces_transform_t *t
+      = key ? (dt_colorspaces_transform_t *)g_hash_table_lookup(self->transforms, key) : NULL;
+  if(t)
+  {
+    if(t->users++ == 0) g_queue_remove(&self->transforms_unused, t);
+    g_free(key);
+  }
+  else
+  {
+    const double start = dt_get_wtime();
+    cmsHTRANSFORM xform;
+    if(proof_profile)
+      xform = cmsCreateProofingTransform(in_profile, in_format, out_profile, out_format, proof_profile, intent,
+                                         proof_intent, flags);
+    else
+      xform = cmsCreateTransform(in_profile, in_format, out_profile, out_format, intent, flags);
+
+    if(xform)
+    {
+      t = (dt_colorspaces_transform_t *)calloc(1, sizeof(dt_colorspaces_transform_t));
+      t->xform = xform;
+      t->in_format = in_format;
+      t->out_format = out_format;
+      t->key = key;
+      t->users = 1;
+      if(clut) _transform_build_clut(t);
+      if(key) g_hash_table_insert(self->transforms, t->key, t);
+      dt_print(DT_DEBUG_PERF, "[colorspaces] created transform in %.3f secs\n", dt_get_wtime() - start);
+    }
+    else
+      g_free(key);
+  }
+  dt_pthread_mutex_unlock(&self->transforms_lock);
+
+  return t;
+}
+
+void dt_colorspaces_release_transform(dt_colorspaces_transform_t *transform)
+{
+  dt_colorspaces_t *self = darktable.color_profiles;
+  if(!transform) return;
+
+  // keep a few unused transforms around, pipes tend to come back to the same profiles
+  dt_pthread_mutex_lock(&self->transforms_lock);
+  if(--transform->users == 0 && !transform->key)
+    _transform_free(transform);
+  else if(transform->users == 0)
+  {
+    g_queue_push_tail(&self->transforms_unused, transform);
+    while(g_queue_get_length(&self->transforms_unused) > DT_COLORSPACES_TRANSFORMS_UNUSED)
+    {
+      dt_colorspaces_transform_t *t = (dt_colorspaces_transform_t *)g_queue_pop_head(&self->transforms_unused);
+      g_hash_table_remove(self->transforms, t->key);
+    }
+  }
+  dt_pthread_mutex_unlock(&self->transforms_lock);
+}
+
+void dt_colorspaces_apply_transform(const dt_colorspaces_transform_t *transform, const float *in, float *out,
+                                    const int width)
+{
+  if(transform->clut)
+    _clut_apply(transform, in, out, width);
+  else
+    cmsDoTransform(transform->xform, in, out, width);
+}
+
 // make sure that darktable.color_profiles->xprofile_lock is held when calling this!
 static void _update_display_profile(guchar *tmp_data, gsize size, char *name, size_t name_size)
 {
@@ -1142,6 +1445,10 @@ dt_colorspaces_t *dt_colorspaces_init()
 
   pthread_rwlock_init(&res->xprofile_lock, NULL);
 
+  dt_pthread_mutex_init(&res->transforms_lock, NULL);
+  res->transforms = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _transform_free);
+  g_queue_init(&res->transforms_unused);
+
   int in_pos = -1,
       out_pos = -1,
       display_pos = -1;
@@ -1319,6 +1626,10 @@ void dt_colorspaces_cleanup(dt_colorspaces_t *self)
   if(self->transform_adobe_rgb_to_display) cmsDeleteTransform(self->transform_adobe_rgb_to_display);
   self->transform_adobe_rgb_to_display = NULL;
 
+  g_queue_clear(&self->transforms_unused);
+  g_hash_table_destroy(self->transforms);
+  dt_pthread_mutex_destroy(&self->transforms_lock);
+
   for(GList *iter = self->profiles; iter; iter = g_list_next(iter))
   {
     dt_colorspaces_color_profile_t *p = (dt_colorspaces_color_profile_t *)iter->data;
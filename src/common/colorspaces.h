@@ -89,9 +89,26 @@ typedef struct dt_colorspaces_t
   dt_colorspaces_color_mode_t mode;
 
   cmsHTRANSFORM transform_srgb_to_display, transform_adobe_rgb_to_display;
+  // bumped whenever the transforms above are rebuilt, so thumbnails converted with them can be dropped
+  uint32_t display_transforms_generation;
+
+  // lcms2 transforms shared between all pipes, see dt_colorspaces_get_transform()
+  dt_pthread_mutex_t transforms_lock;
+  GHashTable *transforms;
+  GQueue transforms_unused; // transforms nobody holds any more, least recently used first
 
 } dt_colorspaces_t;
 
+typedef struct dt_colorspaces_transform_t
+{
+  cmsHTRANSFORM xform;
+  cmsUInt32Number in_format, out_format;
+  float *clut; // 3d lut sampled from xform, NULL if not wanted or not accurate enough
+  int clut_size;
+  char *key; // NULL if not shared, see dt_colorspaces_get_transform()
+  int users;
+} dt_colorspaces_transform_t;
+
 typedef struct dt_colorspaces_color_profile_t
 {
   dt_colorspaces_color_profile_type_t type; // filename is only used for type DT_COLORSPACE_FILE
@@ -182,6 +199,22 @@ dt_colorspaces_get_profile(dt_colorspaces_color_profile_type_t type, const char
  * make sure that darktable.color_profiles->xprofile_lock is held when calling this! */
 void dt_colorspaces_update_display_transforms();
 
+/** get a float transform from in_profile to out_profile, proofed through proof_profile if that isn't NULL.
+ * transforms are shared between all pipes using profiles with the same contents, formats, intents and flags,
+ * unless a profile has neither a profile id nor can be serialized.
+ * with clut set, non-matrix transforms between 4 channel float formats are sampled into a 3d lut which is used
+ * instead of lcms2 as long as it is accurate enough. returns NULL if lcms2 can't create the transform.
+ * release with dt_colorspaces_release_transform(). */
+dt_colorspaces_transform_t *dt_colorspaces_get_transform(cmsHPROFILE in_profile, cmsUInt32Number in_format,
+                                                         cmsHPROFILE out_profile, cmsUInt32Number out_format,
+                                                         cmsHPROFILE proof_profile, int intent, int proof_intent,
+                                                         cmsUInt32Number flags, gboolean clut);
+void dt_colorspaces_release_transform(dt_colorspaces_transform_t *transform);
+
+/** convert width pixels of 4 floats, in and out may be the same buffer. */
+void dt_colorspaces_apply_transform(const dt_colorspaces_transform_t *transform, const float *in, float *out,
+                                    const int width);
+
 /** Calculate CAM->XYZ, XYZ->CAM matrices **/
 int dt_colorspaces_conversion_matrices_xyz(const char *name, float in_XYZ_to_CAM[9], double XYZ_to_CAM[4][3], double CAM_to_XYZ[3][4]);
 
@@ -44,11 +44,14 @@
 #include "common/grealpath.h"
 #include "common/image.h"
 #include "common/image_cache.h"
+#include "common/image_state.h"
 #include "common/imageio_module.h"
 #include "common/mipmap_cache.h"
 #include "common/noiseprofiles.h"
 #include "common/opencl.h"
 #include "common/points.h"
+#include "common/search_index.h"
+#include "common/threadbudget.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "control/crawler.h"
@@ -907,6 +910,12 @@ int dt_init(int argc, char *argv[], const int init_gui, lua_State *L)
   /* initialize selection */
   darktable.selection = dt_selection_new();
 
+  /* in-memory copy of what thumbnails need to know about images */
+  darktable.image_state = dt_image_state_init();
+
+  /* trigram index for the text filters of the collection */
+  darktable.search_index = dt_search_index_init();
+
   /* capabilities set to NULL */
   darktable.capabilities = NULL;
 
@@ -931,6 +940,9 @@ int dt_init(int argc, char *argv[], const int init_gui, lua_State *L)
   darktable.points = (dt_points_t *)calloc(1, sizeof(dt_points_t));
   dt_points_init(darktable.points, dt_get_num_threads());
 
+  darktable.thread_budget = (dt_thread_budget_t *)calloc(1, sizeof(dt_thread_budget_t));
+  dt_thread_budget_init(darktable.thread_budget, darktable.num_openmp_threads);
+
   darktable.noiseprofile_parser = dt_noiseprofile_init(noiseprofiles_from_command);
 
   // must come before mipmap_cache, because that one will need to access
@@ -1115,6 +1127,8 @@ void dt_cleanup()
   free(darktable.conf);
   dt_points_cleanup(darktable.points);
   free(darktable.points);
+  dt_thread_budget_cleanup(darktable.thread_budget);
+  free(darktable.thread_budget);
   dt_iop_unload_modules_so();
   dt_opencl_cleanup(darktable.opencl);
   free(darktable.opencl);
@@ -1130,6 +1144,12 @@ void dt_cleanup()
 
   dt_guides_cleanup(darktable.guides);
 
+  dt_search_index_cleanup(darktable.search_index);
+  darktable.search_index = NULL;
+
+  dt_image_state_cleanup(darktable.image_state);
+  darktable.image_state = NULL;
+
   dt_database_destroy(darktable.db);
 
   if(init_gui)
@@ -150,6 +150,9 @@ struct dt_imageio_t;
 struct dt_bauhaus_t;
 struct dt_undo_t;
 struct dt_colorspaces_t;
+struct dt_thread_budget_t;
+struct dt_image_state_index_t;
+struct dt_search_index_t;
 
 typedef enum dt_debug_thread_t
 {
@@ -205,6 +208,8 @@ typedef struct darktable_t
   const struct dt_camctl_t *camctl;
   const struct dt_collection_t *collection;
   struct dt_selection_t *selection;
+  struct dt_image_state_index_t *image_state;
+  struct dt_search_index_t *search_index;
   struct dt_points_t *points;
   struct dt_imageio_t *imageio;
   struct dt_opencl_t *opencl;
@@ -212,6 +217,7 @@ typedef struct darktable_t
   struct dt_dbus_t *dbus;
   struct dt_undo_t *undo;
   struct dt_colorspaces_t *color_profiles;
+  struct dt_thread_budget_t *thread_budget;
   dt_pthread_mutex_t db_insert;
   dt_pthread_mutex_t plugin_threadsafe;
   dt_pthread_mutex_t capabilities_threadsafe;
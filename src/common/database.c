@@ -36,7 +36,7 @@
 
 // whenever _create_schema() gets changed you HAVE to bump this version and add an update path to
 // _upgrade_schema_step()!
-#define CURRENT_DATABASE_VERSION 11
+#define CURRENT_DATABASE_VERSION 12
 
 typedef struct dt_database_t
 {
@@ -48,8 +48,39 @@ typedef struct dt_database_t
 
   /* ondisk DB */
   sqlite3 *handle;
+
+  /* write ahead logging is on, background readers get their own connections */
+  gboolean wal;
+
+  /* write transactions on handle, see dt_database_start_transaction(). the lock is held by the thread
+     owning the transaction for as long as it is open, the gui thread joins instead of waiting for it. */
+  GRecMutex transaction_lock;
+  GThread *transaction_owner;
+  int transaction_depth;
+  /* when the outermost one was started, and the number of threads blocked on the lock */
+  gint64 transaction_begin;
+  gint transaction_waiters;
 } dt_database_t;
 
+/* a read only connection owned by one thread. the list of all of them lets us close them before the
+   database goes away, the thread frees the struct when it exits. */
+typedef struct dt_database_reader_t
+{
+  sqlite3 *handle;
+} dt_database_reader_t;
+
+static void _reader_free(gpointer data);
+
+static GPrivate _reader_key = G_PRIVATE_INIT(_reader_free);
+static GMutex _readers_lock;
+static GList *_readers = NULL;
+
+/* depth of the transaction the gui thread has joined instead of waiting for its owner, 0 when it hasn't */
+static GPrivate _joined_key = G_PRIVATE_INIT(NULL);
+
+/* how long a batch keeps its transaction open before dt_database_yield_transaction() commits it, in us */
+#define DT_DATABASE_TRANSACTION_BUDGET 50000
+
 
 /* migrates database from old place to new */
 static void _database_migrate_to_xdg_structure();
@@ -732,6 +763,19 @@ static int _upgrade_schema_step(dt_database_t *db, int version)
     }
     sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
     new_version = 11;
+  }
+  else if(version == 11)
+  {
+    // 11 -> 12 added image_stats table
+    if(sqlite3_exec(db->handle, "CREATE TABLE image_stats (imgid INTEGER PRIMARY KEY, brightness REAL, "
+                                "clipped REAL, crushed REAL, dynamic_range REAL, histogram BLOB)",
+                    NULL, NULL, NULL) != SQLITE_OK)
+    {
+      fprintf(stderr, "[init] can't create `image_stats' table\n");
+      fprintf(stderr, "[init]   %s\n", sqlite3_errmsg(db->handle));
+      return version;
+    }
+    new_version = 12;
   } // maybe in the future, see commented out code elsewhere
     //   else if(version == XXX)
     //   {
@@ -890,6 +934,10 @@ static void _create_schema(dt_database_t *db)
   DT_DEBUG_SQLITE3_EXEC(db->handle, "CREATE TABLE meta_data (id INTEGER, key INTEGER, value VARCHAR)", NULL,
                         NULL, NULL);
   DT_DEBUG_SQLITE3_EXEC(db->handle, "CREATE INDEX metadata_index ON meta_data (id, key)", NULL, NULL, NULL);
+  ////////////////////////////// image_stats
+  DT_DEBUG_SQLITE3_EXEC(db->handle, "CREATE TABLE image_stats (imgid INTEGER PRIMARY KEY, brightness REAL, "
+                                    "clipped REAL, crushed REAL, dynamic_range REAL, histogram BLOB)",
+                        NULL, NULL, NULL);
   ////////////////////////////// presets
   DT_DEBUG_SQLITE3_EXEC(db->handle, "CREATE TABLE presets (name VARCHAR, description VARCHAR, operation "
                                     "VARCHAR, op_version INTEGER, op_params BLOB, "
@@ -936,6 +984,43 @@ static void _sanitize_db(dt_database_t *db)
   sqlite3_finalize(innerstmt);
 }
 
+/* switch the library to write ahead logging. readers don't block the writer and vice versa then, and with
+   synchronous = NORMAL a crash can lose the last transactions but never leaves a broken database. the mode
+   is stored in the file, older versions of darktable put it back to a memory journal on their own. */
+static void _enable_wal(dt_database_t *db)
+{
+  sqlite3_stmt *stmt;
+  gboolean wal = FALSE;
+  if(sqlite3_prepare_v2(db->handle, "PRAGMA journal_mode = WAL", -1, &stmt, NULL) == SQLITE_OK)
+  {
+    if(sqlite3_step(stmt) == SQLITE_ROW)
+      wal = !g_ascii_strcasecmp((const char *)sqlite3_column_text(stmt, 0), "wal");
+    sqlite3_finalize(stmt);
+  }
+  if(!wal)
+  {
+    fprintf(stderr, "[init] couldn't switch database `%s' to wal mode, keeping the memory journal\n",
+            db->dbfilename);
+    return;
+  }
+
+  sqlite3_exec(db->handle, "PRAGMA synchronous = NORMAL", NULL, NULL, NULL);
+  // readers only ever wait for a checkpoint, never for long
+  sqlite3_busy_timeout(db->handle, 1000);
+  db->wal = TRUE;
+  dt_print(DT_DEBUG_SQL, "[sql] database `%s' uses write ahead logging\n", db->dbfilename);
+}
+
+static void _reader_free(gpointer data)
+{
+  dt_database_reader_t *reader = (dt_database_reader_t *)data;
+  g_mutex_lock(&_readers_lock);
+  _readers = g_list_remove(_readers, reader);
+  if(reader->handle) sqlite3_close(reader->handle);
+  g_mutex_unlock(&_readers_lock);
+  free(reader);
+}
+
 dt_database_t *dt_database_init(const char *alternative)
 {
   /* migrate default database location to new default */
@@ -977,6 +1062,7 @@ dt_database_t *dt_database_init(const char *alternative)
   db->dbfilename = g_strdup(dbfilename);
   db->is_new_database = FALSE;
   db->lock_acquired = FALSE;
+  g_rec_mutex_init(&db->transaction_lock);
 
 /* having more than one instance of darktable using the same database is a bad idea */
 /* try to get a lock for the database */
@@ -1082,6 +1168,7 @@ dt_database_t *dt_database_init(const char *alternative)
   sqlite3_exec(db->handle, "attach database ':memory:' as memory", NULL, NULL, NULL);
 
   sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
+  // this also takes a library out of wal mode again when that got switched off
   sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "PRAGMA page_size = 32768", NULL, NULL, NULL);
 
@@ -1193,6 +1280,9 @@ dt_database_t *dt_database_init(const char *alternative)
   // take care of potential bad data in the db.
   _sanitize_db(db);
 
+  // only switch to wal once the schema is up to date, the upgrade code paths all assume the old journal
+  if(dt_conf_get_bool("database/wal") && strcmp(db->dbfilename, ":memory:")) _enable_wal(db);
+
 error:
   g_free(dbname);
 
@@ -1201,7 +1291,27 @@ error:
 
 void dt_database_destroy(const dt_database_t *db)
 {
+  // threads still around keep their reader structs, but not the connections
+  g_mutex_lock(&_readers_lock);
+  for(GList *iter = _readers; iter; iter = g_list_next(iter))
+  {
+    dt_database_reader_t *reader = (dt_database_reader_t *)iter->data;
+    sqlite3_close(reader->handle);
+    reader->handle = NULL;
+  }
+  g_list_free(_readers);
+  _readers = NULL;
+  g_mutex_unlock(&_readers_lock);
+
+  if(db->transaction_depth > 0)
+  {
+    fprintf(stderr, "[database] closing with an open transaction, committing it\n");
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+  }
+  // leave a self contained library.db behind for backups and older versions
+  if(db->wal) sqlite3_exec(db->handle, "PRAGMA wal_checkpoint(TRUNCATE)", NULL, NULL, NULL);
   sqlite3_close(db->handle);
+  g_rec_mutex_clear(&((dt_database_t *)db)->transaction_lock);
   if (db->lockfile)
   {
     unlink(db->lockfile);
@@ -1216,6 +1326,128 @@ sqlite3 *dt_database_get(const dt_database_t *db)
   return db->handle;
 }
 
+gboolean dt_database_is_wal(const dt_database_t *db)
+{
+  return db->wal;
+}
+
+sqlite3 *dt_database_get_reader(const dt_database_t *db)
+{
+  if(!db->wal) return db->handle;
+  // inside a transaction of its own, or one it joined, a thread has to see what it just wrote
+  if(db->transaction_owner == g_thread_self() || GPOINTER_TO_INT(g_private_get(&_joined_key)) > 0)
+    return db->handle;
+
+  dt_database_reader_t *reader = (dt_database_reader_t *)g_private_get(&_reader_key);
+  if(reader && reader->handle) return reader->handle;
+
+  sqlite3 *handle = NULL;
+  // the connection never leaves this thread, so sqlite doesn't need to lock it
+  if(sqlite3_open_v2(db->dbfilename, &handle, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK)
+  {
+    fprintf(stderr, "[database] couldn't open a reader on `%s': %s\n", db->dbfilename, sqlite3_errmsg(handle));
+    sqlite3_close(handle);
+    return db->handle;
+  }
+  sqlite3_busy_timeout(handle, 1000);
+
+  if(!reader)
+  {
+    reader = (dt_database_reader_t *)calloc(1, sizeof(dt_database_reader_t));
+    g_private_set(&_reader_key, reader);
+  }
+  reader->handle = handle;
+  g_mutex_lock(&_readers_lock);
+  if(!g_list_find(_readers, reader)) _readers = g_list_prepend(_readers, reader);
+  g_mutex_unlock(&_readers_lock);
+  dt_print(DT_DEBUG_SQL, "[sql] opened reader connection for thread %p\n", (void *)g_thread_self());
+  return handle;
+}
+
+static gboolean _is_gui_thread()
+{
+  return darktable.control && pthread_equal(darktable.control->gui_thread, pthread_self());
+}
+
+void dt_database_start_transaction(const dt_database_t *db)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  const int joined = GPOINTER_TO_INT(g_private_get(&_joined_key));
+  if(joined > 0)
+  {
+    g_private_set(&_joined_key, GINT_TO_POINTER(joined + 1));
+    return;
+  }
+
+  if(!g_rec_mutex_trylock(&d->transaction_lock))
+  {
+    if(_is_gui_thread())
+    {
+      // the gui never waits for a background batch. its writes go into the open transaction and get
+      // committed with it, or run on their own if that is committed first. nothing is ever rolled back, so
+      // they can't get lost either way.
+      g_private_set(&_joined_key, GINT_TO_POINTER(1));
+      return;
+    }
+    // tell the owner to commit soon, see dt_database_yield_transaction()
+    g_atomic_int_inc(&d->transaction_waiters);
+    g_rec_mutex_lock(&d->transaction_lock);
+    g_atomic_int_add(&d->transaction_waiters, -1);
+  }
+
+  d->transaction_owner = g_thread_self();
+  if(d->transaction_depth++ == 0)
+  {
+    DT_DEBUG_SQLITE3_EXEC(d->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    d->transaction_begin = g_get_monotonic_time();
+  }
+}
+
+void dt_database_release_transaction(const dt_database_t *db)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  const int joined = GPOINTER_TO_INT(g_private_get(&_joined_key));
+  if(joined > 0)
+  {
+    g_private_set(&_joined_key, GINT_TO_POINTER(joined - 1));
+    return;
+  }
+
+  // only the owner can have it locked, so no one else can see itself in there
+  if(d->transaction_owner != g_thread_self() || d->transaction_depth <= 0)
+  {
+    fprintf(stderr, "[database] ending a transaction that this thread didn't start\n");
+    return;
+  }
+
+  // nested ones only count, the outermost one commits
+  if(d->transaction_depth == 1) DT_DEBUG_SQLITE3_EXEC(d->handle, "COMMIT", NULL, NULL, NULL);
+
+  if(--d->transaction_depth == 0) d->transaction_owner = NULL;
+  g_rec_mutex_unlock(&d->transaction_lock);
+}
+
+gboolean dt_database_transaction_contended(const dt_database_t *db)
+{
+  return g_atomic_int_get(&((dt_database_t *)db)->transaction_waiters) > 0;
+}
+
+void dt_database_yield_transaction(const dt_database_t *db)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  if(GPOINTER_TO_INT(g_private_get(&_joined_key)) > 0) return;
+  if(d->transaction_owner != g_thread_self() || d->transaction_depth != 1) return;
+
+  const gboolean contended = dt_database_transaction_contended(db);
+  if(!contended && g_get_monotonic_time() - d->transaction_begin < DT_DATABASE_TRANSACTION_BUDGET) return;
+
+  dt_database_release_transaction(db);
+  // the mutex isn't fair, give the waiting threads a moment to take it before we do again. bounded, so a
+  // steady stream of them can't starve the batch.
+  for(int k = 0; contended && k < 20 && dt_database_transaction_contended(db); k++) g_usleep(500);
+  dt_database_start_transaction(db);
+}
+
 const gchar *dt_database_get_path(const struct dt_database_t *db)
 {
   return db->dbfilename;
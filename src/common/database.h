@@ -29,6 +29,25 @@ struct dt_database_t *dt_database_init(const char *alternative);
 void dt_database_destroy(const struct dt_database_t *);
 /** get handle */
 struct sqlite3 *dt_database_get(const struct dt_database_t *);
+/** test if the database runs with write ahead logging (config key database/wal) */
+gboolean dt_database_is_wal(const struct dt_database_t *db);
+/** get a read only connection for the calling thread, so that reads don't queue up behind a batch of
+    writes on the main handle. it sees committed data only and has no memory database attached. without
+    wal, or while the thread is inside a transaction, this is the main handle. */
+struct sqlite3 *dt_database_get_reader(const struct dt_database_t *db);
+/** group the following writes on the main handle into one transaction, committed by the matching release.
+    the transaction belongs to the calling thread, other threads starting one wait until it is released,
+    except for the gui thread: that one joins the open transaction instead of blocking. calls nest, only
+    the outermost release commits. nothing is ever rolled back, so plain statements other threads run on
+    the main handle meanwhile end up in the transaction and are committed with it. use these instead of
+    raw BEGIN/COMMIT on the main handle, those would end an outer transaction. */
+void dt_database_start_transaction(const struct dt_database_t *db);
+void dt_database_release_transaction(const struct dt_database_t *db);
+/** test if other threads are waiting for the transaction of the calling thread */
+gboolean dt_database_transaction_contended(const struct dt_database_t *db);
+/** for long running batches: commit the outermost transaction and start a new one when others are
+    waiting for it or it has been open for long. a no-op when called nested or outside of a transaction. */
+void dt_database_yield_transaction(const struct dt_database_t *db);
 /** test if database is new */
 gboolean dt_database_is_new(const struct dt_database_t *db);
 /** Returns database path */
@@ -1013,6 +1013,11 @@ int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char
  * XMP data trumps IPTC data trumps EXIF data
  */
 int dt_exif_read(dt_image_t *img, const char *path)
+{
+  return dt_exif_read_from_data(img, path, NULL, 0);
+}
+
+int dt_exif_read_from_data(dt_image_t *img, const char *path, const uint8_t *data, const size_t size)
 {
   // at least set datetime taken to something useful in case there is no exif data in this file (pfm, png,
   // ...)
@@ -1031,7 +1036,11 @@ int dt_exif_read(dt_image_t *img, const char *path)
 #else
     std::unique_ptr<Exiv2::Image> image;
 #endif
-    image = Exiv2::ImageFactory::open(path);
+    // parse from the caller's copy of the file if there is one, Exiv2's MemIo doesn't duplicate it
+    if(data)
+      image = Exiv2::ImageFactory::open((const Exiv2::byte *)data, (long)size);
+    else
+      image = Exiv2::ImageFactory::open(path);
     assert(image.get() != 0);
     image->readMetadata();
     bool res = true;
@@ -1903,6 +1912,8 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
   // exclude pfm to avoid stupid errors on the console
   const char *c = filename + strlen(filename) - 4;
   if(c >= filename && !strcmp(c, ".pfm")) return 1;
+  // so that an exception doesn't leave the transaction, and with it the database, locked
+  bool in_transaction = false;
   try
   {
     // read xmp sidecar
@@ -2065,7 +2076,10 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
       return 1;
     }
 
-    sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+    // this is usually nested in the import's transaction, which nothing ever rolls back. a broken sidecar
+    // cleans up after itself below instead.
+    dt_database_start_transaction(darktable.db);
+    in_transaction = true;
 
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "delete from history where imgid = ?1", -1,
                                 &stmt, NULL);
@@ -2169,18 +2183,32 @@ end:
 
     if(all_ok)
     {
-      sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+      in_transaction = false;
+      dt_database_release_transaction(darktable.db);
     }
     else
     {
       std::cerr << "[exif] error reading history from '" << filename << "'" << std::endl;
-      sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+      // don't leave half a history behind, the image starts out unaltered instead
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "delete from history where imgid = ?1", -1,
+                                  &stmt, NULL);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->id);
+      sqlite3_step(stmt);
+      sqlite3_finalize(stmt);
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                  "UPDATE images SET history_end = 0 where id = ?1", -1, &stmt, NULL);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->id);
+      sqlite3_step(stmt);
+      sqlite3_finalize(stmt);
+      in_transaction = false;
+      dt_database_release_transaction(darktable.db);
       return 1;
     }
 
   }
   catch(Exiv2::AnyError &e)
   {
+    if(in_transaction) dt_database_release_transaction(darktable.db);
     // actually nobody's interested in that if the file doesn't exist:
     // std::string s(e.what());
     // std::cerr << "[exiv2] " << filename << ": " << s << std::endl;
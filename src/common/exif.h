@@ -31,6 +31,10 @@ extern "C" {
  * struct. returns 0 on success. */
 int dt_exif_read(dt_image_t *img, const char *path);
 
+/** same as above, but parse the file contents from data, for loaders which already have the file in memory.
+ * path is only used for file times and messages. */
+int dt_exif_read_from_data(dt_image_t *img, const char *path, const uint8_t *data, const size_t size);
+
 /** read exif data to image struct from given data blob, wherever you got it from. */
 int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size);
 
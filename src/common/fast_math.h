@@ -0,0 +1,335 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_COMMON_FAST_MATH_H
+#define DT_COMMON_FAST_MATH_H
+
+#include "common/darktable.h" // for CLAMPS
+#include <stdint.h>           // for int32_t, uint32_t
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * approximations and conversions shared by the iop kernels. the plain c versions come with sse
+ * (or sse2, if they need integer ops) ones working on one pixel or four values at once, which are
+ * only there if the compiler targets that.
+ */
+
+// very fast approximation for 2^-x (returns 0 for x > 126)
+static inline float dt_fast_mexp2f(const float x)
+{
+  const float i1 = (float)0x3f800000u; // 2^0
+  const float i2 = (float)0x3f000000u; // 2^-1
+  const float k0 = i1 + x * (i2 - i1);
+  union {
+    float f;
+    uint32_t i;
+  } k;
+  k.i = k0 >= (float)0x800000u ? k0 : 0;
+  return k.f;
+}
+
+// approximation of cbrtf(x), good to a few percent, refine with a newton step where that matters
+static inline float dt_fast_cbrtf(const float x)
+{
+  union {
+    float f;
+    int i;
+  } data, dataout;
+
+  data.f = x;
+  dataout.i = (((int)(((float)(data.i)) / 3.0f)) + 709921077);
+  return dataout.f;
+}
+
+// one halley step refining the cube root estimate a of x, which makes dt_fast_cbrtf() good to 3e-5
+static inline float dt_cbrtf_halley(const float a, const float x)
+{
+  const float a3 = a * a * a;
+  return (a * ((x + x) + a3)) / ((a3 + a3) + x);
+}
+
+// the cie lab f() function, its cube root approximated and refined by one halley step
+static inline float dt_lab_f_m(const float x)
+{
+  const float epsilon = (216.0f / 24389.0f);
+  const float kappa = (24389.0f / 27.0f);
+
+  // x > epsilon
+  const float res_big = dt_cbrtf_halley(dt_fast_cbrtf(x), x);
+
+  // x <= epsilon
+  const float res_small = (((kappa * x) + (16.0f)) / (116.0f));
+
+  return ((x > epsilon) ? res_big : res_small);
+}
+
+// inverse of the cie lab f() function
+#if defined(_OPENMP) && defined(OPENMP_SIMD_)
+#pragma omp declare SIMD()
+#endif
+static inline float dt_lab_f_inv_m(const float x)
+{
+  const float epsilon = (0.20689655172413796f); // cbrtf(216.0f/24389.0f);
+  const float kappa_rcp_x16 = (16.0f * 27.0f / 24389.0f);
+  const float kappa_rcp_x116 = (116.0f * 27.0f / 24389.0f);
+
+  // x > epsilon
+  const float res_big = x * x * x;
+
+  // x <= epsilon
+  const float res_small = ((kappa_rcp_x116 * x) - kappa_rcp_x16);
+
+  return ((x > epsilon) ? res_big : res_small);
+}
+
+// XYZ (d50) to Lab, with the fast f(). both take 4 floats, the 4th channel of Lab is 0
+static inline void dt_XYZ_to_Lab_m(const float *const XYZ, float *const Lab)
+{
+  const float d50_inv[4] = { 1.0f / 0.9642f, 1.0f, 1.0f / 0.8249f, 0.0f };
+  const float coef[4] = { 116.0f, 500.0f, 200.0f, 0.0f };
+
+  float f[4];
+  for(int c = 0; c < 4; c++) f[c] = dt_lab_f_m(d50_inv[c] * XYZ[c]);
+
+  // because d50_inv.z is 0.0f, lab_f(0) == 16/116, so Lab[0] = 116*f[0] - 16 equal to 116*(f[0]-f[3])
+  const float sf1[4] = { f[1], f[0], f[1], f[3] };
+  const float sf2[4] = { f[3], f[1], f[2], f[3] };
+  for(int c = 0; c < 4; c++) Lab[c] = (sf1[c] - sf2[c]) * coef[c];
+}
+
+// Lab to XYZ (d50), 3 channels
+static inline void dt_Lab_to_XYZ_m(const float *const Lab, float *const XYZ)
+{
+  const float d50[3] = { 0.9642f, 1.0f, 0.8249f };
+  const float coef[3] = { 1.0f / 500.0f, 1.0f / 116.0f, -1.0f / 200.0f };
+  const float offset = (0.137931034f);
+
+  const float f[3] = { Lab[1] * coef[0], Lab[0] * coef[1], Lab[2] * coef[2] };
+  const float f1[3] = { f[1], 0.0f, f[1] };
+  for(int c = 0; c < 3; c++) XYZ[c] = d50[c] * dt_lab_f_inv_m(f[c] + f1[c] + offset);
+}
+
+// rgb to hue, saturation, lightness, all in [0, 1]. hue and saturation of (almost) grey pixels are 0
+static inline void dt_RGB_to_HSL(const float *RGB, float *HSL)
+{
+  float H, S, L;
+
+  const float R = RGB[0];
+  const float G = RGB[1];
+  const float B = RGB[2];
+
+  const float var_Min = fminf(R, fminf(G, B));
+  const float var_Max = fmaxf(R, fmaxf(G, B));
+  const float del_Max = var_Max - var_Min;
+
+  L = (var_Max + var_Min) / 2.0f;
+
+  if(del_Max < 1e-6f)
+  {
+    H = 0.0f;
+    S = 0.0f;
+  }
+  else
+  {
+    if(L < 0.5f)
+      S = del_Max / (var_Max + var_Min);
+    else
+      S = del_Max / (2.0f - var_Max - var_Min);
+
+    const float del_R = (((var_Max - R) / 6.0f) + (del_Max / 2.0f)) / del_Max;
+    const float del_G = (((var_Max - G) / 6.0f) + (del_Max / 2.0f)) / del_Max;
+    const float del_B = (((var_Max - B) / 6.0f) + (del_Max / 2.0f)) / del_Max;
+
+    if(R == var_Max)
+      H = del_B - del_G;
+    else if(G == var_Max)
+      H = (1.0f / 3.0f) + del_R - del_B;
+    else if(B == var_Max)
+      H = (2.0f / 3.0f) + del_G - del_R;
+    else
+      H = 0.0f; // make GCC happy
+
+    if(H < 0.0f) H += 1.0f;
+    if(H > 1.0f) H -= 1.0f;
+  }
+
+  HSL[0] = H;
+  HSL[1] = S;
+  HSL[2] = L;
+}
+
+static inline float dt_Hue_to_RGB(const float v1, const float v2, float vH)
+{
+  if(vH < 0.0f) vH += 1.0f;
+  if(vH > 1.0f) vH -= 1.0f;
+  if((6.0f * vH) < 1.0f) return (v1 + (v2 - v1) * 6.0f * vH);
+  if((2.0f * vH) < 1.0f) return (v2);
+  if((3.0f * vH) < 2.0f) return (v1 + (v2 - v1) * ((2.0f / 3.0f) - vH) * 6.0f);
+  return (v1);
+}
+
+static inline void dt_HSL_to_RGB(const float *HSL, float *RGB)
+{
+  const float H = HSL[0];
+  const float S = HSL[1];
+  const float L = HSL[2];
+
+  if(S < 1e-6f)
+  {
+    RGB[0] = RGB[1] = RGB[2] = L;
+  }
+  else
+  {
+    const float var_2 = (L < 0.5f) ? L * (1.0f + S) : (L + S) - (S * L);
+    const float var_1 = 2.0f * L - var_2;
+
+    RGB[0] = dt_Hue_to_RGB(var_1, var_2, H + (1.0f / 3.0f));
+    RGB[1] = dt_Hue_to_RGB(var_1, var_2, H);
+    RGB[2] = dt_Hue_to_RGB(var_1, var_2, H - (1.0f / 3.0f));
+  }
+}
+
+// Lab to lightness, chroma and hue, the latter in [0, 1]
+static inline void dt_Lab_to_LCH(const float *Lab, float *LCH)
+{
+  float var_H = atan2f(Lab[2], Lab[1]);
+
+  if(var_H > 0.0f)
+    var_H = var_H / (2.0f * M_PI);
+  else
+    var_H = 1.0f - fabs(var_H) / (2.0f * M_PI);
+
+  LCH[0] = Lab[0];
+  LCH[1] = sqrtf(Lab[1] * Lab[1] + Lab[2] * Lab[2]);
+  LCH[2] = var_H;
+}
+
+static inline void dt_LCH_to_Lab(const float *LCH, float *Lab)
+{
+  Lab[0] = LCH[0];
+  Lab[1] = cosf(2.0f * M_PI * LCH[2]) * LCH[1];
+  Lab[2] = sinf(2.0f * M_PI * LCH[2]) * LCH[1];
+}
+
+// linear interpolation in a lut with the given number of samples covering [0, 1]
+static inline float dt_lerp_lut(const float *const lut, const float v, const int samples)
+{
+  const float ft = CLAMPS(v * (samples - 1), 0, samples - 1);
+  const int t = ft < samples - 2 ? ft : samples - 2;
+  const float f = ft - t;
+  const float l1 = lut[t];
+  const float l2 = lut[t + 1];
+  return l1 * (1.0f - f) + l2 * f;
+}
+
+#if defined(__SSE__)
+static inline __m128 dt_lab_f_inv_m_sse(const __m128 x)
+{
+  const __m128 epsilon = _mm_set1_ps(0.20689655172413796f); // cbrtf(216.0f/24389.0f);
+  const __m128 kappa_rcp_x16 = _mm_set1_ps(16.0f * 27.0f / 24389.0f);
+  const __m128 kappa_rcp_x116 = _mm_set1_ps(116.0f * 27.0f / 24389.0f);
+
+  // x > epsilon
+  const __m128 res_big = _mm_mul_ps(_mm_mul_ps(x, x), x);
+  // x <= epsilon
+  const __m128 res_small = _mm_sub_ps(_mm_mul_ps(kappa_rcp_x116, x), kappa_rcp_x16);
+
+  // blend results according to whether each component is > epsilon or not
+  const __m128 mask = _mm_cmpgt_ps(x, epsilon);
+  return _mm_or_ps(_mm_and_ps(mask, res_big), _mm_andnot_ps(mask, res_small));
+}
+
+static inline __m128 dt_Lab_to_XYZ_sse(const __m128 Lab)
+{
+  const __m128 d50 = _mm_set_ps(0.0f, 0.8249f, 1.0f, 0.9642f);
+  const __m128 coef = _mm_set_ps(0.0f, -1.0f / 200.0f, 1.0f / 116.0f, 1.0f / 500.0f);
+  const __m128 offset = _mm_set1_ps(0.137931034f);
+
+  // last component ins shuffle taken from 1st component of Lab to make sure it is not nan, so it will become
+  // 0.0f in f
+  const __m128 f = _mm_mul_ps(_mm_shuffle_ps(Lab, Lab, _MM_SHUFFLE(0, 2, 0, 1)), coef);
+
+  const __m128 f1 = _mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 1, 3, 1));
+  return _mm_mul_ps(d50, dt_lab_f_inv_m_sse(_mm_add_ps(_mm_add_ps(f, f1), offset)));
+}
+#endif
+
+#if defined(__SSE2__)
+// sse2 version of dt_fast_expf() from darktable.h
+static inline __m128 dt_fast_expf_sse2(const __m128 x)
+{
+  const __m128 i1 = _mm_set1_ps((float)0x3f800000u);
+  const __m128 i2_minus_i1 = _mm_set1_ps((float)0x00adf880u);
+  __m128 f = _mm_add_ps(i1, _mm_mul_ps(x, i2_minus_i1)); // f(n) = i1 + x(n)*(i2-i1)
+  __m128i i = _mm_cvtps_epi32(f);                         // i(n) = int(f(n))
+  __m128i mask = _mm_srai_epi32(i, 31);                   // mask(n) = 0xffffffff if i(n) < 0
+  i = _mm_andnot_si128(mask, i);                          // i(n) = 0 if i(n) < 0
+  return _mm_castsi128_ps(i);                             // return *(float*)&i
+}
+
+static inline __m128 dt_fast_cbrtf_sse2(const __m128 x)
+{
+  return (_mm_castsi128_ps(
+      _mm_add_epi32(_mm_cvtps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_castps_si128(x)), _mm_set1_ps(3.0f))),
+                    _mm_set1_epi32(709921077))));
+}
+
+static inline __m128 dt_cbrtf_halley_sse2(const __m128 a, const __m128 x)
+{
+  const __m128 a3 = _mm_mul_ps(_mm_mul_ps(a, a), a);
+  return _mm_div_ps(_mm_mul_ps(a, _mm_add_ps(a3, _mm_add_ps(x, x))), _mm_add_ps(_mm_add_ps(a3, a3), x));
+}
+
+static inline __m128 dt_lab_f_m_sse2(const __m128 x)
+{
+  const __m128 epsilon = _mm_set1_ps(216.0f / 24389.0f);
+  const __m128 kappa = _mm_set1_ps(24389.0f / 27.0f);
+
+  // calculate as if x > epsilon : result = cbrtf(x)
+  const __m128 res_big = dt_cbrtf_halley_sse2(dt_fast_cbrtf_sse2(x), x);
+
+  // calculate as if x <= epsilon : result = (kappa*x+16)/116
+  const __m128 res_small
+      = _mm_div_ps(_mm_add_ps(_mm_mul_ps(kappa, x), _mm_set1_ps(16.0f)), _mm_set1_ps(116.0f));
+
+  // blend results according to whether each component is > epsilon or not
+  const __m128 mask = _mm_cmpgt_ps(x, epsilon);
+  return _mm_or_ps(_mm_and_ps(mask, res_big), _mm_andnot_ps(mask, res_small));
+}
+
+static inline __m128 dt_XYZ_to_Lab_sse2(const __m128 XYZ)
+{
+  const __m128 d50_inv = _mm_set_ps(0.0f, 1.0f / 0.8249f, 1.0f, 1.0f / 0.9642f);
+  const __m128 coef = _mm_set_ps(0.0f, 200.0f, 500.0f, 116.0f);
+  const __m128 f = dt_lab_f_m_sse2(_mm_mul_ps(XYZ, d50_inv));
+  // because d50_inv.z is 0.0f, lab_f(0) == 16/116, so Lab[0] = 116*f[0] - 16 equal to 116*(f[0]-f[3])
+  return _mm_mul_ps(coef, _mm_sub_ps(_mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 1, 0, 1)),
+                                     _mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 2, 1, 3))));
+}
+#endif
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
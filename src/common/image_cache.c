@@ -33,18 +33,26 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
   dt_image_t *img = (dt_image_t *)g_malloc(sizeof(dt_image_t));
   dt_image_init(img);
   entry->data = img;
-  // load stuff from db and store in cache:
+  // load stuff from db and store in cache. the reader doesn't queue up behind a running import, but it only
+  // sees committed rows: images from a batch that is still open are looked up on the main handle.
+  sqlite3 *const handles[2] = { dt_database_get_reader(darktable.db), dt_database_get(darktable.db) };
   char *str;
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
-      "SELECT id, group_id, film_id, width, height, filename, maker, model, lens, exposure, "
-      "aperture, iso, focal_length, datetime_taken, flags, crop, orientation, focus_distance, "
-      "raw_parameters, longitude, latitude, altitude, color_matrix, colorspace, version, raw_black, "
-      "raw_maximum FROM images WHERE id = ?1",
-      -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, entry->key);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  sqlite3_stmt *stmt = NULL;
+  int rc = SQLITE_DONE;
+  for(int k = 0; k < 2 && rc != SQLITE_ROW && (k == 0 || handles[1] != handles[0]); k++)
+  {
+    sqlite3_finalize(stmt);
+    DT_DEBUG_SQLITE3_PREPARE_V2(
+        handles[k],
+        "SELECT id, group_id, film_id, width, height, filename, maker, model, lens, exposure, "
+        "aperture, iso, focal_length, datetime_taken, flags, crop, orientation, focus_distance, "
+        "raw_parameters, longitude, latitude, altitude, color_matrix, colorspace, version, raw_black, "
+        "raw_maximum FROM images WHERE id = ?1",
+        -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, entry->key);
+    rc = sqlite3_step(stmt);
+  }
+  if(rc == SQLITE_ROW)
   {
     img->id = sqlite3_column_int(stmt, 0);
     img->group_id = sqlite3_column_int(stmt, 1);
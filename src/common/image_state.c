@@ -0,0 +1,326 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/image_state.h"
+#include "common/darktable.h"
+#include "common/database.h"
+#include "common/debug.h"
+#include "common/image.h"
+
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <string.h>
+
+// what the triggers report through dt_image_state_changed(kind, imgid)
+typedef enum dt_image_state_change_t
+{
+  DT_IMAGE_STATE_CHANGE_SELECT = 0,
+  DT_IMAGE_STATE_CHANGE_UNSELECT = 1,
+  DT_IMAGE_STATE_CHANGE_IMAGE = 2,  // something about this one image changed
+  DT_IMAGE_STATE_CHANGE_GROUPS = 3  // group membership changed, which affects other images, too
+} dt_image_state_change_t;
+
+typedef struct dt_image_state_index_t
+{
+  // protects everything below. never hold it while talking to the database: the triggers call us
+  // from inside other threads' statements.
+  dt_pthread_mutex_t lock;
+
+  dt_image_state_t *records; // indexed by imgid
+  uint32_t *selection;       // bitset, indexed by imgid
+  int32_t capacity;          // number of imgids records and selection can hold
+  gboolean selection_valid;
+  // group membership changed since the records were last swept. an import or a regroup changes many rows
+  // in one go, so the records are swept once on the next read instead of once per row.
+  gboolean groups_dirty;
+
+  // bumped on every change, so that a load racing with a change isn't stored as valid
+  uint64_t epoch;
+
+  // serializes the loaders, which share the prepared statements
+  dt_pthread_mutex_t load_lock;
+  sqlite3_stmt *get_image, *get_colors, *get_selection;
+} dt_image_state_index_t;
+
+static const char *_triggers[] = {
+  "CREATE TEMP TRIGGER dt_image_state_select AFTER INSERT ON main.selected_images "
+  "BEGIN SELECT dt_image_state_changed(0, new.imgid); END",
+  "CREATE TEMP TRIGGER dt_image_state_unselect AFTER DELETE ON main.selected_images "
+  "BEGIN SELECT dt_image_state_changed(1, old.imgid); END",
+  "CREATE TEMP TRIGGER dt_image_state_label_insert AFTER INSERT ON main.color_labels "
+  "BEGIN SELECT dt_image_state_changed(2, new.imgid); END",
+  "CREATE TEMP TRIGGER dt_image_state_label_update AFTER UPDATE ON main.color_labels "
+  "BEGIN SELECT dt_image_state_changed(2, old.imgid); SELECT dt_image_state_changed(2, new.imgid); END",
+  "CREATE TEMP TRIGGER dt_image_state_label_delete AFTER DELETE ON main.color_labels "
+  "BEGIN SELECT dt_image_state_changed(2, old.imgid); END",
+  "CREATE TEMP TRIGGER dt_image_state_history_insert AFTER INSERT ON main.history "
+  "BEGIN SELECT dt_image_state_changed(2, new.imgid); END",
+  "CREATE TEMP TRIGGER dt_image_state_history_update AFTER UPDATE ON main.history "
+  "BEGIN SELECT dt_image_state_changed(2, old.imgid); SELECT dt_image_state_changed(2, new.imgid); END",
+  "CREATE TEMP TRIGGER dt_image_state_history_delete AFTER DELETE ON main.history "
+  "BEGIN SELECT dt_image_state_changed(2, old.imgid); END",
+  "CREATE TEMP TRIGGER dt_image_state_image_update AFTER UPDATE OF flags, group_id, filename ON main.images "
+  "WHEN old.flags IS NOT new.flags OR old.group_id IS NOT new.group_id OR old.filename IS NOT new.filename "
+  "BEGIN SELECT dt_image_state_changed(CASE WHEN old.group_id IS new.group_id THEN 2 ELSE 3 END, new.id); END",
+  "CREATE TEMP TRIGGER dt_image_state_image_insert AFTER INSERT ON main.images "
+  "BEGIN SELECT dt_image_state_changed(CASE WHEN new.group_id IS new.id THEN 2 ELSE 3 END, new.id); END",
+  "CREATE TEMP TRIGGER dt_image_state_image_delete AFTER DELETE ON main.images "
+  "BEGIN SELECT dt_image_state_changed(3, old.id); END",
+  NULL
+};
+
+static const char *_trigger_names[] = { "dt_image_state_select", "dt_image_state_unselect",
+                                        "dt_image_state_label_insert", "dt_image_state_label_update",
+                                        "dt_image_state_label_delete", "dt_image_state_history_insert",
+                                        "dt_image_state_history_update", "dt_image_state_history_delete",
+                                        "dt_image_state_image_update", "dt_image_state_image_insert",
+                                        "dt_image_state_image_delete", NULL };
+
+/** make room for imgid. needs index->lock to be held. */
+static gboolean _reserve(dt_image_state_index_t *index, int32_t imgid)
+{
+  if(imgid < index->capacity) return TRUE;
+
+  int32_t capacity = MAX(index->capacity, 1024);
+  while(capacity <= imgid) capacity *= 2;
+
+  dt_image_state_t *records = realloc(index->records, sizeof(dt_image_state_t) * capacity);
+  if(!records) return FALSE;
+  memset(records + index->capacity, 0, sizeof(dt_image_state_t) * (capacity - index->capacity));
+  index->records = records;
+
+  uint32_t *selection = realloc(index->selection, sizeof(uint32_t) * (capacity / 32));
+  if(!selection) return FALSE;
+  memset(selection + index->capacity / 32, 0, sizeof(uint32_t) * ((capacity - index->capacity) / 32));
+  index->selection = selection;
+
+  index->capacity = capacity;
+  return TRUE;
+}
+
+static void _sql_changed(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+  dt_image_state_index_t *index = (dt_image_state_index_t *)sqlite3_user_data(context);
+  const int kind = sqlite3_value_int(argv[0]);
+  const int32_t imgid = sqlite3_value_int(argv[1]);
+
+  dt_pthread_mutex_lock(&index->lock);
+  index->epoch++;
+  switch(kind)
+  {
+    case DT_IMAGE_STATE_CHANGE_SELECT:
+      // keep a valid bitset up to date instead of throwing it away
+      if(index->selection_valid && imgid > 0 && _reserve(index, imgid))
+        index->selection[imgid / 32] |= 1u << (imgid % 32);
+      break;
+    case DT_IMAGE_STATE_CHANGE_UNSELECT:
+      if(imgid > 0 && imgid < index->capacity) index->selection[imgid / 32] &= ~(1u << (imgid % 32));
+      break;
+    case DT_IMAGE_STATE_CHANGE_IMAGE:
+      if(imgid > 0 && imgid < index->capacity) index->records[imgid].state = 0;
+      break;
+    default:
+      if(imgid > 0 && imgid < index->capacity) index->records[imgid].state = 0;
+      index->groups_dirty = TRUE;
+      break;
+  }
+  dt_pthread_mutex_unlock(&index->lock);
+
+  sqlite3_result_null(context);
+}
+
+dt_image_state_index_t *dt_image_state_init()
+{
+  dt_image_state_index_t *index = (dt_image_state_index_t *)calloc(1, sizeof(dt_image_state_index_t));
+  dt_pthread_mutex_init(&index->lock, NULL);
+  dt_pthread_mutex_init(&index->load_lock, NULL);
+
+  sqlite3 *db = dt_database_get(darktable.db);
+  sqlite3_create_function(db, "dt_image_state_changed", 2, SQLITE_UTF8, index, _sql_changed, NULL, NULL);
+  for(int k = 0; _triggers[k]; k++) DT_DEBUG_SQLITE3_EXEC(db, _triggers[k], NULL, NULL, NULL);
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "SELECT flags, group_id, filename, "
+                                  "EXISTS (SELECT 1 FROM images AS g WHERE g.group_id = i.group_id AND g.id != i.id) "
+                                  "FROM images AS i WHERE i.id = ?1",
+                              -1, &index->get_image, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "SELECT color FROM color_labels WHERE imgid = ?1", -1, &index->get_colors,
+                              NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "SELECT imgid FROM selected_images", -1, &index->get_selection, NULL);
+
+  return index;
+}
+
+void dt_image_state_cleanup(dt_image_state_index_t *index)
+{
+  if(!index) return;
+
+  // the triggers would call into freed memory otherwise
+  sqlite3 *db = dt_database_get(darktable.db);
+  for(int k = 0; _trigger_names[k]; k++)
+  {
+    gchar *query = g_strdup_printf("DROP TRIGGER IF EXISTS temp.%s", _trigger_names[k]);
+    DT_DEBUG_SQLITE3_EXEC(db, query, NULL, NULL, NULL);
+    g_free(query);
+  }
+  sqlite3_create_function(db, "dt_image_state_changed", 2, SQLITE_UTF8, NULL, NULL, NULL, NULL);
+
+  sqlite3_finalize(index->get_image);
+  sqlite3_finalize(index->get_colors);
+  sqlite3_finalize(index->get_selection);
+  dt_pthread_mutex_destroy(&index->load_lock);
+  dt_pthread_mutex_destroy(&index->lock);
+  free(index->records);
+  free(index->selection);
+  free(index);
+}
+
+static gboolean _load_image(dt_image_state_index_t *index, int32_t imgid, dt_image_state_t *state)
+{
+  memset(state, 0, sizeof(dt_image_state_t));
+
+  dt_pthread_mutex_lock(&index->load_lock);
+
+  DT_DEBUG_SQLITE3_RESET(index->get_image);
+  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(index->get_image);
+  DT_DEBUG_SQLITE3_BIND_INT(index->get_image, 1, imgid);
+  if(sqlite3_step(index->get_image) != SQLITE_ROW)
+  {
+    dt_pthread_mutex_unlock(&index->load_lock);
+    return FALSE;
+  }
+  state->flags = sqlite3_column_int(index->get_image, 0);
+  state->group_id = sqlite3_column_int(index->get_image, 1);
+  const char *filename = (const char *)sqlite3_column_text(index->get_image, 2);
+  const char *ext = filename ? strrchr(filename, '.') : NULL;
+  if(ext) g_strlcpy(state->extension, ext + 1, sizeof(state->extension));
+  if(sqlite3_column_int(index->get_image, 3)) state->state |= DT_IMAGE_STATE_GROUPED;
+
+  DT_DEBUG_SQLITE3_RESET(index->get_colors);
+  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(index->get_colors);
+  DT_DEBUG_SQLITE3_BIND_INT(index->get_colors, 1, imgid);
+  while(sqlite3_step(index->get_colors) == SQLITE_ROW)
+  {
+    const int color = sqlite3_column_int(index->get_colors, 0);
+    if(color >= 0 && color < 8) state->colorlabels |= 1 << color;
+  }
+
+  dt_pthread_mutex_unlock(&index->load_lock);
+
+  if(dt_image_altered(imgid)) state->state |= DT_IMAGE_STATE_ALTERED;
+  state->state |= DT_IMAGE_STATE_VALID;
+
+  return TRUE;
+}
+
+gboolean dt_image_state_get(dt_image_state_index_t *index, int32_t imgid, dt_image_state_t *state)
+{
+  if(imgid <= 0) return FALSE;
+
+  dt_pthread_mutex_lock(&index->lock);
+  if(index->groups_dirty)
+  {
+    // which images share a group with the changed ones is only known to the records themselves
+    for(int32_t k = 0; k < index->capacity; k++) index->records[k].state = 0;
+    index->groups_dirty = FALSE;
+  }
+  if(imgid < index->capacity && (index->records[imgid].state & DT_IMAGE_STATE_VALID))
+  {
+    *state = index->records[imgid];
+    dt_pthread_mutex_unlock(&index->lock);
+    return TRUE;
+  }
+  const uint64_t epoch = index->epoch;
+  dt_pthread_mutex_unlock(&index->lock);
+
+  if(!_load_image(index, imgid, state)) return FALSE;
+
+  // only remember the result if nothing changed while we were reading it
+  dt_pthread_mutex_lock(&index->lock);
+  if(index->epoch == epoch && _reserve(index, imgid)) index->records[imgid] = *state;
+  dt_pthread_mutex_unlock(&index->lock);
+
+  return TRUE;
+}
+
+static void _load_selection(dt_image_state_index_t *index)
+{
+  dt_pthread_mutex_lock(&index->lock);
+  const uint64_t epoch = index->epoch;
+  dt_pthread_mutex_unlock(&index->lock);
+
+  GArray *selected = g_array_new(FALSE, FALSE, sizeof(int32_t));
+  dt_pthread_mutex_lock(&index->load_lock);
+  DT_DEBUG_SQLITE3_RESET(index->get_selection);
+  while(sqlite3_step(index->get_selection) == SQLITE_ROW)
+  {
+    const int32_t imgid = sqlite3_column_int(index->get_selection, 0);
+    g_array_append_val(selected, imgid);
+  }
+  dt_pthread_mutex_unlock(&index->load_lock);
+
+  dt_pthread_mutex_lock(&index->lock);
+  if(index->epoch == epoch)
+  {
+    if(index->capacity) memset(index->selection, 0, sizeof(uint32_t) * (index->capacity / 32));
+    gboolean ok = TRUE;
+    for(guint k = 0; k < selected->len && ok; k++)
+    {
+      const int32_t imgid = g_array_index(selected, int32_t, k);
+      if(imgid <= 0) continue;
+      ok = _reserve(index, imgid);
+      if(ok) index->selection[imgid / 32] |= 1u << (imgid % 32);
+    }
+    index->selection_valid = ok;
+  }
+  dt_pthread_mutex_unlock(&index->lock);
+
+  g_array_free(selected, TRUE);
+}
+
+gboolean dt_image_state_is_selected(dt_image_state_index_t *index, int32_t imgid)
+{
+  if(imgid <= 0) return FALSE;
+
+  for(int tries = 0; tries < 2; tries++)
+  {
+    dt_pthread_mutex_lock(&index->lock);
+    if(index->selection_valid)
+    {
+      const gboolean selected
+          = imgid < index->capacity && (index->selection[imgid / 32] & (1u << (imgid % 32)));
+      dt_pthread_mutex_unlock(&index->lock);
+      return selected;
+    }
+    dt_pthread_mutex_unlock(&index->lock);
+
+    _load_selection(index);
+  }
+
+  // the selection kept changing under our feet, ask the database directly
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT 1 FROM selected_images WHERE imgid = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  const gboolean selected = sqlite3_step(stmt) == SQLITE_ROW;
+  sqlite3_finalize(stmt);
+  return selected;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,68 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_COMMON_IMAGE_STATE_H
+#define DT_COMMON_IMAGE_STATE_H
+
+#include <glib.h>
+#include <inttypes.h>
+
+/*
+ * in-memory index of the per image state needed to draw a thumbnail: selection, rating,
+ * color labels, grouping and whether the image got altered. the lighttable asks for it on
+ * every expose of every cell, so it must not hit the database.
+ *
+ * the index is filled lazily from the database and kept coherent through temporary
+ * triggers on selected_images, color_labels, history and images, so it doesn't matter
+ * which code path writes to those tables.
+ */
+
+#define DT_IMAGE_STATE_EXTENSION_LEN 8
+
+typedef enum dt_image_state_flags_t
+{
+  DT_IMAGE_STATE_VALID = 1 << 0,
+  DT_IMAGE_STATE_ALTERED = 1 << 1,
+  DT_IMAGE_STATE_GROUPED = 1 << 2 // there is at least one other image in the same group
+} dt_image_state_flags_t;
+
+typedef struct dt_image_state_t
+{
+  int32_t flags;       // dt_image_t flags, rating is (flags & 0x7)
+  int32_t group_id;
+  uint8_t colorlabels; // bit k is set when color label k is attached
+  uint8_t state;       // dt_image_state_flags_t
+  char extension[DT_IMAGE_STATE_EXTENSION_LEN]; // file extension, for the thumbnail background
+} dt_image_state_t;
+
+struct dt_image_state_index_t;
+
+struct dt_image_state_index_t *dt_image_state_init();
+void dt_image_state_cleanup(struct dt_image_state_index_t *index);
+
+/** get the state of imgid, loading it from the database if it isn't known yet. returns FALSE if there is
+ * no such image. */
+gboolean dt_image_state_get(struct dt_image_state_index_t *index, int32_t imgid, dt_image_state_t *state);
+/** check if imgid is part of the current selection. */
+gboolean dt_image_state_is_selected(struct dt_image_state_index_t *index, int32_t imgid);
+
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
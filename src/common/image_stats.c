@@ -0,0 +1,264 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/image_stats.h"
+#include "common/darktable.h"
+#include "common/database.h"
+#include "common/debug.h"
+#include "common/mipmap_cache.h"
+#include "control/conf.h"
+#include "control/control.h"
+#include "control/jobs.h"
+
+#include <math.h>
+#include <string.h>
+
+// images whose statistics are written to the library in one transaction
+#define DT_IMAGE_STATS_BATCH 16
+// resolution of the luma histogram the percentiles are taken from
+#define DT_IMAGE_STATS_LUMA_BINS 1024
+
+// bumped whenever the collection changes, so that a job working on an old one stops
+static volatile uint32_t _generation = 0;
+
+typedef struct dt_image_stats_job_t
+{
+  uint32_t generation;
+  GArray *imgids;
+} dt_image_stats_job_t;
+
+static inline float _linear(const float v)
+{
+  // thumbnails are display referred, close enough to srgb for exposure statistics
+  return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / (1.0f + 0.055f), 2.4f);
+}
+
+static void _stats_from_buffer(const uint8_t *buf, const int width, const int height, dt_image_stats_t *stats)
+{
+  // 8 bit mip buffers are rgba
+  uint32_t luma[DT_IMAGE_STATS_LUMA_BINS] = { 0 };
+  const size_t npixels = (size_t)width * height;
+  double sum = 0.0;
+  size_t clipped = 0, crushed = 0;
+
+  memset(stats->histogram, 0, sizeof(stats->histogram));
+  for(size_t k = 0; k < npixels; k++)
+  {
+    const uint8_t *px = buf + 4 * k;
+    const uint8_t r = px[0], g = px[1], b = px[2];
+    const float l = (0.2126f * r + 0.7152f * g + 0.0722f * b) / 255.0f;
+    stats->histogram[4 * (r >> 2) + 0]++;
+    stats->histogram[4 * (g >> 2) + 1]++;
+    stats->histogram[4 * (b >> 2) + 2]++;
+    stats->histogram[4 * MIN((int)(l * DT_IMAGE_STATS_BINS), DT_IMAGE_STATS_BINS - 1) + 3]++;
+    luma[MIN((int)(l * DT_IMAGE_STATS_LUMA_BINS), DT_IMAGE_STATS_LUMA_BINS - 1)]++;
+    sum += l;
+    if(r == 0xff || g == 0xff || b == 0xff) clipped++;
+    if((r | g | b) == 0) crushed++;
+  }
+
+  stats->histogram_max = 0;
+  for(int k = 0; k < 4 * DT_IMAGE_STATS_BINS; k++)
+    stats->histogram_max = MAX(stats->histogram_max, stats->histogram[k]);
+
+  stats->brightness = 100.0f * sum / npixels;
+  stats->clipped = 100.0f * clipped / npixels;
+  stats->crushed = 100.0f * crushed / npixels;
+
+  // dynamic range between the 1st and the 99th percentile, the darkest level a thumbnail can resolve is half
+  // an 8-bit step
+  int lo = 0, hi = DT_IMAGE_STATS_LUMA_BINS - 1;
+  size_t acc = 0;
+  while(lo < DT_IMAGE_STATS_LUMA_BINS - 1 && (acc += luma[lo]) < npixels / 100) lo++;
+  acc = 0;
+  while(hi > 0 && (acc += luma[hi]) < npixels / 100) hi--;
+  const float black = _linear(MAX((lo + 0.5f) / DT_IMAGE_STATS_LUMA_BINS, 0.5f / 255.0f));
+  const float white = _linear(MAX((hi + 0.5f) / DT_IMAGE_STATS_LUMA_BINS, 0.5f / 255.0f));
+  stats->dynamic_range = MAX(log2f(white / black), 0.0f);
+}
+
+int dt_image_stats_compute(const int32_t imgid, dt_image_stats_t *stats)
+{
+  dt_mipmap_buffer_t buf;
+
+  // take the largest thumbnail that is already there, and only make one if there is none at all
+  buf.buf = NULL;
+  for(int k = DT_MIPMAP_2; k >= DT_MIPMAP_0 && !buf.buf; k--)
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
+  if(!buf.buf) dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_1, DT_MIPMAP_BLOCKING, 'r');
+
+  int err = 1;
+  // images that can't be loaded get an 8x8 skull, that's not worth any statistics
+  if(buf.buf && buf.width > 0 && buf.height > 0 && buf.width * buf.height > 64)
+  {
+    _stats_from_buffer(buf.buf, buf.width, buf.height, stats);
+    err = 0;
+  }
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  return err;
+}
+
+void dt_image_stats_store(const int32_t imgid, const dt_image_stats_t *stats)
+{
+  // the histogram is kept as 16 bit relative to its highest bin, that is all the drawing needs
+  uint16_t histogram[4 * DT_IMAGE_STATS_BINS];
+  for(int k = 0; k < 4 * DT_IMAGE_STATS_BINS; k++)
+    histogram[k] = stats->histogram_max ? (uint64_t)stats->histogram[k] * 0xffff / stats->histogram_max : 0;
+
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR REPLACE INTO main.image_stats "
+                              "(imgid, brightness, clipped, crushed, dynamic_range, histogram) "
+                              "VALUES (?1, ?2, ?3, ?4, ?5, ?6)",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 2, stats->brightness);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 3, stats->clipped);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 4, stats->crushed);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 5, stats->dynamic_range);
+  DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 6, histogram, sizeof(histogram), SQLITE_TRANSIENT);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
+int dt_image_stats_get(const int32_t imgid, dt_image_stats_t *stats)
+{
+  int err = 1;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT brightness, clipped, crushed, dynamic_range, histogram "
+                              "FROM main.image_stats WHERE imgid = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  if(sqlite3_step(stmt) == SQLITE_ROW
+     && sqlite3_column_bytes(stmt, 4) == 4 * DT_IMAGE_STATS_BINS * sizeof(uint16_t))
+  {
+    stats->brightness = sqlite3_column_double(stmt, 0);
+    stats->clipped = sqlite3_column_double(stmt, 1);
+    stats->crushed = sqlite3_column_double(stmt, 2);
+    stats->dynamic_range = sqlite3_column_double(stmt, 3);
+    const uint16_t *histogram = (const uint16_t *)sqlite3_column_blob(stmt, 4);
+    stats->histogram_max = 0;
+    for(int k = 0; k < 4 * DT_IMAGE_STATS_BINS; k++)
+    {
+      stats->histogram[k] = histogram[k];
+      stats->histogram_max = MAX(stats->histogram_max, histogram[k]);
+    }
+    err = 0;
+  }
+  sqlite3_finalize(stmt);
+  return err;
+}
+
+void dt_image_stats_remove(const int32_t imgid)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.image_stats WHERE imgid = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
+static void _job_free(void *data)
+{
+  dt_image_stats_job_t *params = (dt_image_stats_job_t *)data;
+  g_array_free(params->imgids, TRUE);
+  free(params);
+}
+
+static int32_t _update_job_run(dt_job_t *job)
+{
+  dt_image_stats_job_t *params = (dt_image_stats_job_t *)dt_control_job_get_params(job);
+  const guint total = params->imgids->len;
+  int32_t ids[DT_IMAGE_STATS_BATCH];
+  dt_image_stats_t *stats = (dt_image_stats_t *)malloc(sizeof(dt_image_stats_t) * DT_IMAGE_STATS_BATCH);
+  const double start = dt_get_wtime();
+  guint done = 0;
+
+  dt_control_job_add_progress(job, _("computing image statistics"), TRUE);
+  while(done < total)
+  {
+    // stop if the collection changed meanwhile, another job takes over
+    if(params->generation != _generation || dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED
+       || !dt_control_running())
+      break;
+
+    // don't keep a transaction open while thumbnails are being made
+    int count = 0;
+    for(; count < DT_IMAGE_STATS_BATCH && done < total; done++)
+    {
+      const int32_t imgid = g_array_index(params->imgids, int32_t, done);
+      if(!dt_image_stats_compute(imgid, stats + count)) ids[count++] = imgid;
+    }
+
+    // short enough that others waiting for the transaction don't notice
+    dt_database_start_transaction(darktable.db);
+    for(int k = 0; k < count; k++) dt_image_stats_store(ids[k], stats + k);
+    dt_database_release_transaction(darktable.db);
+
+    dt_control_job_set_progress(job, done / (double)total);
+  }
+  free(stats);
+
+  dt_print(DT_DEBUG_PERF, "[image_stats] computed statistics of %u out of %u images in %.3f secs\n", done, total,
+           dt_get_wtime() - start);
+  return 0;
+}
+
+void dt_image_stats_update_collection()
+{
+  const uint32_t generation = __sync_add_and_fetch(&_generation, 1);
+  // the job system isn't up yet while the lighttable is set up during init
+  if(!dt_conf_get_bool("image_stats") || !darktable.control || !dt_control_running()) return;
+
+  dt_image_stats_job_t *params = (dt_image_stats_job_t *)malloc(sizeof(dt_image_stats_job_t));
+  params->generation = generation;
+  params->imgids = g_array_new(FALSE, FALSE, sizeof(int32_t));
+
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT imgid FROM memory.collected_images WHERE imgid NOT IN "
+                              "(SELECT imgid FROM main.image_stats) ORDER BY rowid",
+                              -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int32_t imgid = sqlite3_column_int(stmt, 0);
+    g_array_append_val(params->imgids, imgid);
+  }
+  sqlite3_finalize(stmt);
+
+  if(params->imgids->len == 0)
+  {
+    _job_free(params);
+    return;
+  }
+
+  dt_job_t *job = dt_control_job_create(&_update_job_run, "compute image statistics");
+  if(!job)
+  {
+    _job_free(params);
+    return;
+  }
+  dt_control_job_set_params(job, params, _job_free);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,63 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_COMMON_IMAGE_STATS_H
+#define DT_COMMON_IMAGE_STATS_H
+
+#include <glib.h>
+#include <stdint.h>
+
+/*
+ * per image exposure statistics, kept in the library.
+ *
+ * they are computed from the 8-bit thumbnail of the developed image, so they describe what the
+ * lighttable shows, and are stored in main.image_stats. that lets the collection be sorted and
+ * filtered by them and the histogram be drawn in lighttable without running a pixelpipe.
+ * whenever the thumbnails of an image are thrown away its statistics go with them, and a
+ * background job fills in the missing ones for the current collection.
+ */
+
+#define DT_IMAGE_STATS_BINS 64
+
+typedef struct dt_image_stats_t
+{
+  float brightness;    // mean luma of the display referred image, in percent
+  float clipped;       // pixels with at least one saturated channel, in percent
+  float crushed;       // pixels that are black in all channels, in percent
+  float dynamic_range; // EV between the 1st and the 99th percentile of the luminance
+  // r, g, b and luma, same layout as dt_develop_t::histogram
+  uint32_t histogram[4 * DT_IMAGE_STATS_BINS];
+  uint32_t histogram_max;
+} dt_image_stats_t;
+
+/** compute the statistics of an image from its thumbnail, generating that if needed. returns 0 on success. */
+int dt_image_stats_compute(const int32_t imgid, dt_image_stats_t *stats);
+/** store the statistics of an image in the library. */
+void dt_image_stats_store(const int32_t imgid, const dt_image_stats_t *stats);
+/** read the stored statistics of an image. returns 0 if there were some. */
+int dt_image_stats_get(const int32_t imgid, dt_image_stats_t *stats);
+/** forget the statistics of an image, they'll be recomputed from its new thumbnail. */
+void dt_image_stats_remove(const int32_t imgid);
+/** start a background job computing the missing statistics of the collected images, if enabled. */
+void dt_image_stats_update_collection();
+
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -48,6 +48,7 @@
 #include "develop/blend.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
+#include "develop/imageop_math.h"
 
 #ifdef HAVE_GRAPHICSMAGICK
 #include <magick/api.h>
@@ -66,7 +67,8 @@
 
 // load a full-res thumbnail:
 int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
-                               dt_colorspaces_color_profile_type_t *color_space)
+                               dt_colorspaces_color_profile_type_t *color_space, const int32_t max_width,
+                               const int32_t max_height)
 {
   int res = 1;
 
@@ -82,6 +84,7 @@ int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *
     // Decompress the JPG into our own memory format
     dt_imageio_jpeg_t jpg;
     if(dt_imageio_jpeg_decompress_header(buf, bufsize, &jpg)) goto error;
+    dt_imageio_jpeg_scale_to_fit(&jpg, max_width, max_height);
     *buffer = (uint8_t *)malloc((size_t)sizeof(uint8_t) * jpg.width * jpg.height * 4);
     if(!*buffer) goto error;
 
@@ -524,6 +527,408 @@ void dt_imageio_to_fractional(float in, uint32_t *num, uint32_t *den)
   }
 }
 
+// processed output of an export, kept around so further renditions of the same image can be
+// derived from it by downscaling instead of running the whole pipe again.
+typedef struct dt_imageio_export_shared_t
+{
+  uint32_t imgid;
+  uint64_t key;                // style and upscale settings the buffer was processed with
+  int pending;                 // renditions of the current image still to come after the next export
+  float *buf;                  // rgba float pipe output, without gamma
+  int width, height;           // size of buf
+  float scale;                 // pipe scale buf was processed at
+  int full_width, full_height; // processed size at scale 1
+  int sRGB;
+} dt_imageio_export_shared_t;
+
+static GPrivate _export_shared;
+
+void dt_imageio_export_share_begin()
+{
+  g_private_set(&_export_shared, calloc(1, sizeof(dt_imageio_export_shared_t)));
+}
+
+void dt_imageio_export_share_pending(const int pending)
+{
+  dt_imageio_export_shared_t *shared = g_private_get(&_export_shared);
+  if(shared) shared->pending = pending;
+}
+
+static void _export_shared_drop(dt_imageio_export_shared_t *shared)
+{
+  dt_free_align(shared->buf);
+  shared->buf = NULL;
+  shared->imgid = 0;
+}
+
+void dt_imageio_export_share_end()
+{
+  dt_imageio_export_shared_t *shared = g_private_get(&_export_shared);
+  if(!shared) return;
+  _export_shared_drop(shared);
+  free(shared);
+  g_private_set(&_export_shared, NULL);
+}
+
+static uint64_t _export_shared_key(const dt_imageio_module_data_t *format_params, const gboolean upscale)
+{
+  // bernstein hash (djb2)
+  uint64_t hash = 5381 + upscale + 2 * format_params->style_append;
+  for(const char *c = format_params->style; *c; c++) hash = ((hash << 5) + hash) ^ *c;
+  return hash;
+}
+
+// renditions are downscaled from the pipe output, so nothing but gamma may come after finalscale
+static int _export_shareable_pipe(const dt_dev_pixelpipe_t *pipe)
+{
+  int after_finalscale = 0;
+  for(const GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!strcmp(piece->module->op, "finalscale"))
+      after_finalscale = 1;
+    else if(after_finalscale && piece->enabled && strcmp(piece->module->op, "gamma"))
+      return 0;
+  }
+  return after_finalscale;
+}
+
+// downconversion of the processed buffer to what the format wants, in place
+static void _export_downconvert(uint8_t *outbuf, const int bpp, const int float_input,
+                                const int32_t display_byteorder, const int processed_width,
+                                const int processed_height)
+{
+  if(bpp == 8)
+  {
+    if(display_byteorder)
+    {
+      if(float_input)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
+          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
+          const uint8_t b = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      // else processing output was 8-bit already, and no need to swap order
+    }
+    else // need to flip
+    {
+      // ldr output: char
+      if(float_input)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
+          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
+          const uint8_t b = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      else
+      { // !display_byteorder, need to swap:
+        uint8_t *const buf8 = outbuf;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static)
+#endif
+        // just flip byte order
+        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+        {
+          uint8_t tmp = buf8[4 * k + 0];
+          buf8[4 * k + 0] = buf8[4 * k + 2];
+          buf8[4 * k + 2] = tmp;
+        }
+      }
+    }
+  }
+  else if(bpp == 16)
+  {
+    // uint16_t per color channel
+    float *buff = (float *)outbuf;
+    uint16_t *buf16 = (uint16_t *)outbuf;
+    for(int y = 0; y < processed_height; y++)
+      for(int x = 0; x < processed_width; x++)
+      {
+        // convert in place
+        const size_t k = (size_t)processed_width * y + x;
+        for(int i = 0; i < 3; i++) buf16[4 * k + i] = CLAMP(buff[4 * k + i] * 0x10000, 0, 0xffff);
+      }
+  }
+  // else output float, no further harm done to the pixels :)
+}
+
+// exif blob for the exported image, returns its length
+static int _export_exif_blob(const uint32_t imgid, const int sRGB, const int processed_width,
+                             const int processed_height, uint8_t **exif_profile)
+{
+  // Exif data should be 65536 bytes max, but if original size is close to that, adding new tags could make
+  // it go over that... so let it be and see what happens when we write the image
+  *exif_profile = NULL;
+  char pathname[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
+  // last param is dng mode, it's false here
+  return dt_exif_read_blob(exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
+}
+
+static int _export_write(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                         dt_imageio_module_data_t *format_params, void *outbuf, const int processed_width,
+                         const int processed_height, const int32_t ignore_exif, const int sRGB, int num,
+                         int total)
+{
+  int res;
+  format_params->width = processed_width;
+  format_params->height = processed_height;
+
+  if(!ignore_exif)
+  {
+    uint8_t *exif_profile = NULL;
+    const int length = _export_exif_blob(imgid, sRGB, processed_width, processed_height, &exif_profile);
+
+    res = format->write_image(format_params, filename, outbuf, exif_profile, length, imgid, num, total);
+
+    free(exif_profile);
+  }
+  else
+  {
+    res = format->write_image(format_params, filename, outbuf, NULL, 0, imgid, num, total);
+  }
+  return res;
+}
+
+// runs the export pipe for the rows [y, y + rows) of the processed image
+static void _export_process_rows(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
+                                 const gboolean high_quality_processing, const int with_gamma, const int y,
+                                 const int processed_width, const int rows, const double scale)
+{
+  if(high_quality_processing)
+  {
+    /*
+     * if high quality processing was requested, downsampling will be done
+     * at the very end of the pipe (just before border and watermark)
+     */
+    dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, y, processed_width, rows, scale);
+  }
+  else
+  {
+    // else, downsampling will be right after demosaic
+
+    // so we need to turn temporarily disable in-pipe late downsampling iop.
+
+    // find the finalscale module
+    dt_dev_pixelpipe_iop_t *finalscale = NULL;
+    {
+      GList *nodes = g_list_last(pipe->nodes);
+      while(nodes)
+      {
+        dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
+        if(!strcmp(node->module->op, "finalscale"))
+        {
+          finalscale = node;
+          break;
+        }
+        nodes = g_list_previous(nodes);
+      }
+    }
+
+    if(finalscale) finalscale->enabled = 0;
+
+    // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
+    if(with_gamma)
+      dt_dev_pixelpipe_process(pipe, dev, 0, y, processed_width, rows, scale);
+    else
+      dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, y, processed_width, rows, scale);
+
+    if(finalscale) finalscale->enabled = 1;
+  }
+}
+
+// large exports are processed in strips of about this many pixels and handed to formats that can write rows
+// as they come, so the full processed frame never has to be in memory at once
+#define DT_IMAGEIO_EXPORT_STRIP_PIXELS (1 << 24)
+
+static int _export_stream_wanted(dt_dev_pixelpipe_t *pipe, dt_imageio_module_format_t *format,
+                                 const int processed_width, const int processed_height)
+{
+  if(!format->write_begin) return 0;
+  // every strip is a pipe run of its own, modules with roi derived state would band. that rules out raws,
+  // demosaic isn't roi invariant: they are always exported in one piece.
+  if(!dt_dev_pixelpipe_is_roi_invariant(pipe)) return 0;
+  const int megapixels = dt_conf_get_int("plugins/lighttable/export/stream_megapixels");
+  return megapixels > 0 && (uint64_t)processed_width * processed_height > (uint64_t)megapixels * 1000000;
+}
+
+// one strip handed to the writer thread, which encodes it while the pipe processes the next one
+typedef struct _export_stream_job_t
+{
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *format_params;
+  void *stream;
+  void *buf;
+  int rows;
+  int res;
+} _export_stream_job_t;
+
+static gpointer _export_stream_write(gpointer data)
+{
+  _export_stream_job_t *job = (_export_stream_job_t *)data;
+  job->res = job->format->write_rows(job->format_params, job->stream, job->buf, job->rows);
+  return NULL;
+}
+
+static int _export_stream(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const uint32_t imgid,
+                          const char *filename, dt_imageio_module_format_t *format,
+                          dt_imageio_module_data_t *format_params, const gboolean high_quality_processing,
+                          const int sRGB, const int processed_width, const int processed_height,
+                          const double scale, int num, int total)
+{
+  const int bpp = format->bpp(format_params);
+  const int with_gamma = !high_quality_processing && bpp == 8;
+  const int strip_height = MAX(64, DT_IMAGEIO_EXPORT_STRIP_PIXELS / processed_width);
+  // 4 channels of bpp bits each, the layout write_rows() gets
+  const size_t row_bytes = (size_t)processed_width * 4 * bpp / 8;
+
+  // the pipe reuses its cache lines for the next strip, so the writer gets copies. two of them, one being
+  // written while the other is filled.
+  _export_stream_job_t jobs[2] = { { 0 } };
+  for(int k = 0; k < 2; k++)
+  {
+    jobs[k].buf = dt_alloc_align(64, row_bytes * strip_height);
+    if(!jobs[k].buf)
+    {
+      dt_free_align(jobs[0].buf);
+      return 1;
+    }
+  }
+
+  format_params->width = processed_width;
+  format_params->height = processed_height;
+
+  uint8_t *exif_profile = NULL;
+  const int length = _export_exif_blob(imgid, sRGB, processed_width, processed_height, &exif_profile);
+  void *stream = format->write_begin(format_params, filename, exif_profile, length, imgid, num, total);
+  free(exif_profile);
+  if(!stream)
+  {
+    for(int k = 0; k < 2; k++) dt_free_align(jobs[k].buf);
+    return 1;
+  }
+
+  dt_print(DT_DEBUG_PERF, "[export] streaming %dx%d in strips of %d rows\n", processed_width, processed_height,
+           strip_height);
+
+  int res = 0;
+  GThread *writer = NULL;
+  for(int y = 0, k = 0; y < processed_height && !res; y += strip_height, k ^= 1)
+  {
+    const int rows = MIN(strip_height, processed_height - y);
+    _export_process_rows(pipe, dev, high_quality_processing, with_gamma, y, processed_width, rows, scale);
+    if(!pipe->backbuf || pipe->backbuf_width != processed_width || pipe->backbuf_height != rows)
+    {
+      res = 1;
+      break;
+    }
+    _export_downconvert(pipe->backbuf, bpp, !with_gamma, 0, processed_width, rows);
+
+    // rows have to arrive in order, and the buffer used two strips ago is free again once that is done
+    if(writer)
+    {
+      g_thread_join(writer);
+      writer = NULL;
+      if((res = jobs[k ^ 1].res)) break;
+    }
+    memcpy(jobs[k].buf, pipe->backbuf, row_bytes * rows);
+    jobs[k] = (_export_stream_job_t){ format, format_params, stream, jobs[k].buf, rows, 0 };
+    writer = g_thread_new("export writer", _export_stream_write, &jobs[k]);
+  }
+  if(writer)
+  {
+    g_thread_join(writer);
+    // earlier strips that failed have stopped the loop already, this catches the last one
+    for(int k = 0; k < 2; k++) res |= jobs[k].res;
+  }
+  for(int k = 0; k < 2; k++) dt_free_align(jobs[k].buf);
+
+  // always called, so the format can clean up after a failed strip
+  if(format->write_finish(format_params, stream, res)) res = 1;
+  return res;
+}
+
+static void _export_finish(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                           dt_imageio_module_data_t *format_params, const int32_t thumbnail_export,
+                           const gboolean copy_metadata, dt_imageio_module_storage_t *storage,
+                           dt_imageio_module_data_t *storage_params)
+{
+  /* now write xmp into that container, if possible */
+  if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
+  {
+    dt_exif_xmp_attach(imgid, filename);
+    // no need to cancel the export if this fail
+  }
+
+  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
+    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
+  {
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
+                            format_params, storage, storage_params);
+  }
+}
+
+// export a further rendition of the image in the shared buffer, if it is not larger than that
+static int _export_shared_rendition(dt_imageio_export_shared_t *shared, const uint32_t imgid,
+                                    const char *filename, dt_imageio_module_format_t *format,
+                                    dt_imageio_module_data_t *format_params, const int32_t ignore_exif,
+                                    const gboolean upscale, const gboolean copy_metadata,
+                                    dt_imageio_module_storage_t *storage,
+                                    dt_imageio_module_data_t *storage_params, int num, int total, int *res)
+{
+  if(!shared->buf || shared->imgid != imgid || shared->key != _export_shared_key(format_params, upscale))
+    return 0;
+
+  // same scale computation as for a regular export
+  const float max_scale = upscale ? 100.0 : 1.0;
+  const int width = format_params->max_width;
+  const int height = format_params->max_height;
+  const double scalex = width > 0 ? fminf(width / (double)shared->full_width, max_scale) : 1.0;
+  const double scaley = height > 0 ? fminf(height / (double)shared->full_height, max_scale) : 1.0;
+  const double scale = fminf(scalex, scaley);
+  if(scale > shared->scale) return 0;
+
+  const int processed_width = scale * shared->full_width + .5f;
+  const int processed_height = scale * shared->full_height + .5f;
+  float *outbuf = dt_alloc_align(64, sizeof(float) * 4 * processed_width * processed_height);
+  if(!outbuf) return 0;
+
+  dt_times_t start;
+  dt_get_times(&start);
+  // the same downscaling finalscale does at the end of a high quality export
+  const dt_iop_roi_t roi_in = (dt_iop_roi_t){ 0, 0, shared->width, shared->height, 1.0f };
+  const dt_iop_roi_t roi_out = (dt_iop_roi_t){ 0, 0, processed_width, processed_height, scale / shared->scale };
+  dt_iop_clip_and_zoom_roi(outbuf, shared->buf, &roi_out, &roi_in, processed_width, shared->width);
+  dt_show_times(&start, "[export] downscaling shared rendition", NULL);
+  dt_print(DT_DEBUG_PERF, "[export] image %u: %dx%d derived from %dx%d\n", imgid, processed_width,
+           processed_height, shared->width, shared->height);
+
+  _export_downconvert((uint8_t *)outbuf, format->bpp(format_params), 1, 0, processed_width, processed_height);
+  *res = _export_write(imgid, filename, format, format_params, outbuf, processed_width, processed_height,
+                       ignore_exif, shared->sRGB, num, total);
+  dt_free_align(outbuf);
+  if(shared->pending <= 0) _export_shared_drop(shared);
+
+  _export_finish(imgid, filename, format, format_params, 0, copy_metadata, storage, storage_params);
+  return 1;
+}
+
 int dt_imageio_export(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
                       dt_imageio_module_data_t *format_params, const gboolean high_quality, const gboolean upscale,
                       const gboolean copy_metadata, dt_imageio_module_storage_t *storage,
@@ -546,6 +951,19 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  dt_imageio_module_storage_t *storage,
                                  dt_imageio_module_data_t *storage_params, int num, int total)
 {
+  // part of a multi-rendition export? then this might not need a pipe at all
+  dt_imageio_export_shared_t *shared
+      = (thumbnail_export || filter || display_byteorder) ? NULL : g_private_get(&_export_shared);
+  if(shared)
+  {
+    int res = 0;
+    if(_export_shared_rendition(shared, imgid, filename, format, format_params, ignore_exif, upscale,
+                                copy_metadata, storage, storage_params, num, total, &res))
+      return res;
+    // not usable for this one, don't hold on to it while the pipe runs
+    _export_shared_drop(shared);
+  }
+
   dt_develop_t dev;
   dt_dev_init(&dev, 0);
   dt_dev_load_image(&dev, imgid);
@@ -686,6 +1104,42 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
   dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
                                   &pipe.processed_height);
 
+  // mip f is too small for the larger thumbnails. switch to the smallest level of the float pyramid that
+  // still gives the requested size, the pipe works the same on any of them.
+  if(buf_is_downscaled && format_params->max_width > 0 && format_params->max_height > 0
+     && pipe.processed_width > 0 && pipe.processed_height > 0)
+  {
+    const float full_scale = fminf(format_params->max_width / (pipe.processed_width * pipe.iscale),
+                                   format_params->max_height / (pipe.processed_height * pipe.iscale));
+    const dt_mipmap_size_t mip
+        = dt_mipmap_cache_get_matching_float_size(darktable.mipmap_cache, wd, ht, fminf(full_scale, 1.0f));
+    if(mip != DT_MIPMAP_F)
+    {
+      dt_mipmap_buffer_t level;
+      dt_mipmap_cache_get(darktable.mipmap_cache, &level, imgid, mip, DT_MIPMAP_BLOCKING, 'r');
+      if(level.buf && level.width > 8 && level.height > 8)
+      {
+        dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+        buf = level;
+        dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height,
+                                   dev.image_storage.width / (float)buf.width, buf.pre_monochrome_demosaiced);
+        // the nodes know the input size as well
+        dt_dev_pixelpipe_cleanup_nodes(&pipe);
+        dt_dev_pixelpipe_create_nodes(&pipe, &dev);
+        dt_dev_pixelpipe_synch_all(&pipe, &dev);
+        if(filter)
+        {
+          if(!strncmp(filter, "pre:", 4)) dt_dev_pixelpipe_disable_after(&pipe, filter + 4);
+          if(!strncmp(filter, "post:", 5)) dt_dev_pixelpipe_disable_before(&pipe, filter + 5);
+        }
+        dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
+                                        &pipe.processed_height);
+      }
+      else
+        dt_mipmap_cache_release(darktable.mipmap_cache, &level);
+    }
+  }
+
   dt_show_times(&start, "[export] creating pixelpipe", NULL);
 
   // find output color profile for this image:
@@ -734,163 +1188,59 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
   const int bpp = format->bpp(format_params);
 
+  // keep the float output for the renditions still to come
+  const int share = shared && shared->pending > 0 && _export_shareable_pipe(&pipe);
+
   dt_get_times(&start);
-  if(high_quality_processing)
+  if(!ignore_exif && !thumbnail_export && !display_byteorder && !share
+     && _export_stream_wanted(&pipe, format, processed_width, processed_height))
   {
-    /*
-     * if high quality processing was requested, downsampling will be done
-     * at the very end of the pipe (just before border and watermark)
-     */
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    res = _export_stream(&pipe, &dev, imgid, filename, format, format_params, high_quality_processing, sRGB,
+                         processed_width, processed_height, scale, num, total);
+    dt_show_times(&start, "[dev_process_export] streaming pixel pipeline processing", NULL);
+    goto done;
   }
-  else
-  {
-    // else, downsampling will be right after demosaic
 
-    // so we need to turn temporarily disable in-pipe late downsampling iop.
-
-    // find the finalscale module
-    dt_dev_pixelpipe_iop_t *finalscale = NULL;
-    {
-      GList *nodes = g_list_last(pipe.nodes);
-      while(nodes)
-      {
-        dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
-        if(!strcmp(node->module->op, "finalscale"))
-        {
-          finalscale = node;
-          break;
-        }
-        nodes = g_list_previous(nodes);
-      }
-    }
-
-    if(finalscale) finalscale->enabled = 0;
-
-    // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
-    if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
-    else
-      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
-
-    if(finalscale) finalscale->enabled = 1;
-  }
+  _export_process_rows(&pipe, &dev, high_quality_processing, bpp == 8 && !share, 0, processed_width,
+                       processed_height, scale);
   dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing"
                                          : "[dev_process_export] pixel pipeline processing",
                 NULL);
 
   uint8_t *outbuf = pipe.backbuf;
 
-  // downconversion to low-precision formats:
-  if(bpp == 8)
+  if(share)
   {
-    if(display_byteorder)
-    {
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
-          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
-          const uint8_t b = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      // else processing output was 8-bit already, and no need to swap order
-    }
-    else // need to flip
+    const size_t size = sizeof(float) * 4 * processed_width * processed_height;
+    shared->buf = dt_alloc_align(64, size);
+    if(shared->buf)
     {
-      // ldr output: char
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
-          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
-          const uint8_t b = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      else
-      { // !display_byteorder, need to swap:
-        uint8_t *const buf8 = pipe.backbuf;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(static)
-#endif
-        // just flip byte order
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          uint8_t tmp = buf8[4 * k + 0];
-          buf8[4 * k + 0] = buf8[4 * k + 2];
-          buf8[4 * k + 2] = tmp;
-        }
-      }
+      memcpy(shared->buf, outbuf, size);
+      shared->imgid = imgid;
+      shared->key = _export_shared_key(format_params, upscale);
+      shared->width = processed_width;
+      shared->height = processed_height;
+      shared->scale = scale;
+      shared->full_width = pipe.processed_width;
+      shared->full_height = pipe.processed_height;
+      shared->sRGB = sRGB;
     }
   }
-  else if(bpp == 16)
-  {
-    // uint16_t per color channel
-    float *buff = (float *)outbuf;
-    uint16_t *buf16 = (uint16_t *)outbuf;
-    for(int y = 0; y < processed_height; y++)
-      for(int x = 0; x < processed_width; x++)
-      {
-        // convert in place
-        const size_t k = (size_t)processed_width * y + x;
-        for(int i = 0; i < 3; i++) buf16[4 * k + i] = CLAMP(buff[4 * k + i] * 0x10000, 0, 0xffff);
-      }
-  }
-  // else output float, no further harm done to the pixels :)
-
-  format_params->width = processed_width;
-  format_params->height = processed_height;
-
-  if(!ignore_exif)
-  {
-    int length;
-    uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes max, but if original size is close to that,
-                                  // adding new tags could make it go over that... so let it be and see what
-                                  // happens when we write the image
-    char pathname[PATH_MAX] = { 0 };
-    gboolean from_cache = TRUE;
-    dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
-    // last param is dng mode, it's false here
-    length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
 
-    res = format->write_image(format_params, filename, outbuf, exif_profile, length, imgid, num, total);
+  // downconversion to low-precision formats:
+  _export_downconvert(outbuf, bpp, high_quality_processing || bpp != 8 || share, display_byteorder,
+                      processed_width, processed_height);
 
-    free(exif_profile);
-  }
-  else
-  {
-    res = format->write_image(format_params, filename, outbuf, NULL, 0, imgid, num, total);
-  }
+  res = _export_write(imgid, filename, format, format_params, outbuf, processed_width, processed_height,
+                      ignore_exif, sRGB, num, total);
 
+done:
   dt_dev_pixelpipe_cleanup(&pipe);
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
-  /* now write xmp into that container, if possible */
-  if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
-  {
-    dt_exif_xmp_attach(imgid, filename);
-    // no need to cancel the export if this fail
-  }
-
-  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
-    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
-  {
-    dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
-                            format_params, storage, storage_params);
-  }
+  _export_finish(imgid, filename, format, format_params, thumbnail_export, copy_metadata, storage,
+                 storage_params);
 
   return res;
 
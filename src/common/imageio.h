@@ -80,6 +80,14 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  const gboolean copy_metadata, dt_imageio_module_storage_t *storage,
                                  dt_imageio_module_data_t *storage_params, int num, int total);
 
+// exports of several renditions of the same image on this thread: between begin and end, an export
+// announced with pending > 0 keeps its processed output so that the following, not larger renditions
+// of the same image with the same style are downscaled from it instead of running the pixelpipe again.
+void dt_imageio_export_share_begin();
+// number of renditions of the current image that will still be exported after the next one
+void dt_imageio_export_share_pending(const int pending);
+void dt_imageio_export_share_end();
+
 size_t dt_imageio_write_pos(int i, int j, int wd, int ht, float fwd, float fht,
                             dt_image_orientation_t orientation);
 
@@ -99,8 +107,11 @@ void dt_imageio_flip_buffers_ui8_to_float(float *out, const uint8_t *in, const f
                                           const dt_image_orientation_t orientation);
 
 // allocate buffer and return 0 on success along with largest jpg thumbnail from raw.
+// pass max_width/max_height > 0 to let a jpeg thumbnail be decoded at reduced size, as long as that still covers
+// the given box.
 int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
-                               dt_colorspaces_color_profile_type_t *color_space);
+                               dt_colorspaces_color_profile_type_t *color_space, const int32_t max_width,
+                               const int32_t max_height);
 #endif
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -25,6 +25,7 @@
 #include "common/exif.h"
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
+#include <math.h>
 #include <setjmp.h>
 
 // error functions
@@ -155,11 +156,42 @@ int dt_imageio_jpeg_decompress_header(const void *in, size_t length, dt_imageio_
   return 0;
 }
 
+void dt_imageio_jpeg_scale_to_fit(dt_imageio_jpeg_t *jpg, const int max_width, const int max_height)
+{
+  const int width = jpg->dinfo.image_width, height = jpg->dinfo.image_height;
+  if(max_width <= 0 || max_height <= 0 || width <= 0 || height <= 0) return;
+
+  // the size the image will be scaled to in the end, it must not get any smaller than that
+  const float scale = fminf(max_width / (float)width, max_height / (float)height);
+  int denom = 8;
+  while(denom > 1 && denom * scale > 1.0f) denom /= 2;
+  if(denom == 1) return;
+
+  struct dt_imageio_jpeg_error_mgr jerr;
+  jpg->dinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if(setjmp(jerr.setjmp_buffer))
+  {
+    // just decode at full size then
+    jpg->dinfo.scale_denom = 1;
+    jpg->width = width;
+    jpg->height = height;
+    return;
+  }
+
+  // libjpeg does the downscaling in the inverse dct, skipping most of the work
+  jpg->dinfo.scale_num = 1;
+  jpg->dinfo.scale_denom = denom;
+  jpeg_calc_output_dimensions(&(jpg->dinfo));
+  jpg->width = jpg->dinfo.output_width;
+  jpg->height = jpg->dinfo.output_height;
+}
+
 #ifdef JCS_EXTENSIONS
 static int decompress_jsc(dt_imageio_jpeg_t *jpg, uint8_t *out)
 {
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), &tmp, 1) != 1)
     {
@@ -176,14 +208,14 @@ static int decompress_plain(dt_imageio_jpeg_t *jpg, uint8_t *out)
   JSAMPROW row_pointer[1];
   row_pointer[0] = (uint8_t *)malloc(jpg->dinfo.output_width * jpg->dinfo.num_components);
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), row_pointer, 1) != 1)
     {
       free(row_pointer[0]);
       return 1;
     }
-    for(unsigned int i = 0; i < jpg->dinfo.image_width; i++)
+    for(unsigned int i = 0; i < jpg->dinfo.output_width; i++)
     {
       for(int k = 0; k < 3; k++) tmp[4 * i + k] = row_pointer[0][3 * i + k];
     }
@@ -595,7 +627,7 @@ int dt_imageio_jpeg_read_header(const char *filename, dt_imageio_jpeg_t *jpg)
 static int read_jsc(dt_imageio_jpeg_t *jpg, uint8_t *out)
 {
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), &tmp, 1) != 1)
     {
@@ -612,7 +644,7 @@ static int read_plain(dt_imageio_jpeg_t *jpg, uint8_t *out)
   JSAMPROW row_pointer[1];
   row_pointer[0] = (uint8_t *)malloc(jpg->dinfo.output_width * jpg->dinfo.num_components);
   uint8_t *tmp = out;
-  while(jpg->dinfo.output_scanline < jpg->dinfo.image_height)
+  while(jpg->dinfo.output_scanline < jpg->dinfo.output_height)
   {
     if(jpeg_read_scanlines(&(jpg->dinfo), row_pointer, 1) != 1)
     {
@@ -621,7 +653,7 @@ static int read_plain(dt_imageio_jpeg_t *jpg, uint8_t *out)
       fclose(jpg->f);
       return 1;
     }
-    for(unsigned int i = 0; i < jpg->dinfo.image_width; i++)
+    for(unsigned int i = 0; i < jpg->dinfo.output_width; i++)
       for(int k = 0; k < 3; k++) tmp[4 * i + k] = row_pointer[0][3 * i + k];
     tmp += 4 * jpg->width;
   }
@@ -46,6 +46,9 @@ typedef struct dt_imageio_jpeg_t
 int dt_imageio_jpeg_decompress_header(const void *in, size_t length, dt_imageio_jpeg_t *jpg);
 /** reads the whole image to the out buffer, which has to be large enough. */
 int dt_imageio_jpeg_decompress(dt_imageio_jpeg_t *jpg, uint8_t *out);
+/** after reading the header: decode at 1/2, 1/4 or 1/8 size if that is still large enough to fit
+ * max_width x max_height. updates width/height in jpg. */
+void dt_imageio_jpeg_scale_to_fit(dt_imageio_jpeg_t *jpg, const int max_width, const int max_height);
 /** compresses in to out buffer with given quality (0..100). out buffer must be large enough. returns actual
  * data length. */
 int dt_imageio_jpeg_compress(const uint8_t *in, uint8_t *out, const int width, const int height,
@@ -109,6 +109,15 @@ static int dt_imageio_load_module_format(dt_imageio_module_format_t *module, con
   if(!g_module_symbol(module->module, "free_params", (gpointer) & (module->free_params))) goto error;
   if(!g_module_symbol(module->module, "set_params", (gpointer) & (module->set_params))) goto error;
   if(!g_module_symbol(module->module, "write_image", (gpointer) & (module->write_image))) goto error;
+  // streaming is all or nothing
+  if(!g_module_symbol(module->module, "write_begin", (gpointer) & (module->write_begin))
+     || !g_module_symbol(module->module, "write_rows", (gpointer) & (module->write_rows))
+     || !g_module_symbol(module->module, "write_finish", (gpointer) & (module->write_finish)))
+  {
+    module->write_begin = NULL;
+    module->write_rows = NULL;
+    module->write_finish = NULL;
+  }
   if(!g_module_symbol(module->module, "bpp", (gpointer) & (module->bpp))) goto error;
   if(!g_module_symbol(module->module, "flags", (gpointer) & (module->flags)))
     module->flags = _default_format_flags;
@@ -21,6 +21,13 @@
 
 #include <memory>
 
+#ifndef __WIN32__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "rawspeed/RawSpeed/RawSpeed-API.h"
 
 #define __STDC_LIMIT_MACROS
@@ -113,17 +120,72 @@ uint32_t dt_rawspeed_crop_dcraw_filters(uint32_t filters, uint32_t crop_x, uint3
   return cfa.getDcrawFilter();
 }
 
+#ifndef __WIN32__
+/*
+ * map the whole file copy-on-write, so exiv2 and rawspeed can both parse it without
+ * reading it into the heap first. rawspeed's bit pumps may read up to FILEMAP_MARGIN
+ * bytes past the end, so back the mapping with anonymous zero pages beyond the file.
+ */
+static uint8_t *_rawspeed_map_file(const char *filename, size_t *size, size_t *length)
+{
+  const int fd = open(filename, O_RDONLY);
+  if(fd < 0) return NULL;
+  struct stat st;
+  if(fstat(fd, &st) || st.st_size <= 0 || (uint64_t)st.st_size > UINT32_MAX - FILEMAP_MARGIN)
+  {
+    close(fd);
+    return NULL;
+  }
+  const size_t page = sysconf(_SC_PAGESIZE);
+  *size = st.st_size;
+  *length = (*size + FILEMAP_MARGIN + page - 1) / page * page;
+
+  uint8_t *base = (uint8_t *)mmap(NULL, *length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+  if(base == MAP_FAILED)
+  {
+    close(fd);
+    return NULL;
+  }
+  if(mmap(base, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+  {
+    munmap(base, *length);
+    close(fd);
+    return NULL;
+  }
+  close(fd);
+  // get the readahead going while exiv2 looks at the header
+  madvise(base, *size, MADV_WILLNEED);
+  return base;
+}
+
+// unmaps the file on every way out of the loader
+struct dt_rawspeed_map_guard_t
+{
+  uint8_t *data;
+  size_t length;
+  ~dt_rawspeed_map_guard_t()
+  {
+    if(data) munmap(data, length);
+  }
+};
+#endif
+
 dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filename,
                                              dt_mipmap_buffer_t *mbuf)
 {
+#ifdef __WIN32__
   if(!img->exif_inited) (void)dt_exif_read(img, filename);
 
-#ifdef __WIN32__
   const size_t len = strlen(filename) + 1;
   wchar_t filen[len];
   mbstowcs(filen, filename, len);
   FileReader f(filen);
 #else
+  size_t map_size = 0, map_length = 0;
+  uint8_t *map = _rawspeed_map_file(filename, &map_size, &map_length);
+  dt_rawspeed_map_guard_t map_guard = { map, map_length };
+  if(!img->exif_inited) (void)dt_exif_read_from_data(img, filename, map, map_size);
+
   char filen[PATH_MAX] = { 0 };
   snprintf(filen, sizeof(filen), "%s", filename);
   FileReader f(filen);
@@ -142,9 +204,13 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     dt_rawspeed_load_meta();
 
 #ifdef __APPLE__
-    m = auto_ptr<FileMap>(f.readFile());
+    m = auto_ptr<FileMap>(map ? new FileMap(map, map_size) : f.readFile());
 #else
+#ifdef __WIN32__
     m = unique_ptr<FileMap>(f.readFile());
+#else
+    m = unique_ptr<FileMap>(map ? new FileMap(map, map_size) : f.readFile());
+#endif
 #endif
 
     RawParser t(m.get());
@@ -244,6 +310,11 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     /* free auto pointers on spot */
     d.reset();
     m.reset();
+#ifndef __WIN32__
+    // the decoded image doesn't reference the file any more
+    if(map_guard.data) munmap(map_guard.data, map_guard.length);
+    map_guard.data = NULL;
+#endif
 
     // Grab the WB
     for(int i = 0; i < 4; i++) img->wb_coeffs[i] = r->metadata.wbCoeffs[i];
@@ -22,6 +22,7 @@
 #include "common/exif.h"
 #include "common/grealpath.h"
 #include "common/image_cache.h"
+#include "common/image_stats.h"
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
@@ -79,9 +80,13 @@ struct dt_mipmap_buffer_dsc
   dt_mipmap_buffer_dsc_flags flags;
   uint32_t pre_monochrome_demosaiced;
   dt_colorspaces_color_profile_type_t color_space;
+  uint32_t generation;
   /* NB: sizeof must be a multiple of 4*sizeof(float) */
 } __attribute__((packed, aligned(16)));
 
+// source of dt_mipmap_buffer_dsc.generation
+static uint32_t _mipmap_generation = 0;
+
 // last resort mem alloc for dead images. sizeof(dt_mipmap_buffer_dsc) + dead image pixels (8x8)
 // Must be alignment to 4 * sizeof(float).
 static float dt_mipmap_cache_static_dead_image[sizeof(struct dt_mipmap_buffer_dsc) / sizeof(float) + 64 * 4]
@@ -215,6 +220,13 @@ static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *buf, uint32_t *width,
                     const uint32_t imgid);
 static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, dt_colorspaces_color_profile_type_t *color_space,
                     const uint32_t imgid, const dt_mipmap_size_t size);
+static void _init_f_pyramid(dt_mipmap_buffer_t *mipmap_buf, const uint32_t imgid, const dt_mipmap_size_t mip);
+
+// how often the full image size is halved for a level of the float pyramid
+static inline int _pyramid_level(const dt_mipmap_size_t mip)
+{
+  return 1 + mip - DT_MIPMAP_F_2;
+}
 
 // callback for the imageio core to allocate memory.
 // only needed for _F and _FULL buffers, as they change size
@@ -300,6 +312,7 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
     }
   }
   assert(dsc->size >= sizeof(*dsc));
+  dsc->generation = __sync_add_and_fetch(&_mipmap_generation, 1);
 
   int loaded_from_disk = 0;
   if(mip < DT_MIPMAP_F)
@@ -505,13 +518,20 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->mip_full.stats_misses = 0;
   cache->mip_full.stats_fetches = 0;
   cache->mip_full.stats_standin = 0;
+  cache->mip_pyramid.stats_requests = 0;
+  cache->mip_pyramid.stats_near_match = 0;
+  cache->mip_pyramid.stats_misses = 0;
+  cache->mip_pyramid.stats_fetches = 0;
+  cache->mip_pyramid.stats_standin = 0;
 
   dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem);
   dt_cache_set_allocate_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_deallocate_dynamic, cache);
 
-  const int full_entries
-      = MAX(2, parallel); // even with one thread you want two buffers. one for dr one for thumbs.
+  // even with one thread you want two buffers. one for dr one for thumbs.
+  // on top of that, darkroom preloads its neighbours in both directions.
+  const int preload = CLAMP(dt_conf_get_int("plugins/darkroom/preload_count"), 0, 4);
+  const int full_entries = MAX(2, parallel) + 2 * preload;
   int32_t max_mem_bufs = nearest_power_of_two(full_entries);
 
   // for this buffer, because it can be very busy during import
@@ -527,6 +547,17 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->buffer_size[DT_MIPMAP_F] = sizeof(struct dt_mipmap_buffer_dsc)
                                         + 4 * sizeof(float) * cache->max_width[DT_MIPMAP_F]
                                           * cache->max_height[DT_MIPMAP_F];
+
+  // and for the float pyramid. its levels change size with the image, they are charged in bytes once
+  // they are filled and get a quarter of what the thumbnails may use on top
+  dt_cache_init(&cache->mip_pyramid.cache, 0, max_mem / 4);
+  dt_cache_set_allocate_callback(&cache->mip_pyramid.cache, dt_mipmap_cache_allocate_dynamic, cache);
+  dt_cache_set_cleanup_callback(&cache->mip_pyramid.cache, dt_mipmap_cache_deallocate_dynamic, cache);
+  for(int k = DT_MIPMAP_F_2; k < DT_MIPMAP_NONE; k++)
+  {
+    cache->max_width[k] = cache->max_height[k] = 0;
+    cache->buffer_size[k] = 0;
+  }
 }
 
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
@@ -534,6 +565,7 @@ void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+  dt_cache_cleanup(&cache->mip_pyramid.cache);
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
@@ -548,6 +580,10 @@ void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
   printf("[mipmap_cache] full  fill %d/%d slots (%.2f%%)\n",
          (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
          100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
+  printf("[mipmap_cache] pyramid fill %.2f/%.2f MB (%.2f%%)\n",
+         cache->mip_pyramid.cache.cost / (1024.0 * 1024.0),
+         cache->mip_pyramid.cache.cost_quota / (1024.0 * 1024.0),
+         100.0f * (float)cache->mip_pyramid.cache.cost / (float)cache->mip_pyramid.cache.cost_quota);
 
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
@@ -597,6 +633,10 @@ static dt_mipmap_cache_one_t *_get_cache(dt_mipmap_cache_t *cache, const dt_mipm
       return &cache->mip_full;
     case DT_MIPMAP_F:
       return &cache->mip_f;
+    case DT_MIPMAP_F_2:
+    case DT_MIPMAP_F_4:
+    case DT_MIPMAP_F_8:
+      return &cache->mip_pyramid;
     default:
       return &cache->mip_thumbs;
   }
@@ -627,6 +667,7 @@ void dt_mipmap_cache_get_with_caller(
       buf->imgid = imgid;
       buf->size = mip;
       buf->pre_monochrome_demosaiced = dsc->pre_monochrome_demosaiced;
+      buf->generation = dsc->generation;
       // skip to next 8-byte alignment, for sse buffers.
       buf->buf = (uint8_t *)(dsc + 1);
     }
@@ -728,6 +769,14 @@ void dt_mipmap_cache_get_with_caller(
       {
         _init_f(buf, (float *)(dsc + 1), &dsc->width, &dsc->height, imgid);
       }
+      else if(mip > DT_MIPMAP_FULL)
+      {
+        _init_f_pyramid(buf, imgid, mip);
+        // might have been reallocated:
+        dsc = (struct dt_mipmap_buffer_dsc *)buf->cache_entry->data;
+        if((void *)dsc != (void *)dt_mipmap_cache_static_dead_image)
+          dt_cache_set_cost(&cache->mip_pyramid.cache, buf->cache_entry, dsc->size);
+      }
       else
       {
         // 8-bit thumbs
@@ -778,6 +827,7 @@ void dt_mipmap_cache_get_with_caller(
     buf->imgid = imgid;
     buf->size = mip;
     buf->pre_monochrome_demosaiced = dsc->pre_monochrome_demosaiced;
+    buf->generation = dsc->generation;
     buf->buf = (uint8_t *)(dsc + 1);
     if(dsc->width == 0 || dsc->height == 0)
     {
@@ -884,8 +934,35 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(const dt_mipmap_cache_t *cach
   return best;
 }
 
+dt_mipmap_size_t dt_mipmap_cache_get_matching_float_size(const dt_mipmap_cache_t *cache,
+                                                         const int32_t image_width,
+                                                         const int32_t image_height, const float scale)
+{
+  if(image_width <= 0 || image_height <= 0) return DT_MIPMAP_F;
+
+  // mip f has a fixed size, so depending on the image it sits anywhere between the pyramid levels
+  const float f_scale = fminf(cache->max_width[DT_MIPMAP_F] / (float)image_width,
+                              cache->max_height[DT_MIPMAP_F] / (float)image_height);
+  dt_mipmap_size_t best = DT_MIPMAP_F_2;
+  float best_scale = 0.5f;
+  for(dt_mipmap_size_t k = DT_MIPMAP_F_2; k < DT_MIPMAP_NONE; k++)
+  {
+    const float level_scale = 1.0f / (1 << _pyramid_level(k));
+    if(level_scale >= scale && level_scale < best_scale)
+    {
+      best = k;
+      best_scale = level_scale;
+    }
+  }
+  if(f_scale >= scale && f_scale <= best_scale) best = DT_MIPMAP_F;
+  return best;
+}
+
 void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid)
 {
+  // the exposure statistics are taken from the thumbnails and get stale with them
+  dt_image_stats_remove(imgid);
+
   // get rid of all ldr thumbnails:
 
   for(dt_mipmap_size_t k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++)
@@ -949,7 +1026,7 @@ int dt_image_get_demosaic_method(const int imgid, const char **method_name)
     {
       sqlite3_stmt *stmt;
       DT_DEBUG_SQLITE3_PREPARE_V2(
-          dt_database_get(darktable.db),
+          dt_database_get_reader(darktable.db),
           "SELECT op_params FROM history WHERE imgid=?1 AND operation='demosaic' ORDER BY num DESC LIMIT 1", -1,
           &stmt, NULL);
       DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
@@ -1130,6 +1207,49 @@ static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width,
   *height = roi_out.height;
 }
 
+static void _init_f_pyramid(dt_mipmap_buffer_t *mipmap_buf, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  // the raw has to be loaded anyways, and only after that the image has its final dimensions
+  dt_mipmap_buffer_t full;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &full, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  const int loaded = full.buf != NULL;
+  dt_mipmap_cache_release(darktable.mipmap_cache, &full);
+
+  const dt_image_t *image = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  const uint32_t wd = image->width >> _pyramid_level(mip);
+  const uint32_t ht = image->height >> _pyramid_level(mip);
+  dt_image_cache_read_release(darktable.image_cache, image);
+
+  struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)mipmap_buf->cache_entry->data;
+  if(!loaded || !wd || !ht)
+  {
+    if((void *)dsc != (void *)dt_mipmap_cache_static_dead_image) dsc->width = dsc->height = 0;
+    return;
+  }
+
+  // same as dt_mipmap_cache_alloc() for the full buffers
+  const size_t buffer_size = sizeof(*dsc) + (size_t)4 * sizeof(float) * wd * ht;
+  if(dsc->size < buffer_size || (void *)dsc == (void *)dt_mipmap_cache_static_dead_image)
+  {
+    const uint32_t generation = dsc->generation;
+    if((void *)dsc != (void *)dt_mipmap_cache_static_dead_image) dt_free_align(dsc);
+    mipmap_buf->cache_entry->data = dt_alloc_align(64, buffer_size);
+    if(!mipmap_buf->cache_entry->data)
+    {
+      // that one contains a dead image already
+      mipmap_buf->cache_entry->data = (void *)dt_mipmap_cache_static_dead_image;
+      return;
+    }
+    dsc = (struct dt_mipmap_buffer_dsc *)mipmap_buf->cache_entry->data;
+    dsc->size = buffer_size;
+    dsc->flags = DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
+    dsc->generation = generation;
+  }
+  dsc->width = wd;
+  dsc->height = ht;
+  _init_f(mipmap_buf, (float *)(dsc + 1), &dsc->width, &dsc->height, imgid);
+}
+
 
 // dummy functions for `export' to mipmap buffers:
 typedef struct _dummy_data_t
@@ -1190,6 +1310,10 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, dt_colorspa
     memset(filename, 0, sizeof(filename));
     dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
 
+    // the box the thumbnail has to fill before it gets rotated into place
+    const gboolean swap = (orientation & ORIENTATION_SWAP_XY) != 0;
+    const uint32_t box_wd = swap ? ht : wd, box_ht = swap ? wd : ht;
+
     const char *c = filename + strlen(filename);
     while(*c != '.' && c > filename) c--;
     if(!strcasecmp(c, ".jpg"))
@@ -1198,6 +1322,8 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, dt_colorspa
       dt_imageio_jpeg_t jpg;
       if(!dt_imageio_jpeg_read_header(filename, &jpg))
       {
+        // no need to decode more pixels than the mip can hold
+        dt_imageio_jpeg_scale_to_fit(&jpg, box_wd, box_ht);
         uint8_t *tmp = (uint8_t *)malloc(sizeof(uint8_t) * jpg.width * jpg.height * 4);
         *color_space = dt_imageio_jpeg_read_color_space(&jpg);
         if(!dt_imageio_jpeg_read(&jpg, tmp))
@@ -1213,7 +1339,8 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, dt_colorspa
     {
       uint8_t *tmp = 0;
       int32_t thumb_width, thumb_height;
-      res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, color_space);
+      res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, color_space, box_wd,
+                                       box_ht);
       if(!res)
       {
         // scale to fit
@@ -1246,7 +1373,7 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, dt_colorspa
   if(res)
   {
     // try the real thing: rawspeed + pixelpipe
-    dt_imageio_module_format_t format;
+    dt_imageio_module_format_t format = { 0 };
     _dummy_data_t dat;
     format.bpp = _bpp;
     format.write_image = _write_image;
@@ -35,6 +35,10 @@ typedef enum dt_mipmap_size_t
   DT_MIPMAP_7,
   DT_MIPMAP_F,
   DT_MIPMAP_FULL,
+  // float pyramid, demosaiced like DT_MIPMAP_F but at 1/2, 1/4 and 1/8 of the full image size
+  DT_MIPMAP_F_2,
+  DT_MIPMAP_F_4,
+  DT_MIPMAP_F_8,
   DT_MIPMAP_NONE
 } dt_mipmap_size_t;
 
@@ -69,6 +73,8 @@ typedef struct dt_mipmap_buffer_t
   dt_colorspaces_color_profile_type_t color_space;
   // buffer is pre-demosaiced and the demosaicing method is monochrome
   int pre_monochrome_demosaiced;
+  // changes whenever the cache line is filled anew, so derived data can tell it is stale
+  uint32_t generation;
   dt_cache_entry_t *cache_entry;
 } dt_mipmap_buffer_t;
 
@@ -99,6 +105,7 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_thumbs;
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
+  dt_mipmap_cache_one_t mip_pyramid;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
 } dt_mipmap_cache_t;
 
@@ -155,6 +162,15 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(
     const int32_t width,
     const int32_t height);
 
+// return the smallest float buffer, DT_MIPMAP_F or a level of the float pyramid,
+// that holds an image of the given full size at no less than scale.
+// the largest level if none does.
+dt_mipmap_size_t dt_mipmap_cache_get_matching_float_size(
+    const dt_mipmap_cache_t *cache,
+    const int32_t image_width,
+    const int32_t image_height,
+    const float scale);
+
 // returns the colorspace to use for created thumbnails, takes config into account
 dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace();
 
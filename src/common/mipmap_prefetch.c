@@ -0,0 +1,150 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_prefetch.h"
+#include "common/darktable.h"
+#include "common/debug.h"
+#include "control/control.h"
+#include "control/jobs/image_jobs.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// how far ahead we look, in seconds of scrolling at the current speed
+#define DT_MIPMAP_PREFETCH_LOOKAHEAD 1.0f
+// never queue more than this many pages ahead
+#define DT_MIPMAP_PREFETCH_MAX_PAGES 4
+// and never more than this many thumbnails in one go
+#define DT_MIPMAP_PREFETCH_MAX_IMAGES 256
+
+void dt_mipmap_prefetch_init(dt_mipmap_prefetch_t *prefetch)
+{
+  memset(prefetch, 0, sizeof(dt_mipmap_prefetch_t));
+  prefetch->last_offset = -1;
+  prefetch->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+  prefetch->generation = dt_image_prefetch_generation_new();
+}
+
+void dt_mipmap_prefetch_cleanup(dt_mipmap_prefetch_t *prefetch)
+{
+  if(!prefetch->pending) return;
+  g_hash_table_destroy(prefetch->pending);
+  prefetch->pending = NULL;
+  // whatever is still queued is of no use anymore, the jobs drop their references as they go
+  if(prefetch->generation) g_atomic_int_inc(&prefetch->generation->value);
+  dt_image_prefetch_generation_unref(prefetch->generation);
+  prefetch->generation = NULL;
+}
+
+static void _cancel_pending(dt_mipmap_prefetch_t *prefetch)
+{
+  // jobs still in the queue compare their generation against ours and give up
+  g_atomic_int_inc(&prefetch->generation->value);
+  prefetch->cancelled += g_hash_table_size(prefetch->pending);
+  g_hash_table_remove_all(prefetch->pending);
+}
+
+void dt_mipmap_prefetch_update(dt_mipmap_prefetch_t *prefetch, sqlite3_stmt *query, int32_t offset,
+                               int32_t page, int32_t collection_count, dt_mipmap_size_t mip)
+{
+  if(!query || !prefetch->generation || page <= 0 || offset < 0) return;
+
+  const double now = dt_get_wtime();
+  const int32_t delta = offset - prefetch->last_offset;
+  if(prefetch->last_offset >= 0 && delta == 0) return;
+
+  if(prefetch->last_offset < 0 || abs(delta) > 2 * page)
+  {
+    // the user jumped, nothing we queued so far is of any use
+    _cancel_pending(prefetch);
+    prefetch->velocity = 0.0f;
+  }
+  else
+  {
+    const float velocity = delta / MAX(now - prefetch->last_time, 1e-3);
+    // follow direction changes immediately, smooth the speed otherwise
+    if(velocity * prefetch->velocity <= 0.0f)
+      prefetch->velocity = velocity;
+    else
+      prefetch->velocity = 0.5f * prefetch->velocity + 0.5f * velocity;
+  }
+  prefetch->last_offset = offset;
+  prefetch->last_time = now;
+
+  const int pages = CLAMP(1 + (int)(fabsf(prefetch->velocity) * DT_MIPMAP_PREFETCH_LOOKAHEAD / page), 1,
+                          DT_MIPMAP_PREFETCH_MAX_PAGES);
+  const gboolean forward = prefetch->velocity >= 0.0f;
+
+  int32_t start, count;
+  if(forward)
+  {
+    start = offset + page;
+    count = MIN(MIN(pages * page, DT_MIPMAP_PREFETCH_MAX_IMAGES), collection_count - start);
+  }
+  else
+  {
+    start = MAX(0, offset - MIN(pages * page, DT_MIPMAP_PREFETCH_MAX_IMAGES));
+    count = offset - start;
+  }
+  if(count <= 0) return;
+
+  int32_t *imgids = (int32_t *)malloc(sizeof(int32_t) * count);
+  if(!imgids) return;
+  int32_t num = 0;
+
+  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(query);
+  DT_DEBUG_SQLITE3_RESET(query);
+  DT_DEBUG_SQLITE3_BIND_INT(query, 1, start);
+  DT_DEBUG_SQLITE3_BIND_INT(query, 2, count);
+  while(num < count && sqlite3_step(query) == SQLITE_ROW) imgids[num++] = sqlite3_column_int(query, 0);
+
+  // the jobs run in fifo order, so queue the ones closest to the viewport first
+  for(int32_t k = 0; k < num; k++)
+  {
+    const int32_t imgid = imgids[forward ? k : num - 1 - k];
+    if(g_hash_table_contains(prefetch->pending, GINT_TO_POINTER(imgid))) continue;
+    const gint generation = g_atomic_int_get(&prefetch->generation->value);
+    g_hash_table_insert(prefetch->pending, GINT_TO_POINTER(imgid), GINT_TO_POINTER(generation));
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG,
+                       dt_image_prefetch_job_create(imgid, mip, prefetch->generation, generation));
+    prefetch->requested++;
+  }
+
+  free(imgids);
+}
+
+void dt_mipmap_prefetch_shown(dt_mipmap_prefetch_t *prefetch, int32_t imgid, gboolean ready)
+{
+  if(!g_hash_table_remove(prefetch->pending, GINT_TO_POINTER(imgid))) return;
+  if(ready)
+    prefetch->hits++;
+  else
+    prefetch->late++;
+}
+
+void dt_mipmap_prefetch_print(dt_mipmap_prefetch_t *prefetch, const char *name)
+{
+  const uint64_t shown = prefetch->hits + prefetch->late;
+  dt_print(DT_DEBUG_CACHE, "[mipmap_prefetch] %s: %" PRIu64 " requested, %" PRIu64 " shown, hit rate %.1f%%, %"
+                           PRIu64 " cancelled\n",
+           name, prefetch->requested, shown, shown ? 100.0 * prefetch->hits / shown : 0.0, prefetch->cancelled);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
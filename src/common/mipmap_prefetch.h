@@ -0,0 +1,71 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_COMMON_MIPMAP_PREFETCH_H
+#define DT_COMMON_MIPMAP_PREFETCH_H
+
+#include "common/mipmap_cache.h"
+#include "control/jobs/image_jobs.h"
+
+#include <glib.h>
+#include <inttypes.h>
+#include <sqlite3.h>
+
+/*
+ * scroll aware thumbnail prefetching for lighttable and filmstrip.
+ *
+ * the views report the collection position of their first visible thumbnail on every expose.
+ * from that we estimate scroll direction and speed and queue low priority mip loads for the
+ * pages the user is about to see. when the view jumps somewhere else, everything still in the
+ * queue is stale and gets skipped by the load jobs.
+ */
+
+typedef struct dt_mipmap_prefetch_t
+{
+  int32_t last_offset;  // first visible position at the last update, -1 if unknown
+  double last_time;
+  float velocity;       // smoothed scroll speed in positions per second, negative when going back
+  // bumped when queued prefetches become stale, checked by the jobs
+  dt_image_prefetch_generation_t *generation;
+  GHashTable *pending;  // imgid -> generation, prefetched but not seen on screen yet
+
+  // statistics
+  uint64_t requested;   // prefetch jobs queued
+  uint64_t hits;        // prefetched thumbnails that were ready when they scrolled into view
+  uint64_t late;        // prefetched thumbnails that scrolled into view before they were ready
+  uint64_t cancelled;   // prefetches dropped because the view jumped away
+} dt_mipmap_prefetch_t;
+
+void dt_mipmap_prefetch_init(dt_mipmap_prefetch_t *prefetch);
+void dt_mipmap_prefetch_cleanup(dt_mipmap_prefetch_t *prefetch);
+
+/** report the current view position and queue loads for what comes next.
+ *  query has to return image ids in collection order for the bindings ?1 = offset and ?2 = limit,
+ *  offset is the collection position of the first visible thumbnail and page the number of visible ones. */
+void dt_mipmap_prefetch_update(dt_mipmap_prefetch_t *prefetch, sqlite3_stmt *query, int32_t offset,
+                               int32_t page, int32_t collection_count, dt_mipmap_size_t mip);
+/** a thumbnail got drawn, ready tells if it was drawn with the mip that was asked for. */
+void dt_mipmap_prefetch_shown(dt_mipmap_prefetch_t *prefetch, int32_t imgid, gboolean ready);
+/** print the hit rate, with -d cache. */
+void dt_mipmap_prefetch_print(dt_mipmap_prefetch_t *prefetch, const char *name);
+
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
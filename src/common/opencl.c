@@ -37,6 +37,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <float.h>
 #include <libgen.h>
 #include <sys/stat.h>
 #include <zlib.h>
@@ -54,6 +55,10 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
 {
   char *str;
   dt_pthread_mutex_init(&cl->lock, NULL);
+  dt_pthread_mutex_init(&cl->scheduler_lock, NULL);
+  cl->module_costs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+  dt_pthread_mutex_init(&cl->pool_lock, NULL);
+  cl->pool_objects = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
   cl->inited = 0;
   cl->enabled = 0;
   cl->stopped = 0;
@@ -77,6 +82,8 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
   cl->synch_cache = dt_conf_get_bool("opencl_synch_cache");
   cl->micro_nap = dt_conf_get_int("opencl_micro_nap");
   cl->enable_markesteijn = dt_conf_get_bool("opencl_enable_markesteijn");
+  cl->scheduler = dt_conf_get_bool("opencl_scheduler");
+  cl->pool_limit = (size_t)MAX(0, dt_conf_get_int("opencl_memory_pool")) * 1024 * 1024;
   cl->crc = 0;
   cl->dlocl = NULL;
   cl->dev_priority_image = NULL;
@@ -128,6 +135,8 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
            dt_conf_get_bool("opencl_avoid_atomics"));
   dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_enable_markesteijn: %d\n",
            dt_conf_get_bool("opencl_enable_markesteijn"));
+  dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_scheduler: %d\n", dt_conf_get_bool("opencl_scheduler"));
+  dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_memory_pool: %d\n", dt_conf_get_int("opencl_memory_pool"));
 
 
   dt_print(DT_DEBUG_OPENCL, "[opencl_init] \n");
@@ -239,6 +248,11 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
     cl->dev[dev].totallost = 0;
     cl->dev[dev].summary = CL_COMPLETE;
     cl->dev[dev].used_global_mem = 0;
+    g_queue_init(&cl->dev[dev].pool_free);
+    cl->dev[dev].pool_free_bytes = 0;
+    cl->dev[dev].pool_allocs = 0;
+    cl->dev[dev].pool_hits = 0;
+    cl->dev[dev].pool_evictions = 0;
     cl->dev[dev].nvidia_sm_20 = 0;
     cl->dev[dev].vendor = NULL;
     cl->dev[dev].name = NULL;
@@ -362,6 +376,7 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
     }
 
     dt_pthread_mutex_init(&cl->dev[dev].lock, NULL);
+    cl->dev[dev].busy_until = 0.0;
 
     cl->dev[dev].context = (cl->dlocl->symbols->dt_clCreateContext)(0, 1, &devid, NULL, NULL, &err);
     if(err != CL_SUCCESS)
@@ -620,6 +635,7 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
     dt_interpolation_free_cl_global(cl->interpolation);
     for(int i = 0; i < cl->num_devs; i++)
     {
+      dt_opencl_pool_flush(i);
       dt_pthread_mutex_destroy(&cl->dev[i].lock);
       for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++)
         if(cl->dev[i].kernel_used[k]) (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[i].kernel[k]);
@@ -641,6 +657,12 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
                    cl->dev[i].name);
         }
       }
+      if(cl->print_statistics && cl->dev[i].pool_allocs)
+      {
+        dt_print(DT_DEBUG_OPENCL, "[opencl_summary_statistics] device '%s': %d out of %d allocations were "
+                                  "served from the memory pool, %d buffers evicted\n",
+                 cl->dev[i].name, cl->dev[i].pool_hits, cl->dev[i].pool_allocs, cl->dev[i].pool_evictions);
+      }
       if(cl->use_events)
       {
         dt_opencl_events_reset(i);
@@ -667,6 +689,10 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
   }
 
   free(cl->dev);
+  g_hash_table_destroy(cl->pool_objects);
+  dt_pthread_mutex_destroy(&cl->pool_lock);
+  g_hash_table_destroy(cl->module_costs);
+  dt_pthread_mutex_destroy(&cl->scheduler_lock);
   dt_pthread_mutex_destroy(&cl->lock);
 }
 
@@ -1089,30 +1115,29 @@ static void dt_opencl_priorities_parse(dt_opencl_t *cl, const char *configstr)
 }
 
 
-int dt_opencl_lock_device(const int pipetype)
+static const int *dt_opencl_get_priority(dt_opencl_t *cl, const int pipetype)
 {
-  dt_opencl_t *cl = darktable.opencl;
-  if(!cl->inited) return -1;
-
-  const int *priority;
-
   switch(pipetype)
   {
     case DT_DEV_PIXELPIPE_FULL:
-      priority = cl->dev_priority_image;
-      break;
+      return cl->dev_priority_image;
     case DT_DEV_PIXELPIPE_PREVIEW:
-      priority = cl->dev_priority_preview;
-      break;
+      return cl->dev_priority_preview;
     case DT_DEV_PIXELPIPE_EXPORT:
-      priority = cl->dev_priority_export;
-      break;
+      return cl->dev_priority_export;
     case DT_DEV_PIXELPIPE_THUMBNAIL:
-      priority = cl->dev_priority_thumbnail;
-      break;
+      return cl->dev_priority_thumbnail;
     default:
-      priority = NULL;
+      return NULL;
   }
+}
+
+int dt_opencl_lock_device(const int pipetype)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited) return -1;
+
+  const int *priority = dt_opencl_get_priority(cl, pipetype);
 
   if(priority)
   {
@@ -1137,11 +1162,134 @@ int dt_opencl_lock_device(const int pipetype)
   return -1;
 }
 
+// weight of a new timing in the running average of a module's cost
+#define DT_OPENCL_SCHEDULER_WEIGHT 0.25f
+// how much longer than predicted we wait for a busy device before giving up on it
+#define DT_OPENCL_SCHEDULER_SLACK 1.5
+
+// seconds per megapixel of output of a module in a given pipe type, on the cpu at index 0 followed by all
+// devices. negative if we have never seen the module run there.
+static float *dt_opencl_scheduler_costs(dt_opencl_t *cl, const int pipetype, const char *op, const gboolean create)
+{
+  gchar *key = g_strdup_printf("%d/%s", pipetype, op);
+  float *costs = (float *)g_hash_table_lookup(cl->module_costs, key);
+  if(!costs && create)
+  {
+    costs = (float *)malloc(sizeof(float) * (cl->num_devs + 1));
+    for(int k = 0; k <= cl->num_devs; k++) costs[k] = -1.0f;
+    g_hash_table_insert(cl->module_costs, key, costs);
+    return costs;
+  }
+  g_free(key);
+  return costs;
+}
+
+void dt_opencl_scheduler_record(const int devid, const int pipetype, const char *op, const size_t pixels,
+                                const double seconds)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || pixels == 0 || devid >= cl->num_devs) return;
+
+  const float cost = seconds * 1e6 / pixels;
+  dt_pthread_mutex_lock(&cl->scheduler_lock);
+  float *costs = dt_opencl_scheduler_costs(cl, pipetype, op, TRUE);
+  float *c = costs + MAX(devid, -1) + 1;
+  *c = *c < 0.0f ? cost : *c + DT_OPENCL_SCHEDULER_WEIGHT * (cost - *c);
+  dt_pthread_mutex_unlock(&cl->scheduler_lock);
+}
+
+// predicted seconds for running all of ops on devid (the cpu if < 0), negative if we can't tell.
+// modules that never ran on the device are assumed to fall back to the cpu, like they would in the pipe.
+// to be called with the scheduler lock held.
+static double dt_opencl_scheduler_predict(dt_opencl_t *cl, const int devid, const int pipetype, GList *ops,
+                                          const size_t pixels)
+{
+  double total = 0.0;
+  for(GList *iter = ops; iter; iter = g_list_next(iter))
+  {
+    const float *costs = dt_opencl_scheduler_costs(cl, pipetype, (const char *)iter->data, FALSE);
+    if(!costs) return -1.0;
+    const float c = costs[devid + 1] >= 0.0f ? costs[devid + 1] : costs[0];
+    if(c < 0.0f) return -1.0;
+    total += c;
+  }
+  return total * pixels * 1e-6;
+}
+
+int dt_opencl_lock_device_scheduled(const int pipetype, GList *ops, const size_t pixels)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited) return -1;
+
+  double now = dt_get_wtime();
+  int devid = dt_opencl_lock_device(pipetype);
+
+  if(devid < 0 && cl->scheduler)
+  {
+    // all devices are busy: find the one expected to be done with our pipe first
+    const int *priority = dt_opencl_get_priority(cl, pipetype);
+    int best = -1;
+    double best_finish = DBL_MAX, best_wait = 0.0;
+
+    dt_pthread_mutex_lock(&cl->scheduler_lock);
+    const double cpu = dt_opencl_scheduler_predict(cl, -1, pipetype, ops, pixels);
+    for(int k = 0; k < cl->num_devs; k++)
+    {
+      const int dev = priority ? priority[k] : k;
+      if(dev < 0) break;
+      const double run = dt_opencl_scheduler_predict(cl, dev, pipetype, ops, pixels);
+      const double busy_until = cl->dev[dev].busy_until;
+      if(run < 0.0 || busy_until <= 0.0) continue;
+      const double wait = MAX(0.0, busy_until - now);
+      if(wait + run < best_finish)
+      {
+        best = dev;
+        best_finish = wait + run;
+        best_wait = wait;
+      }
+    }
+    dt_pthread_mutex_unlock(&cl->scheduler_lock);
+
+    if(best >= 0 && cpu >= 0.0 && best_finish < cpu)
+    {
+      dt_print(DT_DEBUG_OPENCL, "[opencl_scheduler] waiting %.3f secs for device %d, predicted %.3f secs there "
+                                "versus %.3f secs on the cpu\n",
+               best_wait, best, best_finish, cpu);
+      const double deadline = now + DT_OPENCL_SCHEDULER_SLACK * best_wait + 0.01;
+      while(dt_get_wtime() < deadline)
+      {
+        if(!dt_pthread_mutex_trylock(&cl->dev[best].lock))
+        {
+          devid = best;
+          break;
+        }
+        g_usleep(1000);
+      }
+      if(devid < 0)
+        dt_print(DT_DEBUG_OPENCL, "[opencl_scheduler] device %d is still busy, falling back to the cpu\n", best);
+      now = dt_get_wtime();
+    }
+  }
+
+  if(devid >= 0)
+  {
+    dt_pthread_mutex_lock(&cl->scheduler_lock);
+    const double run = dt_opencl_scheduler_predict(cl, devid, pipetype, ops, pixels);
+    cl->dev[devid].busy_until = run >= 0.0 ? now + run : 0.0;
+    dt_pthread_mutex_unlock(&cl->scheduler_lock);
+  }
+
+  return devid;
+}
+
 void dt_opencl_unlock_device(const int dev)
 {
   dt_opencl_t *cl = darktable.opencl;
   if(!cl->inited) return;
   if(dev < 0 || dev >= cl->num_devs) return;
+  dt_pthread_mutex_lock(&cl->scheduler_lock);
+  cl->dev[dev].busy_until = 0.0;
+  dt_pthread_mutex_unlock(&cl->scheduler_lock);
   dt_pthread_mutex_unlock(&cl->dev[dev].lock);
 }
 
@@ -1832,10 +1980,105 @@ void *dt_opencl_copy_host_to_device_rowpitch(const int devid, void *host, const
 }
 
 
+/** pooled images and buffers. all commands of a device go through one in-order queue, so an object released
+ * by one module can be handed to the next one right away. */
+typedef struct dt_opencl_pool_object_t
+{
+  cl_mem mem;
+  int devid;
+  int width, height, bpp; // images only, width is 0 for buffers
+  size_t size;
+} dt_opencl_pool_object_t;
+
+// buffers are bucketed to 1/8th steps between powers of two, so slightly varying sizes still find a match
+static size_t dt_opencl_pool_bucket(const size_t size)
+{
+  size_t step = 1;
+  while(step * 16 <= size) step <<= 1;
+  return (size + step - 1) / step * step;
+}
+
+// take a matching unused object from the pool, the one released last
+static cl_mem dt_opencl_pool_get(const int devid, const int width, const int height, const int bpp,
+                                 const size_t size)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  cl_mem mem = NULL;
+  dt_pthread_mutex_lock(&cl->pool_lock);
+  cl->dev[devid].pool_allocs++;
+  for(GList *iter = g_queue_peek_tail_link(&cl->dev[devid].pool_free); iter; iter = g_list_previous(iter))
+  {
+    dt_opencl_pool_object_t *o = (dt_opencl_pool_object_t *)iter->data;
+    if(o->width == width && o->height == height && o->bpp == bpp && o->size == size)
+    {
+      g_queue_delete_link(&cl->dev[devid].pool_free, iter);
+      cl->dev[devid].pool_free_bytes -= o->size;
+      cl->dev[devid].pool_hits++;
+      mem = o->mem;
+      break;
+    }
+  }
+  dt_pthread_mutex_unlock(&cl->pool_lock);
+  return mem;
+}
+
+static void dt_opencl_pool_add(cl_mem mem, const int devid, const int width, const int height, const int bpp,
+                               const size_t size)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!mem) return;
+  dt_opencl_pool_object_t *o = (dt_opencl_pool_object_t *)malloc(sizeof(dt_opencl_pool_object_t));
+  *o = (dt_opencl_pool_object_t){ mem, devid, width, height, bpp, size };
+  dt_pthread_mutex_lock(&cl->pool_lock);
+  g_hash_table_insert(cl->pool_objects, mem, o);
+  dt_pthread_mutex_unlock(&cl->pool_lock);
+}
+
+// drop the least recently released objects of a device until its unused ones fit into limit.
+// to be called with the pool lock held.
+static void dt_opencl_pool_shrink(const int devid, const size_t limit)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  while(cl->dev[devid].pool_free_bytes > limit)
+  {
+    dt_opencl_pool_object_t *o = (dt_opencl_pool_object_t *)g_queue_pop_head(&cl->dev[devid].pool_free);
+    cl->dev[devid].pool_free_bytes -= o->size;
+    cl->dev[devid].pool_evictions++;
+    (cl->dlocl->symbols->dt_clReleaseMemObject)(o->mem);
+    g_hash_table_remove(cl->pool_objects, o->mem);
+  }
+}
+
+void dt_opencl_pool_flush(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0) return;
+  dt_pthread_mutex_lock(&cl->pool_lock);
+  if(cl->dev[devid].pool_free_bytes)
+    dt_print(DT_DEBUG_OPENCL | DT_DEBUG_MEMORY, "[opencl_pool] freeing %zu MB of unused buffers on device %d\n",
+             cl->dev[devid].pool_free_bytes / (1024 * 1024), devid);
+  dt_opencl_pool_shrink(devid, 0);
+  dt_pthread_mutex_unlock(&cl->pool_lock);
+}
+
 void dt_opencl_release_mem_object(void *mem)
 {
-  if(!darktable.opencl->inited) return;
-  (darktable.opencl->dlocl->symbols->dt_clReleaseMemObject)(mem);
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited) return;
+
+  dt_pthread_mutex_lock(&cl->pool_lock);
+  dt_opencl_pool_object_t *o = (dt_opencl_pool_object_t *)g_hash_table_lookup(cl->pool_objects, mem);
+  if(o)
+  {
+    g_queue_push_tail(&cl->dev[o->devid].pool_free, o);
+    cl->dev[o->devid].pool_free_bytes += o->size;
+    dt_opencl_pool_shrink(o->devid, cl->pool_limit);
+    dt_pthread_mutex_unlock(&cl->pool_lock);
+    return;
+  }
+  dt_pthread_mutex_unlock(&cl->pool_lock);
+
+  (cl->dlocl->symbols->dt_clReleaseMemObject)(mem);
 }
 
 void *dt_opencl_map_buffer(const int devid, cl_mem buffer, const int blocking, const int flags, size_t offset,
@@ -1878,11 +2121,25 @@ void *dt_opencl_alloc_device(const int devid, const int width, const int height,
   else
     return NULL;
 
-  cl_mem dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
+  const size_t size = (size_t)width * height * bpp;
+  const int pooled = darktable.opencl->pool_limit > 0;
+  cl_mem dev = pooled ? dt_opencl_pool_get(devid, width, height, bpp, size) : NULL;
+  if(dev) return dev;
+
+  dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
       darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE, &fmt, width, height, 0, NULL, &err);
+  if(pooled && (err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES))
+  {
+    // maybe the pool is hogging the memory we need
+    dt_opencl_pool_flush(devid);
+    dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
+        darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE, &fmt, width, height, 0, NULL, &err);
+  }
   if(err != CL_SUCCESS)
     dt_print(DT_DEBUG_OPENCL, "[opencl alloc_device] could not alloc img buffer on device %d: %d\n", devid,
              err);
+  else if(pooled)
+    dt_opencl_pool_add(dev, devid, width, height, bpp, size);
   return dev;
 }
 
@@ -1920,11 +2177,25 @@ void *dt_opencl_alloc_device_buffer(const int devid, const size_t size)
   if(!darktable.opencl->inited) return NULL;
   cl_int err;
 
-  cl_mem buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
-                                                                     CL_MEM_READ_WRITE, size, NULL, &err);
+  const size_t bucket = dt_opencl_pool_bucket(size);
+  const int pooled = darktable.opencl->pool_limit > 0;
+  cl_mem buf = pooled ? dt_opencl_pool_get(devid, 0, 0, 0, bucket) : NULL;
+  if(buf) return buf;
+
+  buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
+                                                              CL_MEM_READ_WRITE, pooled ? bucket : size, NULL,
+                                                              &err);
+  if(pooled && (err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES))
+  {
+    dt_opencl_pool_flush(devid);
+    buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
+                                                                CL_MEM_READ_WRITE, bucket, NULL, &err);
+  }
   if(err != CL_SUCCESS)
     dt_print(DT_DEBUG_OPENCL, "[opencl alloc_device_buffer] could not alloc buffer on device %d: %d\n", devid,
              err);
+  else if(pooled)
+    dt_opencl_pool_add(buf, devid, 0, 0, 0, bucket);
   return buf;
 }
 
@@ -1971,6 +2242,11 @@ int dt_opencl_image_fits_device(const int devid, const size_t width, const size_
 
   if(darktable.opencl->dev[devid].max_global_mem < total + headroom) return FALSE;
 
+  // it fits, but maybe not next to what the pool keeps around for later
+  if(darktable.opencl->dev[devid].max_global_mem
+     < total + headroom + darktable.opencl->dev[devid].pool_free_bytes)
+    dt_opencl_pool_flush(devid);
+
   return TRUE;
 }
 
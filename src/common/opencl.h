@@ -94,6 +94,12 @@ typedef struct dt_opencl_device_t
   const char *options;
   cl_int summary;
   float benchmark;
+  // when the pipe holding the lock is expected to be done, 0 if unknown
+  double busy_until;
+  // released images and buffers kept for reuse, least recently released first
+  GQueue pool_free;
+  size_t pool_free_bytes;
+  int pool_allocs, pool_hits, pool_evictions;
 } dt_opencl_device_t;
 
 struct dt_bilateral_cl_global_t;
@@ -133,6 +139,16 @@ typedef struct dt_opencl_t
 
   // global kernels for interpolation resampling.
   struct dt_interpolation_cl_global_t *interpolation;
+
+  // running averages of module timings on the cpu and each device, see dt_opencl_scheduler_record()
+  int scheduler;
+  dt_pthread_mutex_t scheduler_lock;
+  GHashTable *module_costs;
+
+  // pool of device images and buffers, see dt_opencl_alloc_device()
+  dt_pthread_mutex_t pool_lock;
+  GHashTable *pool_objects; // all pooled cl_mem, in use or not
+  size_t pool_limit;        // max bytes of unused objects kept per device
 } dt_opencl_t;
 
 /** inits the opencl subsystem. */
@@ -150,9 +166,18 @@ int dt_opencl_enqueue_barrier(const int devid);
 /** locks a device for your thread's exclusive use */
 int dt_opencl_lock_device(const int pipetype);
 
+/** like dt_opencl_lock_device(), but when all devices are busy this waits for the one predicted to finish
+ * the modules in ops first, as long as that is expected to be faster than running them on the cpu. */
+int dt_opencl_lock_device_scheduled(const int pipetype, GList *ops, const size_t pixels);
+
 /** done with your command queue. */
 void dt_opencl_unlock_device(const int dev);
 
+/** record that module op took seconds in a pipe of pipetype producing pixels, on device devid or on the cpu
+ * for devid < 0. */
+void dt_opencl_scheduler_record(const int devid, const int pipetype, const char *op, const size_t pixels,
+                                const double seconds);
+
 /** calculates md5sums for a list of CL include files. */
 void dt_opencl_md5sum(const char **files, char **md5sums);
 
@@ -250,6 +275,8 @@ void *dt_opencl_copy_host_to_device_constant(const int devid, const size_t size,
 int dt_opencl_enqueue_copy_image(const int devid, cl_mem src, cl_mem dst, size_t *orig_src, size_t *orig_dst,
                                  size_t *region);
 
+/** images from here and buffers from dt_opencl_alloc_device_buffer() come from a per device pool and go back
+ * there in dt_opencl_release_mem_object(). */
 void *dt_opencl_alloc_device(const int devid, const int width, const int height, const int bpp);
 
 void *dt_opencl_alloc_device_use_host_pointer(const int devid, const int width, const int height,
@@ -276,6 +303,9 @@ void *dt_opencl_alloc_device_buffer_with_flags(const int devid, const size_t siz
 
 void dt_opencl_release_mem_object(void *mem);
 
+/** free all unused pooled images and buffers of a device. */
+void dt_opencl_pool_flush(const int devid);
+
 void *dt_opencl_map_buffer(const int devid, cl_mem buffer, const int blocking, const int flags, size_t offset,
                            size_t size);
 
@@ -342,9 +372,17 @@ static inline int dt_opencl_lock_device(const int dev)
 {
   return -1;
 }
+static inline int dt_opencl_lock_device_scheduled(const int pipetype, GList *ops, const size_t pixels)
+{
+  return -1;
+}
 static inline void dt_opencl_unlock_device(const int dev)
 {
 }
+static inline void dt_opencl_scheduler_record(const int devid, const int pipetype, const char *op,
+                                              const size_t pixels, const double seconds)
+{
+}
 static inline int dt_opencl_load_program(const int dev, const char *filename)
 {
   return -1;
@@ -414,6 +452,9 @@ static inline int dt_opencl_get_max_global_mem(const int devid)
 static inline void dt_opencl_release_mem_object(void *mem)
 {
 }
+static inline void dt_opencl_pool_flush(const int devid)
+{
+}
 static inline void *dt_opencl_events_get_slot(const int devid, const char *tag)
 {
   return NULL;
@@ -0,0 +1,302 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/search_index.h"
+#include "common/darktable.h"
+#include "common/database.h"
+#include "common/debug.h"
+#include "common/metadata.h"
+#include "control/control.h"
+
+#include <sqlite3.h>
+#include <stdlib.h>
+#include <string.h>
+
+// images per statement while filling the index, so that we never block the database for long
+#define DT_SEARCH_INDEX_BATCH 2000
+
+typedef enum dt_search_index_state_t
+{
+  DT_SEARCH_INDEX_UNAVAILABLE, // no fts5 in this sqlite
+  DT_SEARCH_INDEX_EMPTY,
+  DT_SEARCH_INDEX_BUILDING,
+  DT_SEARCH_INDEX_READY
+} dt_search_index_state_t;
+
+typedef struct dt_search_index_t
+{
+  dt_pthread_mutex_t lock;
+  dt_search_index_state_t state;
+} dt_search_index_t;
+
+static const char *_column_names[DT_SEARCH_INDEX_LAST]
+    = { "filename", "lens", "creator", "publisher", "title", "description", "rights" };
+
+static const char *_trigger_names[]
+    = { "dt_search_index_image_insert", "dt_search_index_image_update", "dt_search_index_image_delete",
+        "dt_search_index_meta_insert",  "dt_search_index_meta_update",  "dt_search_index_meta_delete",
+        "dt_search_index_tag_insert",   "dt_search_index_tag_update",   "dt_search_index_tag_delete",
+        NULL };
+
+// insert or refresh the index rows of all images matching where
+static gchar *_image_rows(const char *where)
+{
+  return g_strdup_printf("INSERT OR REPLACE INTO memory.search_images "
+                         "(rowid, filename, lens, creator, publisher, title, description, rights) "
+                         "SELECT i.id, i.filename, i.lens, "
+                         "(SELECT value FROM main.meta_data AS m WHERE m.id = i.id AND m.key = %d), "
+                         "(SELECT value FROM main.meta_data AS m WHERE m.id = i.id AND m.key = %d), "
+                         "(SELECT value FROM main.meta_data AS m WHERE m.id = i.id AND m.key = %d), "
+                         "(SELECT value FROM main.meta_data AS m WHERE m.id = i.id AND m.key = %d), "
+                         "(SELECT value FROM main.meta_data AS m WHERE m.id = i.id AND m.key = %d) "
+                         "FROM main.images AS i WHERE %s",
+                         DT_METADATA_XMP_DC_CREATOR, DT_METADATA_XMP_DC_PUBLISHER, DT_METADATA_XMP_DC_TITLE,
+                         DT_METADATA_XMP_DC_DESCRIPTION, DT_METADATA_XMP_DC_RIGHTS, where);
+}
+
+static void _create_triggers(sqlite3 *db)
+{
+  gchar *new_row = _image_rows("i.id = new.id");
+  gchar *old_row = _image_rows("i.id = old.id");
+  gchar *triggers[] = {
+    g_strdup_printf("CREATE TEMP TRIGGER dt_search_index_image_insert AFTER INSERT ON main.images "
+                    "BEGIN %s; END", new_row),
+    g_strdup_printf("CREATE TEMP TRIGGER dt_search_index_image_update AFTER UPDATE OF filename, lens ON main.images "
+                    "BEGIN %s; END", new_row),
+    g_strdup("CREATE TEMP TRIGGER dt_search_index_image_delete AFTER DELETE ON main.images "
+             "BEGIN DELETE FROM memory.search_images WHERE rowid = old.id; END"),
+    g_strdup_printf("CREATE TEMP TRIGGER dt_search_index_meta_insert AFTER INSERT ON main.meta_data "
+                    "BEGIN %s; END", new_row),
+    g_strdup_printf("CREATE TEMP TRIGGER dt_search_index_meta_update AFTER UPDATE ON main.meta_data "
+                    "BEGIN %s; %s; END", old_row, new_row),
+    g_strdup_printf("CREATE TEMP TRIGGER dt_search_index_meta_delete AFTER DELETE ON main.meta_data "
+                    "BEGIN %s; END", old_row),
+    g_strdup("CREATE TEMP TRIGGER dt_search_index_tag_insert AFTER INSERT ON main.tags "
+             "BEGIN INSERT OR REPLACE INTO memory.search_tags (rowid, name) VALUES (new.id, new.name); END"),
+    g_strdup("CREATE TEMP TRIGGER dt_search_index_tag_update AFTER UPDATE OF id, name ON main.tags "
+             "BEGIN DELETE FROM memory.search_tags WHERE rowid = old.id; "
+             "INSERT OR REPLACE INTO memory.search_tags (rowid, name) VALUES (new.id, new.name); END"),
+    g_strdup("CREATE TEMP TRIGGER dt_search_index_tag_delete AFTER DELETE ON main.tags "
+             "BEGIN DELETE FROM memory.search_tags WHERE rowid = old.id; END"),
+    NULL
+  };
+  for(int k = 0; triggers[k]; k++)
+  {
+    DT_DEBUG_SQLITE3_EXEC(db, triggers[k], NULL, NULL, NULL);
+    g_free(triggers[k]);
+  }
+  g_free(new_row);
+  g_free(old_row);
+}
+
+static double _time_count(sqlite3 *db, const char *query, const char *pattern, int *count)
+{
+  sqlite3_stmt *stmt;
+  const double start = dt_get_wtime();
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query, -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, pattern, -1, SQLITE_TRANSIENT);
+  *count = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+  sqlite3_finalize(stmt);
+  return 1000.0 * (dt_get_wtime() - start);
+}
+
+// compare the plain like queries with the indexed ones on a substring taken from the library itself
+static void _benchmark(sqlite3 *db)
+{
+  for(int c = 0; c <= DT_SEARCH_INDEX_LAST; c++)
+  {
+    const gboolean tags = c == DT_SEARCH_INDEX_LAST;
+    const char *column = tags ? "name" : _column_names[c];
+    const char *table = tags ? "memory.search_tags" : "memory.search_images";
+
+    sqlite3_stmt *stmt;
+    gchar *query = g_strdup_printf("SELECT '%%' || substr(%s, length(%s) / 2, 3) || '%%' FROM %s "
+                                   "WHERE length(%s) >= 6 LIMIT 1",
+                                   column, column, table, column);
+    DT_DEBUG_SQLITE3_PREPARE_V2(db, query, -1, &stmt, NULL);
+    gchar *pattern = sqlite3_step(stmt) == SQLITE_ROW ? g_strdup((const char *)sqlite3_column_text(stmt, 0)) : NULL;
+    sqlite3_finalize(stmt);
+    g_free(query);
+    if(!pattern) continue;
+
+    gchar *like;
+    if(tags)
+      like = g_strdup("SELECT count(*) FROM main.tags WHERE name LIKE ?1");
+    else if(c <= DT_SEARCH_INDEX_LENS)
+      like = g_strdup_printf("SELECT count(*) FROM main.images WHERE %s LIKE ?1", column);
+    else
+    {
+      const int key[] = { DT_METADATA_XMP_DC_CREATOR, DT_METADATA_XMP_DC_PUBLISHER, DT_METADATA_XMP_DC_TITLE,
+                          DT_METADATA_XMP_DC_DESCRIPTION, DT_METADATA_XMP_DC_RIGHTS };
+      like = g_strdup_printf("SELECT count(DISTINCT id) FROM main.meta_data WHERE key = %d AND value LIKE ?1",
+                             key[c - DT_SEARCH_INDEX_CREATOR]);
+    }
+    gchar *indexed = g_strdup_printf("SELECT count(*) FROM %s WHERE %s LIKE ?1", table, column);
+
+    int like_count, index_count;
+    const double like_time = _time_count(db, like, pattern, &like_count);
+    const double index_time = _time_count(db, indexed, pattern, &index_count);
+    dt_print(DT_DEBUG_PERF, "[search_index] %s like '%s': %.3fms (%d rows) plain, %.3fms (%d rows) indexed%s\n",
+             tags ? "tag" : column, pattern, like_time, like_count, index_time, index_count,
+             like_count == index_count ? "" : " MISMATCH");
+
+    g_free(like);
+    g_free(indexed);
+    g_free(pattern);
+  }
+}
+
+static int32_t _build_job_run(dt_job_t *job)
+{
+  dt_search_index_t *index = dt_control_job_get_params(job);
+  sqlite3 *db = dt_database_get(darktable.db);
+  const double start = dt_get_wtime();
+
+  DT_DEBUG_SQLITE3_EXEC(db, "INSERT OR REPLACE INTO memory.search_tags (rowid, name) SELECT id, name FROM main.tags",
+                        NULL, NULL, NULL);
+
+  int32_t max_id = 0;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "SELECT MAX(id) FROM main.images", -1, &stmt, NULL);
+  if(sqlite3_step(stmt) == SQLITE_ROW) max_id = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  // images changing meanwhile are taken care of by the triggers already, replacing their rows is harmless
+  gchar *query = _image_rows("i.id > ?1 AND i.id <= ?2");
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query, -1, &stmt, NULL);
+  g_free(query);
+  gboolean cancelled = FALSE;
+  for(int32_t id = 0; id < max_id && !cancelled; id += DT_SEARCH_INDEX_BATCH)
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, id + DT_SEARCH_INDEX_BATCH);
+    sqlite3_step(stmt);
+    DT_DEBUG_SQLITE3_RESET(stmt);
+    // don't hold up shutting down
+    cancelled = !dt_control_running();
+  }
+  sqlite3_finalize(stmt);
+
+  dt_pthread_mutex_lock(&index->lock);
+  index->state = cancelled ? DT_SEARCH_INDEX_EMPTY : DT_SEARCH_INDEX_READY;
+  dt_pthread_mutex_unlock(&index->lock);
+  if(cancelled) return 0;
+
+  dt_print(DT_DEBUG_PERF, "[search_index] indexed %d image ids in %.3f secs\n", max_id, dt_get_wtime() - start);
+  if(darktable.unmuted & DT_DEBUG_PERF) _benchmark(db);
+  return 0;
+}
+
+// kick off the background fill the first time someone wants to search. returns TRUE if the index can be used.
+static gboolean _usable(dt_search_index_t *index)
+{
+  if(!index) return FALSE;
+  dt_pthread_mutex_lock(&index->lock);
+  // the job system only exists with a gui, and isn't up yet while the collection is set up during init
+  if(index->state == DT_SEARCH_INDEX_EMPTY && darktable.control && darktable.control->thread
+     && dt_control_running())
+  {
+    dt_job_t *job = dt_control_job_create(&_build_job_run, "build search index");
+    if(job)
+    {
+      dt_control_job_set_params(job, index, NULL);
+      index->state = DT_SEARCH_INDEX_BUILDING;
+      dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+    }
+  }
+  const gboolean ready = index->state == DT_SEARCH_INDEX_READY;
+  dt_pthread_mutex_unlock(&index->lock);
+  return ready;
+}
+
+// the trigram index is only used for like patterns with at least three literal characters in a row,
+// everything else would end up scanning the fts table, which is slower than the original query
+static gboolean _indexable(const char *pattern)
+{
+  int run = 0;
+  for(const char *c = pattern; c && *c; c = g_utf8_next_char(c))
+  {
+    if(*c == '%' || *c == '_')
+      run = 0;
+    else if(++run >= 3)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+gchar *dt_search_index_images_like(dt_search_index_t *index, dt_search_index_column_t column, const char *pattern)
+{
+  if(column < 0 || column >= DT_SEARCH_INDEX_LAST || !_indexable(pattern) || !_usable(index)) return NULL;
+  return g_strdup_printf("SELECT rowid FROM memory.search_images WHERE %s LIKE '%s'", _column_names[column],
+                         pattern);
+}
+
+gchar *dt_search_index_tags_like(dt_search_index_t *index, const char *pattern)
+{
+  if(!_indexable(pattern) || !_usable(index)) return NULL;
+  return g_strdup_printf("SELECT rowid FROM memory.search_tags WHERE name LIKE '%s'", pattern);
+}
+
+dt_search_index_t *dt_search_index_init()
+{
+  dt_search_index_t *index = (dt_search_index_t *)calloc(1, sizeof(dt_search_index_t));
+  dt_pthread_mutex_init(&index->lock, NULL);
+
+  // not every sqlite is built with fts5, and the trigram tokenizer is fairly new. no error if it isn't there.
+  sqlite3 *db = dt_database_get(darktable.db);
+  if(sqlite3_exec(db, "CREATE VIRTUAL TABLE memory.search_images USING fts5"
+                      "(filename, lens, creator, publisher, title, description, rights, tokenize = 'trigram')",
+                  NULL, NULL, NULL) != SQLITE_OK
+     || sqlite3_exec(db, "CREATE VIRTUAL TABLE memory.search_tags USING fts5(name, tokenize = 'trigram')", NULL,
+                     NULL, NULL) != SQLITE_OK)
+  {
+    dt_print(DT_DEBUG_SQL, "[search_index] no fts5 trigram support, text filters won't be indexed: %s\n",
+             sqlite3_errmsg(db));
+    sqlite3_exec(db, "DROP TABLE IF EXISTS memory.search_images", NULL, NULL, NULL);
+    index->state = DT_SEARCH_INDEX_UNAVAILABLE;
+    return index;
+  }
+
+  _create_triggers(db);
+  index->state = DT_SEARCH_INDEX_EMPTY;
+  return index;
+}
+
+void dt_search_index_cleanup(dt_search_index_t *index)
+{
+  if(!index) return;
+
+  // the build job is gone by now, the job system has been shut down before us
+  if(index->state != DT_SEARCH_INDEX_UNAVAILABLE)
+  {
+    sqlite3 *db = dt_database_get(darktable.db);
+    for(int k = 0; _trigger_names[k]; k++)
+    {
+      gchar *query = g_strdup_printf("DROP TRIGGER IF EXISTS temp.%s", _trigger_names[k]);
+      DT_DEBUG_SQLITE3_EXEC(db, query, NULL, NULL, NULL);
+      g_free(query);
+    }
+  }
+
+  dt_pthread_mutex_destroy(&index->lock);
+  free(index);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,66 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_COMMON_SEARCH_INDEX_H
+#define DT_COMMON_SEARCH_INDEX_H
+
+#include <glib.h>
+
+/*
+ * trigram index for the text filters of the collect module and the tag suggestions.
+ *
+ * `like '%foo%'` can't use a b-tree index, so every keystroke used to scan the whole library.
+ * if sqlite comes with fts5 we keep two trigram tables in the in-memory database: one row per
+ * image with filename, lens and the xmp metadata, and one row per tag. sqlite answers `like`
+ * on those from the trigram index as long as the pattern has three characters in a row that
+ * aren't wildcards, with exactly the semantics of the plain `like`.
+ *
+ * the tables are filled by a background job the first time a search is done and kept
+ * up to date by temporary triggers. until they are complete, and whenever fts5 is missing,
+ * the functions below return NULL and callers stay with their old queries.
+ */
+
+typedef enum dt_search_index_column_t
+{
+  DT_SEARCH_INDEX_FILENAME = 0,
+  DT_SEARCH_INDEX_LENS,
+  DT_SEARCH_INDEX_CREATOR,
+  DT_SEARCH_INDEX_PUBLISHER,
+  DT_SEARCH_INDEX_TITLE,
+  DT_SEARCH_INDEX_DESCRIPTION,
+  DT_SEARCH_INDEX_RIGHTS,
+  DT_SEARCH_INDEX_LAST
+} dt_search_index_column_t;
+
+struct dt_search_index_t;
+
+struct dt_search_index_t *dt_search_index_init();
+void dt_search_index_cleanup(struct dt_search_index_t *index);
+
+/** sql subquery selecting the ids of the images whose column is like pattern, or NULL if the index can't
+ * help. pattern is already escaped for use inside single quotes. free with g_free(). */
+gchar *dt_search_index_images_like(struct dt_search_index_t *index, dt_search_index_column_t column,
+                                   const char *pattern);
+/** same for the ids of the tags with a name like pattern. */
+gchar *dt_search_index_tags_like(struct dt_search_index_t *index, const char *pattern);
+
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -21,6 +21,7 @@
 #include "common/collection.h"
 #include "common/darktable.h"
 #include "common/debug.h"
+#include "common/search_index.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include <glib.h>
@@ -427,13 +428,27 @@ uint32_t dt_tag_get_suggestions(const gchar *keyword, GList **result)
   gchar *keyword_expr = g_strdup_printf("%%%s%%", keyword);
 
   /* SELECT T.id FROM tags T WHERE T.name LIKE '%%%s%%';  --> into temp table */
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "INSERT INTO memory.tagq (id) SELECT id FROM tags T WHERE "
-                              "T.name LIKE ?1",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, keyword_expr, -1, SQLITE_TRANSIENT);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+  char *escaped_expr = sqlite3_mprintf("%q", keyword_expr);
+  gchar *indexed = dt_search_index_tags_like(darktable.search_index, escaped_expr);
+  sqlite3_free(escaped_expr);
+  if(indexed)
+  {
+    // the trigram index answers the like without scanning all tags
+    gchar *query = g_strdup_printf("INSERT INTO memory.tagq (id) %s", indexed);
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), query, NULL, NULL, NULL);
+    g_free(query);
+    g_free(indexed);
+  }
+  else
+  {
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "INSERT INTO memory.tagq (id) SELECT id FROM tags T WHERE "
+                                "T.name LIKE ?1",
+                                -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, keyword_expr, -1, SQLITE_TRANSIENT);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+  }
   g_free(keyword_expr);
 
   /*
@@ -0,0 +1,159 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/threadbudget.h"
+#include "common/darktable.h"
+#include "control/conf.h"
+
+#include <inttypes.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static const char *_class_names[DT_THREAD_BUDGET_CLASSES] = { "full", "preview", "export", "thumbnail" };
+
+static dt_thread_budget_class_t _pipe_type_to_class(dt_dev_pixelpipe_type_t type)
+{
+  if(type & DT_DEV_PIXELPIPE_FULL) return DT_THREAD_BUDGET_FULL;
+  if(type & DT_DEV_PIXELPIPE_PREVIEW) return DT_THREAD_BUDGET_PREVIEW;
+  if(type & DT_DEV_PIXELPIPE_THUMBNAIL) return DT_THREAD_BUDGET_THUMBNAIL;
+  return DT_THREAD_BUDGET_EXPORT;
+}
+
+static void _set_team_size(int32_t threads)
+{
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+}
+
+void dt_thread_budget_init(dt_thread_budget_t *budget, int32_t total)
+{
+  memset(budget, 0, sizeof(dt_thread_budget_t));
+  dt_pthread_mutex_init(&budget->lock, NULL);
+  budget->total = MAX(total, 1);
+
+  // relative share of the cores when several pipe types compete. the darkroom is what the user is
+  // looking at, so it gets the lion's share.
+  budget->weight[DT_THREAD_BUDGET_FULL] = MAX(dt_conf_get_int("threads/weight_full"), 1);
+  budget->weight[DT_THREAD_BUDGET_PREVIEW] = MAX(dt_conf_get_int("threads/weight_preview"), 1);
+  budget->weight[DT_THREAD_BUDGET_EXPORT] = MAX(dt_conf_get_int("threads/weight_export"), 1);
+  budget->weight[DT_THREAD_BUDGET_THUMBNAIL] = MAX(dt_conf_get_int("threads/weight_thumbnail"), 1);
+
+  budget->start_time = dt_get_wtime();
+  for(int k = 0; k < DT_THREAD_BUDGET_CLASSES; k++) budget->last_change[k] = budget->start_time;
+}
+
+void dt_thread_budget_cleanup(dt_thread_budget_t *budget)
+{
+  dt_thread_budget_print_stats(budget);
+  dt_pthread_mutex_destroy(&budget->lock);
+}
+
+/** integrate busy time and handed out threads of a class up to now. needs budget->lock to be held. */
+static void _account(dt_thread_budget_t *budget, dt_thread_budget_class_t cls)
+{
+  const double now = dt_get_wtime();
+  const double elapsed = now - budget->last_change[cls];
+  dt_thread_budget_stats_t *stats = &budget->stats[cls];
+  if(stats->active > 0) stats->busy_time += elapsed;
+  stats->thread_time += stats->granted * elapsed;
+  budget->last_change[cls] = now;
+}
+
+int32_t dt_thread_budget_acquire(dt_thread_budget_t *budget, dt_dev_pixelpipe_type_t type)
+{
+  const dt_thread_budget_class_t cls = _pipe_type_to_class(type);
+
+  dt_pthread_mutex_lock(&budget->lock);
+
+  _account(budget, cls);
+  dt_thread_budget_stats_t *stats = budget->stats;
+  stats[cls].active++;
+  stats[cls].runs++;
+
+  // weighted fair share among all running pipes, this one included
+  int32_t weights = 0, granted = 0;
+  for(int k = 0; k < DT_THREAD_BUDGET_CLASSES; k++)
+  {
+    weights += stats[k].active * budget->weight[k];
+    granted += stats[k].granted;
+  }
+  int32_t threads = (budget->total * budget->weight[cls] + weights / 2) / weights;
+
+  // background pipes only get what is left, the darkroom pipe may briefly
+  // oversubscribe until the others are done with their current run.
+  if(cls != DT_THREAD_BUDGET_FULL) threads = MIN(threads, budget->total - granted);
+  threads = CLAMP(threads, 1, budget->total);
+
+  stats[cls].granted += threads;
+
+  dt_pthread_mutex_unlock(&budget->lock);
+
+  dt_print(DT_DEBUG_PERF, "[thread_budget] %s pipe gets %d of %d threads\n", _class_names[cls], threads,
+           budget->total);
+
+  _set_team_size(threads);
+  return threads;
+}
+
+void dt_thread_budget_release(dt_thread_budget_t *budget, dt_dev_pixelpipe_type_t type, int32_t threads)
+{
+  const dt_thread_budget_class_t cls = _pipe_type_to_class(type);
+
+  dt_pthread_mutex_lock(&budget->lock);
+  _account(budget, cls);
+  budget->stats[cls].active--;
+  budget->stats[cls].granted -= threads;
+  dt_pthread_mutex_unlock(&budget->lock);
+
+  _set_team_size(darktable.num_openmp_threads);
+}
+
+void dt_thread_budget_get_stats(dt_thread_budget_t *budget, dt_thread_budget_class_t cls,
+                                dt_thread_budget_stats_t *stats)
+{
+  if(((unsigned int)cls) >= DT_THREAD_BUDGET_CLASSES || !stats) return;
+  dt_pthread_mutex_lock(&budget->lock);
+  _account(budget, cls);
+  *stats = budget->stats[cls];
+  dt_pthread_mutex_unlock(&budget->lock);
+}
+
+void dt_thread_budget_print_stats(dt_thread_budget_t *budget)
+{
+  if(!(darktable.unmuted & DT_DEBUG_PERF)) return;
+
+  const double uptime = MAX(dt_get_wtime() - budget->start_time, 1e-6);
+  for(int k = 0; k < DT_THREAD_BUDGET_CLASSES; k++)
+  {
+    dt_thread_budget_stats_t stats;
+    dt_thread_budget_get_stats(budget, k, &stats);
+    // utilization is relative to all cores during the whole session
+    dt_print(DT_DEBUG_PERF, "[thread_budget] %-9s %6" PRIu64 " runs, busy %8.2fs, avg team %5.2f, "
+                            "utilization %5.1f%%\n",
+             _class_names[k], stats.runs, stats.busy_time,
+             stats.busy_time > 0.0 ? stats.thread_time / stats.busy_time : 0.0,
+             100.0 * stats.thread_time / (budget->total * uptime));
+  }
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
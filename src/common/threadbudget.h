@@ -0,0 +1,82 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2016 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_COMMON_THREADBUDGET_H
+#define DT_COMMON_THREADBUDGET_H
+
+#include "common/dtpthread.h"
+#include "develop/pixelpipe.h"
+
+#include <stdint.h>
+
+/*
+ * every worker thread may run a pixelpipe, and every pixelpipe runs openmp parallel
+ * sections. without coordination n concurrent pipes would each spawn a full team
+ * and oversubscribe the cpu n times. the thread budget hands out openmp team sizes
+ * per pipe run, weighted by pipe type, so that the darkroom pipe gets the bulk of
+ * the cores while thumbnails and exports share the rest.
+ */
+
+typedef enum dt_thread_budget_class_t
+{
+  DT_THREAD_BUDGET_FULL = 0,
+  DT_THREAD_BUDGET_PREVIEW,
+  DT_THREAD_BUDGET_EXPORT,
+  DT_THREAD_BUDGET_THUMBNAIL,
+  DT_THREAD_BUDGET_CLASSES
+} dt_thread_budget_class_t;
+
+typedef struct dt_thread_budget_stats_t
+{
+  uint64_t runs;        // number of pipe runs that asked for threads
+  int32_t active;       // pipes of this class currently running
+  int32_t granted;      // threads currently handed out to this class
+  double busy_time;     // accumulated wall time with at least one pipe of this class running
+  double thread_time;   // accumulated threads * seconds handed out
+} dt_thread_budget_stats_t;
+
+typedef struct dt_thread_budget_t
+{
+  dt_pthread_mutex_t lock;
+  int32_t total;  // number of openmp threads we may use in total
+  int32_t weight[DT_THREAD_BUDGET_CLASSES];
+  double start_time;
+  double last_change[DT_THREAD_BUDGET_CLASSES]; // last time active/granted of a class changed
+  dt_thread_budget_stats_t stats[DT_THREAD_BUDGET_CLASSES];
+} dt_thread_budget_t;
+
+void dt_thread_budget_init(dt_thread_budget_t *budget, int32_t total);
+void dt_thread_budget_cleanup(dt_thread_budget_t *budget);
+
+/** reserve an openmp team for a pipe run of the given type and set it for the calling thread.
+ *  returns the team size, which has to be passed to dt_thread_budget_release() once the pipe is done. */
+int32_t dt_thread_budget_acquire(dt_thread_budget_t *budget, dt_dev_pixelpipe_type_t type);
+/** give the threads back and restore the default team size for the calling thread. */
+void dt_thread_budget_release(dt_thread_budget_t *budget, dt_dev_pixelpipe_type_t type, int32_t threads);
+
+/** get a snapshot of the per class statistics. */
+void dt_thread_budget_get_stats(dt_thread_budget_t *budget, dt_thread_budget_class_t cls,
+                                dt_thread_budget_stats_t *stats);
+/** print the utilization per class, with -d perf. */
+void dt_thread_budget_print_stats(dt_thread_budget_t *budget);
+
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -185,10 +185,7 @@ void dt_control_shutdown(dt_control_t *s)
   s->running = 0;
   dt_pthread_mutex_unlock(&s->run_mutex);
   dt_pthread_mutex_unlock(&s->cond_mutex);
-  pthread_cond_broadcast(&s->cond);
-
-  /* first wait for kick_on_workers_thread */
-  pthread_join(s->kick_on_workers_thread, NULL);
+  dt_control_jobs_wake_all(s);
 
   int k;
   for(k = 0; k < s->num_threads; k++)
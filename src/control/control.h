@@ -181,13 +181,16 @@ typedef struct dt_control_t
   dt_pthread_mutex_t queue_mutex, cond_mutex, run_mutex;
   pthread_cond_t cond;
   int32_t num_threads;
-  pthread_t *thread, kick_on_workers_thread;
+  pthread_t *thread;
   dt_job_t **job;
+  int32_t idle_threads; // workers sleeping on cond, protected by queue_mutex
 
-  GList *queues[DT_JOB_QUEUE_MAX];
-  size_t queue_length[DT_JOB_QUEUE_MAX];
+  GQueue *queues[DT_JOB_QUEUE_MAX];
+  GHashTable *queued_jobs; // jobs in DT_JOB_QUEUE_SYSTEM_FG -> their link in the queue, for deduping
+  dt_control_queue_stats_t queue_stats[DT_JOB_QUEUE_MAX];
 
   dt_pthread_mutex_t res_mutex;
+  pthread_cond_t cond_res[DT_CTL_WORKER_RESERVED];
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
   uint8_t new_res[DT_CTL_WORKER_RESERVED];
   pthread_t thread_res[DT_CTL_WORKER_RESERVED];
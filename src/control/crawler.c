@@ -57,7 +57,8 @@ GList *dt_control_crawler_run()
   GList *result = NULL;
   gboolean look_for_xmp = dt_conf_get_bool("write_sidecar_files");
 
-  sqlite3_prepare_v2(dt_database_get(darktable.db),
+  // read from a snapshot of its own, so the updates below don't interfere with the scan
+  sqlite3_prepare_v2(dt_database_get_reader(darktable.db),
                      "SELECT images.id, write_timestamp, version, folder || '/' || filename, flags "
                      "FROM images, film_rolls WHERE images.film_id = film_rolls.id "
                      "ORDER BY film_rolls.id, filename",
@@ -65,11 +66,13 @@ GList *dt_control_crawler_run()
   sqlite3_prepare_v2(dt_database_get(darktable.db), "UPDATE images SET flags = ?1 WHERE id = ?2", -1,
                      &inner_stmt, NULL);
 
-  // let's wrap this into a transaction, it might make it a little faster.
-  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  // let's wrap this into a transaction, it might make it a little faster. committed every now and then, so
+  // it doesn't hold up others that want to write.
+  dt_database_start_transaction(darktable.db);
 
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
+    dt_database_yield_transaction(darktable.db);
     const int id = sqlite3_column_int(stmt, 0);
     const time_t timestamp = sqlite3_column_int(stmt, 1);
     const int version = sqlite3_column_int(stmt, 2);
@@ -171,7 +174,7 @@ GList *dt_control_crawler_run()
     g_free(extra_path);
   }
 
-  sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
 
   sqlite3_finalize(stmt);
   sqlite3_finalize(inner_stmt);
@@ -26,10 +26,6 @@
 #define DT_CONTROL_FG_PRIORITY 4
 #define DT_CONTROL_MAX_JOBS 30
 
-/* the queue can have scheduled jobs but all
-    the workers are sleeping, so this kicks the workers
-    on timed interval.
-*/
 typedef struct worker_thread_parameters_t
 {
   dt_control_t *self;
@@ -51,6 +47,9 @@ typedef struct _dt_job_t
   unsigned char priority;
   dt_job_queue_t queue;
 
+  guint hash;         // identity hash, computed when the job gets queued
+  double queued_time; // wall time when the job got queued, for latency statistics
+
   dt_job_state_change_callback state_changed_cb;
 
   dt_progress_t *progress;
@@ -62,16 +61,46 @@ typedef struct _dt_job_t
    match
     we don't want to compare result, priority or state since these will change during the course of
    processing.
+    jobs with sized params are compared by their params, all others by their description. this has to stay in
+   sync with dt_control_job_hash().
     NOTE: maybe allow to pass a comparator for params.
  */
-static inline int dt_control_job_equal(_dt_job_t *j1, _dt_job_t *j2)
+static inline int dt_control_job_equal(const _dt_job_t *j1, const _dt_job_t *j2)
 {
   if(!j1 || !j2) return 0;
-  if(j1->params_size != 0 && j1->params_size == j2->params_size)
-    return (j1->execute == j2->execute && j1->state_changed_cb == j2->state_changed_cb
-            && j1->queue == j2->queue && (memcmp(j1->params, j2->params, j1->params_size) == 0));
-  return (j1->execute == j2->execute && j1->state_changed_cb == j2->state_changed_cb && j1->queue == j2->queue
-          && (g_strcmp0(j1->description, j2->description) == 0));
+  if(j1->execute != j2->execute || j1->state_changed_cb != j2->state_changed_cb || j1->queue != j2->queue
+     || j1->params_size != j2->params_size)
+    return 0;
+  if(j1->params_size != 0) return memcmp(j1->params, j2->params, j1->params_size) == 0;
+  return g_strcmp0(j1->description, j2->description) == 0;
+}
+
+static inline guint dt_control_hash_bytes(guint hash, const void *data, size_t size)
+{
+  // fnv-1a, good enough to spread thumbnail jobs that only differ in their image id
+  const unsigned char *bytes = (const unsigned char *)data;
+  for(size_t k = 0; k < size; k++) hash = (hash ^ bytes[k]) * 16777619u;
+  return hash;
+}
+
+/** hash over the same fields dt_control_job_equal() looks at, so that queued jobs can be deduped in O(1) */
+static guint dt_control_job_hash(const _dt_job_t *job)
+{
+  const uintptr_t identity[4] = { (uintptr_t)job->execute, (uintptr_t)job->state_changed_cb,
+                                  (uintptr_t)job->queue, (uintptr_t)job->params_size };
+  guint hash = dt_control_hash_bytes(2166136261u, identity, sizeof(identity));
+  if(job->params_size != 0) return dt_control_hash_bytes(hash, job->params, job->params_size);
+  return dt_control_hash_bytes(hash, job->description, strlen(job->description));
+}
+
+static guint dt_control_job_hash_func(gconstpointer key)
+{
+  return ((const _dt_job_t *)key)->hash;
+}
+
+static gboolean dt_control_job_equal_func(gconstpointer a, gconstpointer b)
+{
+  return dt_control_job_equal((const _dt_job_t *)a, (const _dt_job_t *)b);
 }
 
 static void dt_control_job_set_state(_dt_job_t *job, dt_job_state_t state)
@@ -222,6 +251,23 @@ static int32_t dt_control_run_job_res(dt_control_t *control, int32_t res)
   return 0;
 }
 
+/** check if any of the queues has a job a worker is allowed to pick. needs queue_mutex to be held. */
+static gboolean dt_control_has_runnable_job(const dt_control_t *control)
+{
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  {
+    if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
+    if(!g_queue_is_empty(control->queues[i])) return TRUE;
+  }
+  return FALSE;
+}
+
+/** wake up exactly one sleeping worker, if there is any. needs queue_mutex to be held. */
+static void dt_control_wake_worker(dt_control_t *control)
+{
+  if(control->idle_threads > 0) pthread_cond_signal(&control->cond);
+}
+
 static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
 {
   /*
@@ -243,9 +289,9 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   int max_priority = -1;
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
   {
-    if(control->queues[i] == NULL) continue;
+    if(g_queue_is_empty(control->queues[i])) continue;
     if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *_job = (_dt_job_t *)control->queues[i]->data;
+    _dt_job_t *_job = (_dt_job_t *)g_queue_peek_head(control->queues[i]);
     if(_job->priority > max_priority)
     {
       max_priority = _job->priority;
@@ -265,9 +311,8 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   // invariant -> job is the one we are looking for
 
   // remove the to be scheduled job from its queue
-  GList **queue = &control->queues[winner_queue];
-  *queue = g_list_delete_link(*queue, *queue);
-  control->queue_length[winner_queue]--;
+  g_queue_pop_head(control->queues[winner_queue]);
+  if(winner_queue == DT_JOB_QUEUE_SYSTEM_FG) g_hash_table_remove(control->queued_jobs, job);
   if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
 
   // and place it in scheduled job array (for job deduping)
@@ -276,10 +321,20 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   // increment the priorities of the others
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
   {
-    if(i == winner_queue || control->queues[i] == NULL) continue;
-    ((_dt_job_t *)control->queues[i]->data)->priority++;
+    if(i == winner_queue || g_queue_is_empty(control->queues[i])) continue;
+    ((_dt_job_t *)g_queue_peek_head(control->queues[i]))->priority++;
   }
 
+  // book keeping of how long jobs are waiting in the queues
+  const double latency = dt_get_wtime() - job->queued_time;
+  dt_control_queue_stats_t *stats = &control->queue_stats[winner_queue];
+  stats->scheduled++;
+  stats->latency_sum += latency;
+  stats->latency_max = MAX(stats->latency_max, latency);
+
+  // there might be more work than awake workers, pass it on
+  if(dt_control_has_runnable_job(control)) dt_control_wake_worker(control);
+
   dt_pthread_mutex_unlock(&control->queue_mutex);
 
   return job;
@@ -318,7 +373,12 @@ static int32_t dt_control_run_job(dt_control_t *control)
   // remove the job from scheduled job array (for job deduping)
   dt_pthread_mutex_lock(&control->queue_mutex);
   control->job[dt_control_get_threadid()] = NULL;
-  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = FALSE;
+  if(job->queue == DT_JOB_QUEUE_USER_EXPORT)
+  {
+    control->export_scheduled = FALSE;
+    // the next export may have been waiting for us
+    if(!g_queue_is_empty(control->queues[DT_JOB_QUEUE_USER_EXPORT])) dt_control_wake_worker(control);
+  }
   dt_pthread_mutex_unlock(&control->queue_mutex);
 
   // and free it
@@ -353,11 +413,10 @@ int32_t dt_control_add_job_res(dt_control_t *control, _dt_job_t *job, int32_t re
   control->job_res[res] = job;
   control->new_res[res] = 1;
 
-  dt_pthread_mutex_unlock(&control->res_mutex);
+  // only the reserved worker owning this slot has to know
+  pthread_cond_signal(&control->cond_res[res]);
 
-  dt_pthread_mutex_lock(&control->cond_mutex);
-  pthread_cond_broadcast(&control->cond);
-  dt_pthread_mutex_unlock(&control->cond_mutex);
+  dt_pthread_mutex_unlock(&control->res_mutex);
 
   return 0;
 }
@@ -371,15 +430,16 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
   }
 
   job->queue = queue_id;
+  job->hash = dt_control_job_hash(job);
+  job->queued_time = dt_get_wtime();
 
   _dt_job_t *job_for_disposal = NULL;
 
   dt_pthread_mutex_lock(&control->queue_mutex);
 
-  GList **queue = &control->queues[queue_id];
-  size_t length = control->queue_length[queue_id];
+  GQueue *queue = control->queues[queue_id];
 
-  dt_print(DT_DEBUG_CONTROL, "[add_job] %zu | ", length);
+  dt_print(DT_DEBUG_CONTROL, "[add_job] %u | ", g_queue_get_length(queue));
   dt_control_job_print(job);
   dt_print(DT_DEBUG_CONTROL, "\n");
 
@@ -398,6 +458,7 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
         dt_control_job_print(other_job);
         dt_print(DT_DEBUG_CONTROL, "\n");
 
+        control->queue_stats[queue_id].discarded++;
         dt_pthread_mutex_unlock(&control->queue_mutex);
 
         dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
@@ -408,40 +469,37 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
     }
 
     // if the job is already in the queue -> move it to the top
-    for(GList *iter = *queue; iter; iter = g_list_next(iter))
+    GList *link = (GList *)g_hash_table_lookup(control->queued_jobs, job);
+    if(link)
     {
-      _dt_job_t *other_job = (_dt_job_t *)iter->data;
-      if(dt_control_job_equal(job, other_job))
-      {
-        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
-        dt_control_job_print(other_job);
-        dt_print(DT_DEBUG_CONTROL, "\n");
+      _dt_job_t *other_job = (_dt_job_t *)link->data;
+      dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
+      dt_control_job_print(other_job);
+      dt_print(DT_DEBUG_CONTROL, "\n");
 
-        *queue = g_list_delete_link(*queue, iter);
-        length--;
+      g_queue_unlink(queue, link);
+      g_queue_push_head_link(queue, link);
+      control->queue_stats[queue_id].discarded++;
 
-        job_for_disposal = job;
-
-        job = other_job;
-        break; // there can't be any further copy in the list
-      }
+      job_for_disposal = job;
+      job = other_job;
+    }
+    else
+    {
+      // now we can add the new job to the list
+      g_queue_push_head(queue, job);
+      g_hash_table_insert(control->queued_jobs, job, queue->head);
     }
-
-    // now we can add the new job to the list
-    *queue = g_list_prepend(*queue, job);
-    length++;
 
     // and take care of the maximal queue size
-    if(length > DT_CONTROL_MAX_JOBS)
+    if(g_queue_get_length(queue) > DT_CONTROL_MAX_JOBS)
     {
-      GList *last = g_list_last(*queue);
-      dt_control_job_set_state((_dt_job_t *)last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose((_dt_job_t *)last->data);
-      *queue = g_list_delete_link(*queue, last);
-      length--;
+      _dt_job_t *last = (_dt_job_t *)g_queue_pop_tail(queue);
+      g_hash_table_remove(control->queued_jobs, last);
+      control->queue_stats[queue_id].discarded++;
+      dt_control_job_set_state(last, DT_JOB_STATE_DISCARDED);
+      dt_control_job_dispose(last);
     }
-
-    control->queue_length[queue_id] = length;
   }
   else
   {
@@ -452,16 +510,14 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
       job->priority = 0;
     else
       job->priority = DT_CONTROL_FG_PRIORITY;
-    *queue = g_list_append(*queue, job);
-    control->queue_length[queue_id]++;
+    g_queue_push_tail(queue, job);
   }
   dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
-  dt_pthread_mutex_unlock(&control->queue_mutex);
 
-  // notify workers
-  dt_pthread_mutex_lock(&control->cond_mutex);
-  pthread_cond_broadcast(&control->cond);
-  dt_pthread_mutex_unlock(&control->cond_mutex);
+  // notify one worker, the others can keep sleeping
+  if(dt_control_has_runnable_job(control)) dt_control_wake_worker(control);
+
+  dt_pthread_mutex_unlock(&control->queue_mutex);
 
   // dispose of dropped job, if any
   dt_control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
@@ -470,6 +526,16 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
   return 0;
 }
 
+void dt_control_jobs_get_queue_stats(dt_control_t *control, dt_job_queue_t queue_id,
+                                     dt_control_queue_stats_t *stats)
+{
+  if(((unsigned int)queue_id) >= DT_JOB_QUEUE_MAX || !stats) return;
+  dt_pthread_mutex_lock(&control->queue_mutex);
+  *stats = control->queue_stats[queue_id];
+  stats->length = g_queue_get_length(control->queues[queue_id]);
+  dt_pthread_mutex_unlock(&control->queue_mutex);
+}
+
 static __thread int threadid = -1;
 
 int32_t dt_control_get_threadid()
@@ -499,12 +565,14 @@ static void *dt_control_work_res(void *ptr)
     // dt_print(DT_DEBUG_CONTROL, "[control_work] %d\n", threadid_res);
     if(dt_control_run_job_res(s, threadid_res) < 0)
     {
-      // wait for a new job.
+      // wait for a new job. new_res is checked under the same lock add_job_res signals with,
+      // so a job can't slip through between the check and going to sleep.
       int old;
       pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
-      dt_pthread_mutex_lock(&s->cond_mutex);
-      dt_pthread_cond_wait(&s->cond, &s->cond_mutex);
-      dt_pthread_mutex_unlock(&s->cond_mutex);
+      dt_pthread_mutex_lock(&s->res_mutex);
+      if(!s->new_res[threadid_res] && dt_control_running())
+        dt_pthread_cond_wait(&s->cond_res[threadid_res], &s->res_mutex);
+      dt_pthread_mutex_unlock(&s->res_mutex);
       int tmp;
       pthread_setcancelstate(old, &tmp);
     }
@@ -512,19 +580,6 @@ static void *dt_control_work_res(void *ptr)
   return NULL;
 }
 
-static void *dt_control_worker_kicker(void *ptr)
-{
-  dt_control_t *control = (dt_control_t *)ptr;
-  while(dt_control_running())
-  {
-    sleep(2);
-    dt_pthread_mutex_lock(&control->cond_mutex);
-    pthread_cond_broadcast(&control->cond);
-    dt_pthread_mutex_unlock(&control->cond_mutex);
-  }
-  return NULL;
-}
-
 static void *dt_control_work(void *ptr)
 {
 #ifdef _OPENMP // need to do this in every thread
@@ -540,15 +595,32 @@ static void *dt_control_work(void *ptr)
     // dt_print(DT_DEBUG_CONTROL, "[control_work] %d\n", threadid);
     if(dt_control_run_job(control) < 0)
     {
-      // wait for a new job.
-      dt_pthread_mutex_lock(&control->cond_mutex);
-      dt_pthread_cond_wait(&control->cond, &control->cond_mutex);
-      dt_pthread_mutex_unlock(&control->cond_mutex);
+      // wait for a new job. the queues are checked under the same lock add_job signals with,
+      // so no wakeup can get lost and there is no need to periodically kick the workers.
+      dt_pthread_mutex_lock(&control->queue_mutex);
+      if(!dt_control_has_runnable_job(control) && dt_control_running())
+      {
+        control->idle_threads++;
+        dt_pthread_cond_wait(&control->cond, &control->queue_mutex);
+        control->idle_threads--;
+      }
+      dt_pthread_mutex_unlock(&control->queue_mutex);
     }
   }
   return NULL;
 }
 
+void dt_control_jobs_wake_all(dt_control_t *control)
+{
+  dt_pthread_mutex_lock(&control->queue_mutex);
+  pthread_cond_broadcast(&control->cond);
+  dt_pthread_mutex_unlock(&control->queue_mutex);
+
+  dt_pthread_mutex_lock(&control->res_mutex);
+  for(int k = 0; k < DT_CTL_WORKER_RESERVED; k++) pthread_cond_broadcast(&control->cond_res[k]);
+  dt_pthread_mutex_unlock(&control->res_mutex);
+}
+
 // convenience functions to have a progress bar for the job.
 // this allows to show the gui indicator of the job even before it got scheduled
 void dt_control_job_add_progress(dt_job_t *job, const char *message, gboolean cancellable)
@@ -585,6 +657,14 @@ void dt_control_jobs_init(dt_control_t *control)
   control->num_threads = CLAMP(dt_conf_get_int("worker_threads"), 1, 8);
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
   control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  control->idle_threads = 0;
+  for(int k = 0; k < DT_JOB_QUEUE_MAX; k++)
+  {
+    control->queues[k] = g_queue_new();
+    memset(&control->queue_stats[k], 0, sizeof(dt_control_queue_stats_t));
+  }
+  control->queued_jobs = g_hash_table_new(dt_control_job_hash_func, dt_control_job_equal_func);
+  for(int k = 0; k < DT_CTL_WORKER_RESERVED; k++) pthread_cond_init(&control->cond_res[k], NULL);
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = 1;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -597,9 +677,6 @@ void dt_control_jobs_init(dt_control_t *control)
     pthread_create(&control->thread[k], NULL, dt_control_work, params);
   }
 
-  /* create queue kicker thread */
-  pthread_create(&control->kick_on_workers_thread, NULL, dt_control_worker_kicker, control);
-
   for(int k = 0; k < DT_CTL_WORKER_RESERVED; k++)
   {
     control->job_res[k] = NULL;
@@ -614,6 +691,19 @@ void dt_control_jobs_init(dt_control_t *control)
 
 void dt_control_jobs_cleanup(dt_control_t *control)
 {
+  for(int k = 0; k < DT_JOB_QUEUE_MAX; k++)
+  {
+    const dt_control_queue_stats_t *stats = &control->queue_stats[k];
+    dt_print(DT_DEBUG_CONTROL, "[jobs] queue %d: %" PRIu64 " scheduled, %" PRIu64
+                               " discarded, latency avg %.3fs max %.3fs\n",
+             k, stats->scheduled, stats->discarded,
+             stats->scheduled ? stats->latency_sum / stats->scheduled : 0.0, stats->latency_max);
+    g_queue_free(control->queues[k]);
+    control->queues[k] = NULL;
+  }
+  g_hash_table_destroy(control->queued_jobs);
+  control->queued_jobs = NULL;
+  for(int k = 0; k < DT_CTL_WORKER_RESERVED; k++) pthread_cond_destroy(&control->cond_res[k]);
   free(control->job);
   free(control->thread);
 }
@@ -54,6 +54,16 @@ typedef enum dt_job_queue_t
 
 typedef struct _dt_job_t dt_job_t;
 
+/** per queue statistics, to see how long jobs are waiting before a worker picks them up */
+typedef struct dt_control_queue_stats_t
+{
+  uint64_t scheduled;  // number of jobs picked from the queue by a worker
+  uint64_t discarded;  // number of jobs dropped as duplicates or because the queue was full
+  double latency_sum;  // accumulated time between queuing and scheduling, in seconds
+  double latency_max;  // longest time a job waited to be scheduled, in seconds
+  uint32_t length;     // current number of jobs in the queue, filled in on query
+} dt_control_queue_stats_t;
+
 typedef int32_t (*dt_job_execute_callback)(dt_job_t *);
 typedef void (*dt_job_state_change_callback)(dt_job_t *, dt_job_state_t state);
 typedef void (*dt_job_destroy_callback)(void *data);
@@ -89,6 +99,11 @@ void dt_control_jobs_cleanup(struct dt_control_t *control);
 
 int dt_control_add_job(struct dt_control_t *control, dt_job_queue_t queue_id, dt_job_t *job);
 int32_t dt_control_add_job_res(struct dt_control_t *s, dt_job_t *job, int32_t res);
+/** get a snapshot of the latency statistics of one queue */
+void dt_control_jobs_get_queue_stats(struct dt_control_t *control, dt_job_queue_t queue_id,
+                                     dt_control_queue_stats_t *stats);
+/** wake up all sleeping workers, e.g. on shutdown */
+void dt_control_jobs_wake_all(struct dt_control_t *control);
 
 int32_t dt_control_get_threadid();
 
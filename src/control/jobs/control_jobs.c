@@ -60,9 +60,7 @@ typedef struct dt_control_gpx_apply_t
 
 typedef struct dt_control_export_t
 {
-  int max_width, max_height, format_index, storage_index;
-  dt_imageio_module_data_t *sdata; // needed since the gui thread resets things like overwrite once the export
-  // is dispatched, but we have to keep that information
+  GList *targets; // dt_control_export_target_t
   gboolean high_quality, upscale;
   char style[128];
   gboolean style_append;
@@ -1148,63 +1146,114 @@ static int32_t dt_control_local_copy_images_job_run(dt_job_t *job)
   return 0;
 }
 
+// per target state of a running export job
+typedef struct dt_control_export_run_t
+{
+  dt_control_export_target_t *target;
+  dt_imageio_module_format_t *mformat;
+  dt_imageio_module_storage_t *mstorage;
+  dt_imageio_module_data_t *fdata;
+  double scale; // of the current image, see _export_run_scale()
+} dt_control_export_run_t;
+
+// the scale dt_imageio_export() will render the image at for this run, from the unprocessed size. crops and
+// rotations can change that, in which case the shared rendition is bypassed by the export itself.
+static double _export_run_scale(const dt_control_export_run_t *run, const int width, const int height,
+                                const gboolean upscale)
+{
+  const double max_scale = upscale ? 100.0 : 1.0;
+  const int max_width = run->fdata->max_width, max_height = run->fdata->max_height;
+  const double scalex = (max_width > 0 && width > 0) ? fmin(max_width / (double)width, max_scale) : 1.0;
+  const double scaley = (max_height > 0 && height > 0) ? fmin(max_height / (double)height, max_scale) : 1.0;
+  return fmin(scalex, scaley);
+}
+
 static int32_t dt_control_export_job_run(dt_job_t *job)
 {
   int imgid = -1;
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
   dt_control_export_t *settings = (dt_control_export_t *)params->data;
   GList *t = params->index;
-  dt_imageio_module_format_t *mformat = dt_imageio_get_format_by_index(settings->format_index);
-  g_assert(mformat);
-  dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(settings->storage_index);
-  g_assert(mstorage);
-  dt_imageio_module_data_t *sdata = settings->sdata;
-
-  // get a thread-safe fdata struct (one jpeg struct per thread etc):
-  dt_imageio_module_data_t *fdata = mformat->get_params(mformat);
+  const int ntargets = g_list_length(settings->targets);
+  dt_control_export_run_t *runs = calloc(ntargets, sizeof(dt_control_export_run_t));
+  if(!runs) return 1;
+  // the runs of the current image, by decreasing scale
+  dt_control_export_run_t **order = calloc(ntargets, sizeof(dt_control_export_run_t *));
+  if(!order)
+  {
+    free(runs);
+    return 1;
+  }
 
-  if(mstorage->initialize_store)
+  int k = 0;
+  for(GList *l = settings->targets; l; l = g_list_next(l), k++)
   {
-    if(mstorage->initialize_store(mstorage, sdata, &mformat, &fdata, &t, settings->high_quality, settings->upscale))
+    dt_control_export_run_t *run = runs + k;
+    dt_control_export_target_t *target = (dt_control_export_target_t *)l->data;
+    run->target = target;
+    run->mformat = dt_imageio_get_format_by_index(target->format_index);
+    g_assert(run->mformat);
+    run->mstorage = dt_imageio_get_storage_by_index(target->storage_index);
+    g_assert(run->mstorage);
+    dt_imageio_module_data_t *sdata = target->sdata;
+
+    // get a thread-safe fdata struct (one jpeg struct per thread etc):
+    run->fdata = run->mformat->get_params(run->mformat);
+
+    if(run->mstorage->initialize_store)
     {
-      // bail out, something went wrong
-      goto end;
+      // with several targets the image list is shared, a storage can't change it for the others
+      GList *images = ntargets == 1 ? t : g_list_copy(t);
+      const int failed = run->mstorage->initialize_store(run->mstorage, sdata, &run->mformat, &run->fdata,
+                                                         &images, settings->high_quality, settings->upscale);
+      if(ntargets == 1)
+        t = images;
+      else
+        g_list_free(images);
+      if(failed)
+      {
+        // bail out, something went wrong
+        goto end;
+      }
+      run->mformat->set_params(run->mformat, run->fdata, run->mformat->params_size(run->mformat));
+      run->mstorage->set_params(run->mstorage, sdata, run->mstorage->params_size(run->mstorage));
     }
-    mformat->set_params(mformat, fdata, mformat->params_size(mformat));
-    mstorage->set_params(mstorage, sdata, mstorage->params_size(mstorage));
-  }
 
-  // Get max dimensions...
-  uint32_t w, h, fw, fh, sw, sh;
-  fw = fh = sw = sh = 0;
-  mstorage->dimension(mstorage, sdata, &sw, &sh);
-  mformat->dimension(mformat, fdata, &fw, &fh);
+    // Get max dimensions...
+    uint32_t w, h, fw, fh, sw, sh;
+    fw = fh = sw = sh = 0;
+    run->mstorage->dimension(run->mstorage, sdata, &sw, &sh);
+    run->mformat->dimension(run->mformat, run->fdata, &fw, &fh);
 
-  if(sw == 0 || fw == 0)
-    w = sw > fw ? sw : fw;
-  else
-    w = sw < fw ? sw : fw;
+    if(sw == 0 || fw == 0)
+      w = sw > fw ? sw : fw;
+    else
+      w = sw < fw ? sw : fw;
 
-  if(sh == 0 || fh == 0)
-    h = sh > fh ? sh : fh;
-  else
-    h = sh < fh ? sh : fh;
+    if(sh == 0 || fh == 0)
+      h = sh > fh ? sh : fh;
+    else
+      h = sh < fh ? sh : fh;
+
+    // set up the fdata struct
+    dt_imageio_module_data_t *fdata = run->fdata;
+    fdata->max_width = (target->max_width != 0 && w != 0) ? MIN(w, target->max_width) : MAX(w, target->max_width);
+    fdata->max_height
+        = (target->max_height != 0 && h != 0) ? MIN(h, target->max_height) : MAX(h, target->max_height);
+    g_strlcpy(fdata->style, settings->style, sizeof(fdata->style));
+    fdata->style_append = settings->style_append;
+  }
 
   const guint total = g_list_length(t);
   dt_control_log(ngettext("exporting %d image..", "exporting %d images..", total), total);
   char message[512] = { 0 };
   snprintf(message, sizeof(message), ngettext("exporting %d image to %s", "exporting %d images to %s", total),
-           total, mstorage->name(mstorage));
+           total, runs[0].mstorage->name(runs[0].mstorage));
   // update the message. initialize_store() might have changed the number of images
   dt_control_job_set_progress_message(job, message);
 
   double fraction = 0;
 
-  // set up the fdata struct
-  fdata->max_width = (settings->max_width != 0 && w != 0) ? MIN(w, settings->max_width) : MAX(w, settings->max_width);
-  fdata->max_height = (settings->max_height != 0 && h != 0) ? MIN(h, settings->max_height) : MAX(h, settings->max_height);
-  g_strlcpy(fdata->style, settings->style, sizeof(fdata->style));
-  fdata->style_append = settings->style_append;
   guint num = 0;
   // Invariant: the tagid for 'darktable|changed' will not change while this function runs. Is this a
   // sensible assumption?
@@ -1212,6 +1261,10 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   dt_tag_new("darktable|changed", &tagid);
   dt_tag_new("darktable|exported", &etagid);
 
+  // the smaller renditions of an image are derived from the output of the largest one. they are all in the
+  // output profile of the export settings, see dt_control_export_targets()
+  if(ntargets > 1) dt_imageio_export_share_begin();
+
   while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
   {
     if(!t)
@@ -1243,9 +1296,27 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
       }
       else
       {
+        // largest rendition first, so every further one can be downscaled from the shared buffer
+        for(k = 0; k < ntargets; k++)
+        {
+          dt_control_export_run_t *run = runs + k;
+          run->scale = _export_run_scale(run, image->width, image->height, settings->upscale);
+          int i = k;
+          for(; i > 0 && order[i - 1]->scale < run->scale; i--) order[i] = order[i - 1];
+          order[i] = run;
+        }
         dt_image_cache_read_release(darktable.image_cache, image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata, num, total, settings->high_quality, settings->upscale) != 0)
-          dt_control_job_cancel(job);
+        for(k = 0; k < ntargets; k++)
+        {
+          dt_control_export_run_t *run = order[k];
+          if(ntargets > 1) dt_imageio_export_share_pending(ntargets - 1 - k);
+          if(run->mstorage->store(run->mstorage, run->target->sdata, imgid, run->mformat, run->fdata, num,
+                                  total, settings->high_quality, settings->upscale) != 0)
+          {
+            dt_control_job_cancel(job);
+            break;
+          }
+        }
       }
     }
 
@@ -1255,11 +1326,17 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   }
   params->index = NULL;
 
-  if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
+  if(ntargets > 1) dt_imageio_export_share_end();
+
+  for(k = 0; k < ntargets; k++)
+    if(runs[k].mstorage->finalize_store) runs[k].mstorage->finalize_store(runs[k].mstorage, runs[k].target->sdata);
 
 end:
   // all threads free their fdata
-  mformat->free_params(mformat, fdata);
+  for(k = 0; k < ntargets; k++)
+    if(runs[k].fdata) runs[k].mformat->free_params(runs[k].mformat, runs[k].fdata);
+  free(order);
+  free(runs);
 
   return 0;
 }
@@ -1565,29 +1642,40 @@ static dt_control_image_enumerator_t *dt_control_export_alloc()
   return params;
 }
 
+static void dt_control_export_target_free(gpointer data)
+{
+  dt_control_export_target_t *target = (dt_control_export_target_t *)data;
+  dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(target->storage_index);
+  if(mstorage && target->sdata) mstorage->free_params(mstorage, target->sdata);
+  free(target);
+}
+
 static void dt_control_export_cleanup(void *p)
 {
   dt_control_image_enumerator_t *params = p;
 
   dt_control_export_t *settings = (dt_control_export_t *)params->data;
-  dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(settings->storage_index);
-  dt_imageio_module_data_t *sdata = settings->sdata;
-
-  mstorage->free_params(mstorage, sdata);
+  g_list_free_full(settings->targets, dt_control_export_target_free);
 
   free(params->data);
 
   dt_control_image_enumerator_cleanup(params);
 }
 
-void dt_control_export(GList *imgid_list, int max_width, int max_height, int format_index, int storage_index,
-                       gboolean high_quality, gboolean upscale, char *style, gboolean style_append)
+void dt_control_export_targets(GList *imgid_list, GList *targets, gboolean high_quality, gboolean upscale,
+                               char *style, gboolean style_append)
 {
+  if(!targets) return;
   dt_job_t *job = dt_control_job_create(&dt_control_export_job_run, "export");
-  if(!job) return;
+  if(!job)
+  {
+    g_list_free_full(targets, dt_control_export_target_free);
+    return;
+  }
   dt_control_image_enumerator_t *params = dt_control_export_alloc();
   if(!params)
   {
+    g_list_free_full(targets, dt_control_export_target_free);
     dt_control_job_dispose(job);
     return;
   }
@@ -1596,10 +1684,31 @@ void dt_control_export(GList *imgid_list, int max_width, int max_height, int for
   params->index = imgid_list;
 
   dt_control_export_t *data = params->data;
-  data->max_width = max_width;
-  data->max_height = max_height;
-  data->format_index = format_index;
-  data->storage_index = storage_index;
+  data->targets = targets;
+  data->high_quality = high_quality;
+  data->upscale = upscale;
+  g_strlcpy(data->style, style, sizeof(data->style));
+  data->style_append = style_append;
+
+  dt_control_job_add_progress(job, _("export images"), TRUE);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_EXPORT, job);
+
+  // tell the storages that we got their params for an export so they can reset themselves to a safe state
+  GList *dispatched = NULL;
+  for(GList *l = data->targets; l; l = g_list_next(l))
+  {
+    dt_imageio_module_storage_t *mstorage
+        = dt_imageio_get_storage_by_index(((dt_control_export_target_t *)l->data)->storage_index);
+    if(g_list_find(dispatched, mstorage)) continue;
+    dispatched = g_list_prepend(dispatched, mstorage);
+    mstorage->export_dispatched(mstorage);
+  }
+  g_list_free(dispatched);
+}
+
+void dt_control_export(GList *imgid_list, int max_width, int max_height, int format_index, int storage_index,
+                       gboolean high_quality, gboolean upscale, char *style, gboolean style_append)
+{
   dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(storage_index);
   g_assert(mstorage);
   // get shared storage param struct (global sequence counter, one picasa connection etc)
@@ -1608,20 +1717,23 @@ void dt_control_export(GList *imgid_list, int max_width, int max_height, int for
   {
     dt_control_log(_("failed to get parameters from storage module `%s', aborting export.."),
                    mstorage->name(mstorage));
-    dt_control_job_dispose(job);
     return;
   }
-  data->sdata = sdata;
-  data->high_quality = high_quality;
-  data->upscale = upscale;
-  g_strlcpy(data->style, style, sizeof(data->style));
-  data->style_append = style_append;
-
-  dt_control_job_add_progress(job, _("export images"), TRUE);
-  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_EXPORT, job);
 
-  // tell the storage that we got its params for an export so it can reset itself to a safe state
-  mstorage->export_dispatched(mstorage);
+  dt_control_export_target_t *target = calloc(1, sizeof(dt_control_export_target_t));
+  if(!target)
+  {
+    mstorage->free_params(mstorage, sdata);
+    return;
+  }
+  target->max_width = max_width;
+  target->max_height = max_height;
+  target->format_index = format_index;
+  target->storage_index = storage_index;
+  target->sdata = sdata;
+
+  dt_control_export_targets(imgid_list, g_list_append(NULL, target), high_quality, upscale, style,
+                            style_append);
 }
 
 static int32_t dt_control_time_offset_job_run(dt_job_t *job)
@@ -41,6 +41,20 @@ void dt_control_set_local_copy_images();
 void dt_control_reset_local_copy_images();
 void dt_control_export(GList *imgid_list, int max_width, int max_height, int format_index, int storage_index,
                        gboolean high_quality, gboolean upscale, char *style, gboolean style_append);
+
+// one rendition of every image of a multi-target export.
+typedef struct dt_control_export_target_t
+{
+  int max_width, max_height, format_index, storage_index;
+  dt_imageio_module_data_t *sdata; // from the storage's get_params(), owned by the job once dispatched
+} dt_control_export_target_t;
+
+// export every image to all targets (a list of dt_control_export_target_t, owned by the job).
+// the pixelpipe runs once per image and the smaller renditions are downscaled from its output, so all
+// targets get the output profile and the format settings of the export module.
+// lua scripts reach this through darktable.export_targets().
+void dt_control_export_targets(GList *imgid_list, GList *targets, gboolean high_quality, gboolean upscale,
+                               char *style, gboolean style_append);
 void dt_control_merge_hdr();
 
 void dt_control_seed_denoise();
@@ -17,9 +17,11 @@
 */
 #include "control/jobs/film_jobs.h"
 #include "common/darktable.h"
+#include "common/database.h"
 #include "common/film.h"
 #include <stdlib.h>
 
+
 typedef struct dt_film_import1_t
 {
   dt_film_t *film;
@@ -197,6 +199,9 @@ void dt_film_import1(dt_job_t *job, dt_film_t *film)
   /* loop thru the images and import to current film roll */
   dt_film_t *cfr = film;
   GList *image = g_list_first(images);
+  // commit in batches instead of once per statement. they are short, and end early when another thread
+  // wants to write something, too
+  dt_database_start_transaction(darktable.db);
   do
   {
     gchar *cdn = g_path_get_dirname((const gchar *)image->data);
@@ -249,11 +254,14 @@ void dt_film_import1(dt_job_t *job, dt_film_t *film)
     /* import image */
     dt_image_import(cfr->id, (const gchar *)image->data, FALSE);
 
+    dt_database_yield_transaction(darktable.db);
+
     fraction += 1.0 / total;
     dt_control_job_set_progress(job, fraction);
 
 
   } while((image = g_list_next(image)) != NULL);
+  dt_database_release_transaction(darktable.db);
 
   g_list_free_full(images, g_free);
 
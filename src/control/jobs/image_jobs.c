@@ -55,6 +55,73 @@ dt_job_t *dt_image_load_job_create(int32_t id, dt_mipmap_size_t mip)
   return job;
 }
 
+dt_image_prefetch_generation_t *dt_image_prefetch_generation_new()
+{
+  dt_image_prefetch_generation_t *generation
+      = (dt_image_prefetch_generation_t *)calloc(1, sizeof(dt_image_prefetch_generation_t));
+  if(generation) generation->refcount = 1;
+  return generation;
+}
+
+dt_image_prefetch_generation_t *dt_image_prefetch_generation_ref(dt_image_prefetch_generation_t *generation)
+{
+  g_atomic_int_inc(&generation->refcount);
+  return generation;
+}
+
+void dt_image_prefetch_generation_unref(dt_image_prefetch_generation_t *generation)
+{
+  if(generation && g_atomic_int_dec_and_test(&generation->refcount)) free(generation);
+}
+
+typedef struct dt_image_prefetch_t
+{
+  int32_t imgid;
+  dt_mipmap_size_t mip;
+  dt_image_prefetch_generation_t *generation;
+  gint expected;
+} dt_image_prefetch_t;
+
+static void dt_image_prefetch_job_cleanup(void *p)
+{
+  dt_image_prefetch_t *params = (dt_image_prefetch_t *)p;
+  dt_image_prefetch_generation_unref(params->generation);
+  free(params);
+}
+
+static int32_t dt_image_prefetch_job_run(dt_job_t *job)
+{
+  dt_image_prefetch_t *params = dt_control_job_get_params(job);
+
+  // the view moved on since this was queued, don't waste time on it
+  if(g_atomic_int_get(&params->generation->value) != params->expected) return 0;
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  return 0;
+}
+
+dt_job_t *dt_image_prefetch_job_create(int32_t id, dt_mipmap_size_t mip,
+                                       dt_image_prefetch_generation_t *generation, gint expected)
+{
+  dt_job_t *job = dt_control_job_create(&dt_image_prefetch_job_run, "prefetch image %d mip %d", id, mip);
+  if(!job) return NULL;
+  dt_image_prefetch_t *params = (dt_image_prefetch_t *)calloc(1, sizeof(dt_image_prefetch_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return NULL;
+  }
+  dt_control_job_set_params_with_size(job, params, sizeof(dt_image_prefetch_t),
+                                      dt_image_prefetch_job_cleanup);
+  params->imgid = id;
+  params->mip = mip;
+  params->generation = dt_image_prefetch_generation_ref(generation);
+  params->expected = expected;
+  return job;
+}
+
 typedef struct dt_image_import_t
 {
   uint32_t film_id;
@@ -23,7 +23,22 @@
 #include "control/control.h"
 #include <inttypes.h>
 
+/** counter that makes queued prefetches stale when it is bumped. the jobs hold a reference, as they can
+ *  outlive whoever queued them. */
+typedef struct dt_image_prefetch_generation_t
+{
+  gint value;
+  gint refcount;
+} dt_image_prefetch_generation_t;
+
+dt_image_prefetch_generation_t *dt_image_prefetch_generation_new();
+dt_image_prefetch_generation_t *dt_image_prefetch_generation_ref(dt_image_prefetch_generation_t *generation);
+void dt_image_prefetch_generation_unref(dt_image_prefetch_generation_t *generation);
+
 dt_job_t *dt_image_load_job_create(int32_t imgid, dt_mipmap_size_t mip);
+/** speculative load, skipped when generation->value no longer equals the value it was queued with. */
+dt_job_t *dt_image_prefetch_job_create(int32_t imgid, dt_mipmap_size_t mip,
+                                       dt_image_prefetch_generation_t *generation, gint expected);
 
 dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename);
 
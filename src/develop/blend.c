@@ -17,6 +17,7 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "blend.h"
+#include "common/fast_math.h"
 #include "common/gaussian.h"
 #include "control/control.h"
 #include "develop/imageop.h"
@@ -36,91 +37,6 @@ typedef struct _blend_buffer_desc_t
 typedef void(_blend_row_func)(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask,
                               int flag);
 
-static inline void _RGB_2_HSL(const float *RGB, float *HSL)
-{
-  float H, S, L;
-
-  float R = RGB[0];
-  float G = RGB[1];
-  float B = RGB[2];
-
-  float var_Min = fminf(R, fminf(G, B));
-  float var_Max = fmaxf(R, fmaxf(G, B));
-  float del_Max = var_Max - var_Min;
-
-  L = (var_Max + var_Min) / 2.0f;
-
-  if(del_Max < 1e-6f)
-  {
-    H = 0.0f;
-    S = 0.0f;
-  }
-  else
-  {
-    if(L < 0.5f)
-      S = del_Max / (var_Max + var_Min);
-    else
-      S = del_Max / (2.0f - var_Max - var_Min);
-
-    float del_R = (((var_Max - R) / 6.0f) + (del_Max / 2.0f)) / del_Max;
-    float del_G = (((var_Max - G) / 6.0f) + (del_Max / 2.0f)) / del_Max;
-    float del_B = (((var_Max - B) / 6.0f) + (del_Max / 2.0f)) / del_Max;
-
-    if(R == var_Max)
-      H = del_B - del_G;
-    else if(G == var_Max)
-      H = (1.0f / 3.0f) + del_R - del_B;
-    else if(B == var_Max)
-      H = (2.0f / 3.0f) + del_G - del_R;
-    else
-      H = 0.0f; // make GCC happy
-
-    if(H < 0.0f) H += 1.0f;
-    if(H > 1.0f) H -= 1.0f;
-  }
-
-  HSL[0] = H;
-  HSL[1] = S;
-  HSL[2] = L;
-}
-
-static inline float _Hue_2_RGB(float v1, float v2, float vH)
-{
-  if(vH < 0.0f) vH += 1.0f;
-  if(vH > 1.0f) vH -= 1.0f;
-  if((6.0f * vH) < 1.0f) return (v1 + (v2 - v1) * 6.0f * vH);
-  if((2.0f * vH) < 1.0f) return (v2);
-  if((3.0f * vH) < 2.0f) return (v1 + (v2 - v1) * ((2.0f / 3.0f) - vH) * 6.0f);
-  return (v1);
-}
-
-static inline void _HSL_2_RGB(const float *HSL, float *RGB)
-{
-  float H = HSL[0];
-  float S = HSL[1];
-  float L = HSL[2];
-
-  float var_1, var_2;
-
-  if(S < 1e-6f)
-  {
-    RGB[0] = RGB[1] = RGB[2] = L;
-  }
-  else
-  {
-    if(L < 0.5f)
-      var_2 = L * (1.0f + S);
-    else
-      var_2 = (L + S) - (S * L);
-
-    var_1 = 2.0f * L - var_2;
-
-    RGB[0] = _Hue_2_RGB(var_1, var_2, H + (1.0f / 3.0f));
-    RGB[1] = _Hue_2_RGB(var_1, var_2, H);
-    RGB[2] = _Hue_2_RGB(var_1, var_2, H - (1.0f / 3.0f));
-  }
-}
-
 static inline void _RGB_2_HSV(const float *RGB, float *HSV)
 {
   float r = RGB[0], g = RGB[1], b = RGB[2];
@@ -208,27 +124,6 @@ static inline void _HSV_2_RGB(const float *HSV, float *RGB)
   }
 }
 
-static inline void _Lab_2_LCH(const float *Lab, float *LCH)
-{
-  float var_H = atan2f(Lab[2], Lab[1]);
-
-  if(var_H > 0.0f)
-    var_H = var_H / (2.0f * M_PI);
-  else
-    var_H = 1.0f - fabs(var_H) / (2.0f * M_PI);
-
-  LCH[0] = Lab[0];
-  LCH[1] = sqrtf(Lab[1] * Lab[1] + Lab[2] * Lab[2]);
-  LCH[2] = var_H;
-}
-
-static inline void _LCH_2_Lab(const float *LCH, float *Lab)
-{
-  Lab[0] = LCH[0];
-  Lab[1] = cosf(2.0f * M_PI * LCH[2]) * LCH[1];
-  Lab[2] = sinf(2.0f * M_PI * LCH[2]) * LCH[1];
-}
-
 static inline void _CLAMP_XYZ(float *XYZ, const float *min, const float *max)
 {
   XYZ[0] = CLAMP_RANGE(XYZ[0], min[0], max[0]);
@@ -271,8 +166,8 @@ static inline float _blendif_factor(dt_iop_colorspace_type_t cst, const float *i
       {
         float LCH_input[3];
         float LCH_output[3];
-        _Lab_2_LCH(input, LCH_input);
-        _Lab_2_LCH(output, LCH_output);
+        dt_Lab_to_LCH(input, LCH_input);
+        dt_Lab_to_LCH(output, LCH_output);
 
         scaled[DEVELOP_BLENDIF_C_in] = CLAMP_RANGE(LCH_input[1] / (128.0f * sqrtf(2.0f)), 0.0f,
                                                    1.0f);                     // C scaled to 0..1
@@ -303,8 +198,8 @@ static inline float _blendif_factor(dt_iop_colorspace_type_t cst, const float *i
       {
         float HSL_input[3];
         float HSL_output[3];
-        _RGB_2_HSL(input, HSL_input);
-        _RGB_2_HSL(output, HSL_output);
+        dt_RGB_to_HSL(input, HSL_input);
+        dt_RGB_to_HSL(output, HSL_output);
 
         scaled[DEVELOP_BLENDIF_H_in] = CLAMP_RANGE(HSL_input[0], 0.0f, 1.0f); // H scaled to 0..1
         scaled[DEVELOP_BLENDIF_S_in] = CLAMP_RANGE(HSL_input[1], 0.0f, 1.0f); // S scaled to 0..1
@@ -1873,14 +1768,14 @@ static void _blend_lightness(const _blend_buffer_desc_t *bd, const float *a, flo
       _CLAMP_XYZ(ta, min, max);
       _CLAMP_XYZ(&b[j], min, max);
 
-      _RGB_2_HSL(ta, tta);
-      _RGB_2_HSL(&b[j], ttb);
+      dt_RGB_to_HSL(ta, tta);
+      dt_RGB_to_HSL(&b[j], ttb);
 
       ttb[0] = tta[0];
       ttb[1] = tta[1];
       ttb[2] = (tta[2] * (1.0f - local_opacity)) + ttb[2] * local_opacity;
 
-      _HSL_2_RGB(ttb, &b[j]);
+      dt_HSL_to_RGB(ttb, &b[j]);
       _CLAMP_XYZ(&b[j], min, max);
 
       b[j + 3] = local_opacity;
@@ -1911,17 +1806,17 @@ static void _blend_chroma(const _blend_buffer_desc_t *bd, const float *a, float
       float tta[3], ttb[3];
       _blend_Lab_scale(&a[j], ta);
       _CLAMP_XYZ(ta, min, max);
-      _Lab_2_LCH(ta, tta);
+      dt_Lab_to_LCH(ta, tta);
 
       _blend_Lab_scale(&b[j], tb);
       _CLAMP_XYZ(tb, min, max);
-      _Lab_2_LCH(tb, ttb);
+      dt_Lab_to_LCH(tb, ttb);
 
       ttb[0] = tta[0];
       ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
       ttb[2] = tta[2];
 
-      _LCH_2_Lab(ttb, tb);
+      dt_LCH_to_Lab(ttb, tb);
       _CLAMP_XYZ(tb, min, max);
       _blend_Lab_rescale(tb, &b[j]);
 
@@ -1939,14 +1834,14 @@ static void _blend_chroma(const _blend_buffer_desc_t *bd, const float *a, float
       _CLAMP_XYZ(ta, min, max);
       _CLAMP_XYZ(&b[j], min, max);
 
-      _RGB_2_HSL(ta, tta);
-      _RGB_2_HSL(&b[j], ttb);
+      dt_RGB_to_HSL(ta, tta);
+      dt_RGB_to_HSL(&b[j], ttb);
 
       ttb[0] = tta[0];
       ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
       ttb[2] = tta[2];
 
-      _HSL_2_RGB(ttb, &b[j]);
+      dt_HSL_to_RGB(ttb, &b[j]);
       _CLAMP_XYZ(&b[j], min, max);
 
       b[j + 3] = local_opacity;
@@ -1976,11 +1871,11 @@ static void _blend_hue(const _blend_buffer_desc_t *bd, const float *a, float *b,
       float tta[3], ttb[3];
       _blend_Lab_scale(&a[j], ta);
       _CLAMP_XYZ(ta, min, max);
-      _Lab_2_LCH(ta, tta);
+      dt_Lab_to_LCH(ta, tta);
 
       _blend_Lab_scale(&b[j], tb);
       _CLAMP_XYZ(tb, min, max);
-      _Lab_2_LCH(tb, ttb);
+      dt_Lab_to_LCH(tb, ttb);
 
       ttb[0] = tta[0];
       ttb[1] = tta[1];
@@ -1989,7 +1884,7 @@ static void _blend_hue(const _blend_buffer_desc_t *bd, const float *a, float *b,
       float s = d > 0.5f ? -local_opacity * (1.0f - d) / d : local_opacity;
       ttb[2] = fmod((tta[2] * (1.0f - s)) + ttb[2] * s + 1.0f, 1.0f);
 
-      _LCH_2_Lab(ttb, tb);
+      dt_LCH_to_Lab(ttb, tb);
       _CLAMP_XYZ(tb, min, max);
       _blend_Lab_rescale(tb, &b[j]);
 
@@ -2007,8 +1902,8 @@ static void _blend_hue(const _blend_buffer_desc_t *bd, const float *a, float *b,
       _CLAMP_XYZ(ta, min, max);
       _CLAMP_XYZ(&b[j], min, max);
 
-      _RGB_2_HSL(ta, tta);
-      _RGB_2_HSL(&b[j], ttb);
+      dt_RGB_to_HSL(ta, tta);
+      dt_RGB_to_HSL(&b[j], ttb);
 
       /* blend hue along shortest distance on color circle */
       float d = fabs(tta[0] - ttb[0]);
@@ -2017,7 +1912,7 @@ static void _blend_hue(const _blend_buffer_desc_t *bd, const float *a, float *b,
       ttb[1] = tta[1];
       ttb[2] = tta[2];
 
-      _HSL_2_RGB(ttb, &b[j]);
+      dt_HSL_to_RGB(ttb, &b[j]);
       _CLAMP_XYZ(&b[j], min, max);
 
       b[j + 3] = local_opacity;
@@ -2047,11 +1942,11 @@ static void _blend_color(const _blend_buffer_desc_t *bd, const float *a, float *
       float tta[3], ttb[3];
       _blend_Lab_scale(&a[j], ta);
       _CLAMP_XYZ(ta, min, max);
-      _Lab_2_LCH(ta, tta);
+      dt_Lab_to_LCH(ta, tta);
 
       _blend_Lab_scale(&b[j], tb);
       _CLAMP_XYZ(tb, min, max);
-      _Lab_2_LCH(tb, ttb);
+      dt_Lab_to_LCH(tb, ttb);
 
       ttb[0] = tta[0];
       ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
@@ -2061,7 +1956,7 @@ static void _blend_color(const _blend_buffer_desc_t *bd, const float *a, float *
       float s = d > 0.5f ? -local_opacity * (1.0f - d) / d : local_opacity;
       ttb[2] = fmod((tta[2] * (1.0f - s)) + ttb[2] * s + 1.0f, 1.0f);
 
-      _LCH_2_Lab(ttb, tb);
+      dt_LCH_to_Lab(ttb, tb);
       _CLAMP_XYZ(tb, min, max);
       _blend_Lab_rescale(tb, &b[j]);
 
@@ -2080,8 +1975,8 @@ static void _blend_color(const _blend_buffer_desc_t *bd, const float *a, float *
       _CLAMP_XYZ(ta, min, max);
       _CLAMP_XYZ(&b[j], min, max);
 
-      _RGB_2_HSL(ta, tta);
-      _RGB_2_HSL(&b[j], ttb);
+      dt_RGB_to_HSL(ta, tta);
+      dt_RGB_to_HSL(&b[j], ttb);
 
       /* blend hue along shortest distance on color circle */
       float d = fabs(tta[0] - ttb[0]);
@@ -2091,7 +1986,7 @@ static void _blend_color(const _blend_buffer_desc_t *bd, const float *a, float *
       ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
       ttb[2] = tta[2];
 
-      _HSL_2_RGB(ttb, &b[j]);
+      dt_HSL_to_RGB(ttb, &b[j]);
       _CLAMP_XYZ(&b[j], min, max);
 
       b[j + 3] = local_opacity;
@@ -2122,11 +2017,11 @@ static void _blend_coloradjust(const _blend_buffer_desc_t *bd, const float *a, f
       float tta[3], ttb[3];
       _blend_Lab_scale(&a[j], ta);
       _CLAMP_XYZ(ta, min, max);
-      _Lab_2_LCH(ta, tta);
+      dt_Lab_to_LCH(ta, tta);
 
       _blend_Lab_scale(&b[j], tb);
       _CLAMP_XYZ(tb, min, max);
-      _Lab_2_LCH(tb, ttb);
+      dt_Lab_to_LCH(tb, ttb);
 
       // ttb[0] (output lightness) unchanged
       ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
@@ -2136,7 +2031,7 @@ static void _blend_coloradjust(const _blend_buffer_desc_t *bd, const float *a, f
       float s = d > 0.5f ? -local_opacity * (1.0f - d) / d : local_opacity;
       ttb[2] = fmod((tta[2] * (1.0f - s)) + ttb[2] * s + 1.0f, 1.0f);
 
-      _LCH_2_Lab(ttb, tb);
+      dt_LCH_to_Lab(ttb, tb);
       _CLAMP_XYZ(tb, min, max);
       _blend_Lab_rescale(tb, &b[j]);
 
@@ -2154,8 +2049,8 @@ static void _blend_coloradjust(const _blend_buffer_desc_t *bd, const float *a, f
       _CLAMP_XYZ(ta, min, max);
       _CLAMP_XYZ(&b[j], min, max);
 
-      _RGB_2_HSL(ta, tta);
-      _RGB_2_HSL(&b[j], ttb);
+      dt_RGB_to_HSL(ta, tta);
+      dt_RGB_to_HSL(&b[j], ttb);
 
       /* blend hue along shortest distance on color circle */
       float d = fabs(tta[0] - ttb[0]);
@@ -2165,7 +2060,7 @@ static void _blend_coloradjust(const _blend_buffer_desc_t *bd, const float *a, f
       ttb[1] = (tta[1] * (1.0f - local_opacity)) + ttb[1] * local_opacity;
       // ttb[2] (output lightness) unchanged
 
-      _HSL_2_RGB(ttb, &b[j]);
+      dt_HSL_to_RGB(ttb, &b[j]);
       _CLAMP_XYZ(&b[j], min, max);
 
       b[j + 3] = local_opacity;
@@ -44,6 +44,7 @@
 #define DT_DEV_AVERAGE_DELAY_START 250
 #define DT_DEV_PREVIEW_AVERAGE_DELAY_START 50
 #define DT_DEV_AVERAGE_DELAY_COUNT 5
+#define DT_DEV_PROGRESSIVE_SCALE 0.25f
 
 const gchar *dt_dev_histogram_type_names[DT_DEV_HISTOGRAM_N] = { "logarithmic", "linear", "waveform" };
 
@@ -280,6 +281,23 @@ restart:
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 }
 
+// decide whether the main pipe should run a coarse pass before the final one
+static int _dev_progressive_wanted(dt_develop_t *dev, dt_dev_pixelpipe_change_t pipe_changed, float scale)
+{
+  if(!dev->gui_attached || dev->image_loading) return 0;
+  // zooming and panning is covered by the preview pipe already
+  if(!(pipe_changed & (DT_DEV_PIPE_TOP_CHANGED | DT_DEV_PIPE_REMOVE | DT_DEV_PIPE_SYNCH))) return 0;
+  if(!dt_conf_get_bool("darkroom/ui/progressive")) return 0;
+  // fast pipes are better off with a single pass
+  if(dev->average_delay < (uint32_t)MAX(0, dt_conf_get_int("darkroom/ui/progressive_threshold"))) return 0;
+  // no point if the coarse frame would not be sharper than the upscaled preview
+  const float preview_scale = dev->pipe->processed_width > 0
+                                  ? dev->preview_pipe->processed_width * dev->preview_downsampling
+                                        / (float)dev->pipe->processed_width
+                                  : 1.0f;
+  return scale * DT_DEV_PROGRESSIVE_SCALE > preview_scale;
+}
+
 void dt_dev_process_image_job(dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&dev->pipe_mutex);
@@ -379,8 +397,37 @@ restart:
   x = MAX(0, scale * dev->pipe->processed_width  * (.5 + zoom_x) - wd / 2);
   y = MAX(0, scale * dev->pipe->processed_height * (.5 + zoom_y) - ht / 2);
 
+  // progressive mode: after a history change on a slow pipe, first render the visible region at
+  // a fraction of the final scale and show that, then refine. a new change while refining makes
+  // dt_iop_breakpoint() bail out of the full pass and we start over with a coarse one.
+  if(_dev_progressive_wanted(dev, pipe_changed, scale))
+  {
+    const float coarse = DT_DEV_PROGRESSIVE_SCALE;
+    dt_get_times(&start);
+    if(dt_dev_pixelpipe_process(dev->pipe, dev, x * coarse, y * coarse, MAX(1, wd * coarse),
+                                MAX(1, ht * coarse), scale * coarse))
+    {
+      if(dev->image_force_reload)
+      {
+        dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+        dt_control_log_busy_leave();
+        dev->image_status = DT_DEV_PIXELPIPE_INVALID;
+        dt_pthread_mutex_unlock(&dev->pipe_mutex);
+        return;
+      }
+      else
+        goto restart;
+    }
+    dt_show_times(&start, "[dev_process_image] coarse pixel pipeline processing", NULL);
+
+    // show the coarse frame right away, darkroom expose upscales it by backbuf_scale
+    dev->image_status = DT_DEV_PIXELPIPE_VALID;
+    dt_control_queue_redraw_center();
+  }
+
+  // when only panned, this just renders the strips that scrolled into view
   dt_get_times(&start);
-  if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale))
+  if(dt_dev_pixelpipe_process_pan(dev->pipe, dev, x, y, wd, ht, scale))
   {
     // interrupted because image changed?
     if(dev->image_force_reload)
@@ -930,7 +977,7 @@ static void auto_apply_presets(dt_develop_t *dev)
                                     "UPDATE memory.history SET num=?1 WHERE rowid=?2", -1, &stmt, NULL);
 
         // let's wrap this into a transaction, it might make it a little faster.
-        sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+        dt_database_start_transaction(darktable.db);
         do
         {
           DT_DEBUG_SQLITE3_CLEAR_BINDINGS(stmt);
@@ -944,7 +991,7 @@ static void auto_apply_presets(dt_develop_t *dev)
           r = g_list_next(r);
         } while((sqlite3_step(stmt) == SQLITE_DONE) && r);
 
-        sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+        dt_database_release_transaction(darktable.db);
 
         g_list_free(rowids);
         sqlite3_finalize(stmt);
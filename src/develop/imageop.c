@@ -1401,6 +1401,8 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
 
     // assume process_cl is ready, commit_params can overwrite this.
     if(module->process_cl) piece->process_cl_ready = 1;
+    // same for processing parts of the image on their own
+    piece->roi_invariant = (module->flags() & IOP_FLAGS_ROI_INVARIANT) != 0;
     module->commit_params(module, params, pipe, piece);
     for(int i = 0; i < length; i++) hash = ((hash << 5) + hash) ^ str[i];
     piece->hash = hash;
@@ -1479,6 +1481,15 @@ dt_iop_colorspace_type_t dt_iop_module_colorspace(const dt_iop_module_t *module)
   return iop_cs_rgb;
 }
 
+int dt_iop_module_output_is_scene_linear(const dt_iop_module_t *module)
+{
+  // also makes sure the priorities of the color* plugins are known
+  const dt_iop_colorspace_type_t cst = dt_iop_module_colorspace(module);
+  if(cst != iop_cs_rgb) return cst == iop_cs_RAW;
+  // colorin itself already outputs Lab
+  return strcmp(module->op, "colorin") && module->priority < _iop_module_colorin;
+}
+
 static void dt_iop_gui_reset_callback(GtkButton *button, dt_iop_module_t *module)
 {
   // if a drawn mask is set, remove it from the list
@@ -91,7 +91,9 @@ typedef enum dt_iop_flags_t
   IOP_FLAGS_PREVIEW_NON_OPENCL
   = 1 << 8, // Preview pixelpipe of this module must not run on GPU but always on CPU
   IOP_FLAGS_NO_HISTORY_STACK = 1 << 9, // This iop will never show up in the history stack
-  IOP_FLAGS_NO_MASKS = 1 << 10         // The module doesn't support masks (used with SUPPORT_BLENDING)
+  IOP_FLAGS_NO_MASKS = 1 << 10,        // The module doesn't support masks (used with SUPPORT_BLENDING)
+  IOP_FLAGS_ROI_INVARIANT = 1 << 11,   // Output of a region doesn't depend on which region is processed
+  IOP_FLAGS_FULL_PRECISION_CACHE = 1 << 12 // Output must not be cached as half floats
 } dt_iop_flags_t;
 
 /** status of a module*/
@@ -520,6 +522,8 @@ typedef enum dt_iop_colorspace_type_t
 
 /** find which colorspace the module works within */
 dt_iop_colorspace_type_t dt_iop_module_colorspace(const dt_iop_module_t *module);
+/** true if the module outputs raw or scene referred rgb data, i.e. it comes before colorin */
+int dt_iop_module_output_is_scene_linear(const dt_iop_module_t *module);
 
 dt_iop_module_t *get_colorout_module();
 
@@ -20,6 +20,9 @@
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
 #include <stdlib.h>
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
 
 
 // TODO: make cache global (needs to be thread safe then)
@@ -38,6 +41,9 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
   cache->size = (size_t *)calloc(entries, sizeof(size_t));
   cache->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
   cache->used = (int32_t *)calloc(entries, sizeof(int32_t));
+  cache->packed = (void **)calloc(entries, sizeof(void *));
+  cache->packable = (size_t *)calloc(entries, sizeof(size_t));
+  cache->half = 0;
   for(int k = 0; k < entries; k++)
   {
     if(size)
@@ -54,6 +60,7 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
     cache->used[k] = 0;
   }
   cache->queries = cache->misses = 0;
+  cache->packs = cache->unpacks = 0;
   return 1;
 
 alloc_memory_fail:
@@ -66,17 +73,116 @@ alloc_memory_fail:
   free(cache->size);
   free(cache->hash);
   free(cache->used);
+  free(cache->packed);
+  free(cache->packable);
 
   return 0;
 }
 
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
 {
-  for(int k = 0; k < cache->entries; k++) dt_free_align(cache->data[k]);
+  for(int k = 0; k < cache->entries; k++)
+  {
+    dt_free_align(cache->data[k]);
+    dt_free_align(cache->packed[k]);
+  }
   free(cache->data);
   free(cache->hash);
   free(cache->used);
   free(cache->size);
+  free(cache->packed);
+  free(cache->packable);
+}
+
+// round to nearest even, same as the f16c instructions
+static inline uint16_t _float_to_half(const float f)
+{
+  union { uint32_t u; float f; } in = { .f = f };
+  const uint32_t sign = in.u & 0x80000000u;
+  uint16_t o;
+  in.u ^= sign;
+  if(in.u >= (143u << 23)) // too large for half: inf, nan stays nan
+    o = (in.u > (255u << 23)) ? 0x7e00 : 0x7c00;
+  else if(in.u < (113u << 23)) // denormal half: let the fpu do the rounding
+  {
+    const union { uint32_t u; float f; } magic = { .u = 126u << 23 };
+    in.f += magic.f;
+    o = in.u - magic.u;
+  }
+  else
+  {
+    const uint32_t odd = (in.u >> 13) & 1;
+    in.u += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+    o = in.u >> 13;
+  }
+  return o | (sign >> 16);
+}
+
+static inline float _half_to_float(const uint16_t h)
+{
+  const union { uint32_t u; float f; } magic = { .u = 113u << 23 };
+  union { uint32_t u; float f; } o = { .u = (h & 0x7fffu) << 13 };
+  const uint32_t exp = o.u & (0x7c00u << 13);
+  o.u += (127u - 15u) << 23;
+  if(exp == (0x7c00u << 13)) // inf or nan
+    o.u += (128u - 16u) << 23;
+  else if(exp == 0) // zero or denormal
+  {
+    o.u += 1u << 23;
+    o.f -= magic.f;
+  }
+  o.u |= (uint32_t)(h & 0x8000u) << 16;
+  return o.f;
+}
+
+static void _pack(uint16_t *out, const float *in, size_t npixels)
+{
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) default(none) shared(out, in, npixels)
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+#ifdef __F16C__
+    _mm_storel_epi64((__m128i *)(out + 4 * k),
+                     _mm_cvtps_ph(_mm_load_ps(in + 4 * k), _MM_FROUND_TO_NEAREST_INT));
+#else
+    for(int c = 0; c < 4; c++) out[4 * k + c] = _float_to_half(in[4 * k + c]);
+#endif
+  }
+}
+
+static void _unpack(float *out, const uint16_t *in, size_t npixels)
+{
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) default(none) shared(out, in, npixels)
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+#ifdef __F16C__
+    _mm_store_ps(out + 4 * k, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)(in + 4 * k))));
+#else
+    for(int c = 0; c < 4; c++) out[4 * k + c] = _half_to_float(in[4 * k + c]);
+#endif
+  }
+}
+
+// expand a packed line back to floats, drops it if there is no memory for that
+static void _cache_unpack(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  cache->data[k] = (void *)dt_alloc_align(16, cache->size[k]);
+  if(cache->data[k])
+  {
+    _unpack((float *)cache->data[k], (const uint16_t *)cache->packed[k],
+            cache->packable[k] / (4 * sizeof(float)));
+    cache->unpacks++;
+  }
+  else
+  {
+    cache->hash[k] = -1;
+    cache->size[k] = 0;
+  }
+  dt_free_align(cache->packed[k]);
+  cache->packed[k] = NULL;
 }
 
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_pixelpipe_t *pipe, int module)
@@ -139,7 +245,7 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
 {
   cache->queries++;
   *data = NULL;
-  int max_used = -1, max = 0;
+  int max_used = -1, max = 0, hit = -1;
   size_t sz = 0;
   for(int k = 0; k < cache->entries; k++)
   {
@@ -152,22 +258,30 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
     cache->used[k]++; // age all entries
     if(cache->hash[k] == hash)
     {
-      *data = cache->data[k];
+      hit = k;
       sz = cache->size[k];
       cache->used[k] = weight; // this is the MRU entry
     }
   }
+  if(hit >= 0)
+  {
+    if(cache->packed[hit]) _cache_unpack(cache, hit);
+    *data = cache->data[hit];
+  }
 
   if(!*data || sz < size)
   {
     // kill LRU entry
     // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries,
     // weight);
-    if(cache->size[max] < size)
+    dt_free_align(cache->packed[max]);
+    cache->packed[max] = NULL;
+    cache->packable[max] = 0;
+    if(cache->size[max] < size || !cache->data[max])
     {
       dt_free_align(cache->data[max]);
-      cache->data[max] = (void *)dt_alloc_align(16, size);
-      cache->size[max] = size;
+      cache->data[max] = (void *)dt_alloc_align(16, MAX(size, cache->size[max]));
+      cache->size[max] = MAX(size, cache->size[max]);
     }
     *data = cache->data[max];
     cache->hash[max] = hash;
@@ -185,6 +299,13 @@ void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
   {
     cache->hash[k] = -1;
     cache->used[k] = 0;
+    // nothing will ever hit these again
+    if(cache->packed[k])
+    {
+      dt_free_align(cache->packed[k]);
+      cache->packed[k] = NULL;
+      cache->size[k] = 0;
+    }
   }
 }
 
@@ -192,7 +313,7 @@ void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data
 {
   for(int k = 0; k < cache->entries; k++)
   {
-    if(cache->data[k] == data)
+    if(data && cache->data[k] == data)
     {
       cache->used[k] = -cache->entries;
     }
@@ -203,22 +324,56 @@ void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *da
 {
   for(int k = 0; k < cache->entries; k++)
   {
-    if(cache->data[k] == data)
+    if(data && cache->data[k] == data)
     {
       cache->hash[k] = -1;
     }
   }
 }
 
+void dt_dev_pixelpipe_cache_set_packable(dt_dev_pixelpipe_cache_t *cache, void *data, size_t bytes)
+{
+  for(int k = 0; k < cache->entries; k++)
+    if(data && cache->data[k] == data) cache->packable[k] = MIN(bytes, cache->size[k]);
+}
+
+static void _cache_pack(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  if(!cache->data[k] || !cache->packable[k] || cache->hash[k] == (uint64_t)-1) return;
+  cache->packed[k] = dt_alloc_align(16, cache->packable[k] / 2);
+  if(!cache->packed[k]) return;
+  _pack((uint16_t *)cache->packed[k], (const float *)cache->data[k],
+        cache->packable[k] / (4 * sizeof(float)));
+  dt_free_align(cache->data[k]);
+  cache->data[k] = NULL;
+  cache->packs++;
+}
+
+void dt_dev_pixelpipe_cache_pack(dt_dev_pixelpipe_cache_t *cache, void *keep)
+{
+  if(!cache->half) return;
+  for(int k = 0; k < cache->entries; k++)
+    if(cache->data[k] != keep) _cache_pack(cache, k);
+}
+
+void dt_dev_pixelpipe_cache_pack_line(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  if(!cache->half || !data) return;
+  for(int k = 0; k < cache->entries; k++)
+    if(cache->data[k] == data) _cache_pack(cache, k);
+}
+
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
 {
   for(int k = 0; k < cache->entries; k++)
   {
     printf("pixelpipe cacheline %d ", k);
     printf("used %d by %" PRIu64 "", cache->used[k], cache->hash[k]);
+    if(cache->packed[k]) printf(" (half)");
     printf("\n");
   }
   printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
+  if(cache->half) printf("lines packed %" PRIu64 ", unpacked %" PRIu64 "\n", cache->packs, cache->unpacks);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -23,6 +23,10 @@
  * implements a simple pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
  * it is optimized for very few entries (~5), so most operations are O(N).
+ *
+ * optionally (half != 0) lines holding 4xfloat pixels that were marked packable are converted to
+ * half floats as soon as the module reading them is done, which halves what idle lines take. a packed
+ * line is expanded again by the _get() that hits it.
  */
 struct dt_dev_pixelpipe_t;
 typedef struct dt_dev_pixelpipe_cache_t
@@ -32,12 +36,17 @@ typedef struct dt_dev_pixelpipe_cache_t
   size_t *size;
   uint64_t *hash;
   int32_t *used;
+  void **packed;       // half float copy of a line whose float buffer has been freed, or NULL
+  size_t *packable;    // bytes of 4xfloat content that may be packed, 0 if the line must stay float
+  int32_t half;        // pack lines at all?
 #ifdef HAVE_OPENCL
   void **gpu_mem;
 #endif
   // profiling:
   uint64_t queries;
   uint64_t misses;
+  uint64_t packs;
+  uint64_t unpacks;
 } dt_dev_pixelpipe_cache_t;
 
 /** constructs a new cache with given cache line count (entries) and float buffer entry size in bytes.
@@ -73,6 +82,15 @@ void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data
 /** mark the given cache line pointer as invalid. */
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data);
 
+/** allow the line holding data to be stored as half floats, bytes of 4xfloat pixels or 0 to keep it float. */
+void dt_dev_pixelpipe_cache_set_packable(dt_dev_pixelpipe_cache_t *cache, void *data, size_t bytes);
+
+/** convert all valid packable lines except keep to half floats, if enabled. */
+void dt_dev_pixelpipe_cache_pack(dt_dev_pixelpipe_cache_t *cache, void *keep);
+
+/** convert the line holding data to half floats, if enabled and it is packable. */
+void dt_dev_pixelpipe_cache_pack_line(dt_dev_pixelpipe_cache_t *cache, void *data);
+
 /** print out cache lines/hashes (debug). */
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache);
 
@@ -20,6 +20,7 @@
 #include "common/histogram.h"
 #include "common/imageio.h"
 #include "common/opencl.h"
+#include "common/threadbudget.h"
 #include "control/control.h"
 #include "control/signal.h"
 #include "develop/blend.h"
@@ -108,8 +109,10 @@ int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t
 int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  int res = dt_dev_pixelpipe_init_cached(
-      pipe, 0, 5);
+  // half float lines save memory, but the count stays the same: lines of scene referred data are never packed
+  const int half = dt_conf_get_bool("pixelpipe_cache_half");
+  int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5);
+  pipe->cache.half = res && half;
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW;
   return res;
 }
@@ -117,8 +120,9 @@ int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  int res = dt_dev_pixelpipe_init_cached(
-      pipe, 0, 5);
+  const int half = dt_conf_get_bool("pixelpipe_cache_half");
+  int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5);
+  pipe->cache.half = res && half;
   pipe->type = DT_DEV_PIXELPIPE_FULL;
   return res;
 }
@@ -134,6 +138,11 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
   pipe->cache_obsolete = 0;
   pipe->backbuf = NULL;
+  pipe->backbuf_scale = 1.0f;
+  pipe->backbuf_x = pipe->backbuf_y = 0;
+  pipe->backbuf_stack_hash = 0;
+  pipe->pan_buf[0] = pipe->pan_buf[1] = NULL;
+  pipe->pan_buf_size[0] = pipe->pan_buf_size[1] = 0;
   pipe->processing = 0;
   pipe->shutdown = 0;
   pipe->opencl_error = 0;
@@ -168,6 +177,9 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   dt_dev_pixelpipe_cleanup_nodes(pipe);
   // so now it's safe to clean up cache:
   dt_dev_pixelpipe_cache_cleanup(&(pipe->cache));
+  dt_free_align(pipe->pan_buf[0]);
+  dt_free_align(pipe->pan_buf[1]);
+  pipe->pan_buf[0] = pipe->pan_buf[1] = NULL;
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   dt_pthread_mutex_destroy(&(pipe->backbuf_mutex));
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
@@ -897,6 +909,11 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       (void)dt_dev_pixelpipe_cache_get_important(&(pipe->cache), hash, bufsize, output);
     else
       (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output);
+    // scene referred data is unscaled, its shadows would end up in half float denormals. modules can opt
+    // out on their own, too.
+    const int packable = bpp == 4 * sizeof(float) && !dt_iop_module_output_is_scene_linear(module)
+                         && !(module->flags() & IOP_FLAGS_FULL_PRECISION_CACHE);
+    dt_dev_pixelpipe_cache_set_packable(&(pipe->cache), *output, packable ? bufsize : 0);
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
 
 // if(module) printf("reserving new buf in cache for module %s %s: %ld buf %p\n", module->op, pipe ==
@@ -1832,6 +1849,16 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
                     : pixelpipe_flow & PIXELPIPE_FLOW_HISTOGRAM_ON_CPU ? "CPU" : ""));
     }
 
+    piece->process_time = dt_get_wtime() - start.clock;
+
+    // feed the opencl scheduler. asynchronous opencl pipes only tell us how long it took to enqueue the kernels.
+    if(!(pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU))
+      dt_opencl_scheduler_record(-1, pipe->type, module->op, pipe->output_pixels, piece->process_time);
+#ifdef HAVE_OPENCL
+    else if(!darktable.opencl->async_pixelpipe || pipe->type == DT_DEV_PIXELPIPE_EXPORT)
+      dt_opencl_scheduler_record(pipe->devid, pipe->type, module->op, pipe->output_pixels, piece->process_time);
+#endif
+
     gchar *module_label = dt_history_item_get_name(module);
     dt_show_times(
         &start, "[dev_pixelpipe]", "processed `%s' on %s%s%s, blended on %s [%s]", module_label,
@@ -2271,6 +2298,16 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       if(dev->gui_attached && !dev->gui_leaving && strcmp(module->op, "gamma") == 0)
         dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_UI_PIPE_FINISHED);
     }
+
+    // this module was the only consumer of its input, pack that line right away instead of after the run,
+    // so that no more than the lines in flight are at full size. the focussed module's input is kept as it
+    // is, it is about to be needed again.
+    if(input && module != dev->gui_module)
+    {
+      dt_pthread_mutex_lock(&pipe->busy_mutex);
+      dt_dev_pixelpipe_cache_pack_line(&(pipe->cache), input);
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    }
   }
 
   return 0;
@@ -2372,13 +2409,29 @@ static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, d
 }
 
 
-int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
-                             float scale)
+// runs the pipe for the given roi and returns the final buffer (a cache line) without publishing it
+static int _dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width,
+                                  int height, float scale, void **output)
 {
   pipe->processing = 1;
+  // size our openmp team according to what the other running pipes already use
+  const int32_t omp_threads = dt_thread_budget_acquire(darktable.thread_budget, pipe->type);
   pipe->opencl_enabled = dt_opencl_update_enabled(); // update enabled flag from preferences
-  pipe->devid = (pipe->opencl_enabled) ? dt_opencl_lock_device(pipe->type)
-                                       : -1; // try to get/lock opencl resource
+  pipe->output_pixels = (size_t)width * height;
+  if(pipe->opencl_enabled)
+  {
+    // try to get/lock opencl resource, the scheduler needs to know what we are going to run
+    GList *ops = NULL;
+    for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+    {
+      dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+      if(piece->enabled) ops = g_list_prepend(ops, piece->module->op);
+    }
+    pipe->devid = dt_opencl_lock_device_scheduled(pipe->type, ops, pipe->output_pixels);
+    g_list_free(ops);
+  }
+  else
+    pipe->devid = -1;
 
   dt_print(DT_DEBUG_OPENCL, "[pixelpipe_process] [%s] using device %d\n", _pipe_type_to_str(pipe->type),
            pipe->devid);
@@ -2468,20 +2521,145 @@ restart:
   // ... and in case of other errors ...
   if(err)
   {
+    dt_thread_budget_release(darktable.thread_budget, pipe->type, omp_threads);
     pipe->processing = 0;
     return 1;
   }
 
-  // terminate
+  *output = buf;
+
+  // the run is done, what it left in the cache is idle until the next one
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  dt_dev_pixelpipe_cache_pack(&(pipe->cache), buf);
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+
+  dt_thread_budget_release(darktable.thread_budget, pipe->type, omp_threads);
+
+  // printf("pixelpipe homebrew process end\n");
+  pipe->processing = 0;
+  return 0;
+}
+
+// hash of the module stack and scale, independent of the roi position
+static uint64_t _dev_pixelpipe_stack_hash(dt_dev_pixelpipe_t *pipe, float scale)
+{
+  dt_iop_roi_t roi = (dt_iop_roi_t){ 0, 0, 0, 0, scale };
+  return dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi, pipe, g_list_length(pipe->nodes));
+}
+
+static void _dev_pixelpipe_set_backbuf(dt_dev_pixelpipe_t *pipe, void *buf, int x, int y, int width, int height,
+                                       float scale)
+{
+  dt_iop_roi_t roi = (dt_iop_roi_t){ x, y, width, height, scale };
   dt_pthread_mutex_lock(&pipe->backbuf_mutex);
   pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi, pipe, 0);
+  pipe->backbuf_stack_hash = _dev_pixelpipe_stack_hash(pipe, scale);
   pipe->backbuf = buf;
+  pipe->backbuf_x = x;
+  pipe->backbuf_y = y;
   pipe->backbuf_width = width;
   pipe->backbuf_height = height;
+  pipe->backbuf_scale = scale;
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+}
 
-  // printf("pixelpipe homebrew process end\n");
-  pipe->processing = 0;
+int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
+                             float scale)
+{
+  void *buf = NULL;
+  if(_dev_pixelpipe_process(pipe, dev, x, y, width, height, scale, &buf)) return 1;
+  _dev_pixelpipe_set_backbuf(pipe, buf, x, y, width, height, scale);
+  return 0;
+}
+
+// can the previous backbuffer be shifted and completed by rendering only the uncovered strips?
+static int _dev_pixelpipe_pan_possible(dt_dev_pixelpipe_t *pipe, int x, int y, int width, int height,
+                                       float scale)
+{
+  if(!pipe->backbuf || pipe->backbuf_width != width || pipe->backbuf_height != height
+     || pipe->backbuf_scale != scale)
+    return 0;
+  const int dx = x - pipe->backbuf_x, dy = y - pipe->backbuf_y;
+  if(dx == 0 && dy == 0) return 0;
+  if(abs(dx) >= width || abs(dy) >= height) return 0;
+  // not worth it if most of the window is new anyways
+  if((size_t)(width - abs(dx)) * (height - abs(dy)) < (size_t)width * height / 4) return 0;
+  if(pipe->backbuf_stack_hash != _dev_pixelpipe_stack_hash(pipe, scale)) return 0;
+
+  // the strips are composed into the frame for good, so they have to match the rest of it exactly
+  return dt_dev_pixelpipe_is_roi_invariant(pipe);
+}
+
+int dt_dev_pixelpipe_is_roi_invariant(dt_dev_pixelpipe_t *pipe)
+{
+  // tiling isn't enough of a guarantee, that tolerates seams. modules have to say so explicitly, and
+  // clear it in commit_params for modes that compute statistics over their roi.
+  // raw pipes never qualify: demosaic picks its method from the scale and its sampling phase from the roi
+  // offset, so it isn't flagged. panning raws is not accelerated.
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled) continue;
+    if(!piece->roi_invariant) return 0;
+    // histograms would only cover a part
+    if(piece->request_histogram & DT_REQUEST_ON) return 0;
+    // blurred blend masks are computed on the processed roi only
+    const dt_develop_blend_params_t *bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+    if(bp && bp->mask_mode != DEVELOP_MASK_DISABLED && bp->radius > 0.0f) return 0;
+  }
+  return 1;
+}
+
+int dt_dev_pixelpipe_process_pan(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width,
+                                 int height, float scale)
+{
+  if(!_dev_pixelpipe_pan_possible(pipe, x, y, width, height, scale))
+    return dt_dev_pixelpipe_process(pipe, dev, x, y, width, height, scale);
+
+  // compose into the pan buffer that is not on screen right now
+  const int k = (pipe->backbuf == pipe->pan_buf[0]) ? 1 : 0;
+  const size_t size = (size_t)4 * width * height;
+  if(pipe->pan_buf_size[k] < size)
+  {
+    dt_free_align(pipe->pan_buf[k]);
+    pipe->pan_buf[k] = dt_alloc_align(64, size);
+    pipe->pan_buf_size[k] = pipe->pan_buf[k] ? size : 0;
+    if(!pipe->pan_buf[k]) return dt_dev_pixelpipe_process(pipe, dev, x, y, width, height, scale);
+  }
+  uint8_t *out = pipe->pan_buf[k];
+
+  // overlap of the old window, in coordinates of the new one
+  const int dx = x - pipe->backbuf_x, dy = y - pipe->backbuf_y;
+  const int ox0 = MAX(0, -dx), ox1 = MIN(width, width - dx);
+  const int oy0 = MAX(0, -dy), oy1 = MIN(height, height - dy);
+
+  // copy the overlap first, the backbuffer may live in a cache line the strips will reuse
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  for(int j = oy0; j < oy1; j++)
+    memcpy(out + 4 * ((size_t)j * width + ox0), pipe->backbuf + 4 * ((size_t)(j + dy) * width + ox0 + dx),
+           (size_t)4 * (ox1 - ox0));
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+
+  // at most two of these are non-empty for a single pan step
+  const int strips[4][4] = { { 0, 0, width, oy0 },
+                             { 0, oy1, width, height - oy1 },
+                             { 0, oy0, ox0, oy1 - oy0 },
+                             { ox1, oy0, width - ox1, oy1 - oy0 } };
+  for(int s = 0; s < 4; s++)
+  {
+    const int sx = strips[s][0], sy = strips[s][1], sw = strips[s][2], sh = strips[s][3];
+    if(sw <= 0 || sh <= 0) continue;
+    void *buf = NULL;
+    if(_dev_pixelpipe_process(pipe, dev, x + sx, y + sy, sw, sh, scale, &buf)) return 1;
+    for(int j = 0; j < sh; j++)
+      memcpy(out + 4 * ((size_t)(sy + j) * width + sx), (uint8_t *)buf + (size_t)4 * j * sw, (size_t)4 * sw);
+  }
+
+  dt_print(DT_DEBUG_PERF, "[pixelpipe_process_pan] [%s] shifted by %d %d, rendered %.0f%% of %dx%d\n",
+           _pipe_type_to_str(pipe->type), dx, dy,
+           100.0 * (1.0 - (double)(ox1 - ox0) * (oy1 - oy0) / ((double)width * height)), width, height);
+
+  _dev_pixelpipe_set_backbuf(pipe, out, x, y, width, height, scale);
   return 0;
 }
 
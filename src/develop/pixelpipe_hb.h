@@ -54,6 +54,8 @@ typedef struct dt_dev_pixelpipe_iop_t
   dt_iop_roi_t buf_in,
       buf_out;                // theoretical full buffer regions of interest, as passed through modify_roi_out
   int process_cl_ready;       // set this to 0 in commit_params to temporarily disable the use of process_cl
+  int roi_invariant;          // from IOP_FLAGS_ROI_INVARIANT, cleared in commit_params by modes that aren't
+  double process_time;        // seconds the last run of this piece took, blending and tiling included
 
   // the following are used  internally for caching:
   float processed_maximum[4]; // sensor saturation after this iop
@@ -109,7 +111,15 @@ typedef struct dt_dev_pixelpipe_t
   uint8_t *backbuf;
   size_t backbuf_size;
   int backbuf_width, backbuf_height;
+  // roi the backbuffer was processed for (scale is lower than requested after a progressive coarse pass)
+  int backbuf_x, backbuf_y;
+  float backbuf_scale;
   uint64_t backbuf_hash;
+  // hash of the module stack the backbuffer was processed with, regardless of roi
+  uint64_t backbuf_stack_hash;
+  // owned output buffers for incremental panning, one of them may be the backbuf
+  uint8_t *pan_buf[2];
+  size_t pan_buf_size[2];
   dt_pthread_mutex_t backbuf_mutex, busy_mutex;
   // working?
   int processing;
@@ -132,6 +142,8 @@ typedef struct dt_dev_pixelpipe_t
   dt_imageio_levels_t levels;
   // opencl device that has been locked for this pipe.
   int devid;
+  // pixels of the roi currently processed, the unit the opencl scheduler measures modules in
+  size_t output_pixels;
   // image struct as it was when the pixelpipe was initialized. copied to avoid race conditions.
   dt_image_t image;
 } dt_dev_pixelpipe_t;
@@ -181,10 +193,18 @@ void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *d
 // process region of interest of pixels. returns 1 if pipe was altered during processing.
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width,
                              int height, float scale);
+// same as above, but if only the roi position changed since the last run and all modules allow it,
+// shift the previous backbuffer and only process the newly exposed strips.
+int dt_dev_pixelpipe_process_pan(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width,
+                                 int height, float scale);
 // convenience method that does not gamma-compress the image.
 int dt_dev_pixelpipe_process_no_gamma(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y,
                                       int width, int height, float scale);
 
+// true if processing the image in parts gives the same pixels as processing it at once, because no enabled
+// module derives anything from the roi it is given. never the case with demosaic in the pipe.
+int dt_dev_pixelpipe_is_roi_invariant(dt_dev_pixelpipe_t *pipe);
+
 // disable given op and all that comes after it in the pipe:
 void dt_dev_pixelpipe_disable_after(dt_dev_pixelpipe_t *pipe, const char *op);
 // disable given op and all that comes before it in the pipe:
@@ -235,7 +235,7 @@ uint32_t next_random()
 static int process_next_image()
 {
   static int counter = 0;
-  dt_imageio_module_format_t buf;
+  dt_imageio_module_format_t buf = { 0 };
   dt_imageio_module_data_t dat;
   buf.mime = mime;
   buf.levels = levels;
@@ -77,6 +77,14 @@ int bpp(struct dt_imageio_module_data_t *data);
 /* write to file, with exif if not NULL, and icc profile if supported. */
 int write_image(struct dt_imageio_module_data_t *data, const char *filename, const void *in, void *exif,
                 int exif_len, int imgid, int num, int total);
+/* optional row streaming version of write_image(), for images too large to be processed in one go.
+ * write_begin() returns a handle (NULL on fail) and has to copy the exif blob if it needs it later,
+ * write_rows() gets the next rows of data->width pixels in the same layout write_image() gets them,
+ * write_finish() is always called, with error != 0 if the image is incomplete. return != 0 on fail. */
+void *write_begin(struct dt_imageio_module_data_t *data, const char *filename, void *exif, int exif_len,
+                  int imgid, int num, int total);
+int write_rows(struct dt_imageio_module_data_t *data, void *stream, const void *in, int rows);
+int write_finish(struct dt_imageio_module_data_t *data, void *stream, int error);
 /* flag that describes the available precision/levels of output format. mainly used for dithering. */
 int levels(struct dt_imageio_module_data_t *data);
 
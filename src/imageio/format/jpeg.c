@@ -313,24 +313,57 @@ read_icc_profile (j_decompress_ptr cinfo,
 #undef MAX_SEQ_NO
 
 
-int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp, void *exif,
-                int exif_len, int imgid, int num, int total)
+// state of an image being written row by row
+typedef struct dt_imageio_jpeg_stream_t
 {
-  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
-  const uint8_t *in = (const uint8_t *)in_tmp;
   struct dt_imageio_jpeg_error_mgr jerr;
+  FILE *f;
+  char *filename;
+  void *exif;
+  int exif_len;
+  uint8_t *row;
+} dt_imageio_jpeg_stream_t;
 
-  jpg->cinfo.err = jpeg_std_error(&jerr.pub);
-  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
-  if(setjmp(jerr.setjmp_buffer))
+static void _stream_free(dt_imageio_jpeg_stream_t *stream)
+{
+  if(stream->f) fclose(stream->f);
+  g_free(stream->filename);
+  g_free(stream->exif);
+  free(stream->row);
+  free(stream);
+}
+
+void *write_begin(dt_imageio_module_data_t *jpg_tmp, const char *filename, void *exif, int exif_len, int imgid,
+                  int num, int total)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
+  dt_imageio_jpeg_stream_t *stream = calloc(1, sizeof(dt_imageio_jpeg_stream_t));
+  if(!stream) return NULL;
+  stream->row = malloc(sizeof(uint8_t) * 3 * jpg->width);
+  stream->f = fopen(filename, "wb");
+  if(!stream->row || !stream->f)
+  {
+    _stream_free(stream);
+    return NULL;
+  }
+  stream->filename = g_strdup(filename);
+  // the blob is written once the file is complete
+  if(exif && exif_len > 0)
+  {
+    stream->exif = g_memdup(exif, exif_len);
+    stream->exif_len = exif_len;
+  }
+
+  jpg->cinfo.err = jpeg_std_error(&stream->jerr.pub);
+  stream->jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if(setjmp(stream->jerr.setjmp_buffer))
   {
     jpeg_destroy_compress(&(jpg->cinfo));
-    return 1;
+    _stream_free(stream);
+    return NULL;
   }
   jpeg_create_compress(&(jpg->cinfo));
-  FILE *f = fopen(filename, "wb");
-  if(!f) return 1;
-  jpeg_stdio_dest(&(jpg->cinfo), f);
+  jpeg_stdio_dest(&(jpg->cinfo), stream->f);
 
   jpg->cinfo.image_width = jpg->width;
   jpg->cinfo.image_height = jpg->height;
@@ -380,24 +413,57 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
     }
   }
 
-  uint8_t row[3 * jpg->width];
-  const uint8_t *buf;
-  while(jpg->cinfo.next_scanline < jpg->cinfo.image_height)
+  return stream;
+}
+
+int write_rows(dt_imageio_module_data_t *jpg_tmp, void *stream_tmp, const void *in_tmp, int rows)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
+  dt_imageio_jpeg_stream_t *stream = (dt_imageio_jpeg_stream_t *)stream_tmp;
+  const uint8_t *in = (const uint8_t *)in_tmp;
+  if(setjmp(stream->jerr.setjmp_buffer)) return 1;
+
+  uint8_t *row = stream->row;
+  for(int j = 0; j < rows && jpg->cinfo.next_scanline < jpg->cinfo.image_height; j++)
   {
     JSAMPROW tmp[1];
-    buf = in + (size_t)jpg->cinfo.next_scanline * jpg->cinfo.image_width * 4;
+    const uint8_t *buf = in + (size_t)j * jpg->cinfo.image_width * 4;
     for(int i = 0; i < jpg->width; i++)
       for(int k = 0; k < 3; k++) row[3 * i + k] = buf[4 * i + k];
     tmp[0] = row;
     jpeg_write_scanlines(&(jpg->cinfo), tmp, 1);
   }
-  jpeg_finish_compress(&(jpg->cinfo));
+  return 0;
+}
+
+int write_finish(dt_imageio_module_data_t *jpg_tmp, void *stream_tmp, int error)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
+  dt_imageio_jpeg_stream_t *stream = (dt_imageio_jpeg_stream_t *)stream_tmp;
+  if(setjmp(stream->jerr.setjmp_buffer))
+  {
+    jpeg_destroy_compress(&(jpg->cinfo));
+    _stream_free(stream);
+    return 1;
+  }
+  if(!error) jpeg_finish_compress(&(jpg->cinfo));
   jpeg_destroy_compress(&(jpg->cinfo));
-  fclose(f);
+  fclose(stream->f);
+  stream->f = NULL;
 
-  dt_exif_write_blob(exif, exif_len, filename, 1);
+  if(!error) dt_exif_write_blob(stream->exif, stream->exif_len, stream->filename, 1);
 
-  return 0;
+  _stream_free(stream);
+  return error;
+}
+
+int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp, void *exif,
+                int exif_len, int imgid, int num, int total)
+{
+  void *stream = write_begin(jpg_tmp, filename, exif, exif_len, imgid, num, total);
+  if(!stream) return 1;
+  const int error = write_rows(jpg_tmp, stream, in_tmp, jpg_tmp->height);
+  return write_finish(jpg_tmp, stream, error);
 }
 
 static int __attribute__((__unused__)) read_header(const char *filename, dt_imageio_jpeg_t *jpg)
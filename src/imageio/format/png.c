@@ -120,13 +120,47 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
   png_free(ping, text);
 }
 
-int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid, void *exif,
-                int exif_len, int imgid, int num, int total)
+// the image data is filtered and deflated here instead of in libpng, so it can use all cores: rows are
+// filtered in parallel, and the filtered data is cut into chunks that are deflated in parallel, each one
+// primed with the 32k of data before it. all but the last chunk end on a sync flush, so the pieces join
+// into one zlib stream, as in pigz. the result goes out as regular IDAT chunks.
+#define DT_PNG_DEFLATE_CHUNK (1 << 17)
+#define DT_PNG_DEFLATE_WINDOW (1 << 15)
+#define DT_PNG_IDAT_SIZE (1 << 18)
+
+// state of an image being written row by row
+typedef struct dt_imageio_png_stream_t
+{
+  FILE *f;
+  png_structp png_ptr;
+  png_infop info_ptr;
+  int y;              // rows written so far
+  uint8_t *prev;      // last packed row, the filters of the next row need it
+  uint8_t *window;    // last DT_PNG_DEFLATE_WINDOW bytes of filtered data, dictionary of the next chunk
+  size_t window_len;
+  uLong adler;        // of all filtered data so far
+} dt_imageio_png_stream_t;
+
+static void _stream_free(dt_imageio_png_stream_t *stream)
+{
+  free(stream->prev);
+  free(stream->window);
+  free(stream);
+}
+
+void *write_begin(dt_imageio_module_data_t *p_tmp, const char *filename, void *exif, int exif_len, int imgid,
+                  int num, int total)
 {
   dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
   const int width = p->width, height = p->height;
+  dt_imageio_png_stream_t *stream = calloc(1, sizeof(dt_imageio_png_stream_t));
+  if(!stream) return NULL;
   FILE *f = fopen(filename, "wb");
-  if(!f) return 1;
+  if(!f)
+  {
+    free(stream);
+    return NULL;
+  }
 
   png_structp png_ptr;
   png_infop info_ptr;
@@ -135,7 +169,8 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
   if(!png_ptr)
   {
     fclose(f);
-    return 1;
+    free(stream);
+    return NULL;
   }
 
   info_ptr = png_create_info_struct(png_ptr);
@@ -143,14 +178,16 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
   {
     fclose(f);
     png_destroy_write_struct(&png_ptr, NULL);
-    return 1;
+    free(stream);
+    return NULL;
   }
 
   if(setjmp(png_jmpbuf(png_ptr)))
   {
     fclose(f);
     png_destroy_write_struct(&png_ptr, &info_ptr);
-    return 1;
+    free(stream);
+    return NULL;
   }
 
   png_init_io(png_ptr, f);
@@ -194,37 +231,264 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
 
   png_write_info(png_ptr, info_ptr);
 
-  /*
-   * Get rid of filler (OR ALPHA) bytes, pack XRGB/RGBX/ARGB/RGBA into
-   * RGB (4 channels -> 3 channels). The second parameter is not used.
-   */
-  png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
+  const size_t rowbytes = (size_t)3 * width * (p->bpp / 8);
+  stream->prev = calloc(rowbytes, 1);
+  stream->window = malloc(DT_PNG_DEFLATE_WINDOW);
+  if(!stream->prev || !stream->window)
+  {
+    fclose(f);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    _stream_free(stream);
+    return NULL;
+  }
+  stream->adler = adler32(0L, Z_NULL, 0);
 
-  png_bytep *row_pointers = malloc((size_t)height * sizeof(png_bytep));
+  stream->f = f;
+  stream->png_ptr = png_ptr;
+  stream->info_ptr = info_ptr;
+  return stream;
+}
 
+// rgba in host order to rgb in network order
+static void _pack_row(const dt_imageio_png_t *p, const void *ivoid, const int y, uint8_t *row)
+{
+  const int width = p->width;
   if(p->bpp > 8)
   {
-    /* swap bytes of 16 bit files to most significant bit first */
-    png_set_swap(png_ptr);
-
-    for(unsigned i = 0; i < height; i++)
-      row_pointers[i] = (png_bytep)((uint16_t *)ivoid + (size_t)4 * i * width);
+    const uint16_t *in = (const uint16_t *)ivoid + (size_t)4 * y * width;
+    for(int x = 0; x < width; x++, in += 4)
+      for(int c = 0; c < 3; c++, row += 2)
+      {
+        row[0] = in[c] >> 8;
+        row[1] = in[c] & 0xff;
+      }
   }
   else
   {
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (uint8_t *)ivoid + (size_t)4 * i * width;
+    const uint8_t *in = (const uint8_t *)ivoid + (size_t)4 * y * width;
+    for(int x = 0; x < width; x++, in += 4, row += 3) memcpy(row, in, 3);
   }
+}
 
-  png_write_image(png_ptr, row_pointers);
+static inline uint8_t _paeth(const int a, const int b, const int c)
+{
+  const int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+  if(pa <= pb && pa <= pc) return a;
+  if(pb <= pc) return b;
+  return c;
+}
 
-  free(row_pointers);
+// picks the filter type with the smallest sum of absolute differences, like libpng does, and writes the
+// filter type byte followed by the filtered row to out
+static void _filter_row(const uint8_t *row, const uint8_t *prev, const size_t rowbytes, const int bpp,
+                        uint8_t *out)
+{
+  uint64_t sum[5] = { 0 };
+  for(size_t i = 0; i < rowbytes; i++)
+  {
+    const int x = row[i], b = prev[i];
+    const int a = i >= (size_t)bpp ? row[i - bpp] : 0, c = i >= (size_t)bpp ? prev[i - bpp] : 0;
+    sum[0] += abs((int8_t)x);
+    sum[1] += abs((int8_t)(x - a));
+    sum[2] += abs((int8_t)(x - b));
+    sum[3] += abs((int8_t)(x - ((a + b) >> 1)));
+    sum[4] += abs((int8_t)(x - _paeth(a, b, c)));
+  }
+  int type = 0;
+  for(int k = 1; k < 5; k++)
+    if(sum[k] < sum[type]) type = k;
 
-  png_write_end(png_ptr, info_ptr);
-  png_destroy_write_struct(&png_ptr, &info_ptr);
-  fclose(f);
+  out[0] = type;
+  out++;
+  for(size_t i = 0; i < rowbytes; i++)
+  {
+    const int x = row[i], b = prev[i];
+    const int a = i >= (size_t)bpp ? row[i - bpp] : 0, c = i >= (size_t)bpp ? prev[i - bpp] : 0;
+    switch(type)
+    {
+      case 0:
+        out[i] = x;
+        break;
+      case 1:
+        out[i] = x - a;
+        break;
+      case 2:
+        out[i] = x - b;
+        break;
+      case 3:
+        out[i] = x - ((a + b) >> 1);
+        break;
+      default:
+        out[i] = x - _paeth(a, b, c);
+        break;
+    }
+  }
+}
+
+// raw deflate of one chunk, primed with the data in front of it. returns the compressed size, 0 on fail
+static size_t _deflate_chunk(const uint8_t *dict, const size_t dict_len, const uint8_t *in, const size_t len,
+                             const int last, uint8_t *out, const size_t out_len)
+{
+  z_stream z = { 0 };
+  if(deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 0;
+  if(dict_len) deflateSetDictionary(&z, dict, dict_len);
+  z.next_in = (Bytef *)in;
+  z.avail_in = len;
+  z.next_out = out;
+  z.avail_out = out_len;
+  const int ret = deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+  const size_t written = out_len - z.avail_out;
+  deflateEnd(&z);
+  if(last ? ret != Z_STREAM_END : (ret != Z_OK || z.avail_in)) return 0;
+  return written;
+}
+
+static int _write_batch(const dt_imageio_png_t *p, dt_imageio_png_stream_t *stream, const void *ivoid,
+                        const int rows)
+{
+  const int pixelbytes = 3 * (p->bpp / 8);
+  const size_t rowbytes = (size_t)pixelbytes * p->width;
+  const size_t filtered_len = (rowbytes + 1) * rows;
+  const int last = stream->y + rows >= p->height;
+  const int nchunks = (filtered_len + DT_PNG_DEFLATE_CHUNK - 1) / DT_PNG_DEFLATE_CHUNK;
+  const size_t bound = deflateBound(NULL, DT_PNG_DEFLATE_CHUNK) + 16;
+  int err = 0;
+
+  uint8_t *packed = malloc(rowbytes * rows);
+  // filtered data behind the window of what came before, so every chunk finds its dictionary in front of it
+  uint8_t *filtered = malloc(DT_PNG_DEFLATE_WINDOW + filtered_len);
+  uint8_t *deflated = malloc(bound * nchunks);
+  size_t *deflated_len = calloc(nchunks, sizeof(size_t));
+  uLong *adler = malloc(sizeof(uLong) * nchunks);
+  if(!packed || !filtered || !deflated || !deflated_len || !adler)
+  {
+    err = 1;
+    goto end;
+  }
+  uint8_t *data = filtered + DT_PNG_DEFLATE_WINDOW;
+  uint8_t *const dict_start = data - stream->window_len;
+  memcpy(dict_start, stream->window, stream->window_len);
+  const uint8_t *prev = stream->prev;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(p, ivoid, packed) schedule(static)
+#endif
+  for(int j = 0; j < rows; j++) _pack_row(p, ivoid, j, packed + rowbytes * j);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(packed, data, prev) schedule(static)
+#endif
+  for(int j = 0; j < rows; j++)
+    _filter_row(packed + rowbytes * j, j ? packed + rowbytes * (j - 1) : prev, rowbytes, pixelbytes,
+                data + (rowbytes + 1) * j);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(data, deflated, deflated_len, adler) schedule(dynamic)
+#endif
+  for(int k = 0; k < nchunks; k++)
+  {
+    const size_t offset = (size_t)k * DT_PNG_DEFLATE_CHUNK;
+    const size_t len = MIN(DT_PNG_DEFLATE_CHUNK, filtered_len - offset);
+    const uint8_t *dict = MAX(dict_start, data + offset - DT_PNG_DEFLATE_WINDOW);
+    deflated_len[k] = _deflate_chunk(dict, data + offset - dict, data + offset, len, last && k == nchunks - 1,
+                                     deflated + bound * k, bound);
+    adler[k] = adler32(adler32(0L, Z_NULL, 0), data + offset, len);
+  }
+
+  if(setjmp(png_jmpbuf(stream->png_ptr)))
+  {
+    err = 1;
+    goto end;
+  }
+
+  // zlib header first: deflate with 32k window, maximum compression
+  if(stream->y == 0)
+  {
+    const uint8_t header[2] = { 0x78, 0xda };
+    png_write_chunk(stream->png_ptr, (png_const_bytep) "IDAT", header, sizeof(header));
+  }
+  for(int k = 0; k < nchunks; k++)
+  {
+    if(!deflated_len[k])
+    {
+      err = 1;
+      goto end;
+    }
+    for(size_t o = 0; o < deflated_len[k]; o += DT_PNG_IDAT_SIZE)
+      png_write_chunk(stream->png_ptr, (png_const_bytep) "IDAT", deflated + bound * k + o,
+                      MIN(DT_PNG_IDAT_SIZE, deflated_len[k] - o));
+    const size_t len = MIN(DT_PNG_DEFLATE_CHUNK, filtered_len - (size_t)k * DT_PNG_DEFLATE_CHUNK);
+    stream->adler = adler32_combine(stream->adler, adler[k], len);
+  }
+  if(last)
+  {
+    const uint8_t trailer[4] = { stream->adler >> 24, (stream->adler >> 16) & 0xff, (stream->adler >> 8) & 0xff,
+                                 stream->adler & 0xff };
+    png_write_chunk(stream->png_ptr, (png_const_bytep) "IDAT", trailer, sizeof(trailer));
+  }
+
+  // keep what the next batch needs
+  memcpy(stream->prev, packed + rowbytes * (rows - 1), rowbytes);
+  stream->window_len = MIN(DT_PNG_DEFLATE_WINDOW, stream->window_len + filtered_len);
+  memcpy(stream->window, data + filtered_len - stream->window_len, stream->window_len);
+  stream->y += rows;
+
+end:
+  free(packed);
+  free(filtered);
+  free(deflated);
+  free(deflated_len);
+  free(adler);
+  return err;
+}
+
+int write_rows(dt_imageio_module_data_t *p_tmp, void *stream_tmp, const void *ivoid, int rows)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  dt_imageio_png_stream_t *stream = (dt_imageio_png_stream_t *)stream_tmp;
+  const size_t rowbytes = (size_t)3 * p->width * (p->bpp / 8);
+  const size_t rowsize = (size_t)4 * p->width * (p->bpp / 8);
+  // a few chunks per thread at a time, to keep the scratch memory small
+  const int batch = MAX(1, (int)(4 * DT_PNG_DEFLATE_CHUNK * (size_t)dt_get_num_threads() / rowbytes));
+
+  dt_times_t start;
+  dt_get_times(&start);
+  for(int y = 0; y < rows; y += batch)
+    if(_write_batch(p, stream, (const uint8_t *)ivoid + rowsize * y, MIN(batch, rows - y))) return 1;
+  dt_show_times(&start, "[png] filter and deflate", "%d rows of %zu bytes", rows, rowbytes);
   return 0;
 }
 
+int write_finish(dt_imageio_module_data_t *p_tmp, void *stream_tmp, int error)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  dt_imageio_png_stream_t *stream = (dt_imageio_png_stream_t *)stream_tmp;
+
+  // the image data went out as raw IDAT chunks, so end the file ourselves instead of png_write_end()
+  if(!error && stream->y != p->height) error = 1;
+  if(setjmp(png_jmpbuf(stream->png_ptr)))
+    error = 1;
+  else if(!error)
+  {
+    png_write_chunk(stream->png_ptr, (png_const_bytep) "IEND", NULL, 0);
+    png_write_flush(stream->png_ptr);
+  }
+
+  png_destroy_write_struct(&stream->png_ptr, &stream->info_ptr);
+  fclose(stream->f);
+  _stream_free(stream);
+  return error;
+}
+
+int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid, void *exif,
+                int exif_len, int imgid, int num, int total)
+{
+  void *stream = write_begin(p_tmp, filename, exif, exif_len, imgid, num, total);
+  if(!stream) return 1;
+  const int error = write_rows(p_tmp, stream, ivoid, p_tmp->height);
+  return write_finish(p_tmp, stream, error);
+}
+
 static int __attribute__((__unused__)) read_header(const char *filename, dt_imageio_module_data_t *p_tmp)
 {
   dt_imageio_png_t *png = (dt_imageio_png_t *)p_tmp;
@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <tiffio.h>
+#include <zlib.h>
 
 DT_MODULE(2)
 
@@ -51,19 +52,139 @@ typedef struct dt_imageio_tiff_gui_t
 } dt_imageio_tiff_gui_t;
 
 
-int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void, void *exif,
-                int exif_len, int imgid, int num, int total)
+// state of an image being written row by row
+typedef struct dt_imageio_tiff_stream_t
+{
+  TIFF *tif;
+  int y;         // next row to write
+  int predictor; // deflate predictor if we compress the strips ourselves, 0 to leave it to libtiff
+  void *rowdata;
+  char *filename;
+  void *exif;
+  int exif_len;
+} dt_imageio_tiff_stream_t;
+
+static void _stream_free(dt_imageio_tiff_stream_t *stream)
+{
+  if(stream->tif) TIFFClose(stream->tif);
+  free(stream->rowdata);
+  g_free(stream->filename);
+  g_free(stream->exif);
+  free(stream);
+}
+
+// rows written as one deflate strip each. libtiff compresses them one after the other, so for the
+// deflate settings we pack, predict and compress a batch of rows on all cores and hand the finished strips
+// to TIFFWriteRawStrip() in order. the strips are the same libtiff would write.
+#define DT_TIFF_DEFLATE_BATCH 16
+
+static void _pack_row(const dt_imageio_tiff_t *d, const void *in_void, const int y, uint8_t *row)
+{
+  const size_t bytes = d->bpp / 8;
+  const uint8_t *in = (const uint8_t *)in_void + (size_t)4 * y * d->width * bytes;
+  for(int x = 0; x < d->width; x++, in += 4 * bytes, row += 3 * bytes) memcpy(row, in, 3 * bytes);
+}
+
+// horizontal differencing, TIFFTAG_PREDICTOR 2. samples are in host order, which is the file's order here
+static void _predict_horizontal(const dt_imageio_tiff_t *d, uint8_t *row)
+{
+  const size_t n = (size_t)3 * d->width;
+  if(d->bpp == 8)
+  {
+    for(size_t i = n - 1; i >= 3; i--) row[i] -= row[i - 3];
+  }
+  else if(d->bpp == 16)
+  {
+    uint16_t *r = (uint16_t *)row;
+    for(size_t i = n - 1; i >= 3; i--) r[i] -= r[i - 3];
+  }
+  else
+  {
+    uint32_t *r = (uint32_t *)row;
+    for(size_t i = n - 1; i >= 3; i--) r[i] -= r[i - 3];
+  }
+}
+
+// floating point predictor, TIFFTAG_PREDICTOR 3: bytes of the floats split into planes, most significant
+// first, and then differenced like 8-bit samples. tmp is scratch space of one row.
+static void _predict_float(const dt_imageio_tiff_t *d, uint8_t *row, uint8_t *tmp)
+{
+  const size_t wc = (size_t)3 * d->width;
+  const size_t cc = 4 * wc;
+  memcpy(tmp, row, cc);
+  for(size_t count = 0; count < wc; count++)
+    for(int byte = 0; byte < 4; byte++)
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+      row[byte * wc + count] = tmp[4 * count + byte];
+#else
+      row[(4 - byte - 1) * wc + count] = tmp[4 * count + byte];
+#endif
+  for(size_t i = cc - 1; i >= 3; i--) row[i] -= row[i - 3];
+}
+
+static int _write_rows_deflate(const dt_imageio_tiff_t *d, dt_imageio_tiff_stream_t *stream,
+                               const void *in_void, const int rows)
+{
+  const size_t rowsize = (size_t)3 * d->width * d->bpp / 8;
+  const uLong bound = compressBound(rowsize);
+  const int batch = MIN(rows, DT_TIFF_DEFLATE_BATCH * dt_get_num_threads());
+  const int predictor = stream->predictor;
+
+  uint8_t *scratch = dt_alloc_align(64, 2 * rowsize * batch);
+  uint8_t *packed = dt_alloc_align(64, bound * batch);
+  uLongf *packed_len = malloc(sizeof(uLongf) * batch);
+  int err = !scratch || !packed || !packed_len;
+
+  dt_times_t start;
+  dt_get_times(&start);
+  for(int y0 = 0; y0 < rows && !err; y0 += batch)
+  {
+    const int n = MIN(batch, rows - y0);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(d, in_void, scratch, packed, packed_len, y0) schedule(dynamic)
+#endif
+    for(int j = 0; j < n; j++)
+    {
+      uint8_t *row = scratch + 2 * rowsize * j;
+      _pack_row(d, in_void, y0 + j, row);
+      if(predictor == 2)
+        _predict_horizontal(d, row);
+      else if(predictor == 3)
+        _predict_float(d, row, row + rowsize);
+      packed_len[j] = bound;
+      // zlib stream at TIFFTAG_ZIPQUALITY 9, like libtiff's own deflate codec
+      if(compress2(packed + bound * j, packed_len + j, row, rowsize, 9) != Z_OK) packed_len[j] = 0;
+    }
+
+    for(int j = 0; j < n && !err; j++)
+    {
+      if(!packed_len[j] || TIFFWriteRawStrip(stream->tif, stream->y, packed + bound * j, packed_len[j]) == -1)
+        err = 1;
+      else
+        stream->y++;
+    }
+  }
+  dt_show_times(&start, "[tiff] deflate", "%d rows of %zu bytes", rows, rowsize);
+
+  dt_free_align(scratch);
+  dt_free_align(packed);
+  free(packed_len);
+  return err;
+}
+
+void *write_begin(dt_imageio_module_data_t *d_tmp, const char *filename, void *exif, int exif_len, int imgid,
+                  int num, int total)
 {
   const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
 
   uint8_t *profile = NULL;
   uint32_t profile_len = 0;
 
-  TIFF *tif = NULL;
-
-  void *rowdata = NULL;
+  dt_imageio_tiff_stream_t *stream = calloc(1, sizeof(dt_imageio_tiff_stream_t));
+  if(!stream) return NULL;
 
-  int rc = 1; // default to error
+  const size_t rowsize = (d->width * 3) * d->bpp / 8;
+  if((stream->rowdata = malloc(rowsize)) == NULL) goto error;
 
   if(imgid > 0)
   {
@@ -72,22 +193,14 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     if(profile_len > 0)
     {
       profile = malloc(profile_len);
-      if(!profile)
-      {
-        rc = 1;
-        goto exit;
-      }
+      if(!profile) goto error;
       cmsSaveProfileToMem(out_profile, profile, &profile_len);
     }
   }
 
   // Create little endian tiff image
-  tif = TIFFOpen(filename, "wl");
-  if(!tif)
-  {
-    rc = 1;
-    goto exit;
-  }
+  TIFF *tif = stream->tif = TIFFOpen(filename, "wl");
+  if(!tif) goto error;
 
   // http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
   // "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
@@ -145,16 +258,39 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, (uint16_t)RESUNIT_INCH);
   }
 
-  const size_t rowsize = (d->width * 3) * d->bpp / 8;
-  if((rowdata = malloc(rowsize)) == NULL)
+  free(profile);
+
+  // strips are written raw, so their samples have to be in the file's byte order already
+  if(d->compress > 0 && G_BYTE_ORDER == G_LITTLE_ENDIAN)
+    stream->predictor = d->compress == 1 ? 1 : (d->compress == 3 && d->bpp == 32) ? 3 : 2;
+
+  stream->filename = g_strdup(filename);
+  // the blob is added once the file is closed
+  if(exif && exif_len > 0)
   {
-    rc = 1;
-    goto exit;
+    stream->exif = g_memdup(exif, exif_len);
+    stream->exif_len = exif_len;
   }
+  return stream;
+
+error:
+  free(profile);
+  _stream_free(stream);
+  return NULL;
+}
+
+int write_rows(dt_imageio_module_data_t *d_tmp, void *stream_tmp, const void *in_void, int rows)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_stream_t *stream = (dt_imageio_tiff_stream_t *)stream_tmp;
+  TIFF *tif = stream->tif;
+  void *rowdata = stream->rowdata;
+
+  if(stream->predictor) return _write_rows_deflate(d, stream, in_void, rows);
 
   if(d->bpp == 32)
   {
-    for(int y = 0; y < d->height; y++)
+    for(int y = 0; y < rows; y++)
     {
       float *in = (float *)in_void + (size_t)4 * y * d->width;
       float *out = (float *)rowdata;
@@ -164,16 +300,12 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
         memcpy(out, in, 3 * sizeof(float));
       }
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
+      if(TIFFWriteScanline(tif, rowdata, stream->y++, 0) == -1) return 1;
     }
   }
   else if(d->bpp == 16)
   {
-    for(int y = 0; y < d->height; y++)
+    for(int y = 0; y < rows; y++)
     {
       uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->width;
       uint16_t *out = (uint16_t *)rowdata;
@@ -183,16 +315,12 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
         memcpy(out, in, 3 * sizeof(uint16_t));
       }
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
+      if(TIFFWriteScanline(tif, rowdata, stream->y++, 0) == -1) return 1;
     }
   }
   else
   {
-    for(int y = 0; y < d->height; y++)
+    for(int y = 0; y < rows; y++)
     {
       uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->width;
       uint8_t *out = (uint8_t *)rowdata;
@@ -202,38 +330,43 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
         memcpy(out, in, 3 * sizeof(uint8_t));
       }
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
+      if(TIFFWriteScanline(tif, rowdata, stream->y++, 0) == -1) return 1;
     }
   }
 
-  // success
-  rc = 0;
+  return 0;
+}
+
+int write_finish(dt_imageio_module_data_t *d_tmp, void *stream_tmp, int error)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_stream_t *stream = (dt_imageio_tiff_stream_t *)stream_tmp;
+  int rc = error;
 
-exit:
   // close the file before adding exif data
-  if(tif)
-  {
-    TIFFClose(tif);
-    tif = NULL;
-  }
-  if(!rc && exif)
+  TIFFClose(stream->tif);
+  stream->tif = NULL;
+
+  if(!rc && stream->exif)
   {
-    rc = dt_exif_write_blob(exif, exif_len, filename, d->compress > 0);
+    rc = dt_exif_write_blob(stream->exif, stream->exif_len, stream->filename, d->compress > 0);
     // Until we get symbolic error status codes, if rc is 1, return 0
     rc = (rc == 1) ? 0 : 1;
   }
-  free(profile);
-  profile = NULL;
-  free(rowdata);
-  rowdata = NULL;
 
+  _stream_free(stream);
   return rc;
 }
 
+int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void, void *exif,
+                int exif_len, int imgid, int num, int total)
+{
+  void *stream = write_begin(d_tmp, filename, exif, exif_len, imgid, num, total);
+  if(!stream) return 1;
+  const int error = write_rows(d_tmp, stream, in_void, d_tmp->height);
+  return write_finish(d_tmp, stream, error);
+}
+
 #if 0
 int dt_imageio_tiff_read_header(const char *filename, dt_imageio_tiff_t *tiff)
 {
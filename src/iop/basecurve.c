@@ -243,7 +243,7 @@ int groups()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_ROI_INVARIANT;
 }
 
 static void set_presets(dt_iop_module_so_t *self, const basecurve_preset_t *presets, int count, int *force_autoapply)
@@ -273,14 +273,14 @@ static void set_presets(dt_iop_module_so_t *self, const basecurve_preset_t *pres
 void init_presets(dt_iop_module_so_t *self)
 {
   // sql begin
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "begin", NULL, NULL, NULL);
+  dt_database_start_transaction(darktable.db);
 
   set_presets(self, basecurve_presets, basecurve_presets_cnt, NULL);
   int force_autoapply = dt_conf_get_bool("plugins/darkroom/basecurve/auto_apply_percamera_presets");
   set_presets(self, basecurve_camera_presets, basecurve_camera_presets_cnt, &force_autoapply);
 
   // sql commit
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "commit", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
 }
 
 #ifdef HAVE_OPENCL
@@ -665,6 +665,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   // TODO: implement opencl version:
   if(p->exposure_fusion) piece->process_cl_ready = 0;
+  // the fused pyramids are built over the roi
+  if(p->exposure_fusion) piece->roi_invariant = 0;
   d->exposure_fusion = p->exposure_fusion;
   d->exposure_stops = p->exposure_stops;
 
@@ -22,8 +22,10 @@
 #include "bauhaus/bauhaus.h"
 #include "common/colormatrices.c"
 #include "common/colorspaces.h"
+#include "common/fast_math.h"
 #include "common/image_cache.h"
 #include "common/opencl.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include "develop/develop.h"
 #include "gui/gtk.h"
@@ -92,9 +94,9 @@ typedef struct dt_iop_colorin_data_t
   int clear_input;
   cmsHPROFILE input;
   cmsHPROFILE nrgb;
-  cmsHTRANSFORM *xform_cam_Lab;
-  cmsHTRANSFORM *xform_cam_nrgb;
-  cmsHTRANSFORM *xform_nrgb_Lab;
+  dt_colorspaces_transform_t *xform_cam_Lab;
+  dt_colorspaces_transform_t *xform_cam_nrgb;
+  dt_colorspaces_transform_t *xform_nrgb_Lab;
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
   float nmatrix[9];
@@ -117,7 +119,7 @@ int groups()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_ROI_INVARIANT;
 }
 
 int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version,
@@ -351,17 +353,6 @@ static void normalize_changed(GtkWidget *widget, gpointer user_data)
 }
 
 
-static float lerp_lut(const float *const lut, const float v)
-{
-  // TODO: check if optimization is worthwhile!
-  const float ft = CLAMPS(v * (LUT_SAMPLES - 1), 0, LUT_SAMPLES - 1);
-  const int t = ft < LUT_SAMPLES - 2 ? ft : LUT_SAMPLES - 2;
-  const float f = ft - t;
-  const float l1 = lut[t];
-  const float l2 = lut[t + 1];
-  return l1 * (1.0f - f) + l2 * f;
-}
-
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -448,114 +439,6 @@ error:
 }
 #endif
 
-static inline float _cbrtf(const float x)
-{
-  union convert {
-    float f;
-    int i;
-  } data, dataout;
-
-  data.f = x;
-
-  // approximate cbrtf(x):
-  dataout.i = (((int)(((float)(data.i)) / 3.0f)) + 709921077);
-
-  return dataout.f;
-}
-
-#if defined(__SSE2__)
-static inline __m128 _cbrtf_sse2(const __m128 x)
-{
-  return (_mm_castsi128_ps(
-      _mm_add_epi32(_mm_cvtps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_castps_si128(x)), _mm_set1_ps(3.0f))),
-                    _mm_set1_epi32(709921077))));
-}
-#endif
-
-static inline float lab_f_m(const float x)
-{
-  const float epsilon = (216.0f / 24389.0f);
-  const float kappa = (24389.0f / 27.0f);
-
-  const float a = _cbrtf(x);
-  const float a3 = a * a * a;
-
-  // x > epsilon
-  const float res_big = (((a) * ((x + x) + a3)) / ((a3 + a3) + x));
-
-  // x <= epsilon
-  const float res_small = (((kappa * x) + (16.0f)) / (116.0f));
-
-  // blend results according to whether each component is > epsilon or not
-  return ((x > epsilon) ? res_big : res_small);
-}
-
-#if defined(__SSE2__)
-static inline __m128 lab_f_m_sse2(const __m128 x)
-{
-  const __m128 epsilon = _mm_set1_ps(216.0f / 24389.0f);
-  const __m128 kappa = _mm_set1_ps(24389.0f / 27.0f);
-
-  // calculate as if x > epsilon : result = cbrtf(x)
-  // approximate cbrtf(x):
-  const __m128 a = _cbrtf_sse2(x);
-  const __m128 a3 = _mm_mul_ps(_mm_mul_ps(a, a), a);
-  const __m128 res_big
-      = _mm_div_ps(_mm_mul_ps(a, _mm_add_ps(a3, _mm_add_ps(x, x))), _mm_add_ps(_mm_add_ps(a3, a3), x));
-
-  // calculate as if x <= epsilon : result = (kappa*x+16)/116
-  const __m128 res_small
-      = _mm_div_ps(_mm_add_ps(_mm_mul_ps(kappa, x), _mm_set1_ps(16.0f)), _mm_set1_ps(116.0f));
-
-  // blend results according to whether each component is > epsilon or not
-  const __m128 mask = _mm_cmpgt_ps(x, epsilon);
-  return _mm_or_ps(_mm_and_ps(mask, res_big), _mm_andnot_ps(mask, res_small));
-}
-#endif
-
-static inline void _dt_XYZ_to_Lab(const float *const XYZ, float *const Lab)
-{
-  const float d50_inv[4] = { 1.0f / 0.9642f, 1.0f, 1.0f / 0.8249f, 0.0f };
-  const float coef[4] = { 116.0f, 500.0f, 200.0f, 0.0f };
-
-  float _xyz[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-  for(int c = 0; c < 4; c++)
-  {
-    _xyz[c] = lab_f_m(d50_inv[c] * XYZ[c]);
-  }
-
-  // because d50_inv.z is 0.0f, lab_f(0) == 16/116, so Lab[0] = 116*f[0] - 16 equal to 116*(f[0]-f[3])
-
-  float sf1[4];
-  sf1[0] = _xyz[1];
-  sf1[1] = _xyz[0];
-  sf1[2] = _xyz[1];
-  sf1[3] = _xyz[3];
-
-  float sf2[4];
-  sf2[0] = _xyz[3];
-  sf2[1] = _xyz[1];
-  sf2[2] = _xyz[2];
-  sf2[3] = _xyz[3];
-
-  for(int c = 0; c < 4; c++)
-  {
-    Lab[c] = (sf1[c] - sf2[c]) * coef[c];
-  }
-}
-
-#if defined(__SSE2__)
-static inline __m128 dt_XYZ_to_Lab_sse2(const __m128 XYZ)
-{
-  const __m128 d50_inv = _mm_set_ps(0.0f, 1.0f / 0.8249f, 1.0f, 1.0f / 0.9642f);
-  const __m128 coef = _mm_set_ps(0.0f, 200.0f, 500.0f, 116.0f);
-  const __m128 f = lab_f_m_sse2(_mm_mul_ps(XYZ, d50_inv));
-  // because d50_inv.z is 0.0f, lab_f(0) == 16/116, so Lab[0] = 116*f[0] - 16 equal to 116*(f[0]-f[3])
-  return _mm_mul_ps(coef, _mm_sub_ps(_mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 1, 0, 1)),
-                                     _mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 2, 1, 3))));
-}
-#endif
-
 static inline void apply_blue_mapping(const float *const in, float *const out)
 {
   out[0] = in[0];
@@ -602,7 +485,7 @@ static void process_cmatrix_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
       // avoid calling this for linear profiles (marked with negative entries), assures unbounded
       // color management without extrapolation.
       for(int c = 0; c < 3; c++)
-        cam[c] = (d->lut[c][0] >= 0.0f) ? ((in[c] < 1.0f) ? lerp_lut(d->lut[c], in[c])
+        cam[c] = (d->lut[c][0] >= 0.0f) ? ((in[c] < 1.0f) ? dt_lerp_lut(d->lut[c], in[c], LUT_SAMPLES)
                                                           : dt_iop_eval_exp(d->unbounded_coeffs[c], in[c]))
                                         : in[c];
 
@@ -621,7 +504,7 @@ static void process_cmatrix_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
           }
         }
 
-        _dt_XYZ_to_Lab(_xyz, out);
+        dt_XYZ_to_Lab_m(_xyz, out);
       }
       else
       {
@@ -651,7 +534,7 @@ static void process_cmatrix_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
           }
         }
 
-        _dt_XYZ_to_Lab(XYZ, out);
+        dt_XYZ_to_Lab_m(XYZ, out);
       }
     }
   }
@@ -685,7 +568,7 @@ static void process_cmatrix_fastpath_simple(struct dt_iop_module_t *self, dt_dev
       }
     }
 
-    _dt_XYZ_to_Lab(_xyz, out);
+    dt_XYZ_to_Lab_m(_xyz, out);
   }
 }
 
@@ -732,7 +615,7 @@ static void process_cmatrix_fastpath_clipping(struct dt_iop_module_t *self, dt_d
       }
     }
 
-    _dt_XYZ_to_Lab(XYZ, out);
+    dt_XYZ_to_Lab_m(XYZ, out);
   }
 }
 
@@ -778,7 +661,7 @@ static void process_cmatrix_proper(struct dt_iop_module_t *self, dt_dev_pixelpip
       // avoid calling this for linear profiles (marked with negative entries), assures unbounded
       // color management without extrapolation.
       for(int c = 0; c < 3; c++)
-        cam[c] = (d->lut[c][0] >= 0.0f) ? ((in[c] < 1.0f) ? lerp_lut(d->lut[c], in[c])
+        cam[c] = (d->lut[c][0] >= 0.0f) ? ((in[c] < 1.0f) ? dt_lerp_lut(d->lut[c], in[c], LUT_SAMPLES)
                                                           : dt_iop_eval_exp(d->unbounded_coeffs[c], in[c]))
                                         : in[c];
 
@@ -795,7 +678,7 @@ static void process_cmatrix_proper(struct dt_iop_module_t *self, dt_dev_pixelpip
           }
         }
 
-        _dt_XYZ_to_Lab(_xyz, out);
+        dt_XYZ_to_Lab_m(_xyz, out);
       }
       else
       {
@@ -825,7 +708,7 @@ static void process_cmatrix_proper(struct dt_iop_module_t *self, dt_dev_pixelpip
           }
         }
 
-        _dt_XYZ_to_Lab(XYZ, out);
+        dt_XYZ_to_Lab_m(XYZ, out);
       }
     }
   }
@@ -876,11 +759,11 @@ static void process_lcms2_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
     if(!d->nrgb)
     {
-      cmsDoTransform(d->xform_cam_Lab, out, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_cam_Lab, out, out, roi_out->width);
     }
     else
     {
-      cmsDoTransform(d->xform_cam_nrgb, out, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_cam_nrgb, out, out, roi_out->width);
 
       float *rgbptr = (float *)out;
       for(int j = 0; j < roi_out->width; j++, rgbptr += 4)
@@ -891,7 +774,7 @@ static void process_lcms2_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
         }
       }
 
-      cmsDoTransform(d->xform_nrgb_Lab, out, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_nrgb_Lab, out, out, roi_out->width);
     }
   }
 }
@@ -915,11 +798,11 @@ static void process_lcms2_proper(struct dt_iop_module_t *self, dt_dev_pixelpipe_
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
     if(!d->nrgb)
     {
-      cmsDoTransform(d->xform_cam_Lab, in, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_cam_Lab, in, out, roi_out->width);
     }
     else
     {
-      cmsDoTransform(d->xform_cam_nrgb, in, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_cam_nrgb, in, out, roi_out->width);
 
       float *rgbptr = (float *)out;
       for(int j = 0; j < roi_out->width; j++, rgbptr += 4)
@@ -930,7 +813,7 @@ static void process_lcms2_proper(struct dt_iop_module_t *self, dt_dev_pixelpipe_
         }
       }
 
-      cmsDoTransform(d->xform_nrgb_Lab, out, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_nrgb_Lab, out, out, roi_out->width);
     }
   }
 }
@@ -1016,7 +899,7 @@ void process_sse2_cmatrix_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
       // avoid calling this for linear profiles (marked with negative entries), assures unbounded
       // color management without extrapolation.
       for(int c = 0; c < 3; c++)
-        cam[c] = (d->lut[c][0] >= 0.0f) ? ((buf_in[c] < 1.0f) ? lerp_lut(d->lut[c], buf_in[c])
+        cam[c] = (d->lut[c][0] >= 0.0f) ? ((buf_in[c] < 1.0f) ? dt_lerp_lut(d->lut[c], buf_in[c], LUT_SAMPLES)
                                                               : dt_iop_eval_exp(d->unbounded_coeffs[c], buf_in[c]))
                                         : buf_in[c];
 
@@ -1177,7 +1060,7 @@ void process_sse2_cmatrix_proper(struct dt_iop_module_t *self, dt_dev_pixelpipe_
       // avoid calling this for linear profiles (marked with negative entries), assures unbounded
       // color management without extrapolation.
       for(int c = 0; c < 3; c++)
-        cam[c] = (d->lut[c][0] >= 0.0f) ? ((buf_in[c] < 1.0f) ? lerp_lut(d->lut[c], buf_in[c])
+        cam[c] = (d->lut[c][0] >= 0.0f) ? ((buf_in[c] < 1.0f) ? dt_lerp_lut(d->lut[c], buf_in[c], LUT_SAMPLES)
                                                               : dt_iop_eval_exp(d->unbounded_coeffs[c], buf_in[c]))
                                         : buf_in[c];
 
@@ -1250,11 +1133,11 @@ static void process_sse2_lcms2_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
     if(!d->nrgb)
     {
-      cmsDoTransform(d->xform_cam_Lab, out, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_cam_Lab, out, out, roi_out->width);
     }
     else
     {
-      cmsDoTransform(d->xform_cam_nrgb, out, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_cam_nrgb, out, out, roi_out->width);
 
       float *rgbptr = (float *)out;
       for(int j = 0; j < roi_out->width; j++, rgbptr += 4)
@@ -1267,7 +1150,7 @@ static void process_sse2_lcms2_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe
       }
       _mm_sfence();
 
-      cmsDoTransform(d->xform_nrgb_Lab, out, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_nrgb_Lab, out, out, roi_out->width);
     }
   }
 }
@@ -1292,11 +1175,11 @@ static void process_sse2_lcms2_proper(struct dt_iop_module_t *self, dt_dev_pixel
     // convert to (L,a/L,b/L) to be able to change L without changing saturation.
     if(!d->nrgb)
     {
-      cmsDoTransform(d->xform_cam_Lab, in, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_cam_Lab, in, out, roi_out->width);
     }
     else
     {
-      cmsDoTransform(d->xform_cam_nrgb, in, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_cam_nrgb, in, out, roi_out->width);
 
       float *rgbptr = (float *)out;
       for(int j = 0; j < roi_out->width; j++, rgbptr += 4)
@@ -1309,7 +1192,7 @@ static void process_sse2_lcms2_proper(struct dt_iop_module_t *self, dt_dev_pixel
       }
       _mm_sfence();
 
-      cmsDoTransform(d->xform_nrgb_Lab, out, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform_nrgb_Lab, out, out, roi_out->width);
     }
   }
 }
@@ -1375,6 +1258,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   d->type = p->type;
   const cmsHPROFILE Lab = dt_colorspaces_get_profile(DT_COLORSPACE_LAB, "", DT_PROFILE_DIRECTION_ANY)->profile;
+  const gboolean clut = dt_conf_get_bool("color_transform_lut");
 
   // only clean up when it's a type that we created here
   if(d->input && d->clear_input) dt_colorspaces_cleanup_profile(d->input);
@@ -1405,17 +1289,17 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   if(d->xform_cam_Lab)
   {
-    cmsDeleteTransform(d->xform_cam_Lab);
+    dt_colorspaces_release_transform(d->xform_cam_Lab);
     d->xform_cam_Lab = NULL;
   }
   if(d->xform_cam_nrgb)
   {
-    cmsDeleteTransform(d->xform_cam_nrgb);
+    dt_colorspaces_release_transform(d->xform_cam_nrgb);
     d->xform_cam_nrgb = NULL;
   }
   if(d->xform_nrgb_Lab)
   {
-    cmsDeleteTransform(d->xform_nrgb_Lab);
+    dt_colorspaces_release_transform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
 
@@ -1543,9 +1427,12 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     {
       piece->process_cl_ready = 0;
       d->cmatrix[0] = NAN;
-      d->xform_cam_Lab = cmsCreateTransform(d->input, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, p->intent, 0);
-      d->xform_cam_nrgb = cmsCreateTransform(d->input, TYPE_RGBA_FLT, d->nrgb, TYPE_RGBA_FLT, p->intent, 0);
-      d->xform_nrgb_Lab = cmsCreateTransform(d->nrgb, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, p->intent, 0);
+      d->xform_cam_Lab = dt_colorspaces_get_transform(d->input, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT,
+                                                      NULL, p->intent, 0, 0, clut);
+      d->xform_cam_nrgb = dt_colorspaces_get_transform(d->input, TYPE_RGBA_FLT, d->nrgb, TYPE_RGBA_FLT,
+                                                       NULL, p->intent, 0, 0, clut);
+      d->xform_nrgb_Lab = dt_colorspaces_get_transform(d->nrgb, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT,
+                                                       NULL, p->intent, 0, 0, clut);
     }
     else
     {
@@ -1564,7 +1451,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     {
       piece->process_cl_ready = 0;
       d->cmatrix[0] = NAN;
-      d->xform_cam_Lab = cmsCreateTransform(d->input, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, p->intent, 0);
+      d->xform_cam_Lab = dt_colorspaces_get_transform(d->input, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT,
+                                                      NULL, p->intent, 0, 0, clut);
     }
   }
 
@@ -1573,12 +1461,12 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   {
     if(d->xform_cam_nrgb)
     {
-      cmsDeleteTransform(d->xform_cam_nrgb);
+      dt_colorspaces_release_transform(d->xform_cam_nrgb);
       d->xform_cam_nrgb = NULL;
     }
     if(d->xform_nrgb_Lab)
     {
-      cmsDeleteTransform(d->xform_nrgb_Lab);
+      dt_colorspaces_release_transform(d->xform_nrgb_Lab);
       d->xform_nrgb_Lab = NULL;
     }
     d->nrgb = NULL;
@@ -1597,7 +1485,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     {
       piece->process_cl_ready = 0;
       d->cmatrix[0] = NAN;
-      d->xform_cam_Lab = cmsCreateTransform(d->input, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, p->intent, 0);
+      d->xform_cam_Lab = dt_colorspaces_get_transform(d->input, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT,
+                                                      NULL, p->intent, 0, 0, clut);
     }
   }
 
@@ -1615,8 +1504,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
       d->nonlinearlut++;
 
       const float x[4] = { 0.7f, 0.8f, 0.9f, 1.0f };
-      const float y[4] = { lerp_lut(d->lut[k], x[0]), lerp_lut(d->lut[k], x[1]), lerp_lut(d->lut[k], x[2]),
-                           lerp_lut(d->lut[k], x[3]) };
+      const float y[4] = { dt_lerp_lut(d->lut[k], x[0], LUT_SAMPLES), dt_lerp_lut(d->lut[k], x[1], LUT_SAMPLES),
+                           dt_lerp_lut(d->lut[k], x[2], LUT_SAMPLES), dt_lerp_lut(d->lut[k], x[3], LUT_SAMPLES) };
       dt_iop_estimate_exp(x, y, 4, d->unbounded_coeffs[k]);
     }
     else
@@ -1642,17 +1531,17 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
   if(d->input && d->clear_input) dt_colorspaces_cleanup_profile(d->input);
   if(d->xform_cam_Lab)
   {
-    cmsDeleteTransform(d->xform_cam_Lab);
+    dt_colorspaces_release_transform(d->xform_cam_Lab);
     d->xform_cam_Lab = NULL;
   }
   if(d->xform_cam_nrgb)
   {
-    cmsDeleteTransform(d->xform_cam_nrgb);
+    dt_colorspaces_release_transform(d->xform_cam_nrgb);
     d->xform_cam_nrgb = NULL;
   }
   if(d->xform_nrgb_Lab)
   {
-    cmsDeleteTransform(d->xform_nrgb_Lab);
+    dt_colorspaces_release_transform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
 
@@ -21,6 +21,7 @@
 #endif
 #include "bauhaus/bauhaus.h"
 #include "common/colorspaces.h"
+#include "common/fast_math.h"
 #include "common/opencl.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -51,7 +52,7 @@ typedef struct dt_iop_colorout_data_t
   dt_colorspaces_color_mode_t mode;
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
-  cmsHTRANSFORM *xform;
+  dt_colorspaces_transform_t *xform;
   float unbounded_coeffs[3][3]; // for extrapolation of shaper curves
 } dt_iop_colorout_data_t;
 
@@ -85,7 +86,7 @@ int groups()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_ROI_INVARIANT;
 }
 
 int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version,
@@ -196,19 +197,6 @@ static void _signal_profile_changed(gpointer instance, gpointer user_data)
   dt_dev_reprocess_center(dev);
 }
 
-#if 1
-static float lerp_lut(const float *const lut, const float v)
-{
-  // TODO: check if optimization is worthwhile!
-  const float ft = CLAMPS(v * (LUT_SAMPLES - 1), 0, LUT_SAMPLES - 1);
-  const int t = ft < LUT_SAMPLES - 2 ? ft : LUT_SAMPLES - 2;
-  const float f = ft - t;
-  const float l1 = lut[t];
-  const float l2 = lut[t + 1];
-  return l1 * (1.0f - f) + l2 * f;
-}
-#endif
-
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -296,7 +284,7 @@ static void process_fastpath_apply_tonecurves(struct dt_iop_module_t *self, dt_d
       {
         for(int c = 0; c < 3; c++)
         {
-          out[k + c] = (out[k + c] < 1.0f) ? lerp_lut(d->lut[c], out[k + c])
+          out[k + c] = (out[k + c] < 1.0f) ? dt_lerp_lut(d->lut[c], out[k + c], LUT_SAMPLES)
                                            : dt_iop_eval_exp(d->unbounded_coeffs[c], out[k + c]);
         }
       }
@@ -313,7 +301,7 @@ static void process_fastpath_apply_tonecurves(struct dt_iop_module_t *self, dt_d
         {
           if(d->lut[c][0] >= 0.0f)
           {
-            out[k + c] = (out[k + c] < 1.0f) ? lerp_lut(d->lut[c], out[k + c])
+            out[k + c] = (out[k + c] < 1.0f) ? dt_lerp_lut(d->lut[c], out[k + c], LUT_SAMPLES)
                                              : dt_iop_eval_exp(d->unbounded_coeffs[c], out[k + c]);
           }
         }
@@ -322,87 +310,6 @@ static void process_fastpath_apply_tonecurves(struct dt_iop_module_t *self, dt_d
   }
 }
 
-#if defined(_OPENMP) && defined(OPENMP_SIMD_)
-#pragma omp declare SIMD()
-#endif
-static inline float lab_f_inv_m(const float x)
-{
-  const float epsilon = (0.20689655172413796f); // cbrtf(216.0f/24389.0f);
-  const float kappa_rcp_x16 = (16.0f * 27.0f / 24389.0f);
-  const float kappa_rcp_x116 = (116.0f * 27.0f / 24389.0f);
-
-  // x > epsilon
-  float res_big = x * x * x;
-
-  // x <= epsilon
-  float res_small = ((kappa_rcp_x116 * x) - kappa_rcp_x16);
-
-  // blend results according to whether each component is > epsilon or not
-  return ((x > epsilon) ? res_big : res_small);
-}
-
-#if defined(__SSE__)
-static inline __m128 lab_f_inv_m_SSE(const __m128 x)
-{
-  const __m128 epsilon = _mm_set1_ps(0.20689655172413796f); // cbrtf(216.0f/24389.0f);
-  const __m128 kappa_rcp_x16 = _mm_set1_ps(16.0f * 27.0f / 24389.0f);
-  const __m128 kappa_rcp_x116 = _mm_set1_ps(116.0f * 27.0f / 24389.0f);
-
-  // x > epsilon
-  const __m128 res_big = _mm_mul_ps(_mm_mul_ps(x, x), x);
-  // x <= epsilon
-  const __m128 res_small = _mm_sub_ps(_mm_mul_ps(kappa_rcp_x116, x), kappa_rcp_x16);
-
-  // blend results according to whether each component is > epsilon or not
-  const __m128 mask = _mm_cmpgt_ps(x, epsilon);
-  return _mm_or_ps(_mm_and_ps(mask, res_big), _mm_andnot_ps(mask, res_small));
-}
-#endif
-
-static inline void _dt_Lab_to_XYZ(const float *const Lab, float *const xyz)
-{
-  const float d50[] = { 0.9642f, 1.0f, 0.8249f };
-  const float coef[] = { 1.0f / 500.0f, 1.0f / 116.0f, -1.0f / 200.0f };
-  const float offset = (0.137931034f);
-
-  float _F[3];
-  _F[0] = Lab[1];
-  _F[1] = Lab[0];
-  _F[2] = Lab[2];
-
-  for(int c = 0; c < 3; c++)
-  {
-    _F[c] *= coef[c];
-  }
-
-  float _F1[3];
-  _F1[0] = _F[1];
-  _F1[1] = 0.0f;
-  _F1[2] = _F[1];
-
-  for(int c = 0; c < 3; c++)
-  {
-    const float f = _F[c] + _F1[c] + offset;
-    xyz[c] = d50[c] * lab_f_inv_m(f);
-  }
-}
-
-#if defined(__SSE__)
-static inline __m128 dt_Lab_to_XYZ_SSE(const __m128 Lab)
-{
-  const __m128 d50 = _mm_set_ps(0.0f, 0.8249f, 1.0f, 0.9642f);
-  const __m128 coef = _mm_set_ps(0.0f, -1.0f / 200.0f, 1.0f / 116.0f, 1.0f / 500.0f);
-  const __m128 offset = _mm_set1_ps(0.137931034f);
-
-  // last component ins shuffle taken from 1st component of Lab to make sure it is not nan, so it will become
-  // 0.0f in f
-  const __m128 f = _mm_mul_ps(_mm_shuffle_ps(Lab, Lab, _MM_SHUFFLE(0, 2, 0, 1)), coef);
-
-  return _mm_mul_ps(
-      d50, lab_f_inv_m_SSE(_mm_add_ps(_mm_add_ps(f, _mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 1, 3, 1))), offset)));
-}
-#endif
-
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -427,7 +334,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       float *out = (float *)ovoid + (size_t)k;
 
       float xyz[3];
-      _dt_Lab_to_XYZ(in, xyz);
+      dt_Lab_to_XYZ_m(in, xyz);
 
       for(int c = 0; c < 3; c++)
       {
@@ -452,7 +359,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       const float *in = ((float *)ivoid) + (size_t)ch * k * roi_out->width;
       float *out = ((float *)ovoid) + (size_t)ch * k * roi_out->width;
 
-      cmsDoTransform(d->xform, in, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform, in, out, roi_out->width);
 
       if(gamutcheck)
       {
@@ -502,7 +409,7 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 
       for(int i = 0; i < roi_out->width; i++, in += ch, out += ch)
       {
-        const __m128 xyz = dt_Lab_to_XYZ_SSE(_mm_load_ps(in));
+        const __m128 xyz = dt_Lab_to_XYZ_sse(_mm_load_ps(in));
         const __m128 t
             = _mm_add_ps(_mm_mul_ps(m0, _mm_shuffle_ps(xyz, xyz, _MM_SHUFFLE(0, 0, 0, 0))),
                          _mm_add_ps(_mm_mul_ps(m1, _mm_shuffle_ps(xyz, xyz, _MM_SHUFFLE(1, 1, 1, 1))),
@@ -527,7 +434,7 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
       const float *in = ((float *)ivoid) + (size_t)ch * k * roi_out->width;
       float *out = ((float *)ovoid) + (size_t)ch * k * roi_out->width;
 
-      cmsDoTransform(d->xform, in, out, roi_out->width);
+      dt_colorspaces_apply_transform(d->xform, in, out, roi_out->width);
 
       if(gamutcheck)
       {
@@ -583,6 +490,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   const dt_iop_color_intent_t over_intent = dt_conf_get_int("plugins/lighttable/export/iccintent");
 
   const int force_lcms2 = dt_conf_get_bool("plugins/lighttable/export/force_lcms2");
+  // the 3d lut only stands in for profiles we can't handle with a matrix, never when lcms2 was asked for
+  const gboolean clut = !force_lcms2 && dt_conf_get_bool("color_transform_lut");
 
   dt_colorspaces_color_profile_type_t out_type = DT_COLORSPACE_SRGB;
   gchar *out_filename = NULL;
@@ -597,7 +506,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   if(d->xform)
   {
-    cmsDeleteTransform(d->xform);
+    dt_colorspaces_release_transform(d->xform);
     d->xform = NULL;
   }
   d->cmatrix[0] = NAN;
@@ -703,8 +612,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   {
     d->cmatrix[0] = NAN;
     piece->process_cl_ready = 0;
-    d->xform = cmsCreateProofingTransform(Lab, TYPE_LabA_FLT, output, TYPE_RGBA_FLT, softproof,
-                                          out_intent, INTENT_RELATIVE_COLORIMETRIC, transformFlags);
+    d->xform = dt_colorspaces_get_transform(Lab, TYPE_LabA_FLT, output, TYPE_RGBA_FLT, softproof, out_intent,
+                                            INTENT_RELATIVE_COLORIMETRIC, transformFlags, clut);
   }
 
   // user selected a non-supported output profile, check that:
@@ -720,8 +629,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
       d->cmatrix[0] = NAN;
       piece->process_cl_ready = 0;
 
-      d->xform = cmsCreateProofingTransform(Lab, TYPE_LabA_FLT, output, TYPE_RGBA_FLT, softproof,
-                                            out_intent, INTENT_RELATIVE_COLORIMETRIC, transformFlags);
+      d->xform = dt_colorspaces_get_transform(Lab, TYPE_LabA_FLT, output, TYPE_RGBA_FLT, softproof, out_intent,
+                                              INTENT_RELATIVE_COLORIMETRIC, transformFlags, clut);
     }
   }
 
@@ -737,8 +646,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     if(d->lut[k][0] >= 0.0f)
     {
       const float x[4] = { 0.7f, 0.8f, 0.9f, 1.0f };
-      const float y[4] = { lerp_lut(d->lut[k], x[0]), lerp_lut(d->lut[k], x[1]), lerp_lut(d->lut[k], x[2]),
-                           lerp_lut(d->lut[k], x[3]) };
+      const float y[4] = { dt_lerp_lut(d->lut[k], x[0], LUT_SAMPLES), dt_lerp_lut(d->lut[k], x[1], LUT_SAMPLES),
+                           dt_lerp_lut(d->lut[k], x[2], LUT_SAMPLES), dt_lerp_lut(d->lut[k], x[3], LUT_SAMPLES) };
       dt_iop_estimate_exp(x, y, 4, d->unbounded_coeffs[k]);
     }
     else
@@ -763,7 +672,7 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
   dt_iop_colorout_data_t *d = (dt_iop_colorout_data_t *)piece->data;
   if(d->xform)
   {
-    cmsDeleteTransform(d->xform);
+    dt_colorspaces_release_transform(d->xform);
     d->xform = NULL;
   }
 
@@ -151,7 +151,8 @@ int groups()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  // everything after it is computed from the demosaiced data, don't risk any precision there
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_FULL_PRECISION_CACHE;
 }
 
 void init_key_accels(dt_iop_module_so_t *self)
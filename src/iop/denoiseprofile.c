@@ -19,6 +19,7 @@
 #include "config.h"
 #endif
 #include "bauhaus/bauhaus.h"
+#include "common/fast_math.h"
 #include "common/noiseprofiles.h"
 #include "common/opencl.h"
 #include "common/opencl.h"
@@ -148,23 +149,6 @@ int flags()
   return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
 }
 
-typedef union floatint_t
-{
-  float f;
-  uint32_t i;
-} floatint_t;
-
-// very fast approximation for 2^-x (returns 0 for x > 126)
-static inline float fast_mexp2f(const float x)
-{
-  const float i1 = (float)0x3f800000u; // 2^0
-  const float i2 = (float)0x3f000000u; // 2^-1
-  const float k0 = i1 + x * (i2 - i1);
-  floatint_t k;
-  k.i = k0 >= (float)0x800000u ? k0 : 0;
-  return k.f;
-}
-
 void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                      const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out,
                      struct dt_develop_tiling_t *tiling)
@@ -301,7 +285,7 @@ static inline float weight(const float *c1, const float *c2, const float inv_sig
   const float var
       = 0.02f; // FIXME: this should ideally depend on the image before noise stabilizing transforms!
   const float off2 = 9.0f; // (3 sigma)^2
-  return fast_mexp2f(MAX(0, dot * var - off2));
+  return dt_fast_mexp2f(MAX(0, dot * var - off2));
 #endif
 }
 
@@ -318,7 +302,7 @@ static inline __m128 weight_sse(const __m128 *c1, const __m128 *c2, const float
   const float var
       = 0.02f; // FIXME: this should ideally depend on the image before noise stabilizing transforms!
   const float off2 = 9.0f; // (3 sigma)^2
-  return _mm_set1_ps(fast_mexp2f(MAX(0, dot * var - off2)));
+  return _mm_set1_ps(dt_fast_mexp2f(MAX(0, dot * var - off2)));
 #endif
 }
 #endif
@@ -977,7 +961,7 @@ static void process_nlmeans(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t
 #endif
             for(size_t c = 0; c < 4; c++)
             {
-              out[c] += iv[c] * fast_mexp2f(fmaxf(0.0f, slide * norm - 2.0f));
+              out[c] += iv[c] * dt_fast_mexp2f(fmaxf(0.0f, slide * norm - 2.0f));
             }
           }
         }
@@ -1121,8 +1105,8 @@ static void process_nlmeans_sse(struct dt_iop_module_t *self, dt_dev_pixelpipe_i
             const float norm = .015f / (2 * P + 1);
             const __m128 iv = { ins[0], ins[1], ins[2], 1.0f };
             _mm_store_ps(out,
-                         _mm_load_ps(out) + iv * _mm_set1_ps(fast_mexp2f(fmaxf(0.0f, slide * norm - 2.0f))));
-            // _mm_store_ps(out, _mm_load_ps(out) + iv * _mm_set1_ps(fast_mexp2f(fmaxf(0.0f, slide*norm))));
+                         _mm_load_ps(out) + iv * _mm_set1_ps(dt_fast_mexp2f(fmaxf(0.0f, slide * norm - 2.0f))));
+            // _mm_store_ps(out, _mm_load_ps(out) + iv * _mm_set1_ps(dt_fast_mexp2f(fmaxf(0.0f, slide*norm))));
           }
           s++;
           ins += 4;
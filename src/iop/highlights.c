@@ -82,7 +82,7 @@ int groups()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_ROI_INVARIANT;
 }
 
 int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version,
@@ -871,6 +871,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   // no OpenCL for DT_IOP_HIGHLIGHTS_INPAINT yet.
   if(d->mode == DT_IOP_HIGHLIGHTS_INPAINT) piece->process_cl_ready = 0;
+
+  // the reconstructing modes look at the clipped regions around each pixel as far as the roi goes
+  if(d->mode != DT_IOP_HIGHLIGHTS_CLIP) piece->roi_invariant = 0;
 }
 
 void init_global(dt_iop_module_so_t *module)
@@ -74,7 +74,7 @@ int groups()
 
 int flags()
 {
-  return IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_ROI_INVARIANT;
 }
 
 void init_key_accels(dt_iop_module_so_t *self)
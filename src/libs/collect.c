@@ -508,7 +508,8 @@ static gboolean list_match_string(GtkTreeModel *model, GtkTreePath *path, GtkTre
 
   int property = gtk_combo_box_get_active(dr->combo);
   if(property == DT_COLLECTION_PROP_APERTURE || property == DT_COLLECTION_PROP_FOCAL_LENGTH
-     || property == DT_COLLECTION_PROP_ISO)
+     || property == DT_COLLECTION_PROP_ISO || property == DT_COLLECTION_PROP_BRIGHTNESS
+     || property == DT_COLLECTION_PROP_CLIPPING || property == DT_COLLECTION_PROP_DYNAMIC_RANGE)
   {
     // handle of numeric value, which can have some operator before the text
     visible = TRUE;
@@ -1022,6 +1023,24 @@ static void list_view(dt_lib_collect_rule_t *dr)
         g_strlcpy(query, "select distinct filename, 1 from images order by filename", sizeof(query));
         break;
 
+      case DT_COLLECTION_PROP_BRIGHTNESS: // brightness
+        g_strlcpy(query, "select distinct cast(round(brightness) as integer) as brightness, 1 "
+                         "from image_stats order by brightness",
+                  sizeof(query));
+        break;
+
+      case DT_COLLECTION_PROP_CLIPPING: // clipping
+        g_strlcpy(query, "select distinct cast(round(clipped) as integer) as clipped, 1 "
+                         "from image_stats order by clipped",
+                  sizeof(query));
+        break;
+
+      case DT_COLLECTION_PROP_DYNAMIC_RANGE: // dynamic range
+        g_strlcpy(query, "select distinct cast(round(dynamic_range) as integer) as dynamic_range, 1 "
+                         "from image_stats order by dynamic_range",
+                  sizeof(query));
+        break;
+
       case DT_COLLECTION_PROP_DAY:
         g_strlcpy(query,
                   "SELECT DISTINCT substr(datetime_taken, 1, 10), 1 FROM images ORDER BY datetime_taken DESC",
@@ -1090,7 +1109,9 @@ static void list_view(dt_lib_collect_rule_t *dr)
      || property == DT_COLLECTION_PROP_LENS || property == DT_COLLECTION_PROP_PUBLISHER
      || property == DT_COLLECTION_PROP_RIGHTS || property == DT_COLLECTION_PROP_TIME
      || property == DT_COLLECTION_PROP_TITLE || property == DT_COLLECTION_PROP_APERTURE
-     || property == DT_COLLECTION_PROP_FOCAL_LENGTH || property == DT_COLLECTION_PROP_ISO)
+     || property == DT_COLLECTION_PROP_FOCAL_LENGTH || property == DT_COLLECTION_PROP_ISO
+     || property == DT_COLLECTION_PROP_BRIGHTNESS || property == DT_COLLECTION_PROP_CLIPPING
+     || property == DT_COLLECTION_PROP_DYNAMIC_RANGE)
     gtk_tree_model_foreach(model, (GtkTreeModelForeachFunc)list_match_string, dr);
   // we update list selection
   gtk_tree_selection_unselect_all(gtk_tree_view_get_selection(d->view));
@@ -1245,7 +1266,8 @@ static void combo_changed(GtkComboBox *combo, dt_lib_collect_rule_t *d)
   }
 
   if(property == DT_COLLECTION_PROP_APERTURE || property == DT_COLLECTION_PROP_FOCAL_LENGTH
-     || property == DT_COLLECTION_PROP_ISO)
+     || property == DT_COLLECTION_PROP_ISO || property == DT_COLLECTION_PROP_BRIGHTNESS
+     || property == DT_COLLECTION_PROP_CLIPPING || property == DT_COLLECTION_PROP_DYNAMIC_RANGE)
   {
     gtk_widget_set_tooltip_text(d->text, _("type your query, use <, <=, >, >=, <>, =, [;] as operators"));
   }
@@ -1912,6 +1934,9 @@ void init(struct dt_lib_module_t *self)
   luaA_enum_value(L,dt_collection_properties_t,DT_COLLECTION_PROP_APERTURE);
   luaA_enum_value(L,dt_collection_properties_t,DT_COLLECTION_PROP_FILENAME);
   luaA_enum_value(L,dt_collection_properties_t,DT_COLLECTION_PROP_GEOTAGGING);
+  luaA_enum_value(L,dt_collection_properties_t,DT_COLLECTION_PROP_BRIGHTNESS);
+  luaA_enum_value(L,dt_collection_properties_t,DT_COLLECTION_PROP_CLIPPING);
+  luaA_enum_value(L,dt_collection_properties_t,DT_COLLECTION_PROP_DYNAMIC_RANGE);
 
 }
 #endif
@@ -21,6 +21,7 @@
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/image_cache.h"
+#include "common/image_stats.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/develop.h"
@@ -28,6 +29,7 @@
 #include "gui/gtk.h"
 #include "libs/lib.h"
 #include "libs/lib_api.h"
+#include "views/view.h"
 
 DT_MODULE(1)
 
@@ -42,6 +44,10 @@ typedef struct dt_lib_histogram_t
   gboolean red, green, blue;
   float mode_x, mode_w, red_x, green_x, blue_x;
   float color_w, button_h, button_y, button_spacing;
+  // lighttable shows the stored statistics of the image under the mouse
+  int32_t stats_imgid;
+  gboolean stats_valid;
+  dt_image_stats_t stats;
 } dt_lib_histogram_t;
 
 static gboolean _lib_histogram_draw_callback(GtkWidget *widget, cairo_t *cr, gpointer user_data);
@@ -64,7 +70,9 @@ const char *name(dt_lib_module_t *self)
 
 uint32_t views(dt_lib_module_t *self)
 {
-  return DT_VIEW_DARKROOM | DT_VIEW_TETHERING;
+  uint32_t v = DT_VIEW_DARKROOM | DT_VIEW_TETHERING;
+  if(dt_conf_get_bool("image_stats")) v |= DT_VIEW_LIGHTTABLE;
+  return v;
 }
 
 uint32_t container(dt_lib_module_t *self)
@@ -83,6 +91,12 @@ int position()
 }
 
 
+static gboolean _lib_histogram_in_lighttable()
+{
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  return cv && cv->view((dt_view_t *)cv) == DT_VIEW_LIGHTTABLE;
+}
+
 static void _lib_histogram_change_callback(gpointer instance, gpointer user_data)
 {
   dt_lib_module_t *self = (dt_lib_module_t *)user_data;
@@ -121,6 +135,7 @@ void gui_init(dt_lib_module_t *self)
   d->red = dt_conf_get_bool("plugins/darkroom/histogram/show_red");
   d->green = dt_conf_get_bool("plugins/darkroom/histogram/show_green");
   d->blue = dt_conf_get_bool("plugins/darkroom/histogram/show_blue");
+  d->stats_imgid = -1;
 
   /* create drawingarea */
   self->widget = gtk_drawing_area_new();
@@ -154,6 +169,9 @@ void gui_init(dt_lib_module_t *self)
   /* connect to preview pipe finished  signal */
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW_PIPE_FINISHED,
                             G_CALLBACK(_lib_histogram_change_callback), self);
+  /* and to the hovered image changing, for lighttable */
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_MOUSE_OVER_IMAGE_CHANGE,
+                            G_CALLBACK(_lib_histogram_change_callback), self);
 }
 
 void gui_cleanup(dt_lib_module_t *self)
@@ -258,8 +276,25 @@ static gboolean _lib_histogram_draw_callback(GtkWidget *widget, cairo_t *crf, gp
 
   dt_develop_t *dev = darktable.develop;
   uint32_t *hist = dev->histogram;
-  float hist_max = dev->histogram_type == DT_DEV_HISTOGRAM_LINEAR ? dev->histogram_max
-                                                                  : logf(1.0 + dev->histogram_max);
+  uint32_t histogram_max = dev->histogram_max;
+  dt_dev_histogram_type_t type = dev->histogram_type;
+  const gboolean lighttable = _lib_histogram_in_lighttable();
+  int32_t imgid = dev->image_storage.id;
+  if(lighttable)
+  {
+    imgid = dt_control_get_mouse_over_id();
+    // statistics may have been computed since we last looked
+    if(imgid != d->stats_imgid || !d->stats_valid)
+    {
+      d->stats_imgid = imgid;
+      d->stats_valid = imgid > 0 && !dt_image_stats_get(imgid, &d->stats);
+    }
+    hist = d->stats.histogram;
+    histogram_max = d->stats_valid ? d->stats.histogram_max : 0;
+    // there is no waveform without a pixelpipe
+    if(type == DT_DEV_HISTOGRAM_WAVEFORM) type = DT_DEV_HISTOGRAM_LOGARITHMIC;
+  }
+  float hist_max = type == DT_DEV_HISTOGRAM_LINEAR ? histogram_max : logf(1.0 + histogram_max);
   const int inset = DT_HIST_INSET;
   GtkAllocation allocation;
   gtk_widget_get_allocation(widget, &allocation);
@@ -342,7 +377,7 @@ static gboolean _lib_histogram_draw_callback(GtkWidget *widget, cairo_t *crf, gp
   // draw grid
   cairo_set_line_width(cr, .4);
   cairo_set_source_rgb(cr, .1, .1, .1);
-  if(dev->histogram_type == DT_DEV_HISTOGRAM_WAVEFORM)
+  if(type == DT_DEV_HISTOGRAM_WAVEFORM)
     dt_draw_waveform_lines(cr, 0, 0, width, height);
   else
     dt_draw_grid(cr, 4, 0, 0, width, height);
@@ -350,7 +385,7 @@ static gboolean _lib_histogram_draw_callback(GtkWidget *widget, cairo_t *crf, gp
   if(hist_max > 0.0f)
   {
     cairo_save(cr);
-    if(dev->histogram_type == DT_DEV_HISTOGRAM_WAVEFORM)
+    if(type == DT_DEV_HISTOGRAM_WAVEFORM)
     {
       // make the color channel selector work:
       uint8_t *buf = (uint8_t *)malloc(sizeof(uint8_t) * height * stride);
@@ -383,17 +418,17 @@ static gboolean _lib_histogram_draw_callback(GtkWidget *widget, cairo_t *crf, gp
       if(d->red)
       {
         cairo_set_source_rgba(cr, 1., 0., 0., 0.2);
-        dt_draw_histogram_8(cr, hist, 0, dev->histogram_type == DT_DEV_HISTOGRAM_LINEAR);
+        dt_draw_histogram_8(cr, hist, 0, type == DT_DEV_HISTOGRAM_LINEAR);
       }
       if(d->green)
       {
         cairo_set_source_rgba(cr, 0., 1., 0., 0.2);
-        dt_draw_histogram_8(cr, hist, 1, dev->histogram_type == DT_DEV_HISTOGRAM_LINEAR);
+        dt_draw_histogram_8(cr, hist, 1, type == DT_DEV_HISTOGRAM_LINEAR);
       }
       if(d->blue)
       {
         cairo_set_source_rgba(cr, 0., 0., 1., 0.2);
-        dt_draw_histogram_8(cr, hist, 2, dev->histogram_type == DT_DEV_HISTOGRAM_LINEAR);
+        dt_draw_histogram_8(cr, hist, 2, type == DT_DEV_HISTOGRAM_LINEAR);
       }
       cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
       // cairo_set_antialias(cr, CAIRO_ANTIALIAS_DEFAULT);
@@ -411,8 +446,15 @@ static gboolean _lib_histogram_draw_callback(GtkWidget *widget, cairo_t *crf, gp
   pango_font_description_set_absolute_size(desc, .1 * height * PANGO_SCALE);
   pango_layout_set_font_description(layout, desc);
 
-  char exifline[50];
-  dt_image_print_exif(&dev->image_storage, exifline, 50);
+  char exifline[50] = { 0 };
+  if(!lighttable)
+    dt_image_print_exif(&dev->image_storage, exifline, 50);
+  else if(imgid > 0)
+  {
+    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+    dt_image_print_exif(img, exifline, 50);
+    dt_image_cache_read_release(darktable.image_cache, img);
+  }
   pango_layout_set_text(layout, exifline, -1);
   pango_layout_get_pixel_extents(layout, &ink, NULL);
   cairo_move_to(cr, .02 * width, .98 * height - ink.height - ink.y);
@@ -425,10 +467,28 @@ static gboolean _lib_histogram_draw_callback(GtkWidget *widget, cairo_t *crf, gp
   cairo_fill(cr);
   cairo_restore(cr);
 
+  if(lighttable && d->stats_valid)
+  {
+    char statsline[100];
+    snprintf(statsline, sizeof(statsline), _("brightness %.0f%%, %.1f EV, %.1f%% clipped"),
+             d->stats.brightness, d->stats.dynamic_range, d->stats.clipped);
+    pango_layout_set_text(layout, statsline, -1);
+    pango_layout_get_pixel_extents(layout, &ink, NULL);
+    cairo_move_to(cr, .02 * width, .02 * height - ink.y);
+    cairo_save(cr);
+    cairo_set_line_width(cr, DT_PIXEL_APPLY_DPI(2.0));
+    cairo_set_source_rgba(cr, 1, 1, 1, 0.3);
+    pango_cairo_layout_path(cr, layout);
+    cairo_stroke_preserve(cr);
+    cairo_set_source_rgb(cr, .25, .25, .25);
+    cairo_fill(cr);
+    cairo_restore(cr);
+  }
+
   // buttons to control the display of the histogram: linear/log, r, g, b
   if(d->highlight != 0)
   {
-    _draw_mode_toggle(cr, d->mode_x, d->button_y, d->mode_w, d->button_h, dev->histogram_type);
+    _draw_mode_toggle(cr, d->mode_x, d->button_y, d->mode_w, d->button_h, type);
     cairo_set_source_rgba(cr, 1.0, 0.0, 0.0, 0.4);
     _draw_color_toggle(cr, d->red_x, d->button_y, d->color_w, d->button_h, d->red);
     cairo_set_source_rgba(cr, 0.0, 1.0, 0.0, 0.4);
@@ -452,8 +512,9 @@ static gboolean _lib_histogram_motion_notify_callback(GtkWidget *widget, GdkEven
   dt_lib_module_t *self = (dt_lib_module_t *)user_data;
   dt_lib_histogram_t *d = (dt_lib_histogram_t *)self->data;
 
-  /* check if exposure hooks are available */
-  gboolean hooks_available = dt_dev_exposure_hooks_available(darktable.develop);
+  /* check if exposure hooks are available, they aren't meant for the lighttable */
+  gboolean hooks_available
+      = !_lib_histogram_in_lighttable() && dt_dev_exposure_hooks_available(darktable.develop);
 
   if(!hooks_available) return TRUE;
 
@@ -547,8 +608,9 @@ static gboolean _lib_histogram_button_press_callback(GtkWidget *widget, GdkEvent
   dt_lib_module_t *self = (dt_lib_module_t *)user_data;
   dt_lib_histogram_t *d = (dt_lib_histogram_t *)self->data;
 
-  /* check if exposure hooks are available */
-  gboolean hooks_available = dt_dev_exposure_hooks_available(darktable.develop);
+  /* check if exposure hooks are available, they aren't meant for the lighttable */
+  gboolean hooks_available
+      = !_lib_histogram_in_lighttable() && dt_dev_exposure_hooks_available(darktable.develop);
 
   if(!hooks_available) return TRUE;
 
@@ -602,6 +664,8 @@ static gboolean _lib_histogram_scroll_callback(GtkWidget *widget, GdkEventScroll
   dt_lib_module_t *self = (dt_lib_module_t *)user_data;
   dt_lib_histogram_t *d = (dt_lib_histogram_t *)self->data;
 
+  if(_lib_histogram_in_lighttable()) return TRUE;
+
   float ce = dt_dev_exposure_get_exposure(darktable.develop);
   float cb = dt_dev_exposure_get_black(darktable.develop);
 
@@ -224,7 +224,7 @@ _print_button_clicked (GtkWidget *widget, gpointer user_data)
 
   dt_print(DT_DEBUG_PRINT, "[print] max image size %d x %d (at resolution %d)\n", max_width, max_height, ps->prt.printer.resolution);
 
-  dt_imageio_module_format_t buf;
+  dt_imageio_module_format_t buf = { 0 };
   buf.mime = mime;
   buf.levels = levels;
   buf.bpp = bpp;
@@ -23,6 +23,7 @@
 #include "common/history.h"
 #include "common/image_cache.h"
 #include "common/mipmap_cache.h"
+#include "common/mipmap_prefetch.h"
 #include "common/selection.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -69,6 +70,9 @@ typedef struct dt_lib_filmstrip_t
   int32_t select_id;
 
   dt_gui_hist_dialog_t dg;
+
+  // scroll aware thumbnail prefetching
+  dt_mipmap_prefetch_t prefetch;
 } dt_lib_filmstrip_t;
 
 /* proxy function to center filmstrip on imgid */
@@ -289,6 +293,7 @@ void gui_init(dt_lib_module_t *self)
   d->pointerx = -1;
   d->pointery = -1;
   dt_gui_hist_dialog_init(&d->dg);
+  dt_mipmap_prefetch_init(&d->prefetch);
 
   /* creating drawing area */
   self->widget = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
@@ -376,6 +381,9 @@ void gui_cleanup(dt_lib_module_t *self)
   darktable.view_manager->proxy.filmstrip.module = NULL;
 
   /* cleanup */
+  dt_lib_filmstrip_t *strip = (dt_lib_filmstrip_t *)self->data;
+  dt_mipmap_prefetch_print(&strip->prefetch, "filmstrip");
+  dt_mipmap_prefetch_cleanup(&strip->prefetch);
   free(self->data);
   self->data = NULL;
 }
@@ -737,7 +745,10 @@ static gboolean _lib_filmstrip_draw_callback(GtkWidget *widget, cairo_t *cr, gpo
       // getting it from the matrix ...
       cairo_matrix_t m;
       cairo_get_matrix(cr, &m);
-      dt_view_image_expose(&(strip->image_over), id, cr, wd, ht, max_cols, img_pointerx, img_pointery, FALSE, FALSE);
+      const int missing
+          = dt_view_image_expose(&(strip->image_over), id, cr, wd, ht, max_cols, img_pointerx, img_pointery,
+                                 FALSE, FALSE);
+      dt_mipmap_prefetch_shown(&strip->prefetch, id, !missing);
       cairo_restore(cr);
     }
     else if(step_res == SQLITE_DONE)
@@ -750,6 +761,11 @@ static gboolean _lib_filmstrip_draw_callback(GtkWidget *widget, cairo_t *cr, gpo
   }
 failure:
   cairo_restore(cr);
+
+  /* queue the thumbnails next to the visible ones in the direction we are scrolling */
+  dt_mipmap_prefetch_update(&strip->prefetch, stmt, MAX(0, offset - max_cols / 2), max_cols,
+                            strip->collection_count,
+                            dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, wd, ht));
   sqlite3_finalize(stmt);
 
   if(darktable.gui->center_tooltip == 1) // set in this round
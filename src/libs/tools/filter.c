@@ -148,6 +148,8 @@ void gui_init(dt_lib_module_t *self)
   gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(widget), _("color label"));
   gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(widget), _("group"));
   gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(widget), _("full path"));
+  gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(widget), _("brightness"));
+  gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(widget), _("dynamic range"));
 
   /* select the last selected value */
   gtk_combo_box_set_active(GTK_COMBO_BOX(widget), dt_collection_get_sort_field(darktable.collection));
@@ -18,6 +18,7 @@
 #include "lua/storage.h"
 #include "common/imageio.h"
 #include "control/conf.h"
+#include "control/jobs/control_jobs.h"
 #include "lua/image.h"
 #include "lua/modules.h"
 #include "lua/types.h"
@@ -143,6 +144,123 @@ static int new_storage(lua_State *L)
   return 1;
 }
 
+static dt_imageio_module_storage_t *_target_storage(lua_State *L, int index, luaA_Type *type)
+{
+  lua_getfield(L, index, "storage");
+  lua_getmetatable(L, -1);
+  lua_getfield(L, -1, "__luaA_Type");
+  *type = luaL_checkint(L, -1);
+  lua_pop(L, 1);
+  lua_getfield(L, -1, "__associated_object");
+  dt_imageio_module_storage_t *storage = lua_touserdata(L, -1);
+  lua_pop(L, 2);
+  return storage; // the storage object stays on the stack
+}
+
+static dt_imageio_module_format_t *_target_format(lua_State *L, int index)
+{
+  lua_getfield(L, index, "format");
+  luaL_getmetafield(L, -1, "__associated_object");
+  dt_imageio_module_format_t *format = lua_touserdata(L, -1);
+  lua_pop(L, 2);
+  return format;
+}
+
+static void _check_target(lua_State *L, int index)
+{
+  luaL_argcheck(L, lua_istable(L, index), 2, "table of targets expected");
+  lua_getfield(L, index, "storage");
+  luaL_argcheck(L, dt_lua_isa(L, -1, dt_imageio_module_storage_t), 2, "storage expected in every target");
+  lua_getfield(L, index, "format");
+  luaL_argcheck(L, dt_lua_isa(L, -1, dt_imageio_module_format_t), 2, "format expected in every target");
+  lua_getfield(L, index, "max_width");
+  luaL_optint(L, -1, 0);
+  lua_getfield(L, index, "max_height");
+  luaL_optint(L, -1, 0);
+  lua_pop(L, 4);
+
+  luaA_Type storage_type;
+  dt_imageio_module_storage_t *storage = _target_storage(L, index, &storage_type);
+  lua_pop(L, 1);
+  dt_imageio_module_format_t *format = _target_format(L, index);
+  luaL_argcheck(L, storage->supported(storage, format), 2, "format not supported by storage");
+}
+
+static void _export_target_free(gpointer data)
+{
+  dt_control_export_target_t *target = (dt_control_export_target_t *)data;
+  dt_imageio_module_storage_t *storage = dt_imageio_get_storage_by_index(target->storage_index);
+  if(target->sdata) storage->free_params(storage, target->sdata);
+  free(target);
+}
+
+/*
+ * darktable.export_targets(images, targets [, upscale]) exports the images to every
+ * { storage = ..., format = ..., max_width = ..., max_height = ... } of targets, running the pixelpipe once
+ * per image. the format settings and the output profile are those of the export module for all targets.
+ */
+static int export_targets(lua_State *L)
+{
+  luaL_checktype(L, 1, LUA_TTABLE);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  const gboolean upscale = lua_toboolean(L, 3);
+
+  // check everything before allocating, lua errors don't return
+  lua_pushnil(L);
+  while(lua_next(L, 1) != 0)
+  {
+    luaL_argcheck(L, dt_lua_isa(L, -1, dt_lua_image_t), 1, "table of images expected");
+    lua_pop(L, 1);
+  }
+  lua_pushnil(L);
+  while(lua_next(L, 2) != 0)
+  {
+    _check_target(L, lua_gettop(L));
+    lua_pop(L, 1);
+  }
+
+  GList *targets = NULL;
+  lua_pushnil(L);
+  while(lua_next(L, 2) != 0)
+  {
+    const int index = lua_gettop(L);
+    dt_control_export_target_t *target = calloc(1, sizeof(dt_control_export_target_t));
+    luaA_Type storage_type;
+    dt_imageio_module_storage_t *storage = _target_storage(L, index, &storage_type);
+    target->storage_index = dt_imageio_get_index_of_storage(storage);
+    target->format_index = dt_imageio_get_index_of_format(_target_format(L, index));
+    target->sdata = storage->get_params(storage);
+    targets = g_list_append(targets, target);
+    if(!target->sdata)
+    {
+      g_list_free_full(targets, _export_target_free);
+      return luaL_error(L, "failed to get parameters from storage module `%s'", storage->name(storage));
+    }
+    luaA_to_type(L, storage_type, target->sdata, -1);
+    lua_getfield(L, index, "max_width");
+    target->max_width = luaL_optint(L, -1, 0);
+    lua_getfield(L, index, "max_height");
+    target->max_height = luaL_optint(L, -1, 0);
+    lua_pop(L, 4);
+  }
+  if(!targets) return luaL_argerror(L, 2, "no export target");
+
+  GList *images = NULL;
+  lua_pushnil(L);
+  while(lua_next(L, 1) != 0)
+  {
+    int imgid;
+    luaA_to(L, dt_lua_image_t, &imgid, -1);
+    images = g_list_prepend(images, GINT_TO_POINTER(imgid));
+    lua_pop(L, 1);
+  }
+  images = g_list_reverse(images);
+
+  const gboolean high_quality = dt_conf_get_bool("plugins/lighttable/export/high_quality_processing");
+  dt_control_export_targets(images, targets, high_quality, upscale, "", FALSE);
+  return 0;
+}
+
 int dt_lua_init_early_storage(lua_State *L)
 {
 
@@ -170,6 +288,9 @@ int dt_lua_init_early_storage(lua_State *L)
   lua_pushstring(L, "new_storage");
   lua_pushcfunction(L, &new_storage);
   lua_settable(L, -3);
+  lua_pushstring(L, "export_targets");
+  lua_pushcfunction(L, &export_targets);
+  lua_settable(L, -3);
   lua_pop(L, 1);
   return 0;
 }
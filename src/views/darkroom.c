@@ -190,8 +190,11 @@ void expose(
     float ht = dev->pipe->backbuf_height;
     stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, wd);
     surface = dt_cairo_image_surface_create_for_data(dev->pipe->backbuf, CAIRO_FORMAT_RGB24, wd, ht, stride);
-    wd /= darktable.gui->ppd;
-    ht /= darktable.gui->ppd;
+    // a progressive coarse pass leaves a backbuffer at reduced scale, blow it up to the final size
+    float upscale = dt_dev_get_zoom_scale(dev, zoom, 1.0f, 0) * darktable.gui->ppd / dev->pipe->backbuf_scale;
+    if(upscale < 1.01f) upscale = 1.0f;
+    wd *= upscale / darktable.gui->ppd;
+    ht *= upscale / darktable.gui->ppd;
     if(dev->full_preview)
       cairo_set_source_rgb(cr, .1, .1, .1);
     else
@@ -203,10 +206,14 @@ void expose(
       cairo_scale(cr, 2.0, 2.0);
       cairo_translate(cr, -.25f * wd, -.25f * ht);
     }
-    cairo_rectangle(cr, 0, 0, wd, ht);
+    cairo_save(cr);
+    cairo_scale(cr, upscale, upscale);
+    cairo_rectangle(cr, 0, 0, wd / upscale, ht / upscale);
     cairo_set_source_surface(cr, surface, 0, 0);
-    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
-    cairo_fill_preserve(cr);
+    cairo_pattern_set_filter(cairo_get_source(cr), upscale > 1.0f ? CAIRO_FILTER_GOOD : CAIRO_FILTER_FAST);
+    cairo_fill(cr);
+    cairo_restore(cr);
+    cairo_rectangle(cr, 0, 0, wd, ht);
     cairo_set_line_width(cr, 1.0);
     cairo_set_source_rgb(cr, .3, .3, .3);
     cairo_stroke(cr);
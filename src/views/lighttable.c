@@ -25,6 +25,8 @@
 #include "common/grouping.h"
 #include "common/history.h"
 #include "common/image_cache.h"
+#include "common/image_stats.h"
+#include "common/mipmap_prefetch.h"
 #include "common/ratings.h"
 #include "common/selection.h"
 #include "control/conf.h"
@@ -106,6 +108,9 @@ typedef struct dt_library_t
 
   int32_t collection_count;
 
+  // scroll aware thumbnail prefetching
+  dt_mipmap_prefetch_t prefetch;
+
   // stuff for the audio player
   GPid audio_player_pid;   // the pid of the child process
   int32_t audio_player_id; // the imgid of the image the audio is played for
@@ -350,6 +355,9 @@ static void _update_collected_images(dt_view_t *self)
     sqlite3_finalize(stmt);
   }
 
+  // fill in the exposure statistics this collection is still missing
+  dt_image_stats_update_collection();
+
   /* if we have a statment lets clean it */
   if(lib->statements.main_query) sqlite3_finalize(lib->statements.main_query);
 
@@ -419,6 +427,7 @@ void init(dt_view_t *self)
   lib->full_res_thumb = 0;
   lib->full_res_thumb_id = -1;
   lib->audio_player_id = -1;
+  dt_mipmap_prefetch_init(&lib->prefetch);
 
   /* setup collection listener and initialize main_query statement */
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED,
@@ -443,6 +452,8 @@ void cleanup(dt_view_t *self)
   dt_conf_set_float("lighttable/ui/zoom_x", lib->zoom_x);
   dt_conf_set_float("lighttable/ui/zoom_y", lib->zoom_y);
   if(lib->audio_player_id != -1) _stop_audio(lib);
+  dt_mipmap_prefetch_print(&lib->prefetch, "lighttable");
+  dt_mipmap_prefetch_cleanup(&lib->prefetch);
   free(lib->full_res_thumb);
   free(self->data);
 }
@@ -738,8 +749,10 @@ end_query_cache:
           // this single image.
           dt_selection_select_single(darktable.selection, id);
         }
-        missing += dt_view_image_expose(&(lib->image_over), id, cr, wd, iir == 1 ? height : ht, iir, img_pointerx,
-                             img_pointery, FALSE, FALSE);
+        const int image_missing = dt_view_image_expose(&(lib->image_over), id, cr, wd, iir == 1 ? height : ht,
+                                                       iir, img_pointerx, img_pointery, FALSE, FALSE);
+        dt_mipmap_prefetch_shown(&lib->prefetch, id, !image_missing);
+        missing += image_missing;
 
         cairo_restore(cr);
       }
@@ -900,30 +913,11 @@ after_drawing:
   /* check if offset was changed and we need to prefetch thumbs */
   if(offset_changed)
   {
-    int32_t imgids_num = 0;
-    const int prefetchrows = .5 * max_rows + 1;
-    int32_t imgids[prefetchrows * iir];
-
-    /* clear and reset main query */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
-    DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
-
-    /* setup offest and row for prefetch */
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, offset + max_rows * iir);
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, prefetchrows * iir);
-
-    // prefetch jobs in inverse order: supersede previous jobs: most important last
-    while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW && imgids_num < prefetchrows * iir)
-      imgids[imgids_num++] = sqlite3_column_int(lib->statements.main_query, 0);
-
-    float imgwd = iir == 1 ? 0.97 : 0.8;
-    dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, imgwd * wd,
-                                                             imgwd * (iir == 1 ? height : ht));
-    while(imgids_num > 0)
-    {
-      imgids_num--;
-      dt_mipmap_cache_get(darktable.mipmap_cache, NULL, imgids[imgids_num], mip, DT_MIPMAP_PREFETCH, 'r');
-    }
+    const float imgwd = iir == 1 ? 0.97 : 0.8;
+    const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, imgwd * wd,
+                                                                   imgwd * (iir == 1 ? height : ht));
+    dt_mipmap_prefetch_update(&lib->prefetch, lib->statements.main_query, offset, max_rows * iir,
+                              lib->collection_count, mip);
   }
 
   lib->offset_changed = FALSE;
@@ -1134,6 +1128,7 @@ static int expose_zoomable(dt_view_t *self, cairo_t *cr, int32_t width, int32_t
   }
   else
     lib->offset = offset;
+  const int first_offset = MAX(0, offset);
 
   int id;
 
@@ -1174,8 +1169,10 @@ static int expose_zoomable(dt_view_t *self, cairo_t *cr, int32_t width, int32_t
 
         cairo_save(cr);
         // if(zoom == 1) dt_image_prefetch(image, DT_IMAGE_MIPF);
-        missing += dt_view_image_expose(&(lib->image_over), id, cr, wd, zoom == 1 ? height : ht, zoom, img_pointerx,
-                             img_pointery, FALSE, FALSE);
+        const int image_missing = dt_view_image_expose(&(lib->image_over), id, cr, wd, zoom == 1 ? height : ht,
+                                                       zoom, img_pointerx, img_pointery, FALSE, FALSE);
+        dt_mipmap_prefetch_shown(&lib->prefetch, id, !image_missing);
+        missing += image_missing;
         cairo_restore(cr);
         if(zoom == 1)
         {
@@ -1194,6 +1191,14 @@ static int expose_zoomable(dt_view_t *self, cairo_t *cr, int32_t width, int32_t
   }
 failure:
 
+  {
+    // rows of the zoomable grid are DT_LIBRARY_MAX_ZOOM wide, so a page covers whole rows
+    const dt_mipmap_size_t mip
+        = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, wd, zoom == 1 ? height : ht);
+    dt_mipmap_prefetch_update(&lib->prefetch, lib->statements.main_query, first_offset,
+                              zoom == 1 ? 1 : max_rows * DT_LIBRARY_MAX_ZOOM, lib->collection_count, mip);
+  }
+
   lib->zoom_x = zoom_x;
   lib->zoom_y = zoom_y;
   lib->track = 0;
@@ -1303,7 +1308,7 @@ static int expose_full_preview(dt_view_t *self, cairo_t *cr, int32_t width, int3
       if(!dt_imageio_large_thumbnail(filename, &lib->full_res_thumb,
                                                &lib->full_res_thumb_wd,
                                                &lib->full_res_thumb_ht,
-                                               &color_space)) {
+                                               &color_space, 0, 0)) {
         lib->full_res_thumb_orientation = ORIENTATION_NONE;
         lib->full_res_thumb_id = lib->full_preview_id;
       }
@@ -1647,6 +1652,7 @@ void enter(dt_view_t *self)
   lib->button = 0;
   lib->pan = 0;
   dt_collection_hint_message(darktable.collection);
+  dt_image_stats_update_collection();
 
   // hide panel if we are in full preview mode
   if(lib->full_preview_id != -1)
@@ -17,6 +17,7 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "bauhaus/bauhaus.h"
 #include "common/collection.h"
 #include "common/darktable.h"
 #include "common/debug.h"
@@ -34,11 +35,30 @@
 #include "views/view_api.h"
 #include <gdk/gdkkeysyms.h>
 
+#include <math.h>
 #include <osm-gps-map.h>
+#include <stdlib.h>
 
 DT_MODULE(1)
 
 
+/* a geotagged image in the in-memory location index */
+typedef struct dt_map_point_t
+{
+  gint imgid;
+  float lat, lon;
+} dt_map_point_t;
+
+/* a group of images falling into the same cell of the current zoom level */
+typedef struct dt_map_cluster_t
+{
+  uint64_t cell;
+  gint imgid; // the image closest to the centre of the cell
+  float lat, lon;
+  double dist;
+  gint count;
+} dt_map_cluster_t;
+
 typedef struct dt_map_t
 {
   GtkWidget *center;
@@ -53,6 +73,12 @@ typedef struct dt_map_t
   {
     sqlite3_stmt *main_query;
   } statements;
+  struct
+  {
+    dt_map_point_t *points; // sorted by longitude
+    int count;
+    gboolean dirty;
+  } index;
   gboolean drop_filmstrip_activated;
   gboolean filter_images_drawn;
   int max_images_drawn;
@@ -477,6 +503,7 @@ void cleanup(dt_view_t *self)
     //     g_object_unref(G_OBJECT(lib->map));
   }
   if(lib->statements.main_query) sqlite3_finalize(lib->statements.main_query);
+  g_free(lib->index.points);
   free(self->data);
 }
 
@@ -490,6 +517,189 @@ int try_enter(dt_view_t *self)
   return 0;
 }
 
+/* (re)load the locations of all images that can be drawn, sorted by longitude */
+static void _view_map_load_index(dt_map_t *lib)
+{
+  const double start = dt_get_wtime();
+  int count = 0, allocated = 0;
+  dt_map_point_t *points = NULL;
+
+  DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
+  while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW)
+  {
+    if(count == allocated)
+    {
+      allocated = MAX(1024, 2 * allocated);
+      points = g_realloc(points, sizeof(dt_map_point_t) * allocated);
+    }
+    points[count].imgid = sqlite3_column_int(lib->statements.main_query, 0);
+    points[count].lat = sqlite3_column_double(lib->statements.main_query, 1);
+    points[count].lon = sqlite3_column_double(lib->statements.main_query, 2);
+    count++;
+  }
+
+  g_free(lib->index.points);
+  lib->index.points = points;
+  lib->index.count = count;
+  lib->index.dirty = FALSE;
+
+  dt_print(DT_DEBUG_PERF, "[map] indexed %d geotagged images in %.3f secs\n", count, dt_get_wtime() - start);
+}
+
+/* spherical mercator, in pixels of a map that is `world' pixels wide */
+static inline void _view_map_project(const float lat, const float lon, const double world, double *x, double *y)
+{
+  const double s = sin(CLAMP(lat, -85.0511, 85.0511) * M_PI / 180.0);
+  *x = (lon + 180.0) / 360.0 * world;
+  *y = (0.5 - log((1.0 + s) / (1.0 - s)) / (4.0 * M_PI)) * world;
+}
+
+/* first index entry with a longitude of at least lon (or greater than lon when `after' is set) */
+static int _view_map_index_search(const dt_map_t *lib, const float lon, const gboolean after)
+{
+  int lo = 0, hi = lib->index.count;
+  while(lo < hi)
+  {
+    const int mid = lo + (hi - lo) / 2;
+    const float l = lib->index.points[mid].lon;
+    if(l < lon || (after && l == lon))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static int _view_map_cluster_cmp_cell(const void *a, const void *b)
+{
+  const dt_map_cluster_t *ca = (const dt_map_cluster_t *)a, *cb = (const dt_map_cluster_t *)b;
+  if(ca->cell != cb->cell) return ca->cell < cb->cell ? -1 : 1;
+  if(ca->dist != cb->dist) return ca->dist < cb->dist ? -1 : 1;
+  return ca->imgid - cb->imgid;
+}
+
+/* north to south, so that the thumbnails further down overlap the ones above them */
+static int _view_map_cluster_cmp_lat(const void *a, const void *b)
+{
+  const dt_map_cluster_t *ca = (const dt_map_cluster_t *)a, *cb = (const dt_map_cluster_t *)b;
+  if(ca->lat != cb->lat) return ca->lat > cb->lat ? -1 : 1;
+  return ca->imgid - cb->imgid;
+}
+
+/* put the clusters into cells of the given size and collapse each cell into its image closest to the cell's
+ * center, adding up the counts. returns the number of clusters left. */
+static int _view_map_collapse_clusters(dt_map_cluster_t *clusters, const int n, const double world,
+                                       const double cell_size)
+{
+  const uint64_t columns = (uint64_t)(world / cell_size) + 1;
+  for(int i = 0; i < n; i++)
+  {
+    dt_map_cluster_t *c = clusters + i;
+    double x, y;
+    _view_map_project(c->lat, c->lon, world, &x, &y);
+    const uint64_t cx = MAX(0, floor(x / cell_size)), cy = MAX(0, floor(y / cell_size));
+    const double dx = x - (cx + 0.5) * cell_size, dy = y - (cy + 0.5) * cell_size;
+    c->cell = cy * columns + cx;
+    c->dist = dx * dx + dy * dy;
+  }
+
+  qsort(clusters, n, sizeof(dt_map_cluster_t), _view_map_cluster_cmp_cell);
+  int k = 0;
+  for(int i = 0; i < n; i++)
+  {
+    if(k > 0 && clusters[k - 1].cell == clusters[i].cell)
+      clusters[k - 1].count += clusters[i].count;
+    else
+      clusters[k++] = clusters[i];
+  }
+  return k;
+}
+
+/* group the indexed images inside the bounding box into cells of roughly one thumbnail at the given zoom
+ * level. if that gives more than max_images_drawn clusters, the cells are made coarser until it doesn't, so
+ * every image stays counted in one of them. */
+static dt_map_cluster_t *_view_map_get_clusters(const dt_map_t *lib, const int zoom, const float lon0,
+                                                const float lon1, const float lat0, const float lat1,
+                                                int *count)
+{
+  const int begin = _view_map_index_search(lib, lon0, FALSE);
+  const int end = _view_map_index_search(lib, lon1, TRUE);
+
+  *count = 0;
+  if(end <= begin) return NULL;
+
+  const double world = 256.0 * (double)(1 << CLAMP(zoom, 0, 30));
+  double cell_size = DT_PIXEL_APPLY_DPI(thumb_size);
+
+  dt_map_cluster_t *clusters = (dt_map_cluster_t *)malloc(sizeof(dt_map_cluster_t) * (end - begin));
+  int n = 0;
+  for(int i = begin; i < end; i++)
+  {
+    const dt_map_point_t *p = lib->index.points + i;
+    if(p->lat > lat0 || p->lat < lat1) continue;
+
+    dt_map_cluster_t *c = clusters + n++;
+    c->imgid = p->imgid;
+    c->lat = p->lat;
+    c->lon = p->lon;
+    c->count = 1;
+  }
+
+  int k = _view_map_collapse_clusters(clusters, n, world, cell_size);
+  // a cell as large as the world holds everything, so this ends
+  const int max_clusters = MAX(lib->max_images_drawn, 1);
+  while(k > max_clusters)
+  {
+    cell_size *= 2.0;
+    k = _view_map_collapse_clusters(clusters, k, world, cell_size);
+  }
+
+  qsort(clusters, k, sizeof(dt_map_cluster_t), _view_map_cluster_cmp_lat);
+
+  *count = k;
+  return clusters;
+}
+
+/* draw the number of images of a cluster into the top right corner of its thumbnail */
+static GdkPixbuf *_view_map_add_count(GdkPixbuf *thumb, const int count)
+{
+  const int w = gdk_pixbuf_get_width(thumb), h = gdk_pixbuf_get_height(thumb);
+  const float _thumb_border = DT_PIXEL_APPLY_DPI(thumb_border);
+  const float fontsize = 0.2 * DT_PIXEL_APPLY_DPI(thumb_size);
+  const float pad = 0.25 * fontsize;
+
+  cairo_surface_t *cst = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+  cairo_t *cr = cairo_create(cst);
+  gdk_cairo_set_source_pixbuf(cr, thumb, 0, 0);
+  cairo_paint(cr);
+
+  char text[16];
+  snprintf(text, sizeof(text), "%d", count);
+  PangoRectangle ink;
+  PangoFontDescription *desc = pango_font_description_copy_static(darktable.bauhaus->pango_font_desc);
+  pango_font_description_set_weight(desc, PANGO_WEIGHT_BOLD);
+  pango_font_description_set_absolute_size(desc, fontsize * PANGO_SCALE);
+  PangoLayout *layout = pango_cairo_create_layout(cr);
+  pango_layout_set_font_description(layout, desc);
+  pango_layout_set_text(layout, text, -1);
+  pango_layout_get_pixel_extents(layout, &ink, NULL);
+
+  const float x = w - _thumb_border - ink.width - 2 * pad, y = _thumb_border;
+  cairo_rectangle(cr, x, y, ink.width + 2 * pad, ink.height + 2 * pad);
+  cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.7);
+  cairo_fill(cr);
+  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+  cairo_move_to(cr, x + pad - ink.x, y + pad - ink.y);
+  pango_cairo_show_layout(cr, layout);
+  pango_font_description_free(desc);
+  g_object_unref(layout);
+  cairo_destroy(cr);
+
+  GdkPixbuf *result = gdk_pixbuf_get_from_surface(cst, 0, 0, w, h);
+  cairo_surface_destroy(cst);
+  return result;
+}
+
 static gboolean _view_map_redraw(gpointer user_data)
 {
   dt_view_t *self = (dt_view_t *)user_data;
@@ -533,17 +743,17 @@ static void _view_map_changed_callback(OsmGpsMap *map, dt_view_t *self)
   /* check if the prefs have changed and rebuild main_query if needed */
   if(_view_map_prefs_changed(lib)) _view_map_build_main_query(lib);
 
-  /* let's reset and reuse the main_query statement */
-  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
-  DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
+  /* the index is only reloaded when images were moved or the collection changed */
+  if(lib->index.dirty) _view_map_load_index(lib);
 
-  /* bind bounding box coords for the main query */
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 1, bb_0_lon - west_border);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 2, bb_1_lon);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 3, bb_0_lat);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 4, bb_1_lat - south_border);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 5, center_lat);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 6, center_lon);
+  /* group the images in the bounding box for the current zoom level */
+  const double start = dt_get_wtime();
+  int cluster_count = 0;
+  dt_map_cluster_t *clusters
+      = _view_map_get_clusters(lib, zoom, bb_0_lon - west_border, bb_1_lon, bb_0_lat, bb_1_lat - south_border,
+                               &cluster_count);
+  dt_print(DT_DEBUG_PERF, "[map] %d clusters at zoom level %d in %.3f secs\n", cluster_count, zoom,
+           dt_get_wtime() - start);
 
   /* remove the old images */
   if(lib->images)
@@ -562,9 +772,10 @@ static void _view_map_changed_callback(OsmGpsMap *map, dt_view_t *self)
   gboolean needs_redraw = FALSE;
   const int _thumb_size = DT_PIXEL_APPLY_DPI(thumb_size);
   dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, _thumb_size, _thumb_size);
-  while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW)
+  for(int i = 0; i < cluster_count; i++)
   {
-    int imgid = sqlite3_column_int(lib->statements.main_query, 0);
+    const dt_map_cluster_t *cluster = clusters + i;
+    const int imgid = cluster->imgid;
     dt_mipmap_buffer_t buf;
     dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, mip, DT_MIPMAP_BEST_EFFORT, 'r');
 
@@ -599,20 +810,22 @@ static void _view_map_changed_callback(OsmGpsMap *map, dt_view_t *self)
       // and finally add the pin
       gdk_pixbuf_copy_area(lib->image_pin, 0, 0, w + 2 * _thumb_border, _pin_size, thumb, 0, h + 2 * _thumb_border);
 
-      const dt_image_t *cimg = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-      if(!cimg) goto map_changed_failure;
-      dt_map_image_t *entry = (dt_map_image_t *)malloc(sizeof(dt_map_image_t));
-      if(!entry)
+      // clusters show how many images they stand for
+      if(cluster->count > 1)
       {
-        dt_image_cache_read_release(darktable.image_cache, cimg);
-        goto map_changed_failure;
+        GdkPixbuf *counted = _view_map_add_count(thumb, cluster->count);
+        if(!counted) goto map_changed_failure;
+        g_object_unref(thumb);
+        thumb = counted;
       }
+
+      dt_map_image_t *entry = (dt_map_image_t *)malloc(sizeof(dt_map_image_t));
+      if(!entry) goto map_changed_failure;
       entry->imgid = imgid;
-      entry->image = osm_gps_map_image_add_with_alignment(map, cimg->latitude, cimg->longitude, thumb, 0, 1);
+      entry->image = osm_gps_map_image_add_with_alignment(map, cluster->lat, cluster->lon, thumb, 0, 1);
       entry->width = w;
       entry->height = h;
       lib->images = g_slist_prepend(lib->images, entry);
-      dt_image_cache_read_release(darktable.image_cache, cimg);
 
     map_changed_failure:
       if(source) g_object_unref(source);
@@ -622,6 +835,7 @@ static void _view_map_changed_callback(OsmGpsMap *map, dt_view_t *self)
       needs_redraw = TRUE;
     dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
   }
+  free(clusters);
 
   // not exactly thread safe, but should be good enough for updating the display
   static int timeout_event_source = 0;
@@ -778,6 +992,9 @@ void enter(dt_view_t *self)
   lib->selected_image = 0;
   lib->start_drag = FALSE;
 
+  /* geotags might have been changed in other views */
+  lib->index.dirty = TRUE;
+
   /* set the correct map source */
   _view_map_set_map_source_g_object(self, lib->map_source);
 
@@ -1043,6 +1260,9 @@ static void _view_map_collection_changed(gpointer instance, gpointer user_data)
   dt_view_t *view = (dt_view_t *)user_data;
   dt_map_t *lib = (dt_map_t *)view->data;
 
+  /* images might have been imported or removed, too */
+  lib->index.dirty = TRUE;
+
   if(dt_conf_get_bool("plugins/map/filter_images_drawn"))
   {
     /* only redraw when map mode is currently active, otherwise enter() does the magic */
@@ -1127,6 +1347,9 @@ static void _set_image_location(dt_view_t *self, int imgid, float longitude, flo
   if(set_elevation) img->elevation = elevation;
   dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_SAFE);
 
+  dt_map_t *lib = (dt_map_t *)self->data;
+  lib->index.dirty = TRUE;
+
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_MOUSE_OVER_IMAGE_CHANGE);
 }
 
@@ -1261,18 +1484,17 @@ static void _view_map_build_main_query(dt_map_t *lib)
   lib->max_images_drawn = dt_conf_get_int("plugins/map/max_images_drawn");
   if(lib->max_images_drawn == 0) lib->max_images_drawn = 100;
   lib->filter_images_drawn = dt_conf_get_bool("plugins/map/filter_images_drawn");
+  /* the main query loads the location index, the bounding box of the map is handled in memory */
   geo_query = g_strdup_printf(
-      "select * from (select id, latitude from %s where \
-                               longitude >= ?1 and longitude <= ?2 and latitude <= ?3 and latitude >= ?4 \
-                               and longitude not NULL and latitude not NULL order by abs(latitude - ?5), abs(longitude - ?6) \
-                               limit 0, %d) order by (180 - latitude), id",
-      lib->filter_images_drawn ? "images i inner join memory.collected_images c on i.id = c.imgid" : "images",
-      lib->max_images_drawn);
+      "select id, latitude, longitude from %s where longitude not NULL and latitude not NULL order by longitude",
+      lib->filter_images_drawn ? "images i inner join memory.collected_images c on i.id = c.imgid" : "images");
 
   /* prepare the main query statement */
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), geo_query, -1, &lib->statements.main_query, NULL);
 
   g_free(geo_query);
+
+  lib->index.dirty = TRUE;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
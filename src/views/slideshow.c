@@ -22,6 +22,7 @@
 #include "common/dtpthread.h"
 #include "common/imageio.h"
 #include "common/imageio_module.h"
+#include "common/mipmap_cache.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "gui/accelerators.h"
@@ -34,45 +35,49 @@
 
 DT_MODULE(1)
 
-typedef enum dt_slideshow_event_t
-{
-  s_request_step,
-  s_request_step_back,
-  s_image_loaded,
-  s_blended,
-} dt_slideshow_event_t;
+// upper limit for the look-ahead in each direction
+#define DT_SLIDESHOW_MAX_LOOKAHEAD 8
+#define DT_SLIDESHOW_MAX_SLOTS (2 * DT_SLIDESHOW_MAX_LOOKAHEAD + 1)
 
-typedef enum dt_slideshow_state_t
+typedef enum dt_slideshow_slot_state_t
+{
+  s_slot_empty,
+  s_slot_rendering,
+  s_slot_ready,
+  s_slot_failed, // nothing to show for this position, drawn as an empty frame
+} dt_slideshow_slot_state_t;
+
+// one pre-rendered frame of the ring
+typedef struct dt_slideshow_slot_t
 {
-  s_prefetching,
-  s_waiting_for_user,
-  s_blending,
-} dt_slideshow_state_t;
+  uint32_t *buf;
+  // processed sizes might differ from screen size
+  uint32_t width, height;
+  int32_t num; // position in the show this slot is holding
+  dt_slideshow_slot_state_t state;
+} dt_slideshow_slot_t;
 
 typedef struct dt_slideshow_t
 {
   uint32_t random_state;
   uint32_t scramble;
   uint32_t use_random;
-  int32_t step;
+  int32_t *random_order; // collection index for every position when shuffling
+  int32_t count;         // collection size when entering
   uint32_t width, height;
 
-
-  // double buffer
-  uint32_t *buf1, *buf2;
-  uint32_t *front, *back;
-  // processed sizes might differ from screen size
-  uint32_t front_width, front_height;
-  uint32_t back_width, back_height;
-  int32_t front_num, back_num;
+  // ring of frames around the current position, num % num_slots picks the slot
+  dt_slideshow_slot_t slot[DT_SLIDESHOW_MAX_SLOTS];
+  int32_t num_slots, lookahead;
+  int32_t cur;  // position that is on screen
+  int32_t want; // position the user asked for, equals cur unless we are waiting for it to render
+  uint32_t session; // bumped on every enter so jobs from an earlier show don't deliver frames
+  gboolean busy;
 
   // output profile before we overwrote it:
   int old_profile_type;
 
-  // state machine stuff for image transitions:
   dt_pthread_mutex_t lock;
-  dt_slideshow_state_t state;      // global state cycle
-  uint32_t state_waiting_for_user; // user input (needed to step the cycle at one point)
 
   uint32_t auto_advance;
 
@@ -87,10 +92,63 @@ typedef struct dt_slideshow_format_t
   char style[128];
   gboolean style_append;
   dt_slideshow_t *d;
+  int32_t num;
+  uint32_t session;
 } dt_slideshow_format_t;
 
-// fwd declare state machine mechanics:
-static void _step_state(dt_slideshow_t *d, dt_slideshow_event_t event);
+typedef struct dt_slideshow_job_t
+{
+  dt_slideshow_t *d;
+  int32_t num;
+  uint32_t session;
+} dt_slideshow_job_t;
+
+static void _step(dt_slideshow_t *d, int32_t step);
+static gboolean auto_advance(gpointer user_data);
+
+static inline dt_slideshow_slot_t *_slot(dt_slideshow_t *d, int32_t num)
+{
+  int32_t s = num % d->num_slots;
+  if(s < 0) s += d->num_slots;
+  return d->slot + s;
+}
+
+// hand a finished frame over to its slot, called with the pixels in cairo byte order. a NULL frame marks
+// the position as failed, so the show doesn't wait for it forever
+static void _deliver_frame(dt_slideshow_t *d, int32_t num, uint32_t session, const void *in, int width,
+                           int height)
+{
+  gboolean show = FALSE;
+  dt_pthread_mutex_lock(&d->lock);
+  dt_slideshow_slot_t *slot = d->num_slots ? _slot(d, num) : NULL;
+  // the slot might have been recycled meanwhile, or we left the slide show
+  if(slot && slot->buf && session == d->session && slot->num == num)
+  {
+    if(in && width <= d->width && height <= d->height)
+    {
+      memcpy(slot->buf, in, sizeof(uint32_t) * width * height);
+      slot->width = width;
+      slot->height = height;
+      slot->state = s_slot_ready;
+    }
+    else if(slot->state == s_slot_rendering)
+      slot->state = s_slot_failed;
+    if(num == d->want && d->cur != d->want)
+    {
+      d->cur = d->want;
+      if(d->busy) dt_control_log_busy_leave();
+      d->busy = FALSE;
+      // start new one-off timer from when flipping frames.
+      // this will show images before processing-heavy shots a little
+      // longer, but at least not result in shorter viewing times just after these
+      if(d->auto_advance) g_timeout_add_seconds(5, auto_advance, d);
+    }
+    show = (num == d->cur);
+  }
+  dt_pthread_mutex_unlock(&d->lock);
+  // trigger expose
+  if(show) dt_control_queue_redraw_center();
+}
 
 // callbacks for in-memory export
 static int bpp(dt_imageio_module_data_t *data)
@@ -112,17 +170,7 @@ static int write_image(dt_imageio_module_data_t *datai, const char *filename, co
                        int exif_len, int imgid, int num, int total)
 {
   dt_slideshow_format_t *data = (dt_slideshow_format_t *)datai;
-  dt_pthread_mutex_lock(&data->d->lock);
-  if(data->d->back)
-  { // might have been cleaned up when leaving slide show
-    memcpy(data->d->back, in, sizeof(uint32_t) * datai->width * datai->height);
-    data->d->back_width = datai->width;
-    data->d->back_height = datai->height;
-  }
-  dt_pthread_mutex_unlock(&data->d->lock);
-  _step_state(data->d, s_image_loaded);
-  // trigger expose
-  dt_control_queue_redraw_center();
+  _deliver_frame(data->d, data->num, data->session, in, datai->width, datai->height);
   return 0;
 }
 
@@ -138,74 +186,145 @@ static uint32_t next_random(dt_slideshow_t *d)
   return i ^ d->scramble;
 }
 
-// process image
-static int process_next_image(dt_slideshow_t *d)
+// draw the frame right from the mipmap cache if there is one big enough for the screen already
+static gboolean _render_from_mipmap(dt_slideshow_t *d, int32_t num, uint32_t session, int32_t imgid)
 {
-  dt_imageio_module_format_t buf;
-  dt_slideshow_format_t dat;
-  buf.mime = mime;
-  buf.levels = levels;
-  buf.bpp = bpp;
-  buf.write_image = write_image;
-  dat.max_width = d->width;
-  dat.max_height = d->height;
-  dat.style[0] = '\0';
-  dat.d = d;
-
-  // get random image id from sql
-  int32_t id = 0;
-  const int32_t cnt = dt_collection_get_count(darktable.collection);
-  if(!cnt) return 1;
-  dt_pthread_mutex_lock(&d->lock);
-  d->back_num = d->front_num + d->step;
-  int32_t ran = d->back_num;
-  dt_pthread_mutex_unlock(&d->lock);
-  // enumerated all images? i.e. prefetching the one two after the limit, when viewing the one past the end.
-  if(ran == -2 || ran == cnt + 1)
-  {
-    dt_control_log(_("end of images. press any key to return to lighttable mode"));
-  }
-  if(d->use_random)
+  const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, d->width, d->height);
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, mip, DT_MIPMAP_TESTLOCK, 'r');
+  if(!buf.buf) return FALSE;
+
+  // only take display referred thumbnails which don't need upscaling
+  gboolean ok = buf.color_space == DT_COLORSPACE_DISPLAY && buf.width > 8 && buf.height > 8
+                && (buf.width >= d->width || buf.height >= d->height);
+  if(ok)
   {
-    // get random number up to next power of two greater than cnt:
-    const uint32_t zeros = __builtin_clz(cnt);
-    // pull radical inverses only in our desired range:
-    do
-      ran = next_random(d) >> zeros;
-    while(ran >= cnt);
+    const float scale = fminf(d->width / (float)buf.width, d->height / (float)buf.height);
+    const int width = MIN(d->width, (int)(scale * buf.width + .5f));
+    const int height = MIN(d->height, (int)(scale * buf.height + .5f));
+    cairo_surface_t *in = cairo_image_surface_create(CAIRO_FORMAT_RGB24, buf.width, buf.height);
+    cairo_surface_t *out = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    ok = cairo_surface_status(in) == CAIRO_STATUS_SUCCESS && cairo_surface_status(out) == CAIRO_STATUS_SUCCESS
+         && cairo_image_surface_get_stride(out) == 4 * width;
+    if(ok)
+    {
+      // mipmaps are rgba, cairo wants bgra
+      cairo_surface_flush(in);
+      uint8_t *rgb = cairo_image_surface_get_data(in);
+      const int stride = cairo_image_surface_get_stride(in);
+      for(int j = 0; j < buf.height; j++)
+      {
+        const uint8_t *ip = buf.buf + 4 * j * buf.width;
+        uint8_t *op = rgb + j * stride;
+        for(int i = 0; i < buf.width; i++, ip += 4, op += 4)
+        {
+          op[0] = ip[2];
+          op[1] = ip[1];
+          op[2] = ip[0];
+        }
+      }
+      cairo_surface_mark_dirty(in);
+      cairo_t *cr = cairo_create(out);
+      cairo_scale(cr, width / (double)buf.width, height / (double)buf.height);
+      cairo_set_source_surface(cr, in, 0, 0);
+      cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+      cairo_paint(cr);
+      cairo_destroy(cr);
+      cairo_surface_flush(out);
+      _deliver_frame(d, num, session, cairo_image_surface_get_data(out), width, height);
+    }
+    cairo_surface_destroy(out);
+    cairo_surface_destroy(in);
   }
-  int32_t rand = ran % cnt;
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  return ok;
+}
+
+// map a position in the show to an image id
+static int32_t _get_imgid(dt_slideshow_t *d, int32_t num)
+{
+  const int32_t cnt = d->count;
+  if(!cnt) return 0;
+  int32_t rand = num % cnt;
   while(rand < 0) rand += cnt;
+  if(d->random_order) rand = d->random_order[rand];
+
   const gchar *query = dt_collection_get_query(darktable.collection);
-  if(!query) return 1;
+  if(!query) return 0;
+  int32_t id = 0;
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, rand);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, rand + 1);
   if(sqlite3_step(stmt) == SQLITE_ROW) id = sqlite3_column_int(stmt, 0);
   sqlite3_finalize(stmt);
+  return id;
+}
+
+// process image
+static int process_image(dt_slideshow_t *d, int32_t num, uint32_t session)
+{
+  dt_pthread_mutex_lock(&d->lock);
+  // skip if the slot went to another position before we got our turn
+  const gboolean stale = session != d->session || !d->num_slots || _slot(d, num)->num != num;
+  dt_pthread_mutex_unlock(&d->lock);
+  if(stale) return 1;
+
+  const int32_t id = _get_imgid(d, num);
+  if(!id)
+  {
+    _deliver_frame(d, num, session, NULL, 0, 0);
+    return 1;
+  }
 
   // this is a little slow, might be worth to do an option:
   const int high_quality = dt_conf_get_bool("plugins/slideshow/high_quality");
-  if(id)
-    // the flags are: ignore exif, display byteorder, high quality, upscale, thumbnail
-    dt_imageio_export_with_flags(id, "unused", &buf, (dt_imageio_module_data_t *)&dat, 1, 1, high_quality, 1, 0,
-                                 0, 0, 0, 0, 1, 1);
+  if(!high_quality && _render_from_mipmap(d, num, session, id)) return 0;
+
+  dt_imageio_module_format_t buf = { 0 };
+  dt_slideshow_format_t dat;
+  buf.mime = mime;
+  buf.levels = levels;
+  buf.bpp = bpp;
+  buf.write_image = write_image;
+  dat.max_width = d->width;
+  dat.max_height = d->height;
+  dat.style[0] = '\0';
+  dat.d = d;
+  dat.num = num;
+  dat.session = session;
+
+  // the flags are: ignore exif, display byteorder, high quality, upscale, thumbnail
+  if(dt_imageio_export_with_flags(id, "unused", &buf, (dt_imageio_module_data_t *)&dat, 1, 1, high_quality, 1,
+                                  0, 0, 0, 0, 0, 1, 1))
+  {
+    _deliver_frame(d, num, session, NULL, 0, 0);
+    return 1;
+  }
   return 0;
 }
 
 static int32_t process_job_run(dt_job_t *job)
 {
-  dt_slideshow_t *d = dt_control_job_get_params(job);
-  process_next_image(d);
+  dt_slideshow_job_t *params = dt_control_job_get_params(job);
+  process_image(params->d, params->num, params->session);
   return 0;
 }
 
-static dt_job_t *process_job_create(dt_slideshow_t *d)
+static dt_job_t *process_job_create(dt_slideshow_t *d, int32_t num)
 {
-  dt_job_t *job = dt_control_job_create(&process_job_run, "process slideshow image");
+  dt_job_t *job = dt_control_job_create(&process_job_run, "process slideshow image %d", num);
   if(!job) return NULL;
-  dt_control_job_set_params(job, d, NULL);
+  dt_slideshow_job_t *params = (dt_slideshow_job_t *)calloc(1, sizeof(dt_slideshow_job_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return NULL;
+  }
+  dt_control_job_set_params_with_size(job, params, sizeof(dt_slideshow_job_t), free);
+  params->d = d;
+  params->num = num;
+  params->session = d->session;
   return job;
 }
 
@@ -213,83 +332,66 @@ static gboolean auto_advance(gpointer user_data)
 {
   dt_slideshow_t *d = (dt_slideshow_t *)user_data;
   if(!d->auto_advance) return FALSE;
-  _step_state(d, s_request_step);
+  _step(d, 1);
   return FALSE;
 }
 
-// state machine stepping
-static void _step_state(dt_slideshow_t *d, dt_slideshow_event_t event)
+// (re)assign the slot for a position and kick off rendering it. has to be called with the lock held.
+static void _request_frame(dt_slideshow_t *d, int32_t num)
 {
-  dt_pthread_mutex_lock(&d->lock);
+  dt_slideshow_slot_t *slot = _slot(d, num);
+  if(slot->num == num && slot->state != s_slot_empty) return;
+  slot->num = num;
+  dt_job_t *job = process_job_create(d, num);
+  slot->state = job ? s_slot_rendering : s_slot_failed;
+  // jobs run in parallel on all the background workers
+  if(job) dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, job);
+}
 
-  if(event == s_request_step || event == s_request_step_back)
+// fill the ring around the wanted position, closest frames first and the direction of travel before the
+// way back. has to be called with the lock held.
+static void _fill_ring(dt_slideshow_t *d, int32_t step)
+{
+  const int32_t dir = step < 0 ? -1 : 1;
+  _request_frame(d, d->want);
+  for(int k = 1; k <= d->lookahead; k++)
   {
-    if(event == s_request_step) d->step = 1;
-    if(event == s_request_step_back) d->step = -1;
-    // make sure we only enter busy if really flipping the bit
-    if(d->state_waiting_for_user) dt_control_log_busy_enter();
-    d->state_waiting_for_user = 0;
+    _request_frame(d, d->want + dir * k);
+    _request_frame(d, d->want - dir * k);
   }
+}
 
-  switch(d->state)
+static void _step(dt_slideshow_t *d, int32_t step)
+{
+  dt_pthread_mutex_lock(&d->lock);
+  if(!d->num_slots)
   {
-    case s_prefetching:
-      if(event == s_image_loaded)
-      {
-        d->state = s_waiting_for_user;
-        // and go to next case
-      }
-      else
-        break;
-
-    case s_waiting_for_user:
-      if(d->state_waiting_for_user == 0)
-      {
-        d->state = s_blending;
-        // swap buffers, start blending cycle
-        if(d->front_num + d->step == d->back_num)
-        {
-          // if step changed, don't just swap but kick off new job
-          dt_control_log_busy_leave();
-          uint32_t *tmp = d->front;
-          d->front = d->back;
-          d->back = tmp;
-          d->front_width = d->back_width;
-          d->front_height = d->back_height;
-          int32_t tn = d->front_num;
-          d->front_num = d->back_num;
-          d->back_num = tn;
-          // start over
-          d->state_waiting_for_user = 1;
-
-          // start new one-off timer from when flipping buffers.
-          // this will show images before processing-heavy shots a little
-          // longer, but at least not result in shorter viewing times just after these
-          if(d->auto_advance) g_timeout_add_seconds(5, auto_advance, d);
-        }
-        // and execute the next case, too
-      }
-      else
-        break;
+    dt_pthread_mutex_unlock(&d->lock);
+    return;
+  }
 
-    case s_blending:
-      // draw new front buf
-      dt_control_queue_redraw_center();
+  d->want += step;
+  // enumerated all images?
+  if(d->want == -1 || d->want == d->count)
+    dt_control_log(_("end of images. press any key to return to lighttable mode"));
 
-      // TODO: wait for that once there are fancy effects:
-      // if(event == s_blended)
-      {
-        // start bgjob
-        dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, process_job_create(d));
-        d->state = s_prefetching;
-      }
-      break;
+  _fill_ring(d, step);
 
-    default:
-      // uh. should never happen. sanitize:
-      d->state_waiting_for_user = 1;
-      d->state = s_prefetching;
-      break;
+  dt_slideshow_slot_t *slot = _slot(d, d->want);
+  if(slot->state == s_slot_ready || slot->state == s_slot_failed)
+  {
+    // instant advance, the frame was rendered ahead of time
+    d->cur = d->want;
+    if(d->busy) dt_control_log_busy_leave();
+    d->busy = FALSE;
+    if(d->auto_advance) g_timeout_add_seconds(5, auto_advance, d);
+    dt_control_queue_redraw_center();
+  }
+  else if(!d->busy)
+  {
+    // wait for the job to deliver the frame
+    dt_control_log_busy_enter();
+    d->busy = TRUE;
   }
   dt_pthread_mutex_unlock(&d->lock);
 }
@@ -355,35 +457,82 @@ void enter(dt_view_t *self)
   d->old_profile_type = dt_conf_get_int("plugins/lighttable/export/icctype");
   dt_conf_set_int("plugins/lighttable/export/icctype", DT_COLORSPACE_DISPLAY);
 
-  // alloc screen-size double buffer
+  // alloc screen-size frame ring
   GtkWidget *window = dt_ui_main_window(darktable.gui->ui);
   GdkScreen *screen = gtk_widget_get_screen(window);
   if(!screen) screen = gdk_screen_get_default();
   int monitor = gdk_screen_get_monitor_at_window(screen, gtk_widget_get_window(window));
   GdkRectangle rect;
   gdk_screen_get_monitor_geometry(screen, monitor, &rect);
+  const int32_t count = dt_collection_get_count(darktable.collection);
   dt_pthread_mutex_lock(&d->lock);
   d->width = rect.width * darktable.gui->ppd;
   d->height = rect.height * darktable.gui->ppd;
-  d->buf1 = dt_alloc_align(64, sizeof(uint32_t) * d->width * d->height);
-  d->buf2 = dt_alloc_align(64, sizeof(uint32_t) * d->width * d->height);
-  d->front = d->buf1;
-  d->back = d->buf2;
+  d->count = count;
+  d->session++;
+
+  // as many frames as the memory budget allows, but always one in each direction
+  const size_t frame_size = sizeof(uint32_t) * d->width * d->height;
+  const size_t budget = (size_t)MAX(dt_conf_get_int("plugins/slideshow/memory_budget"), 0) << 20;
+  int lookahead = CLAMP(dt_conf_get_int("plugins/slideshow/lookahead"), 1, DT_SLIDESHOW_MAX_LOOKAHEAD);
+  while(lookahead > 1 && (2 * lookahead + 1) * frame_size > budget) lookahead--;
+  // no point in holding more frames than there are images
+  while(lookahead > 1 && 2 * lookahead + 1 > count) lookahead--;
+  d->lookahead = lookahead;
+  d->num_slots = 0;
+  for(int k = 0; k < 2 * lookahead + 1; k++)
+  {
+    d->slot[k].buf = dt_alloc_align(64, frame_size);
+    d->slot[k].state = s_slot_empty;
+    d->slot[k].width = d->slot[k].height = 0;
+    if(!d->slot[k].buf) break;
+    d->num_slots++;
+  }
+  if(d->num_slots < 2 * lookahead + 1)
+  {
+    // out of memory, shrink the ring to what we got
+    d->lookahead = MAX(0, (d->num_slots - 1) / 2);
+    for(int k = 2 * d->lookahead + 1; k < d->num_slots; k++)
+    {
+      dt_free_align(d->slot[k].buf);
+      d->slot[k].buf = NULL;
+    }
+    d->num_slots = d->num_slots ? 2 * d->lookahead + 1 : 0;
+  }
+  dt_print(DT_DEBUG_PERF, "[slideshow] %d frames of %dx%d ahead and behind\n", d->lookahead, d->width,
+           d->height);
 
-  // start in prefetching phase, do that by initing one state before
-  // and stepping through that at the very end of this function
-  d->state = s_blending;
-  d->state_waiting_for_user = 1;
+  // the shuffled order is fixed for the whole show, so stepping back shows what we have seen before
+  free(d->random_order);
+  d->random_order = NULL;
+  if(d->use_random && count > 0)
+  {
+    d->random_order = (int32_t *)malloc(sizeof(int32_t) * count);
+    if(d->random_order)
+    {
+      // get random number up to next power of two greater than cnt:
+      const uint32_t zeros = __builtin_clz(count);
+      for(int32_t k = 0; k < count; k++)
+      {
+        uint32_t ran;
+        // pull radical inverses only in our desired range:
+        do
+          ran = next_random(d) >> zeros;
+        while(ran >= (uint32_t)count);
+        d->random_order[k] = ran;
+      }
+    }
+  }
 
+  d->busy = FALSE;
   d->auto_advance = 0;
 
   // restart from beginning, will first increment counter by step and then prefetch
-  d->front_num = d->back_num = dt_view_lighttable_get_position(darktable.view_manager) - 1;
-  d->step = 1;
+  d->cur = d->want = dt_view_lighttable_get_position(darktable.view_manager) - 1;
   dt_pthread_mutex_unlock(&d->lock);
 
-  // start first job
-  _step_state(d, s_request_step);
+  // start first jobs
+  _step(d, 1);
 }
 
 void leave(dt_view_t *self)
@@ -395,12 +544,21 @@ void leave(dt_view_t *self)
   dt_control_change_cursor(GDK_LEFT_PTR);
   dt_ui_border_show(darktable.gui->ui, TRUE);
   d->auto_advance = 0;
-  dt_view_lighttable_set_position(darktable.view_manager, d->front_num);
+  dt_view_lighttable_set_position(darktable.view_manager, d->cur);
   dt_conf_set_int("plugins/lighttable/export/icctype", d->old_profile_type);
   dt_pthread_mutex_lock(&d->lock);
-  dt_free_align(d->buf1);
-  dt_free_align(d->buf2);
-  d->buf1 = d->buf2 = d->front = d->back = 0;
+  // jobs still queued or running find no slots and drop their frames
+  for(int k = 0; k < d->num_slots; k++)
+  {
+    dt_free_align(d->slot[k].buf);
+    d->slot[k].buf = NULL;
+    d->slot[k].state = s_slot_empty;
+  }
+  d->num_slots = 0;
+  if(d->busy) dt_control_log_busy_leave();
+  d->busy = FALSE;
+  free(d->random_order);
+  d->random_order = NULL;
   dt_pthread_mutex_unlock(&d->lock);
 }
 
@@ -416,21 +574,22 @@ void expose(dt_view_t *self, cairo_t *cr, int32_t width, int32_t height, int32_t
 
   dt_pthread_mutex_lock(&d->lock);
   cairo_paint(cr);
-  if(d->front)
+  dt_slideshow_slot_t *slot = d->num_slots ? _slot(d, d->cur) : NULL;
+  if(slot && slot->buf && slot->num == d->cur && slot->state == s_slot_ready)
   {
     // undo clip region/border around the image:
     cairo_restore(cr); // pop view manager
     cairo_restore(cr); // pop control
     cairo_reset_clip(cr);
     cairo_save(cr);
-    cairo_translate(cr, (d->width - d->front_width) * .5f / darktable.gui->ppd, (d->height - d->front_height) * .5f / darktable.gui->ppd);
+    cairo_translate(cr, (d->width - slot->width) * .5f / darktable.gui->ppd, (d->height - slot->height) * .5f / darktable.gui->ppd);
     cairo_surface_t *surface = NULL;
-    const int32_t stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, d->front_width);
-    surface = dt_cairo_image_surface_create_for_data((uint8_t *)d->front, CAIRO_FORMAT_RGB24, d->front_width,
-                                                  d->front_height, stride);
+    const int32_t stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, slot->width);
+    surface = dt_cairo_image_surface_create_for_data((uint8_t *)slot->buf, CAIRO_FORMAT_RGB24, slot->width,
+                                                  slot->height, stride);
     cairo_set_source_surface(cr, surface, 0, 0);
     cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
-    cairo_rectangle(cr, 0, 0, d->front_width/darktable.gui->ppd, d->front_height/darktable.gui->ppd);
+    cairo_rectangle(cr, 0, 0, slot->width/darktable.gui->ppd, slot->height/darktable.gui->ppd);
     cairo_fill(cr);
     cairo_surface_destroy(surface);
     cairo_restore(cr);
@@ -470,9 +629,9 @@ int button_pressed(dt_view_t *self, double x, double y, double pressure, int whi
 {
   dt_slideshow_t *d = (dt_slideshow_t *)self->data;
   if(which == 1)
-    _step_state(d, s_request_step);
+    _step(d, 1);
   else if(which == 3)
-    _step_state(d, s_request_step_back);
+    _step(d, -1);
   else
     return 1;
 
@@ -493,7 +652,7 @@ int key_pressed(dt_view_t *self, guint key, guint state)
     if(!d->auto_advance)
     {
       d->auto_advance = 1;
-      _step_state(d, s_request_step);
+      _step(d, 1);
     }
     else
       d->auto_advance = 0;
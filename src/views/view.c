@@ -25,9 +25,11 @@
 #include "common/debug.h"
 #include "common/history.h"
 #include "common/image_cache.h"
+#include "common/image_state.h"
 #include "common/mipmap_cache.h"
 #include "control/conf.h"
 #include "control/control.h"
+#include "control/jobs.h"
 #include "develop/develop.h"
 #include "dtgtk/expander.h"
 #include "gui/accelerators.h"
@@ -44,6 +46,156 @@
 
 #define DECORATION_SIZE_LIMIT 40
 
+// a thumbnail converted to the display profile and wrapped in a cairo surface, so redrawing a cell is a blit.
+// stale once the mip buffer is filled anew or the display transforms change.
+typedef struct dt_view_surface_t
+{
+  uint32_t key;
+  cairo_surface_t *surface; // owns rgbbuf
+  uint32_t mip_generation;
+  uint32_t display_generation;
+  gboolean color_managed;
+  size_t cost;
+  GList *link; // in the lru queue
+} dt_view_surface_t;
+
+static const cairo_user_data_key_t _view_surface_buf_key;
+
+static void _view_surface_free(gpointer data)
+{
+  dt_view_surface_t *s = (dt_view_surface_t *)data;
+  cairo_surface_destroy(s->surface);
+  free(s);
+}
+
+static void _view_surface_remove(dt_view_manager_t *vm, dt_view_surface_t *s)
+{
+  g_queue_delete_link(&vm->surfaces.lru, s->link);
+  vm->surfaces.cost -= s->cost;
+  g_hash_table_remove(vm->surfaces.entries, GUINT_TO_POINTER(s->key));
+}
+
+// returns a new reference to the display ready surface of the mip, converting it if there is none yet.
+// only called from the gui thread.
+static cairo_surface_t *_view_surface_get(dt_view_manager_t *vm, dt_mipmap_buffer_t *buf)
+{
+  const uint32_t key = ((uint32_t)buf->size << 28) | (buf->imgid & 0x0fffffff);
+  const gboolean color_managed = dt_conf_get_bool("cache_color_managed");
+
+  // reading the generation without the lock is fine, a race only means one more conversion
+  const uint32_t display_generation = darktable.color_profiles->display_transforms_generation;
+  dt_view_surface_t *s = g_hash_table_lookup(vm->surfaces.entries, GUINT_TO_POINTER(key));
+  if(s)
+  {
+    if(s->mip_generation == buf->generation && s->color_managed == color_managed
+       && (!color_managed || s->display_generation == display_generation)
+       && cairo_image_surface_get_width(s->surface) == buf->width
+       && cairo_image_surface_get_height(s->surface) == buf->height)
+    {
+      g_queue_unlink(&vm->surfaces.lru, s->link);
+      g_queue_push_head_link(&vm->surfaces.lru, s->link);
+      return cairo_surface_reference(s->surface);
+    }
+    _view_surface_remove(vm, s);
+  }
+
+  const int32_t stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, buf->width);
+  uint8_t *rgbbuf = (uint8_t *)calloc((size_t)stride * buf->height, sizeof(uint8_t));
+  if(!rgbbuf) return NULL;
+
+  gboolean have_lock = FALSE;
+  cmsHTRANSFORM transform = NULL;
+
+  if(color_managed)
+  {
+    pthread_rwlock_rdlock(&darktable.color_profiles->xprofile_lock);
+    have_lock = TRUE;
+
+    // we only color manage when a thumbnail is sRGB or AdobeRGB. everything else just gets dumped to the screen
+    if(buf->color_space == DT_COLORSPACE_SRGB && darktable.color_profiles->transform_srgb_to_display)
+    {
+      transform = darktable.color_profiles->transform_srgb_to_display;
+    }
+    else if(buf->color_space == DT_COLORSPACE_ADOBERGB
+            && darktable.color_profiles->transform_adobe_rgb_to_display)
+    {
+      transform = darktable.color_profiles->transform_adobe_rgb_to_display;
+    }
+    else
+    {
+      pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
+      have_lock = FALSE;
+      if(buf->color_space == DT_COLORSPACE_NONE)
+      {
+        fprintf(stderr, "oops, there seems to be a code path not setting the color space of thumbnails!\n");
+      }
+      else if(buf->color_space != DT_COLORSPACE_DISPLAY)
+      {
+        fprintf(stderr,
+                "oops, there seems to be a code path setting an unhandled color space of thumbnails (%s)!\n",
+                dt_colorspaces_get_name(buf->color_space, "from file"));
+      }
+    }
+  }
+
+  const uint8_t *const inbuf = buf->buf;
+  const int width = buf->width, height = buf->height;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) default(none) shared(rgbbuf, transform)
+#endif
+  for(int i = 0; i < height; i++)
+  {
+    const uint8_t *in = inbuf + (size_t)i * width * 4;
+    uint8_t *out = rgbbuf + (size_t)i * stride;
+
+    if(transform)
+    {
+      cmsDoTransform(transform, in, out, width);
+    }
+    else
+    {
+      for(int j = 0; j < width; j++, in += 4, out += 4)
+      {
+        out[0] = in[2];
+        out[1] = in[1];
+        out[2] = in[0];
+      }
+    }
+  }
+  if(have_lock) pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
+
+  cairo_surface_t *surface = cairo_image_surface_create_for_data(rgbbuf, CAIRO_FORMAT_RGB24, width, height, stride);
+  if(cairo_surface_set_user_data(surface, &_view_surface_buf_key, rgbbuf, free) != CAIRO_STATUS_SUCCESS)
+  {
+    cairo_surface_destroy(surface);
+    free(rgbbuf);
+    return NULL;
+  }
+
+  // the stand-in skull and dead images are not worth keeping
+  if(width <= 8 && height <= 8) return surface;
+
+  s = (dt_view_surface_t *)malloc(sizeof(dt_view_surface_t));
+  if(!s) return surface;
+  s->key = key;
+  s->surface = cairo_surface_reference(surface);
+  s->mip_generation = buf->generation;
+  s->display_generation = display_generation;
+  s->color_managed = color_managed;
+  s->cost = (size_t)stride * height;
+  g_queue_push_head(&vm->surfaces.lru, s);
+  s->link = g_queue_peek_head_link(&vm->surfaces.lru);
+  g_hash_table_insert(vm->surfaces.entries, GUINT_TO_POINTER(key), s);
+  vm->surfaces.cost += s->cost;
+
+  // evict the least recently used ones beyond the budget
+  const size_t budget = (size_t)MAX(0, dt_conf_get_int("plugins/lighttable/thumbnail_surface_cache")) << 20;
+  while(vm->surfaces.cost > budget && vm->surfaces.lru.length > 1)
+    _view_surface_remove(vm, (dt_view_surface_t *)g_queue_peek_tail(&vm->surfaces.lru));
+
+  return surface;
+}
+
 void dt_view_manager_init(dt_view_manager_t *vm)
 {
   /* prepare statements */
@@ -56,12 +208,10 @@ void dt_view_manager_init(dt_view_manager_t *vm)
                               &vm->statements.make_selected, NULL);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select num from history where imgid = ?1", -1,
                               &vm->statements.have_history, NULL);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select color from color_labels where imgid=?1",
-                              -1, &vm->statements.get_color, NULL);
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
-      "select id from images where group_id = (select group_id from images where id=?1) and id != ?2", -1,
-      &vm->statements.get_grouped, NULL);
+
+  vm->surfaces.entries = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, _view_surface_free);
+  g_queue_init(&vm->surfaces.lru);
+  vm->surfaces.cost = 0;
 
   int res = 0, midx = 0;
   char *modules[] = { "lighttable", "darkroom",
@@ -104,6 +254,8 @@ void dt_view_manager_gui_init(dt_view_manager_t *vm)
 void dt_view_manager_cleanup(dt_view_manager_t *vm)
 {
   for(int k = 0; k < vm->num_views; k++) dt_view_unload_module(vm->view + k);
+  if(vm->surfaces.entries) g_hash_table_destroy(vm->surfaces.entries);
+  g_queue_clear(&vm->surfaces.lru);
 }
 
 const dt_view_t *dt_view_manager_get_current_view(dt_view_manager_t *vm)
@@ -811,14 +963,7 @@ int32_t dt_view_get_image_to_act_on()
   }
   else
   {
-    /* clear and reset statement */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.is_selected);
-    DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.is_selected);
-
-    /* setup statement and iterate over rows */
-    DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.is_selected, 1, mouse_over_id);
-
-    if(mouse_over_id <= 0 || sqlite3_step(darktable.view_manager->statements.is_selected) == SQLITE_ROW)
+    if(mouse_over_id <= 0 || dt_image_state_is_selected(darktable.image_state, mouse_over_id))
       return -1;
     else
       return mouse_over_id;
@@ -852,19 +997,16 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
   // this is a gui thread only thing. no mutex required:
   const int imgsel = dt_control_get_mouse_over_id(); //  darktable.control->global_settings.lib_image_mouse_over_id;
 
-  if (draw_selected)
-  {
-    /* clear and reset statements */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.is_selected);
-    DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.is_selected);
-    /* bind imgid to prepared statments */
-    DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.is_selected, 1, imgid);
-    /* lets check if imgid is selected */
-    if(sqlite3_step(darktable.view_manager->statements.is_selected) == SQLITE_ROW) selected = 1;
-  }
+  if (draw_selected) selected = dt_image_state_is_selected(darktable.image_state, imgid);
+
+  // rating, labels, grouping and altered state come from the in-memory index, only
+  // the exif overlay of the full preview needs the image struct itself.
+  dt_image_state_t state;
+  const gboolean have_state = dt_image_state_get(darktable.image_state, imgid, &state);
 
   dt_image_t buffered_image;
-  const dt_image_t *img = dt_image_cache_testget(darktable.image_cache, imgid, 'r');
+  const dt_image_t *img = NULL;
+  if(zoom == 1 && draw_metadata) img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
 
   if(selected == 1 && zoom != 1) // If zoom == 1 there is no need to set colors here
   {
@@ -877,8 +1019,6 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
     bgcol = 0.8; // mouse over
     fontcol = 0.7;
     outlinecol = 0.6;
-    // if the user points at this image, we really want it:
-    if(!img) img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
   }
   // release image cache lock as early as possible, to avoid deadlocks (mipmap cache might need to lock it, too)
   if(img)
@@ -923,7 +1063,7 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
     cairo_set_source_rgb(cr, outlinecol, outlinecol, outlinecol);
     cairo_stroke(cr);
 
-    if(img)
+    if(have_state)
     {
       PangoLayout *layout;
       PangoRectangle ink;
@@ -933,11 +1073,8 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
       pango_font_description_set_absolute_size(desc, fontsize * PANGO_SCALE);
       layout = pango_cairo_create_layout(cr);
       pango_layout_set_font_description(layout, desc);
-      const char *ext = img->filename + strlen(img->filename);
-      while(ext > img->filename && *ext != '.') ext--;
-      ext++;
       cairo_set_source_rgb(cr, fontcol, fontcol, fontcol);
-      pango_layout_set_text(layout, ext, -1);
+      pango_layout_set_text(layout, state.extension, -1);
       pango_layout_get_pixel_extents(layout, &ink, NULL);
       cairo_move_to(cr, .025 * width - ink.x, .24 * height - fontsize);
       pango_cairo_show_layout(cr, layout);
@@ -960,75 +1097,9 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
     float scale = 1.0;
 
     cairo_surface_t *surface = NULL;
-    uint8_t *rgbbuf = NULL;
     if(buf.buf)
     {
-      rgbbuf = (uint8_t *)calloc(buf.width * buf.height * 4, sizeof(uint8_t));
-      if(rgbbuf)
-      {
-        gboolean have_lock = FALSE;
-        cmsHTRANSFORM transform = NULL;
-
-        if(dt_conf_get_bool("cache_color_managed"))
-        {
-          pthread_rwlock_rdlock(&darktable.color_profiles->xprofile_lock);
-          have_lock = TRUE;
-
-          // we only color manage when a thumbnail is sRGB or AdobeRGB. everything else just gets dumped to the screen
-          if(buf.color_space == DT_COLORSPACE_SRGB &&
-             darktable.color_profiles->transform_srgb_to_display)
-          {
-            transform = darktable.color_profiles->transform_srgb_to_display;
-          }
-          else if(buf.color_space == DT_COLORSPACE_ADOBERGB &&
-                  darktable.color_profiles->transform_adobe_rgb_to_display)
-          {
-            transform = darktable.color_profiles->transform_adobe_rgb_to_display;
-          }
-          else
-          {
-            pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
-            have_lock = FALSE;
-            if(buf.color_space == DT_COLORSPACE_NONE)
-            {
-              fprintf(stderr, "oops, there seems to be a code path not setting the color space of thumbnails!\n");
-            }
-            else if(buf.color_space != DT_COLORSPACE_DISPLAY)
-            {
-              fprintf(stderr, "oops, there seems to be a code path setting an unhandled color space of thumbnails (%s)!\n",
-                      dt_colorspaces_get_name(buf.color_space, "from file"));
-            }
-          }
-        }
-
-#ifdef _OPENMP
-  #pragma omp parallel for schedule(static) default(none) shared(buf, rgbbuf, transform)
-#endif
-        for(int i = 0; i < buf.height; i++)
-        {
-          const uint8_t *in = buf.buf + i * buf.width * 4;
-          uint8_t *out = rgbbuf + i * buf.width * 4;
-
-          if(transform)
-          {
-            cmsDoTransform(transform, in, out, buf.width);
-          }
-          else
-          {
-            for(int j = 0; j < buf.width; j++, in += 4, out += 4)
-            {
-              out[0] = in[2];
-              out[1] = in[1];
-              out[2] = in[0];
-            }
-          }
-        }
-        if(have_lock) pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
-
-        const int32_t stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, buf.width);
-        surface
-          = cairo_image_surface_create_for_data(rgbbuf, CAIRO_FORMAT_RGB24, buf.width, buf.height, stride);
-      }
+      surface = _view_surface_get(darktable.view_manager, &buf);
 
       if(zoom == 1 && !image_only)
       {
@@ -1061,12 +1132,9 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
         cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
       cairo_rectangle(cr, 0, 0, buf.width, buf.height);
       cairo_fill(cr);
-      cairo_surface_destroy(surface);
-
       cairo_rectangle(cr, 0, 0, buf.width, buf.height);
     }
-
-    free(rgbbuf);
+    if(surface) cairo_surface_destroy(surface);
 
     if (image_only)
     {
@@ -1149,9 +1217,9 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
         y = 0.90 * height;
       else
         y = .12 * fscale;
-      const gboolean image_is_rejected = (img && ((img->flags & 0x7) == 6));
+      const gboolean image_is_rejected = (have_state && ((state.flags & 0x7) == 6));
 
-      if(img)
+      if(have_state)
         for(int k = 0; k < 5; k++)
         {
           if(zoom != 1)
@@ -1169,7 +1237,7 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
               *image_over = DT_VIEW_STAR_1 + k;
               cairo_fill(cr);
             }
-            else if((img->flags & 0x7) > k)
+            else if((state.flags & 0x7) > k)
             {
               cairo_fill_preserve(cr);
               cairo_set_source_rgb(cr, 1.0 - bordercol, 1.0 - bordercol, 1.0 - bordercol);
@@ -1212,7 +1280,7 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
 
       if(draw_audio)
       {
-        if(img && (img->flags & DT_IMAGE_HAS_WAV))
+        if(have_state && (state.flags & DT_IMAGE_HAS_WAV))
         {
           // align to right
           const float s = (r1 + r2) * .5;
@@ -1229,17 +1297,12 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
         }
       }
 
-      if(draw_grouping)
+      if(draw_grouping && have_state)
       {
-        DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.get_grouped);
-        DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.get_grouped);
-        DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.get_grouped, 1, imgid);
-        DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.get_grouped, 2, imgid);
-
         /* lets check if imgid is in a group */
-        if(sqlite3_step(darktable.view_manager->statements.get_grouped) == SQLITE_ROW)
+        if(state.state & DT_IMAGE_STATE_GROUPED)
           is_grouped = 1;
-        else if(img && darktable.gui->expanded_group_id == img->group_id)
+        else if(darktable.gui->expanded_group_id == state.group_id)
           darktable.gui->expanded_group_id = -1;
       }
 
@@ -1261,16 +1324,16 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
           _y = y - (.17 * .04) * fscale;
         }
         cairo_save(cr);
-        if(img && (imgid != img->group_id)) cairo_set_source_rgb(cr, fontcol, fontcol, fontcol);
+        if(imgid != state.group_id) cairo_set_source_rgb(cr, fontcol, fontcol, fontcol);
         dtgtk_cairo_paint_grouping(cr, _x, _y, s, s, 23);
         cairo_restore(cr);
         // mouse is over the grouping icon
-        if(img && fabs(px - _x - .5 * s) <= .8 * s && fabs(py - _y - .5 * s) <= .8 * s)
+        if(fabs(px - _x - .5 * s) <= .8 * s && fabs(py - _y - .5 * s) <= .8 * s)
           *image_over = DT_VIEW_GROUP;
       }
 
       // image altered?
-      if(draw_history && dt_image_altered(imgid))
+      if(draw_history && have_state && (state.state & DT_IMAGE_STATE_ALTERED))
       {
         // align to right
         const float s = (r1 + r2) * .5;
@@ -1283,7 +1346,7 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
           x = (.04 + 8 * 0.04) * fscale;
         dt_view_draw_altered(cr, x, y, s);
         // g_print("px = %d, x = %.4f, py = %d, y = %.4f\n", px, x, py, y);
-        if(img && fabsf(px - x) <= 1.2 * s
+        if(fabsf(px - x) <= 1.2 * s
            && fabsf(py - y) <= 1.2 * s) // mouse hovers over the altered-icon -> history tooltip!
         {
           darktable.gui->center_tooltip = 1;
@@ -1299,7 +1362,6 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
   if (draw_colorlabels)
   {
     // TODO: make mouse sensitive, just as stars!
-    // TODO: cache in image struct!
 
     // TODO: there is a branch that sets the bg == colorlabel
     //       this might help if zoom > 15
@@ -1310,16 +1372,10 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
       const float y = zoom == 1 ? 0.17 * fscale : 0.1 * height;
       const float r = zoom == 1 ? 0.01 * fscale : 0.03 * width;
 
-      /* clear and reset prepared statement */
-      DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.get_color);
-      DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.get_color);
-
-      /* setup statement and iterate rows */
-      DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.get_color, 1, imgid);
-      while(sqlite3_step(darktable.view_manager->statements.get_color) == SQLITE_ROW)
+      for(int col = 0; have_state && col < 8; col++)
       {
+        if(!(state.colorlabels & (1 << col))) continue;
         cairo_save(cr);
-        const int col = sqlite3_column_int(darktable.view_manager->statements.get_color, 0);
         // see src/dtgtk/paint.c
         dtgtk_cairo_paint_label(cr, x + (3 * r * col) - 5 * r, y - r, r * 2, r * 2, col);
         cairo_restore(cr);
@@ -1329,14 +1385,14 @@ int dt_view_image_expose(dt_view_image_over_t *image_over, uint32_t imgid, cairo
 
   if (draw_local_copy)
   {
-    if(img && width > DECORATION_SIZE_LIMIT)
+    if(have_state && width > DECORATION_SIZE_LIMIT)
     {
       // copy status:
       const float x = zoom == 1 ? (0.07) * fscale : .21 * width;
       const float y = zoom == 1 ? 0.17 * fscale : 0.1 * height;
       const float r = zoom == 1 ? 0.01 * fscale : 0.03 * width;
       const int xoffset = 6;
-      const gboolean has_local_copy = (img && (img->flags & DT_IMAGE_LOCAL_COPY));
+      const gboolean has_local_copy = (state.flags & DT_IMAGE_LOCAL_COPY) != 0;
       cairo_save(cr);
       dtgtk_cairo_paint_local_copy(cr, x + (3 * r * xoffset) - 5 * r, y - r, r * 2, r * 2, has_local_copy);
       cairo_restore(cr);
@@ -1589,36 +1645,72 @@ void dt_view_filmstrip_set_active_image(dt_view_manager_t *vm, int iid)
   dt_view_filmstrip_scroll_to_image(vm, iid, TRUE);
 }
 
+// bumped whenever the neighbourhood changes, so queued preloads of stale neighbours are dropped.
+// the static reference is never dropped, so the jobs' references never free it
+static dt_image_prefetch_generation_t _filmstrip_prefetch_generation = { 0, 1 };
+
+// raw buffers are kept outside of the thumbnail memory budget, so make sure
+// a preload can't pile up more than that on top of what is in use already.
+static gboolean _filmstrip_prefetch_fits(const uint32_t imgid, size_t *budget)
+{
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  if(!img) return FALSE;
+  // bpp is only known after the first load, assume 4 floats for non-raws
+  const size_t bpp = img->bpp > 0 ? img->bpp : (img->flags & DT_IMAGE_RAW) ? sizeof(uint16_t) : 4 * sizeof(float);
+  const size_t size = (size_t)img->width * img->height * bpp;
+  dt_image_cache_read_release(darktable.image_cache, img);
+  if(size > *budget) return FALSE;
+  *budget -= size;
+  return TRUE;
+}
+
 void dt_view_filmstrip_prefetch()
 {
   const gchar *qin = dt_collection_get_query(darktable.collection);
   if(!qin) return;
 
-  int offset = 0;
-  if(qin)
-  {
-    int imgid = -1;
-    sqlite3_stmt *stmt;
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select imgid from selected_images", -1, &stmt,
-                                NULL);
-    if(sqlite3_step(stmt) == SQLITE_ROW) imgid = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-
-    offset = dt_collection_image_offset(imgid);
-  }
+  const int count = MIN(4, dt_conf_get_int("plugins/darkroom/preload_count"));
+  const gint generation = g_atomic_int_add(&_filmstrip_prefetch_generation.value, 1) + 1;
+  if(count <= 0) return;
 
+  int imgid = -1;
   sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select imgid from selected_images", -1, &stmt,
+                              NULL);
+  if(sqlite3_step(stmt) == SQLITE_ROW) imgid = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  const int offset = dt_collection_image_offset(imgid);
+  const int first = MAX(0, offset - count);
+
+  // neighbours in the collection, current image excluded
+  uint32_t *ids = calloc(2 * count + 1, sizeof(uint32_t));
+  int num = 0;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-  // only get one more image:
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset + 1);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offset + 2);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, first);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offset + count + 1 - first);
+  while(sqlite3_step(stmt) == SQLITE_ROW) ids[num++] = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  size_t budget = MAX(0, dt_conf_get_int64("cache_memory"));
+  // nearest first, the next image before the previous one
+  for(int d = 1; d <= count; d++)
   {
-    const uint32_t prefetchid = sqlite3_column_int(stmt, 0);
-    // dt_control_log("prefetching image %u", prefetchid);
-    dt_mipmap_cache_get(darktable.mipmap_cache, NULL, prefetchid, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
+    for(int sign = 1; sign >= -1; sign -= 2)
+    {
+      const int k = offset + sign * d - first;
+      if(k < 0 || k >= num || ids[k] == (uint32_t)imgid) continue;
+      // the preview pipe input is downscaled from the full buffer, so that has to fit for either of them
+      if(!_filmstrip_prefetch_fits(ids[k], &budget)) continue;
+      dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG,
+                         dt_image_prefetch_job_create(ids[k], DT_MIPMAP_F, &_filmstrip_prefetch_generation,
+                                                      generation));
+      dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG,
+                         dt_image_prefetch_job_create(ids[k], DT_MIPMAP_FULL, &_filmstrip_prefetch_generation,
+                                                      generation));
+    }
   }
-  sqlite3_finalize(stmt);
+  free(ids);
 }
 
 void dt_view_manager_view_toolbox_add(dt_view_manager_t *vm, GtkWidget *tool, dt_view_type_flags_t views)
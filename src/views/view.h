@@ -182,12 +182,16 @@ typedef struct dt_view_manager_t
     sqlite3_stmt *delete_from_selected;
     /* insert into selected_images values (?1) */
     sqlite3_stmt *make_selected;
-    /* select color from color_labels where imgid=?1 */
-    sqlite3_stmt *get_color;
-    /* select images in group from images where imgid=?1 (also bind to ?2) */
-    sqlite3_stmt *get_grouped;
   } statements;
 
+  /* thumbnails converted for the display, see dt_view_image_expose() */
+  struct
+  {
+    GHashTable *entries; // (imgid, mip) -> dt_view_surface_t
+    GQueue lru;          // most recently used first
+    size_t cost;         // bytes of all entries
+  } surfaces;
+
 
   /*
    * Proxy